@@ -0,0 +1,122 @@
+#include "bench_utils.hpp"
+#include "coro.hpp"
+#include "event_poll.hpp"
+
+#include <unordered_map>
+
+namespace {
+
+constexpr size_t PING_SIZE = 64;
+
+struct PingPair {
+    Socket client;
+    Socket server;
+};
+
+std::vector<PingPair> pingPairs(size_t count) {
+    uint16_t port;
+    Socket   listener = listenLoopback(port);
+
+    std::vector<PingPair> pairs;
+    for (size_t i = 0; i < count; i++) {
+        auto pair = connectedPair(listener, port);
+        pair.first.setNonBlocking(true);
+        pair.second.setNonBlocking(true);
+        pairs.push_back({std::move(pair.first), std::move(pair.second)});
+    }
+    return pairs;
+}
+
+// hand-written baseline: both ends of every pair are driven from one EventPoll by a small state machine
+double callbackRoundTrips(std::vector<PingPair>& pairs, double seconds) {
+    EventPoll                             poll(1024);
+    std::unordered_map<socket_t, Socket*> by_fd;
+    std::unordered_map<socket_t, size_t>  pending;
+    char                                  buffer[PING_SIZE];
+    char                                  message[PING_SIZE] = {};
+
+    for (auto& pair : pairs) {
+        for (Socket* s : {&pair.client, &pair.server}) {
+            poll.addFd(s->fd(), PollEvent::READ);
+            by_fd[s->fd()] = s;
+        }
+        pair.client.trySend(message, PING_SIZE);
+    }
+
+    uint64_t trips = 0;
+    auto     start = std::chrono::steady_clock::now();
+    while (secondsSince(start) < seconds) {
+        poll.wait(10);
+        for (const auto& event : poll.events()) {
+            Socket*       s = by_fd[event.fd];
+            socket_size_t n;
+            while ((n = s->tryRecv(buffer, sizeof(buffer))) > 0) {
+                size_t& got = pending[event.fd];
+                got += static_cast<size_t>(n);
+                for (; got >= PING_SIZE; got -= PING_SIZE) {
+                    s->trySend(message, PING_SIZE);
+                    trips++;
+                }
+            }
+        }
+    }
+    return static_cast<double>(trips) / secondsSince(start);
+}
+
+Task<void> pingPong(CoroLoop& loop, Socket& s, bool serve, const bool& stop, uint64_t& trips) {
+    char message[PING_SIZE] = {};
+    char buffer[PING_SIZE];
+    if (!serve)
+        co_await asyncSend(loop, s, message, PING_SIZE);
+    while (!stop) {
+        size_t got = 0;
+        while (got < PING_SIZE) {
+            socket_size_t n = co_await asyncRecv(loop, s, buffer + got, PING_SIZE - got);
+            if (n == 0)
+                co_return;
+            got += static_cast<size_t>(n);
+        }
+        co_await asyncSend(loop, s, message, PING_SIZE);
+        trips++;
+    }
+}
+
+double coroutineRoundTrips(std::vector<PingPair>& pairs, double seconds) {
+    CoroLoop loop(1024);
+    bool     stop  = false;
+    uint64_t trips = 0;
+    for (auto& pair : pairs) {
+        loop.spawn(pingPong(loop, pair.server, true, stop, trips));
+        loop.spawn(pingPong(loop, pair.client, false, stop, trips));
+    }
+    loop.spawn([](CoroLoop& l, double s, bool& flag) -> Task<void> {
+        co_await l.sleepFor(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::duration<double>(s)));
+        flag = true;
+        l.stop();
+    }(loop, seconds, stop));
+
+    auto start = std::chrono::steady_clock::now();
+    loop.run();
+    return static_cast<double>(trips) / secondsSince(start);
+}
+
+void runPingPong(const BenchOptions& options, size_t connections) {
+    std::vector<PingPair> callback_pairs  = pingPairs(connections);
+    double                callback_trips  = callbackRoundTrips(callback_pairs, options.seconds / 2);
+    std::vector<PingPair> coroutine_pairs = pingPairs(connections);
+    double                coroutine_trips = coroutineRoundTrips(coroutine_pairs, options.seconds / 2);
+
+    BenchReport("coro_ping_pong")
+        .param("connections", static_cast<double>(connections))
+        .metric("callback_trips_per_sec", callback_trips)
+        .metric("coroutine_trips_per_sec", coroutine_trips)
+        .metric("coroutine_ratio", callback_trips == 0 ? 0.0 : coroutine_trips / callback_trips)
+        .print();
+}
+
+} // namespace
+
+BENCH_CASE("coro_ping_pong") {
+    for (size_t connections : {1, 64})
+        runPingPong(options, connections);
+}
@@ -0,0 +1,146 @@
+#include "bench_utils.hpp"
+#include "framing.hpp"
+
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <cstdio>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// counts every delimiter in the buffer, spacing is the frame length it models. the larger it is, the more of the time
+// goes to the vector loop rather than to the call and the hit
+void runScan(const BenchOptions& options, ScanImpl impl, size_t spacing) {
+    std::string data(1024 * 1024, 'x');
+    if (spacing != 0) {
+        for (size_t i = spacing - 1; i < data.size(); i += spacing)
+            data[i] = '\n';
+    }
+
+    const char* end    = data.data() + data.size();
+    size_t      rounds = scaled(options, 2000);
+    size_t      found  = 0;
+    auto        start  = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < rounds; r++) {
+        for (const char* p = data.data(); (p = findByteWith(impl, p, end, '\n')) != end; p++)
+            found++;
+    }
+    double seconds = secondsSince(start);
+
+    BenchReport("framing_scan")
+        .param("impl", scanImplName(impl))
+        .param("spacing", static_cast<double>(spacing))
+        .metric("gb_per_sec", static_cast<double>(rounds * data.size()) / seconds / 1e9)
+        .metric("frames_per_sec", static_cast<double>(found) / seconds)
+        .print();
+}
+
+#ifdef __linux__
+size_t residentBytes() {
+    long  size  = 0;
+    long  pages = 0;
+    FILE* statm = std::fopen("/proc/self/statm", "r");
+    if (statm != nullptr) {
+        if (std::fscanf(statm, "%ld %ld", &size, &pages) != 2)
+            pages = 0;
+        std::fclose(statm);
+    }
+    return static_cast<size_t>(pages) * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+struct BufferedConnection {
+    Socket      socket;
+    FrameBuffer buffer;
+
+    BufferedConnection(Socket s, size_t buffer_size) : socket(std::move(s)), buffer(buffer_size) {}
+};
+
+struct LeanConnection {
+    Socket       socket;
+    PooledBuffer kept;
+    PooledBuffer pending;
+
+    LeanConnection(Socket s, BufferPool& pool) : socket(std::move(s)), kept(pool), pending(pool) {}
+};
+
+// every client sends one line and, one in a hundred, the start of the next, then the connections sit idle. the
+// resident set grows by what the server side keeps per connection, sockets themselves live in kernel memory
+void runIdleMemory(const BenchOptions& options, bool lean, size_t buffer_size) {
+    uint16_t port;
+    Socket   listener = listenLoopback(port);
+    size_t   total    = scaled(options, 5000);
+
+    BufferPool                      pool;
+    FrameBuffer                     scratch(buffer_size);
+    DelimiterDecoder                decoder("\n");
+    FrameView                       frame;
+    std::vector<Socket>             clients;
+    std::vector<BufferedConnection> buffered;
+    std::vector<LeanConnection>     leans;
+    clients.reserve(total);
+    if (lean)
+        leans.reserve(total);
+    else
+        buffered.reserve(total);
+
+    size_t before = residentBytes();
+    size_t frames = 0;
+    for (size_t i = 0; i < total; i++) {
+        auto pair = connectedPair(listener, port);
+        pair.first.send(std::string(i % 100 == 0 ? "hello\npartial" : "hello\n"));
+        clients.push_back(std::move(pair.first));
+
+        if (lean) {
+            leans.emplace_back(std::move(pair.second), pool);
+            LeanConnection& conn = leans.back();
+            conn.kept.restore(scratch);
+            decoder.reset();
+            scratch.fill(conn.socket);
+            while (decoder.next(scratch, frame))
+                frames++;
+            conn.kept.keep(scratch);
+        } else {
+            buffered.emplace_back(std::move(pair.second), buffer_size);
+            BufferedConnection& conn = buffered.back();
+            decoder.reset();
+            conn.buffer.fill(conn.socket);
+            while (decoder.next(conn.buffer, frame))
+                frames++;
+        }
+    }
+    size_t after = residentBytes();
+
+    BenchReport("idle_memory")
+        .param("mode", lean ? "lean" : "buffered")
+        .param("buffer", static_cast<double>(buffer_size))
+        .param("connections", static_cast<double>(total))
+        .metric("frames", static_cast<double>(frames))
+        .metric("rss_mb", static_cast<double>(after - before) / 1e6)
+        .metric("rss_per_connection", static_cast<double>(after - before) / static_cast<double>(total))
+        .metric("pooled_blocks", static_cast<double>(pool.inUse()))
+        .print();
+}
+#endif
+
+} // namespace
+
+BENCH_CASE("framing_scan") {
+    for (ScanImpl impl : {ScanImpl::SCALAR, ScanImpl::LIBC, ScanImpl::SSE2, ScanImpl::AVX2}) {
+        if (!scanImplSupported(impl))
+            continue;
+        for (size_t spacing : {16, 256, 4096, 0})
+            runScan(options, impl, spacing);
+    }
+}
+
+#ifdef __linux__
+// lean first, its few small allocations then cannot be served from memory the buffered run freed
+BENCH_CASE("idle_memory") {
+    raiseFdLimit();
+    runIdleMemory(options, true, 16 * 1024);
+    runIdleMemory(options, false, 16 * 1024);
+}
+#endif
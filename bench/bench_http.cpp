@@ -0,0 +1,95 @@
+#include "bench_utils.hpp"
+#include "event_loop.hpp"
+#include "event_poll.hpp"
+#include "http.hpp"
+
+#include <atomic>
+#include <thread>
+#include <unordered_map>
+
+namespace {
+
+const char HELLO[] = "Hello, World!";
+
+void sendAll(Socket& s, const char* data, size_t size) {
+    while (size > 0) {
+        socket_size_t sent = s.send(data, size);
+        data += sent;
+        size -= static_cast<size_t>(sent);
+    }
+}
+
+// closed loop over loopback: every connection sends depth pipelined requests in one write and the next batch once
+// all responses are in. the hello-world handler keeps the numbers about the parser, the loop and the writes
+void runRequests(const BenchOptions& options, size_t connections, size_t depth) {
+    uint16_t port;
+    Socket   listener = listenLoopback(port);
+
+    EventLoop  loop(1024);
+    HttpServer server(loop, std::move(listener), [](const HttpRequest& /*request*/, HttpResponse& response) {
+        response.static_body = {HELLO, sizeof(HELLO) - 1};
+    });
+    std::thread server_thread([&]() { loop.run(); });
+
+    const std::string request  = "GET /hello HTTP/1.1\r\nHost: bench\r\n\r\n";
+    const std::string head     = "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: 13\r\n\r\n";
+    const size_t      response = head.size() + sizeof(HELLO) - 1;
+    std::string       batch;
+    for (size_t i = 0; i < depth; i++)
+        batch += request;
+
+    std::vector<Socket>                  clients(connections);
+    EventPoll                            poll(1024);
+    std::unordered_map<socket_t, size_t> index;
+    std::vector<size_t>                  received(connections);
+    std::vector<char>                    buffer(64 * 1024);
+    for (size_t i = 0; i < connections; i++) {
+        clients[i].create();
+        clients[i].connect("127.0.0.1", port);
+        setNoDelay(clients[i]);
+        clients[i].setNonBlocking(true);
+        poll.addFd(clients[i].fd(), PollEvent::READ);
+        index[clients[i].fd()] = i;
+        sendAll(clients[i], batch.data(), batch.size());
+    }
+
+    uint64_t requests = 0;
+    auto     start    = std::chrono::steady_clock::now();
+    while (secondsSince(start) < options.seconds) {
+        poll.wait(10);
+        for (const auto& event : poll.events()) {
+            size_t        i = index[event.fd];
+            socket_size_t n;
+            while ((n = clients[i].recv(buffer.data(), buffer.size())) > 0) {
+                received[i] += static_cast<size_t>(n);
+                if (received[i] == response * depth) {
+                    received[i] = 0;
+                    requests += depth;
+                    sendAll(clients[i], batch.data(), batch.size());
+                }
+            }
+        }
+    }
+    double elapsed = secondsSince(start);
+
+    loop.post([&]() { loop.stop(); });
+    server_thread.join();
+    HttpServerStats stats = server.stats();
+
+    BenchReport("http_rps")
+        .param("connections", static_cast<double>(connections))
+        .param("pipeline", static_cast<double>(depth))
+        .metric("seconds", elapsed)
+        .metric("requests_per_sec", static_cast<double>(requests) / elapsed)
+        .metric("requests_per_write", static_cast<double>(stats.requests) / static_cast<double>(stats.writes))
+        .print();
+}
+
+} // namespace
+
+BENCH_CASE("http_rps") {
+    for (size_t connections : {1, 64}) {
+        for (size_t depth : {1, 16})
+            runRequests(options, connections, depth);
+    }
+}
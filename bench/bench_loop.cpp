@@ -0,0 +1,267 @@
+#include "bench_utils.hpp"
+#include "connection_slab.hpp"
+#include "event_loop.hpp"
+#include "event_poll.hpp"
+#include "memory_socket.hpp"
+
+#include <functional>
+#include <thread>
+#include <unordered_map>
+
+namespace {
+
+struct Tally {
+    uint64_t events = 0;
+
+    void onEvent(socket_t /*fd*/, PollEvent /*events*/) { events++; }
+};
+
+// every fd is connected and registered for WRITE, so each wait() reports all of them
+std::vector<Socket> writableSockets(size_t count) {
+    uint16_t port;
+    Socket   listener = listenLoopback(port);
+
+    std::vector<Socket> sockets;
+    while (sockets.size() < count) {
+        auto pair = connectedPair(listener, port);
+        sockets.push_back(std::move(pair.first));
+        sockets.push_back(std::move(pair.second));
+    }
+    sockets.resize(count);
+    return sockets;
+}
+
+template <typename Round> double nsPerEvent(const BenchOptions& options, size_t fds, Round round) {
+    size_t rounds = scaled(options, 2000000) / fds + 1;
+    auto   start  = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < rounds; r++)
+        round();
+    return secondsSince(start) * 1e9 / static_cast<double>(rounds * fds);
+}
+
+void runDispatch(const BenchOptions& options, size_t fds) {
+    std::vector<Socket> sockets = writableSockets(fds);
+    Tally               tally;
+
+    // the same wait() without any dispatch, the difference to it is what the dispatcher costs
+    EventPoll bare(static_cast<int>(fds));
+    for (auto& s : sockets)
+        bare.addFd(s.fd(), PollEvent::WRITE);
+    double wait_ns = nsPerEvent(options, fds, [&]() { bare.wait(0); });
+
+    EventPoll                                                              mapped(static_cast<int>(fds));
+    std::unordered_map<socket_t, std::function<void(socket_t, PollEvent)>> handlers;
+    for (auto& s : sockets) {
+        mapped.addFd(s.fd(), PollEvent::WRITE);
+        handlers[s.fd()] = [&tally](socket_t fd, PollEvent events) { tally.onEvent(fd, events); };
+    }
+    double map_ns = nsPerEvent(options, fds, [&]() {
+        mapped.wait(0);
+        for (const auto& event : mapped.events()) {
+            auto it = handlers.find(event.fd);
+            if (it != handlers.end())
+                it->second(event.fd, event.events);
+        }
+    });
+
+    EventLoop loop(static_cast<int>(fds));
+    for (auto& s : sockets)
+        loop.add(s.fd(), PollEvent::WRITE, memberHandler<Tally, &Tally::onEvent>(&tally));
+    double loop_ns = nsPerEvent(options, fds, [&]() { loop.runOnce(0); });
+
+    // per-connection state in a generation-tagged slab, looked up straight from the event
+    ConnectionSlab<Tally> slab;
+    EventPoll             slabbed(static_cast<int>(fds));
+    for (auto& s : sockets) {
+        slab.emplace(s.fd());
+        slabbed.addFd(s.fd(), PollEvent::WRITE, slab.tag(s.fd()));
+    }
+    double slab_ns = nsPerEvent(options, fds, [&]() {
+        slabbed.wait(0);
+        for (const auto& event : slabbed.events()) {
+            Tally* conn = slab.get(event.fd, event.tag);
+            if (conn != nullptr)
+                conn->onEvent(event.fd, event.events);
+        }
+    });
+
+    BenchReport("loop_dispatch")
+        .param("fds", static_cast<double>(fds))
+        .metric("wait_only_ns_per_event", wait_ns)
+        .metric("map_ns_per_event", map_ns)
+        .metric("event_loop_ns_per_event", loop_ns)
+        .metric("slab_ns_per_event", slab_ns)
+        .metric("map_dispatch_ns", map_ns - wait_ns)
+        .metric("event_loop_dispatch_ns", loop_ns - wait_ns)
+        .metric("slab_dispatch_ns", slab_ns - wait_ns)
+        .metric("handled", static_cast<double>(tally.events))
+        .print();
+}
+
+// producers post as fast as they can while the loop drains, reports throughput and how well wakeups are batched
+void runPost(const BenchOptions& options, size_t producers) {
+    EventLoop loop;
+    size_t    per_producer = scaled(options, 2000000) / producers;
+    uint64_t  ran          = 0;
+
+    std::vector<std::thread> threads;
+    auto                     start = std::chrono::steady_clock::now();
+    for (size_t p = 0; p < producers; p++) {
+        threads.emplace_back([&]() {
+            for (size_t i = 0; i < per_producer; i++)
+                loop.post([&ran]() { ran++; });
+        });
+    }
+    while (ran < per_producer * producers)
+        loop.runOnce(10);
+    double elapsed = secondsSince(start);
+    for (auto& thread : threads)
+        thread.join();
+
+    LoopStats stats = loop.stats();
+    BenchReport("loop_post")
+        .param("producers", static_cast<double>(producers))
+        .metric("tasks_per_sec", static_cast<double>(ran) / elapsed)
+        .metric("tasks_per_batch", static_cast<double>(stats.tasks) / static_cast<double>(stats.batches))
+        .metric("wakeups", static_cast<double>(loop.poll().stats().wakeups))
+        .pollStats(loop.poll().stats())
+        .print();
+}
+
+struct MemoryEcho {
+    MemorySocket socket;
+
+    void onEvent(socket_t /*fd*/, PollEvent /*events*/) {
+        char          buffer[256];
+        socket_size_t n = socket.tryRecv(buffer, sizeof(buffer));
+        if (n > 0)
+            socket.send(buffer, static_cast<size_t>(n));
+    }
+};
+
+// echo over in-process MemorySocket pairs: the same loop, handlers and poll front end as over TCP, but no syscalls,
+// so the result is what the library itself costs per message
+void runMemoryEcho(const BenchOptions& options, size_t connections) {
+    EventLoop                 loop(static_cast<int>(connections), PollBackend::MEMORY);
+    std::vector<MemorySocket> clients;
+    std::vector<MemoryEcho>   servers(connections);
+    for (size_t i = 0; i < connections; i++) {
+        auto ends         = MemorySocket::pair();
+        servers[i].socket = std::move(ends.second);
+        clients.push_back(std::move(ends.first));
+    }
+    for (auto& server : servers)
+        loop.add(server.socket.fd(), PollEvent::READ, memberHandler<MemoryEcho, &MemoryEcho::onEvent>(&server));
+
+    char     message[64] = {};
+    char     reply[64];
+    size_t   rounds      = scaled(options, 2000000) / connections + 1;
+    uint64_t echoed      = 0;
+    auto     start       = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < rounds; r++) {
+        for (auto& client : clients)
+            client.send(message, sizeof(message));
+        loop.runOnce(0);
+        for (auto& client : clients)
+            echoed += client.recv(reply, sizeof(reply)) == sizeof(reply) ? 1 : 0;
+    }
+    double elapsed = secondsSince(start);
+
+    BenchReport("loop_memory_echo")
+        .param("connections", static_cast<double>(connections))
+        .metric("messages_per_sec", static_cast<double>(echoed) / elapsed)
+        .metric("ns_per_message", elapsed * 1e9 / static_cast<double>(echoed))
+        .pollStats(loop.poll().stats())
+        .print();
+}
+
+// answers every request byte of a pipelined batch with a reply of its own, through a LoopOutput
+struct PipelinedResponder {
+    Socket*     socket;
+    LoopOutput* output;
+
+    void onEvent(socket_t /*fd*/, PollEvent /*events*/) {
+        char          requests[64];
+        char          reply[32] = {};
+        socket_size_t n         = socket->tryRecv(requests, sizeof(requests));
+        for (socket_size_t i = 0; i < n; i++)
+            output->write(reply, sizeof(reply));
+    }
+};
+
+const char* outputModeName(OutputMode mode) {
+    switch (mode) {
+        case OutputMode::DIRECT:
+            return "direct";
+        case OutputMode::GATHER:
+            return "gather";
+        case OutputMode::CORK:
+            return "cork";
+    }
+    return "unknown";
+}
+
+void runCoalesce(const BenchOptions& options, OutputMode mode, size_t pipeline) {
+    uint16_t  port;
+    Socket    listener = listenLoopback(port);
+    auto      pair     = connectedPair(listener, port);
+    EventLoop loop;
+    pair.second.setNonBlocking(true);
+
+    LoopOutput         output(loop, pair.second, mode);
+    PipelinedResponder responder{&pair.second, &output};
+    loop.add(pair.second.fd(), PollEvent::READ,
+             memberHandler<PipelinedResponder, &PipelinedResponder::onEvent>(&responder));
+
+    std::vector<char> requests(pipeline, 'r');
+    std::vector<char> replies(pipeline * 32);
+    size_t            batches = scaled(options, 200000) / pipeline + 1;
+    auto              start   = std::chrono::steady_clock::now();
+    for (size_t b = 0; b < batches; b++) {
+        pair.first.send(requests.data(), requests.size());
+        size_t received = 0;
+        while (received < replies.size()) {
+            loop.runOnce(0);
+            received += static_cast<size_t>(pair.first.recv(replies.data(), replies.size() - received));
+        }
+    }
+    double elapsed = secondsSince(start);
+
+    SocketStats stats = pair.second.stats();
+    BenchReport("loop_coalesce")
+        .param("mode", outputModeName(mode))
+        .param("pipeline", static_cast<double>(pipeline))
+        .metric("replies_per_sec", static_cast<double>(batches * pipeline) / elapsed)
+        .metric("sends_per_batch", static_cast<double>(stats.send_calls) / static_cast<double>(batches))
+        .print();
+    loop.remove(pair.second.fd());
+}
+
+} // namespace
+
+BENCH_CASE("loop_post") {
+    for (size_t producers : {1, 2, 4})
+        runPost(options, producers);
+}
+
+BENCH_CASE("loop_dispatch") {
+    raiseFdLimit();
+    for (size_t fds : {64, 1024, 8192})
+        runDispatch(options, fds);
+}
+
+BENCH_CASE("loop_memory_echo") {
+    for (size_t connections : {1, 64, 1024})
+        runMemoryEcho(options, connections);
+}
+
+BENCH_CASE("loop_coalesce") {
+    std::vector<OutputMode> modes = {OutputMode::DIRECT, OutputMode::GATHER};
+#ifdef __linux__
+    modes.push_back(OutputMode::CORK);
+#endif
+    for (OutputMode mode : modes) {
+        for (size_t pipeline : {1, 8, 32})
+            runCoalesce(options, mode, pipeline);
+    }
+}
@@ -0,0 +1,57 @@
+#include "bench_utils.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+
+namespace {
+
+void usage(const char* program) {
+    std::fprintf(stderr,
+                 "usage: %s [--filter NAME] [--seconds S] [--scale X] [--list]\n"
+                 "  --filter NAME  run only benchmarks whose name contains NAME\n"
+                 "  --seconds S    duration of time-bound benchmarks (default 2)\n"
+                 "  --scale X      multiplier for iteration counts (default 1)\n"
+                 "  --list         print benchmark names\n",
+                 program);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+    for (int i = 1; i < argc; i++) {
+        bool has_value = i + 1 < argc;
+        if (std::strcmp(argv[i], "--filter") == 0 && has_value) {
+            options.filter = argv[++i];
+        } else if (std::strcmp(argv[i], "--seconds") == 0 && has_value) {
+            options.seconds = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--scale") == 0 && has_value) {
+            options.scale = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--list") == 0) {
+            options.list = true;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    raiseFdLimit();
+
+    int failed = 0;
+    for (const BenchCase& bench : benchRegistry()) {
+        if (std::strstr(bench.name, options.filter.c_str()) == nullptr)
+            continue;
+        if (options.list) {
+            std::printf("%s\n", bench.name);
+            continue;
+        }
+        try {
+            bench.fn(options);
+        } catch (const std::exception& e) {
+            std::fprintf(stderr, "%s failed: %s\n", bench.name, e.what());
+            failed++;
+        }
+    }
+    return failed == 0 ? 0 : 1;
+}
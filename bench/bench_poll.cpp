@@ -0,0 +1,188 @@
+#include "bench_utils.hpp"
+#include "event_poll.hpp"
+
+#ifndef _WIN32
+#include "basic_event_poll.hpp"
+#endif
+
+namespace {
+
+std::vector<Socket> idleSockets(size_t count) {
+    uint16_t port;
+    Socket   listener = listenLoopback(port);
+
+    std::vector<Socket> sockets;
+    for (size_t i = 0; i < count / 2; i++) {
+        auto pair = connectedPair(listener, port);
+        sockets.push_back(std::move(pair.first));
+        sockets.push_back(std::move(pair.second));
+    }
+    return sockets;
+}
+
+template <typename Op> double nsPerOp(std::vector<Socket>& sockets, size_t rounds, Op op) {
+    auto start = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < rounds; r++) {
+        for (auto& s : sockets)
+            op(s.fd());
+    }
+    return secondsSince(start) * 1e9 / static_cast<double>(rounds * sockets.size());
+}
+
+void runChurn(const BenchOptions& options, size_t fds) {
+    std::vector<Socket> sockets = idleSockets(fds);
+    size_t              rounds  = scaled(options, 200000) / sockets.size() + 1;
+
+    EventPoll poll;
+    double    add_ns  = 0;
+    double    mod_ns  = 0;
+    double    same_ns = 0;
+    double    del_ns  = 0;
+    for (size_t r = 0; r < rounds; r++) {
+        add_ns += nsPerOp(sockets, 1, [&](socket_t fd) { poll.addFd(fd, PollEvent::READ); });
+        mod_ns += nsPerOp(sockets, 1, [&](socket_t fd) {
+            poll.modifyFd(fd, static_cast<PollEvent>(PollEvent::READ | PollEvent::WRITE));
+        });
+        // the interest cache answers these without a syscall
+        same_ns += nsPerOp(sockets, 1, [&](socket_t fd) {
+            poll.modifyFd(fd, static_cast<PollEvent>(PollEvent::READ | PollEvent::WRITE));
+        });
+        del_ns += nsPerOp(sockets, 1, [&](socket_t fd) { poll.removeFd(fd); });
+    }
+
+    BenchReport("fd_churn")
+        .param("fds", static_cast<double>(sockets.size()))
+        .param("rounds", static_cast<double>(rounds))
+        .metric("add_ns", add_ns / static_cast<double>(rounds))
+        .metric("modify_ns", mod_ns / static_cast<double>(rounds))
+        .metric("same_modify_ns", same_ns / static_cast<double>(rounds))
+        .metric("remove_ns", del_ns / static_cast<double>(rounds))
+        .pollStats(poll.stats())
+        .print();
+}
+
+// one always-writable socket among many idle ones, so every wait() returns a single event
+void runIdleWait(const BenchOptions& options, size_t idle) {
+    std::vector<Socket> sockets = idleSockets(idle + 2);
+
+    EventPoll poll;
+    for (size_t i = 1; i <= idle; i++)
+        poll.addFd(sockets[i].fd(), PollEvent::READ);
+    poll.addFd(sockets[0].fd(), PollEvent::WRITE);
+
+    size_t iterations = scaled(options, 200000);
+    auto   start      = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; i++)
+        poll.wait(0);
+    double elapsed = secondsSince(start);
+
+    BenchReport("idle_wait")
+        .param("idle_fds", static_cast<double>(idle))
+        .param("iterations", static_cast<double>(iterations))
+        .metric("wait_ns", elapsed * 1e9 / static_cast<double>(iterations))
+        .latency("wait", poll.waitLatency())
+        .pollStats(poll.stats())
+        .print();
+}
+
+#ifndef _WIN32
+// the receiving ends of connected pairs with an unread byte each, the sending ends are kept open behind them
+std::vector<Socket> readableSockets(size_t count) {
+    std::vector<Socket> sockets = idleSockets(count * 2);
+    for (size_t i = 0; i < sockets.size(); i += 2)
+        sockets[i].send("x", 1);
+    return sockets;
+}
+
+// every registered socket stays readable, so each wait(0) reports all of them and the loop measures the cost of getting
+// events out of the poll. EventPoll decodes through a virtual call into a vector, NativeEventPoll decodes inline while
+// the caller walks the kernel's array
+template <typename Dispatch>
+void runInlineDispatch(const BenchOptions& options, const char* front_end, size_t fds, Dispatch wait_and_dispatch) {
+    size_t   iterations = scaled(options, 200000) / fds + 1;
+    uint64_t seen       = 0;
+    auto     start      = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; i++)
+        seen += wait_and_dispatch();
+    double elapsed = secondsSince(start);
+
+    BenchReport("poll_inline")
+        .param("front_end", front_end)
+        .param("fds", static_cast<double>(fds))
+        .param("iterations", static_cast<double>(iterations))
+        .metric("wait_ns", elapsed * 1e9 / static_cast<double>(iterations))
+        .metric("ns_per_event", elapsed * 1e9 / static_cast<double>(iterations * fds))
+        .metric("events_per_wait", static_cast<double>(seen) / static_cast<double>(iterations))
+        .print();
+}
+
+// one byte back and forth over a connected pair, the syscalls dominate but the wrappers are all that differs
+template <typename PingPong> void runInlineIo(const BenchOptions& options, const char* front_end, PingPong ping_pong) {
+    std::vector<Socket> sockets    = idleSockets(2);
+    size_t              iterations = scaled(options, 200000);
+    auto                start      = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; i++)
+        ping_pong(sockets[0], sockets[1]);
+    double elapsed = secondsSince(start);
+
+    BenchReport("poll_inline_io")
+        .param("front_end", front_end)
+        .param("iterations", static_cast<double>(iterations))
+        .metric("round_ns", elapsed * 1e9 / static_cast<double>(iterations))
+        .print();
+}
+#endif
+
+} // namespace
+
+BENCH_CASE("fd_churn") {
+    for (size_t fds : {16, 256, 4096})
+        runChurn(options, fds);
+}
+
+BENCH_CASE("idle_wait") {
+    for (size_t idle : {0, 100, 1000, 10000})
+        runIdleWait(options, idle);
+}
+
+#ifndef _WIN32
+BENCH_CASE("poll_inline") {
+    for (size_t fds : {1, 16, 256}) {
+        std::vector<Socket> sockets = readableSockets(fds);
+
+        EventPoll poll(static_cast<int>(fds) + 1);
+        for (size_t i = 1; i < sockets.size(); i += 2)
+            poll.addFd(sockets[i].fd(), PollEvent::READ, static_cast<uint32_t>(i));
+        runInlineDispatch(options, "EventPoll", fds, [&]() {
+            poll.wait(0);
+            uint64_t seen = 0;
+            for (const auto& event : poll.events())
+                seen += (event.events & PollEvent::READ) != 0 && event.tag != 0;
+            return seen;
+        });
+
+        NativeEventPoll native(static_cast<int>(fds) + 1);
+        for (size_t i = 1; i < sockets.size(); i += 2)
+            native.addFd(sockets[i].fd(), PollEvent::READ, static_cast<uint32_t>(i));
+        runInlineDispatch(options, "BasicEventPoll", fds, [&]() {
+            size_t   count = native.wait(0);
+            uint64_t seen  = 0;
+            for (size_t i = 0; i < count; i++) {
+                EventPoll::PollEventEntry event = native.event(i);
+                seen += (event.events & PollEvent::READ) != 0 && event.tag != 0;
+            }
+            return seen;
+        });
+    }
+
+    char byte = 0;
+    runInlineIo(options, "Socket", [&](Socket& a, Socket& b) {
+        a.trySend(&byte, 1);
+        b.tryRecv(&byte, 1);
+    });
+    runInlineIo(options, "sendNow/recvNow", [&](Socket& a, Socket& b) {
+        sendNow(a.fd(), &byte, 1);
+        recvNow(b.fd(), &byte, 1);
+    });
+}
+#endif
@@ -0,0 +1,73 @@
+#include "bench_utils.hpp"
+#include "event_loop.hpp"
+#include "tcp_proxy.hpp"
+
+#include <thread>
+
+namespace {
+
+// one stream pushed through the proxy from a sender thread to a sink thread, the proxy runs on the calling thread.
+// copying moves every byte through user space twice, splicing only moves page references
+void runProxy(const BenchOptions& options, ProxyMode mode, size_t buffer_size) {
+    uint16_t port;
+    Socket   listener = listenLoopback(port);
+    auto     inbound  = connectedPair(listener, port);
+    auto     outbound = connectedPair(listener, port);
+
+    EventLoop    loop;
+    ProxyOptions proxy_options;
+    proxy_options.mode        = mode;
+    proxy_options.buffer_size = buffer_size;
+    TcpProxy proxy(loop, proxy_options);
+    proxy.relay(std::move(inbound.second), std::move(outbound.first));
+
+    size_t      total = scaled(options, size_t{1024} * 1024 * 1024);
+    std::thread sender([&]() {
+        std::vector<char> data(256 * 1024, 'x');
+        size_t            left = total;
+        while (left > 0) {
+            size_t        size = left < data.size() ? left : data.size();
+            socket_size_t sent = inbound.first.send(data.data(), size);
+            left -= static_cast<size_t>(sent);
+        }
+        inbound.first.shutdown(ShutdownMode::WRITE);
+    });
+    size_t      received = 0;
+    std::thread sink([&]() {
+        std::vector<char> buffer(256 * 1024);
+        socket_size_t     n;
+        while ((n = outbound.second.recv(buffer.data(), buffer.size())) > 0)
+            received += static_cast<size_t>(n);
+        outbound.second.shutdown(ShutdownMode::WRITE);
+    });
+
+    auto start = std::chrono::steady_clock::now();
+    while (proxy.sessions() > 0)
+        loop.runOnce(100);
+    double elapsed = secondsSince(start);
+    sender.join();
+    sink.join();
+
+    ProxyStats stats = proxy.stats();
+    BenchReport("proxy")
+        .param("mode", mode == ProxyMode::COPY ? "copy" : "splice")
+        .param("buffer", static_cast<double>(buffer_size))
+        .param("bytes", static_cast<double>(received))
+        .metric("seconds", elapsed)
+        .metric("mb_per_sec", static_cast<double>(received) / elapsed / 1e6)
+        .metric("spliced_bytes", static_cast<double>(stats.spliced))
+        .metric("copied_bytes", static_cast<double>(stats.copied))
+        .pollStats(loop.poll().stats())
+        .print();
+}
+
+} // namespace
+
+BENCH_CASE("proxy") {
+    for (size_t buffer_size : {64 * 1024, 1024 * 1024}) {
+#ifdef __linux__
+        runProxy(options, ProxyMode::SPLICE, buffer_size);
+#endif
+        runProxy(options, ProxyMode::COPY, buffer_size);
+    }
+}
@@ -0,0 +1,136 @@
+#ifdef __linux__
+
+#include "bench_utils.hpp"
+#include "event_poll.hpp"
+#include "shm_socket.hpp"
+
+#include <sys/socket.h>
+#include <thread>
+
+namespace {
+
+// both transports have the nonblocking Socket surface, the counters differ
+struct UnixPair {
+    Socket first;
+    Socket second;
+
+    static UnixPair make() {
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == -1)
+            throw std::runtime_error("socketpair failed");
+        UnixPair pair{Socket(fds[0]), Socket(fds[1])};
+        pair.first.setNonBlocking(true);
+        pair.second.setNonBlocking(true);
+        return pair;
+    }
+};
+
+uint64_t doorbells(const ShmSocket& end) {
+    return end.doorbells();
+}
+
+uint64_t doorbells(const Socket& /*end*/) {
+    return 0;
+}
+
+// the doorbell also rings for room, a socket has to be watched for WRITE
+void waitForRoom(EventPoll& poll, ShmSocket& /*end*/) {
+    poll.wait(100);
+}
+
+void waitForRoom(EventPoll& poll, Socket& end) {
+    poll.modifyFd(end.fd(), PollEvent::WRITE);
+    poll.wait(100);
+    poll.modifyFd(end.fd(), PollEvent::READ);
+}
+
+template <typename End> void sendAll(End& end, EventPoll& poll, const char* data, size_t size) {
+    while (size > 0) {
+        socket_size_t sent = end.trySend(data, size);
+        if (sent < 0) {
+            waitForRoom(poll, end);
+            continue;
+        }
+        data += sent;
+        size -= static_cast<size_t>(sent);
+    }
+}
+
+// reads exactly size bytes, sleeping in the poll whenever the transport is empty
+template <typename End> void recvAll(End& end, EventPoll& poll, char* out, size_t size) {
+    while (size > 0) {
+        socket_size_t n = end.tryRecv(out, size);
+        if (n < 0) {
+            poll.wait(100);
+            continue;
+        }
+        if (n == 0)
+            throw std::runtime_error("peer closed");
+        out += n;
+        size -= static_cast<size_t>(n);
+    }
+}
+
+// mode "pingpong" has one message in flight, "stream" keeps the receiver busy with a continuous flow
+template <typename End>
+void runTransport(const BenchOptions& options, const char* transport, const char* mode, End& client, End& server,
+                  size_t payload) {
+    bool   pingpong = std::string(mode) == "pingpong";
+    size_t messages = scaled(options, pingpong ? 200000 : 500000);
+
+    std::thread peer([&]() {
+        EventPoll poll(1);
+        poll.addFd(server.fd(), PollEvent::READ);
+        std::vector<char> buffer(payload);
+        for (size_t i = 0; i < messages; i++) {
+            recvAll(server, poll, buffer.data(), payload);
+            if (pingpong)
+                sendAll(server, poll, buffer.data(), payload);
+        }
+        if (!pingpong)
+            sendAll(server, poll, buffer.data(), 1);
+    });
+
+    EventPoll poll(1);
+    poll.addFd(client.fd(), PollEvent::READ);
+    std::vector<char> buffer(payload, 'm');
+    auto              start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < messages; i++) {
+        sendAll(client, poll, buffer.data(), payload);
+        if (pingpong)
+            recvAll(client, poll, buffer.data(), payload);
+    }
+    if (!pingpong)
+        recvAll(client, poll, buffer.data(), 1);
+    double elapsed = secondsSince(start);
+    peer.join();
+
+    double count = static_cast<double>(messages);
+    BenchReport("shm_transport")
+        .param("transport", transport)
+        .param("mode", mode)
+        .param("payload", static_cast<double>(payload))
+        .metric("messages_per_sec", count / elapsed)
+        .metric("ns_per_message", elapsed * 1e9 / count)
+        .metric("doorbells_per_message", static_cast<double>(doorbells(client) + doorbells(server)) / count)
+        .metric("would_block_per_message",
+                static_cast<double>(client.stats().recv_eagain + client.stats().send_eagain +
+                                    server.stats().recv_eagain + server.stats().send_eagain) /
+                    count)
+        .print();
+}
+
+} // namespace
+
+BENCH_CASE("shm_transport") {
+    for (const char* mode : {"pingpong", "stream"}) {
+        for (size_t payload : {64, 4096}) {
+            auto shm = ShmSocket::pair();
+            runTransport(options, "shm", mode, shm.first, shm.second, payload);
+            auto unix_pair = UnixPair::make();
+            runTransport(options, "unix", mode, unix_pair.first, unix_pair.second, payload);
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,294 @@
+#include "accept_controller.hpp"
+#include "bench_utils.hpp"
+#include "event_poll.hpp"
+
+#ifdef __linux__
+#include <sys/resource.h>
+#endif
+
+#include <atomic>
+#include <thread>
+#include <unordered_map>
+
+namespace {
+
+void sendAll(Socket& s, const char* data, size_t size) {
+    while (size > 0) {
+        socket_size_t sent = s.send(data, size);
+        data += sent;
+        size -= static_cast<size_t>(sent);
+    }
+}
+
+// echoes everything it reads on the given connections until stopped
+void echoServer(std::vector<Socket>& conns, const std::atomic<bool>& stop) {
+    EventPoll                             poll(1024);
+    std::unordered_map<socket_t, Socket*> by_fd;
+    for (auto& conn : conns) {
+        conn.setNonBlocking(true);
+        poll.addFd(conn.fd(), PollEvent::READ);
+        by_fd[conn.fd()] = &conn;
+    }
+
+    std::vector<char> buffer(64 * 1024);
+    while (!stop.load(std::memory_order_relaxed)) {
+        poll.wait(10);
+        for (const auto& event : poll.events()) {
+            Socket*       conn = by_fd[event.fd];
+            socket_size_t n;
+            while ((n = conn->recv(buffer.data(), buffer.size())) > 0)
+                sendAll(*conn, buffer.data(), static_cast<size_t>(n));
+        }
+    }
+}
+
+// closed loop: every connection keeps one message in flight and sends the next one as soon as the echo arrives
+void runEcho(const BenchOptions& options, size_t connections, size_t payload) {
+    uint16_t port;
+    Socket   listener = listenLoopback(port);
+
+    std::vector<Socket> clients;
+    std::vector<Socket> servers;
+    for (size_t i = 0; i < connections; i++) {
+        auto pair = connectedPair(listener, port);
+        clients.push_back(std::move(pair.first));
+        servers.push_back(std::move(pair.second));
+    }
+
+    std::atomic<bool> stop{false};
+    std::thread       server([&]() { echoServer(servers, stop); });
+
+    EventPoll                            poll(1024);
+    std::unordered_map<socket_t, size_t> index;
+    std::vector<uint64_t>                sent_at(connections);
+    std::vector<size_t>                  received(connections);
+    std::vector<char>                    message(payload, 'x');
+    std::vector<char>                    buffer(64 * 1024);
+    LatencyHistogram                     latency;
+
+    for (size_t i = 0; i < connections; i++) {
+        clients[i].setNonBlocking(true);
+        poll.addFd(clients[i].fd(), PollEvent::READ);
+        index[clients[i].fd()] = i;
+        sent_at[i]             = monotonicNs();
+        sendAll(clients[i], message.data(), payload);
+    }
+
+    uint64_t messages = 0;
+    auto     start    = std::chrono::steady_clock::now();
+    while (secondsSince(start) < options.seconds) {
+        poll.wait(10);
+        for (const auto& event : poll.events()) {
+            size_t        i = index[event.fd];
+            socket_size_t n;
+            while ((n = clients[i].recv(buffer.data(), buffer.size())) > 0) {
+                received[i] += static_cast<size_t>(n);
+                while (received[i] >= payload) {
+                    received[i] -= payload;
+                    uint64_t now = monotonicNs();
+                    latency.record(now - sent_at[i]);
+                    messages++;
+                    sent_at[i] = now;
+                    sendAll(clients[i], message.data(), payload);
+                }
+            }
+        }
+    }
+    double elapsed = secondsSince(start);
+
+    stop = true;
+    server.join();
+
+    BenchReport("echo")
+        .param("connections", static_cast<double>(connections))
+        .param("payload", static_cast<double>(payload))
+        .metric("seconds", elapsed)
+        .metric("messages_per_sec", static_cast<double>(messages) / elapsed)
+        .metric("mb_per_sec", static_cast<double>(messages * payload) / elapsed / 1e6)
+        .latency("rtt", latency.snapshot())
+        .pollStats(poll.stats())
+        .print();
+}
+
+void runLargeTransfer(const BenchOptions& options, size_t chunk) {
+    uint16_t port;
+    Socket   listener = listenLoopback(port);
+    auto     pair     = connectedPair(listener, port);
+
+    size_t total = scaled(options, size_t{256} * 1024 * 1024);
+
+    std::thread sender([&]() {
+        std::vector<char> data(chunk, 'x');
+        size_t            left = total;
+        while (left > 0) {
+            size_t size = left < chunk ? left : chunk;
+            sendAll(pair.first, data.data(), size);
+            left -= size;
+        }
+    });
+
+    std::vector<char> buffer(chunk);
+    size_t            received = 0;
+    auto              start    = std::chrono::steady_clock::now();
+    while (received < total)
+        received += static_cast<size_t>(pair.second.recv(buffer.data(), buffer.size()));
+    double elapsed = secondsSince(start);
+    sender.join();
+
+    SocketStats stats = pair.second.stats();
+    BenchReport("large_transfer")
+        .param("chunk", static_cast<double>(chunk))
+        .param("bytes", static_cast<double>(total))
+        .metric("seconds", elapsed)
+        .metric("mb_per_sec", static_cast<double>(total) / elapsed / 1e6)
+        .metric("recv_calls", static_cast<double>(stats.recv_calls))
+        .metric("bytes_per_recv", static_cast<double>(stats.recv_bytes) / static_cast<double>(stats.recv_calls))
+        .print();
+}
+
+// client threads connect and close as fast as they can while one poll loop accepts
+void runAcceptStorm(const BenchOptions& options, size_t client_threads) {
+    uint16_t port;
+    Socket   listener = listenLoopback(port);
+
+    size_t              total = scaled(options, 10000);
+    std::atomic<size_t> next{0};
+
+    std::vector<std::thread> clients;
+    for (size_t t = 0; t < client_threads; t++) {
+        clients.emplace_back([&]() {
+            while (next.fetch_add(1) < total) {
+                Socket client;
+                client.create();
+                client.connect("127.0.0.1", port);
+            }
+        });
+    }
+
+    EventPoll poll;
+    poll.addFd(listener.fd(), PollEvent::READ);
+
+    LatencyHistogram accept_latency;
+    size_t           accepted = 0;
+    auto             start    = std::chrono::steady_clock::now();
+    while (accepted < total) {
+        poll.wait(100);
+        for (size_t i = 0; i < poll.events().size() && accepted < total; i++) {
+            uint64_t before = monotonicNs();
+            Socket   conn   = listener.accept();
+            accept_latency.record(monotonicNs() - before);
+            accepted++;
+        }
+    }
+    double elapsed = secondsSince(start);
+    for (auto& client : clients)
+        client.join();
+
+    BenchReport("accept_storm")
+        .param("client_threads", static_cast<double>(client_threads))
+        .param("connections", static_cast<double>(total))
+        .metric("seconds", elapsed)
+        .metric("accepts_per_sec", static_cast<double>(accepted) / elapsed)
+        .latency("accept", accept_latency.snapshot())
+        .pollStats(poll.stats())
+        .print();
+}
+
+// voluntary context switches of the calling thread, each one is a sleep that something woke up from
+uint64_t threadSwitches() {
+#ifdef __linux__
+    rusage usage{};
+    getrusage(RUSAGE_THREAD, &usage);
+    return static_cast<uint64_t>(usage.ru_nvcsw);
+#else
+    return 0;
+#endif
+}
+
+// several threads with a poll each share one listener while a client connects one connection at a time, so every
+// connection is a separate wakeup. without exclusive wakeups the kernel wakes all threads for it, all but one find
+// the listener drained already. most of them go back to sleep inside epoll_wait() without returning, so the
+// wakeups are counted as context switches of the poll threads
+void runAcceptHerd(const BenchOptions& options, size_t threads, bool exclusive) {
+    uint16_t port;
+    Socket   listener = listenLoopback(port);
+    listener.setNonBlocking(true);
+
+    size_t              total = scaled(options, 5000);
+    std::atomic<size_t> accepted{0};
+    std::atomic<size_t> wakeups{0};
+    std::atomic<size_t> empty{0};
+    std::atomic<size_t> switches{0};
+
+    std::vector<std::thread> acceptors;
+    for (size_t t = 0; t < threads; t++) {
+        acceptors.emplace_back([&]() {
+            EventPoll     poll;
+            AcceptOptions accept_options;
+            accept_options.exclusive = exclusive;
+            AcceptController    controller(listener, poll, accept_options);
+            std::vector<Socket> conns;
+            uint64_t            switches_before = threadSwitches();
+            while (accepted.load() < total) {
+                poll.wait(100);
+                if (poll.events().empty())
+                    continue;
+                wakeups.fetch_add(1);
+                accepted.fetch_add(controller.acceptReady(conns));
+                conns.clear();
+            }
+            switches.fetch_add(threadSwitches() - switches_before);
+            empty.fetch_add(controller.stats().empty);
+        });
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < total; i++) {
+        Socket client;
+        client.create();
+        client.connect("127.0.0.1", port);
+        // wait for the accept, or the next connection would share its wakeup
+        while (accepted.load() <= i)
+            std::this_thread::yield();
+    }
+    double elapsed = secondsSince(start);
+    for (auto& acceptor : acceptors)
+        acceptor.join();
+
+    BenchReport("accept_herd")
+        .param("threads", static_cast<double>(threads))
+        .param("exclusive", exclusive ? "yes" : "no")
+        .param("connections", static_cast<double>(total))
+        .metric("seconds", elapsed)
+        .metric("wakeups_per_accept", static_cast<double>(switches.load()) / static_cast<double>(accepted.load()))
+        .metric("events_per_accept", static_cast<double>(wakeups.load()) / static_cast<double>(accepted.load()))
+        .metric("empty_per_accept", static_cast<double>(empty.load()) / static_cast<double>(accepted.load()))
+        .print();
+}
+
+} // namespace
+
+BENCH_CASE("echo") {
+    for (size_t connections : {1, 16, 128, 1024})
+        runEcho(options, connections, 64);
+    runEcho(options, 16, 4096);
+}
+
+BENCH_CASE("large_transfer") {
+    for (size_t chunk : {4096, 65536, 1048576})
+        runLargeTransfer(options, chunk);
+}
+
+BENCH_CASE("accept_storm") {
+    for (size_t threads : {1, 4})
+        runAcceptStorm(options, threads);
+}
+
+BENCH_CASE("accept_herd") {
+    for (size_t threads : {2, 8}) {
+        runAcceptHerd(options, threads, false);
+#ifdef __linux__
+        runAcceptHerd(options, threads, true);
+#endif
+    }
+}
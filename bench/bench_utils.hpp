@@ -0,0 +1,157 @@
+#pragma once
+
+#include "histogram.hpp"
+#include "socket.hpp"
+#include "stats.hpp"
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/resource.h>
+#endif
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct BenchOptions {
+    double      seconds = 2.0;   // duration of time-bound benchmarks
+    double      scale   = 1.0;   // multiplier for iteration counts
+    std::string filter  = "";    // only run benchmarks whose name contains this
+    bool        list    = false; // print benchmark names and exit
+};
+
+using BenchFn = void (*)(const BenchOptions&);
+
+struct BenchCase {
+    const char* name;
+    BenchFn     fn;
+};
+
+inline std::vector<BenchCase>& benchRegistry() {
+    static std::vector<BenchCase> registry;
+    return registry;
+}
+
+struct BenchRegistrar {
+    BenchRegistrar(const char* name, BenchFn fn) { benchRegistry().push_back({name, fn}); }
+};
+
+#define BENCH_CONCAT_IMPL(a, b) a##b
+#define BENCH_CONCAT(a, b)      BENCH_CONCAT_IMPL(a, b)
+#define BENCH_CASE(name)                                                                                               \
+    static void           BENCH_CONCAT(bench_fn_, __LINE__)(const BenchOptions&);                                      \
+    static BenchRegistrar BENCH_CONCAT(bench_reg_, __LINE__)(name, &BENCH_CONCAT(bench_fn_, __LINE__));                \
+    static void           BENCH_CONCAT(bench_fn_, __LINE__)(const BenchOptions& options)
+
+// one result per line as a flat JSON object, so runs can be diffed and loaded with any JSON tooling
+class BenchReport {
+  public:
+    explicit BenchReport(const std::string& name) { add("bench", "\"" + name + "\""); }
+
+    BenchReport& param(const std::string& key, double value) { return number(key, value); }
+    BenchReport& param(const std::string& key, const std::string& value) { return add(key, "\"" + value + "\""); }
+    BenchReport& metric(const std::string& key, double value) { return number(key, value); }
+
+    BenchReport& latency(const std::string& prefix, const HistogramSnapshot& snapshot) {
+        number(prefix + "_samples", static_cast<double>(snapshot.count));
+        number(prefix + "_mean_ns", snapshot.mean());
+        number(prefix + "_p50_ns", static_cast<double>(snapshot.percentile(50)));
+        number(prefix + "_p99_ns", static_cast<double>(snapshot.percentile(99)));
+        number(prefix + "_p999_ns", static_cast<double>(snapshot.percentile(99.9)));
+        return number(prefix + "_max_ns", static_cast<double>(snapshot.max));
+    }
+
+    BenchReport& pollStats(const PollStats& stats) {
+        number("poll_waits", static_cast<double>(stats.waits));
+        number("poll_empty_waits", static_cast<double>(stats.empty_waits));
+        number("poll_events_per_wait",
+               stats.waits == 0 ? 0.0 : static_cast<double>(stats.events) / static_cast<double>(stats.waits));
+        number("poll_ctl_calls", static_cast<double>(stats.ctl_add + stats.ctl_mod + stats.ctl_del));
+        return number("poll_ctl_saved", static_cast<double>(stats.ctl_saved));
+    }
+
+    void print() const {
+        std::string line = "{";
+        for (size_t i = 0; i < m_fields.size(); i++)
+            line += (i == 0 ? "\"" : ",\"") + m_fields[i].first + "\":" + m_fields[i].second;
+        line += "}\n";
+        std::fputs(line.c_str(), stdout);
+        std::fflush(stdout);
+    }
+
+  private:
+    std::vector<std::pair<std::string, std::string>> m_fields;
+
+    BenchReport& add(const std::string& key, const std::string& value) {
+        m_fields.emplace_back(key, value);
+        return *this;
+    }
+    BenchReport& number(const std::string& key, double value) {
+        std::ostringstream out;
+        out.precision(10);
+        out << value;
+        return add(key, out.str());
+    }
+};
+
+inline double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+inline size_t scaled(const BenchOptions& options, size_t count) {
+    auto value = static_cast<size_t>(static_cast<double>(count) * options.scale);
+    return value == 0 ? 1 : value;
+}
+
+// benchmarks hold thousands of sockets, use whatever the hard limit allows
+inline void raiseFdLimit() {
+#ifndef _WIN32
+    rlimit limit{};
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+#endif
+}
+
+inline Socket listenLoopback(uint16_t& port, int backlog = SOMAXCONN) {
+    Socket s;
+    s.create();
+    s.setReuseAddr(true);
+    s.bind("127.0.0.1", 0);
+    s.listen(backlog);
+
+    sockaddr_in addr{};
+#ifdef _WIN32
+    int len = sizeof(addr);
+#else
+    socklen_t len = sizeof(addr);
+#endif
+    getsockname(s.fd(), reinterpret_cast<sockaddr*>(&addr), &len);
+    port = ntohs(addr.sin_port);
+    return s;
+}
+
+inline void setNoDelay(Socket& s) {
+    int opt = 1;
+    setsockopt(s.fd(), IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&opt), sizeof(opt));
+}
+
+// connected loopback pair, first is the client end and second the accepted end
+inline std::pair<Socket, Socket> connectedPair(Socket& listener, uint16_t port) {
+    Socket client;
+    client.create();
+    client.connect("127.0.0.1", port);
+    Socket accepted = listener.accept();
+    setNoDelay(client);
+    setNoDelay(accepted);
+    return std::make_pair(std::move(client), std::move(accepted));
+}
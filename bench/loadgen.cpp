@@ -0,0 +1,563 @@
+#include "bench_utils.hpp"
+#include "event_poll.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <queue>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+
+namespace {
+
+enum class LoadMode : uint8_t {
+    OPEN,
+    CLOSED
+};
+
+struct LoadOptions {
+    std::string host           = "127.0.0.1";
+    uint16_t    port           = 0; // 0 starts the built-in echo server
+    size_t      ports          = 1; // consecutive target ports, spreads connections past the ephemeral port limit
+    size_t      source_ips     = 1; // bind clients to 127.0.0.1 .. 127.0.0.N for the same reason
+    size_t      connections    = 100;
+    size_t      threads        = 2;
+    size_t      server_threads = 1;
+    size_t      payload        = 64;
+    double      seconds        = 10;
+    double      warmup         = 1;
+    double      rate           = 0; // messages per second over all connections, 0 sends back-to-back (closed only)
+    LoadMode    mode           = LoadMode::CLOSED;
+};
+
+constexpr size_t   MAX_CONNECTS_IN_FLIGHT = 256;
+constexpr size_t   MAX_SENDS_PER_WAIT     = 256;
+constexpr uint64_t NS_PER_SEC             = 1000000000;
+
+// what a nonblocking socket did not take yet. it is sent once the socket reports WRITE, so a peer that stops reading
+// never stalls the thread that writes to it, and that thread keeps reading in the meantime
+struct OutputQueue {
+    std::vector<char> data;
+    size_t            head = 0;
+
+    bool empty() const { return head == data.size(); }
+    void append(const char* bytes, size_t size) { data.insert(data.end(), bytes, bytes + size); }
+
+    // sends as much as the socket takes, true once nothing is left
+    bool flush(Socket& s) {
+        while (!empty()) {
+            socket_size_t sent = s.trySend(data.data() + head, data.size() - head);
+            if (sent < 0) {
+                if (head > data.size() / 2) {
+                    data.erase(data.begin(), data.begin() + static_cast<std::ptrdiff_t>(head));
+                    head = 0;
+                }
+                return false;
+            }
+            head += static_cast<size_t>(sent);
+        }
+        data.clear();
+        head = 0;
+        return true;
+    }
+};
+
+// built-in echo server, each thread owns a subset of the listeners and every connection accepted on them
+class EchoServer {
+  public:
+    EchoServer(size_t ports, size_t threads) {
+        for (size_t i = 0; i < ports; i++) {
+            uint16_t port;
+            m_listeners.push_back(listenLoopback(port));
+            m_listeners.back().setNonBlocking(true);
+            m_ports.push_back(port);
+        }
+        for (size_t t = 0; t < threads; t++)
+            m_threads.emplace_back([this, t, threads]() { run(t, threads); });
+    }
+
+    ~EchoServer() { stop(); }
+
+    EchoServer(const EchoServer&)            = delete;
+    EchoServer& operator=(const EchoServer&) = delete;
+
+    const std::vector<uint16_t>& ports() const { return m_ports; }
+
+    void stop() {
+        m_stop = true;
+        for (auto& thread : m_threads) {
+            if (thread.joinable())
+                thread.join();
+        }
+    }
+
+  private:
+    std::vector<Socket>      m_listeners;
+    std::vector<uint16_t>    m_ports;
+    std::vector<std::thread> m_threads;
+    std::atomic<bool>        m_stop{false};
+
+    struct EchoConnection {
+        Socket      socket;
+        OutputQueue output;
+    };
+
+    // reads only while little is queued, a client that stops reading stops being read
+    static constexpr size_t MAX_QUEUED = 1024 * 1024;
+
+    void run(size_t index, size_t threads) {
+        EventPoll                                    poll(1024);
+        std::unordered_map<socket_t, EchoConnection> conns;
+        std::unordered_map<socket_t, Socket*>        listeners;
+        for (size_t i = index; i < m_listeners.size(); i += threads) {
+            poll.addFd(m_listeners[i].fd(), PollEvent::READ);
+            listeners[m_listeners[i].fd()] = &m_listeners[i];
+        }
+
+        std::vector<char> buffer(64 * 1024);
+        while (!m_stop.load(std::memory_order_relaxed)) {
+            poll.wait(10);
+            for (const auto& event : poll.events()) {
+                auto listener = listeners.find(event.fd);
+                if (listener != listeners.end()) {
+                    Socket conn;
+                    while ((conn = listener->second->tryAccept()).valid()) {
+                        conn.setNonBlocking(true);
+                        setNoDelay(conn);
+                        poll.addFd(conn.fd(), PollEvent::READ);
+                        socket_t fd = conn.fd();
+                        conns[fd].socket = std::move(conn);
+                    }
+                    continue;
+                }
+
+                EchoConnection& conn = conns.at(event.fd);
+                try {
+                    bool          drained = conn.output.flush(conn.socket);
+                    socket_size_t n;
+                    while (conn.output.data.size() < MAX_QUEUED &&
+                           (n = conn.socket.recv(buffer.data(), buffer.size())) > 0) {
+                        conn.output.append(buffer.data(), static_cast<size_t>(n));
+                        drained = conn.output.flush(conn.socket);
+                    }
+                    PollEvent interest = conn.output.data.size() >= MAX_QUEUED ? PollEvent::WRITE
+                                         : drained ? PollEvent::READ
+                                                   : static_cast<PollEvent>(PollEvent::READ | PollEvent::WRITE);
+                    poll.modifyFd(event.fd, interest);
+                } catch (const std::runtime_error&) {
+                    // reset by the client
+                    poll.removeFd(event.fd);
+                    conns.erase(event.fd);
+                    break;
+                }
+            }
+        }
+    }
+};
+
+struct InFlight {
+    uint64_t intended; // when the message should have been sent according to the schedule
+    uint64_t sent;     // when it actually was
+};
+
+struct Connection {
+    Socket                socket;
+    OutputQueue           output;
+    bool                  writing   = false; // registered for WRITE while output is queued
+    bool                  connected = false;
+    size_t                received  = 0;
+    std::vector<InFlight> in_flight;
+    size_t                head = 0;
+
+    void push(InFlight message) { in_flight.push_back(message); }
+    InFlight pop() {
+        InFlight message = in_flight[head++];
+        if (head == in_flight.size()) {
+            in_flight.clear();
+            head = 0;
+        }
+        return message;
+    }
+    bool busy() const { return head < in_flight.size(); }
+};
+
+struct SharedState {
+    std::atomic<size_t>   ready{0};
+    std::atomic<uint64_t> start_ns{0};
+};
+
+struct ThreadResult {
+    size_t            established      = 0;
+    size_t            connect_failures = 0;
+    uint64_t          sent             = 0;
+    uint64_t          completed        = 0;
+    HistogramSnapshot latency;
+    HistogramSnapshot service;
+};
+
+class LoadThread {
+  public:
+    LoadThread(const LoadOptions& options, const std::vector<uint16_t>& ports, size_t index, size_t connections)
+        : m_options(options), m_ports(ports), m_index(index), m_conns(connections), m_message(options.payload, 'x'),
+          m_buffer(64 * 1024) {}
+
+    ThreadResult run(SharedState& shared) {
+        connectAll();
+
+        // every thread starts measuring at the same instant once all of them are connected
+        if (shared.ready.fetch_add(1) + 1 == m_options.threads)
+            shared.start_ns = monotonicNs() + NS_PER_SEC / 10;
+        while (shared.start_ns.load() == 0)
+            std::this_thread::yield();
+
+        uint64_t start = shared.start_ns.load();
+        m_measure_from = start + static_cast<uint64_t>(m_options.warmup * NS_PER_SEC);
+        m_end          = m_measure_from + static_cast<uint64_t>(m_options.seconds * NS_PER_SEC);
+        while (monotonicNs() < start)
+            std::this_thread::yield();
+
+        if (m_options.mode == LoadMode::OPEN)
+            runOpen(start);
+        else
+            runClosed(start);
+
+        m_result.latency = m_latency.snapshot();
+        m_result.service = m_service.snapshot();
+        return m_result;
+    }
+
+  private:
+    const LoadOptions&                   m_options;
+    const std::vector<uint16_t>&         m_ports;
+    size_t                               m_index;
+    std::vector<Connection>              m_conns;
+    std::vector<char>                    m_message;
+    std::vector<char>                    m_buffer;
+    EventPoll                            m_poll{1024};
+    std::unordered_map<socket_t, size_t> m_by_fd;
+    LatencyHistogram                     m_latency; // from the intended send time, corrected for coordinated omission
+    LatencyHistogram                     m_service; // from the actual send time
+    ThreadResult                         m_result;
+    uint64_t                             m_measure_from = 0;
+    uint64_t                             m_end          = 0;
+
+    void startConnect(size_t i) {
+        size_t      global = m_index + i * m_options.threads;
+        uint16_t    port   = m_ports[global % m_ports.size()];
+        Connection& conn   = m_conns[i];
+
+        conn.socket.create();
+        if (m_options.source_ips > 1) {
+            size_t source = (global / m_ports.size()) % m_options.source_ips;
+            conn.socket.bind("127.0.0." + std::to_string(source + 1), 0);
+        }
+        conn.socket.setNonBlocking(true);
+        m_by_fd[conn.socket.fd()] = i;
+        if (conn.socket.tryConnect(m_options.host, port)) {
+            conn.connected = true;
+            m_poll.addFd(conn.socket.fd(), PollEvent::READ);
+        } else {
+            m_poll.addFd(conn.socket.fd(), PollEvent::WRITE);
+        }
+    }
+
+    void connectAll() {
+        size_t next    = 0;
+        size_t pending = 0;
+        size_t done    = 0;
+        while (done < m_conns.size()) {
+            while (next < m_conns.size() && pending < MAX_CONNECTS_IN_FLIGHT) {
+                startConnect(next++);
+                if (m_conns[next - 1].connected) {
+                    m_result.established++;
+                    done++;
+                } else {
+                    pending++;
+                }
+            }
+
+            m_poll.wait(100);
+            for (const auto& event : m_poll.events()) {
+                Connection& conn = m_conns[m_by_fd[event.fd]];
+                if (conn.connected)
+                    continue;
+                pending--;
+                done++;
+                if (conn.socket.pendingError() == 0) {
+                    conn.connected = true;
+                    setNoDelay(conn.socket);
+                    m_poll.modifyFd(conn.socket.fd(), PollEvent::READ);
+                    m_result.established++;
+                } else {
+                    m_poll.removeFd(conn.socket.fd());
+                    m_result.connect_failures++;
+                }
+            }
+        }
+    }
+
+    void send(Connection& conn, uint64_t intended) {
+        uint64_t now = monotonicNs();
+        conn.push({intended, now});
+        conn.output.append(m_message.data(), m_message.size());
+        // while writing the socket is full, the queue moves on its WRITE event
+        if (!conn.writing)
+            flush(conn);
+        m_result.sent++;
+    }
+
+    void flush(Connection& conn) {
+        bool drained = conn.output.flush(conn.socket);
+        if (drained == conn.writing) {
+            conn.writing = !drained;
+            m_poll.modifyFd(conn.socket.fd(),
+                            drained ? PollEvent::READ : static_cast<PollEvent>(PollEvent::READ | PollEvent::WRITE));
+        }
+    }
+
+    // reads every complete echo on the connections the last wait() reported and calls done for each
+    template <typename Done> void receive(Done done) {
+        for (const auto& event : m_poll.events()) {
+            size_t        i    = m_by_fd[event.fd];
+            Connection&   conn = m_conns[i];
+            socket_size_t n;
+            if (conn.writing && (event.events & PollEvent::WRITE) != 0)
+                flush(conn);
+            while ((n = conn.socket.recv(m_buffer.data(), m_buffer.size())) > 0) {
+                conn.received += static_cast<size_t>(n);
+                while (conn.received >= m_options.payload && conn.busy()) {
+                    conn.received -= m_options.payload;
+                    InFlight message = conn.pop();
+                    uint64_t now     = monotonicNs();
+                    if (now >= m_measure_from && now < m_end) {
+                        m_latency.record(now - message.intended);
+                        m_service.record(now - message.sent);
+                        m_result.completed++;
+                    }
+                    done(i, message, now);
+                }
+            }
+        }
+    }
+
+    // open loop: messages are sent on a fixed schedule whether or not earlier ones were answered, and latency is
+    // measured from the scheduled time so a stalled server shows up in the percentiles instead of pausing the clock
+    void runOpen(uint64_t start) {
+        std::vector<size_t> connected;
+        for (size_t i = 0; i < m_conns.size(); i++) {
+            if (m_conns[i].connected)
+                connected.push_back(i);
+        }
+        if (connected.empty())
+            return;
+
+        double   thread_rate = m_options.rate / static_cast<double>(m_options.threads);
+        uint64_t interval    = static_cast<uint64_t>(static_cast<double>(NS_PER_SEC) / thread_rate);
+        uint64_t next        = start + m_index * interval / m_options.threads;
+        size_t   target      = 0;
+
+        uint64_t now;
+        while ((now = monotonicNs()) < m_end) {
+            // a thread that fell behind catches up in batches, reading replies in between, and not past the end
+            for (size_t batch = 0; next <= now && batch < MAX_SENDS_PER_WAIT && monotonicNs() < m_end; batch++) {
+                send(m_conns[connected[target]], next);
+                target = (target + 1) % connected.size();
+                next += interval;
+            }
+            now                 = monotonicNs();
+            uint64_t wake_at    = std::min(next, m_end);
+            int      timeout_ms = wake_at <= now ? 0 : static_cast<int>((wake_at - now) / 1000000);
+            m_poll.wait(timeout_ms);
+            receive([](size_t, const InFlight&, uint64_t) {});
+        }
+    }
+
+    // closed loop: each connection has one message in flight; with a target rate every connection is paced at a
+    // fixed interval and late responses are back-filled with the samples a paced sender would have seen
+    void runClosed(uint64_t start) {
+        using Timer = std::pair<uint64_t, size_t>;
+        std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> timers;
+
+        uint64_t interval = 0;
+        if (m_options.rate > 0)
+            interval = static_cast<uint64_t>(static_cast<double>(m_options.connections) * NS_PER_SEC / m_options.rate);
+
+        for (size_t i = 0; i < m_conns.size(); i++) {
+            if (m_conns[i].connected)
+                timers.push({start + interval * i / m_conns.size(), i});
+        }
+
+        uint64_t now;
+        while ((now = monotonicNs()) < m_end) {
+            while (!timers.empty() && timers.top().first <= now && monotonicNs() < m_end) {
+                Timer timer = timers.top();
+                timers.pop();
+                send(m_conns[timer.second], timer.first);
+            }
+
+            int timeout_ms = timers.empty() ? 10 : static_cast<int>((timers.top().first - now) / 1000000);
+            m_poll.wait(timeout_ms);
+            receive([&](size_t i, const InFlight& message, uint64_t done) {
+                uint64_t elapsed = done - message.sent;
+                if (interval > 0 && elapsed > interval && done >= m_measure_from && done < m_end) {
+                    for (uint64_t missing = elapsed - interval; missing >= interval; missing -= interval)
+                        m_latency.record(missing);
+                }
+                uint64_t next = message.sent + interval;
+                if (next <= done) {
+                    send(m_conns[i], done);
+                } else {
+                    timers.push({next, i});
+                }
+            });
+        }
+    }
+};
+
+void usage(const char* program) {
+    std::fprintf(stderr,
+                 "usage: %s [options]\n"
+                 "  --mode open|closed     fixed arrival rate or one message in flight per connection (closed)\n"
+                 "  --rate N               messages per second over all connections (required for open)\n"
+                 "  --connections N        connections to open (100)\n"
+                 "  --threads N            client threads, each with its own EventPoll (2)\n"
+                 "  --payload N            message size in bytes (64)\n"
+                 "  --seconds S            measured duration (10)\n"
+                 "  --warmup S             unmeasured duration before that (1)\n"
+                 "  --host ADDR            server address (127.0.0.1)\n"
+                 "  --port N               first server port, 0 starts a built-in echo server (0)\n"
+                 "  --ports N              number of consecutive server ports to spread connections over (1)\n"
+                 "  --source-ips N         bind clients to 127.0.0.1 .. 127.0.0.N (1)\n"
+                 "  --server-threads N     threads of the built-in echo server (1)\n",
+                 program);
+}
+
+bool parse(int argc, char* argv[], LoadOptions& options) {
+    for (int i = 1; i < argc; i += 2) {
+        if (i + 1 >= argc)
+            return false;
+        std::string key   = argv[i];
+        const char* value = argv[i + 1];
+        if (key == "--mode" && std::strcmp(value, "open") == 0)
+            options.mode = LoadMode::OPEN;
+        else if (key == "--mode" && std::strcmp(value, "closed") == 0)
+            options.mode = LoadMode::CLOSED;
+        else if (key == "--rate")
+            options.rate = std::atof(value);
+        else if (key == "--connections")
+            options.connections = std::strtoul(value, nullptr, 10);
+        else if (key == "--threads")
+            options.threads = std::strtoul(value, nullptr, 10);
+        else if (key == "--payload")
+            options.payload = std::strtoul(value, nullptr, 10);
+        else if (key == "--seconds")
+            options.seconds = std::atof(value);
+        else if (key == "--warmup")
+            options.warmup = std::atof(value);
+        else if (key == "--host")
+            options.host = value;
+        else if (key == "--port")
+            options.port = static_cast<uint16_t>(std::strtoul(value, nullptr, 10));
+        else if (key == "--ports")
+            options.ports = std::strtoul(value, nullptr, 10);
+        else if (key == "--source-ips")
+            options.source_ips = std::strtoul(value, nullptr, 10);
+        else if (key == "--server-threads")
+            options.server_threads = std::strtoul(value, nullptr, 10);
+        else
+            return false;
+    }
+    if (options.mode == LoadMode::OPEN && options.rate <= 0)
+        return false;
+    return options.connections > 0 && options.threads > 0 && options.payload > 0 && options.ports > 0 &&
+           options.source_ips > 0 && options.server_threads > 0;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    LoadOptions options;
+    if (!parse(argc, argv, options)) {
+        usage(argv[0]);
+        return 1;
+    }
+    options.threads = std::min(options.threads, options.connections);
+
+    raiseFdLimit();
+
+    try {
+        std::unique_ptr<EchoServer> server;
+        std::vector<uint16_t>       ports;
+        if (options.port == 0) {
+            server = std::make_unique<EchoServer>(options.ports, options.server_threads);
+            ports = server->ports();
+        } else {
+            for (size_t i = 0; i < options.ports; i++)
+                ports.push_back(static_cast<uint16_t>(options.port + i));
+        }
+
+        SharedState                              shared;
+        std::vector<std::unique_ptr<LoadThread>> workers;
+        std::vector<ThreadResult>                results(options.threads);
+        std::vector<std::thread>                 threads;
+        for (size_t t = 0; t < options.threads; t++) {
+            size_t count = options.connections / options.threads + (t < options.connections % options.threads);
+            workers.push_back(std::make_unique<LoadThread>(options, ports, t, count));
+        }
+
+        std::atomic<bool> failed{false};
+        for (size_t t = 0; t < options.threads; t++) {
+            threads.emplace_back([&, t]() {
+                try {
+                    results[t] = workers[t]->run(shared);
+                } catch (const std::exception& e) {
+                    std::fprintf(stderr, "load thread %zu failed: %s\n", t, e.what());
+                    failed = true;
+                    // release the threads waiting for everyone to connect
+                    shared.start_ns = monotonicNs();
+                }
+            });
+        }
+        for (auto& thread : threads)
+            thread.join();
+        if (server)
+            server->stop();
+        if (failed)
+            return 1;
+
+        ThreadResult total;
+        for (const auto& result : results) {
+            total.established += result.established;
+            total.connect_failures += result.connect_failures;
+            total.sent += result.sent;
+            total.completed += result.completed;
+            total.latency.merge(result.latency);
+            total.service.merge(result.service);
+        }
+
+        BenchReport("loadgen")
+            .param("mode", options.mode == LoadMode::OPEN ? "open" : "closed")
+            .param("connections", static_cast<double>(options.connections))
+            .param("threads", static_cast<double>(options.threads))
+            .param("payload", static_cast<double>(options.payload))
+            .param("target_rate", options.rate)
+            .param("seconds", options.seconds)
+            .metric("established", static_cast<double>(total.established))
+            .metric("connect_failures", static_cast<double>(total.connect_failures))
+            .metric("sent", static_cast<double>(total.sent))
+            .metric("completed", static_cast<double>(total.completed))
+            .metric("messages_per_sec", static_cast<double>(total.completed) / options.seconds)
+            .latency("latency", total.latency)
+            .latency("service", total.service)
+            .print();
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "loadgen failed: %s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
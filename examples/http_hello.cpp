@@ -0,0 +1,49 @@
+#include "event_loop.hpp"
+#include "http.hpp"
+#include "socket.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <utility>
+
+// answers every request with a fixed body, e.g. for wrk -t4 -c256 http://127.0.0.1:8080/
+int main(int argc, char* argv[]) {
+    const char* host = "0.0.0.0";
+    uint16_t    port = 8080;
+    for (int i = 1; i < argc; i++) {
+        bool has_value = i + 1 < argc;
+        if (std::strcmp(argv[i], "--host") == 0 && has_value) {
+            host = argv[++i];
+        } else if (std::strcmp(argv[i], "--port") == 0 && has_value) {
+            port = static_cast<uint16_t>(std::atoi(argv[++i]));
+        } else {
+            std::fprintf(stderr, "usage: %s [--host ADDRESS] [--port PORT]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    static const char hello[] = "Hello, World!";
+
+    try {
+        Socket listener;
+        listener.create();
+        listener.setReuseAddr(true);
+        listener.bind(host, port);
+        listener.listen();
+
+        EventLoop  loop(1024);
+        HttpServer server(loop, std::move(listener), [](const HttpRequest& /*request*/, HttpResponse& response) {
+            response.static_body = {hello, sizeof(hello) - 1};
+        });
+
+        std::printf("listening on %s:%u\n", host, static_cast<unsigned>(port));
+        std::fflush(stdout);
+        loop.run();
+    } catch (const std::exception& error) {
+        std::fprintf(stderr, "error: %s\n", error.what());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,105 @@
+#include "event_loop.hpp"
+#include "socket.hpp"
+#include "tcp_proxy.hpp"
+
+#ifndef _WIN32
+#include <csignal>
+#endif
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <string>
+#include <utility>
+
+namespace {
+
+struct Forwarder {
+    Socket      listener;
+    TcpProxy*   proxy;
+    std::string upstream_host;
+    uint16_t    upstream_port;
+
+    void onAccept(socket_t /*fd*/, PollEvent /*events*/) {
+        Socket client;
+        try {
+            client = listener.tryAccept();
+        } catch (const SocketError& error) {
+            std::fprintf(stderr, "accept: %s\n", error.what());
+            return;
+        }
+        if (!client.valid())
+            return;
+        // a blocking connect keeps the example short, a real forwarder would use tryConnect() and wait for WRITE
+        Socket upstream;
+        try {
+            upstream.create();
+            upstream.connect(upstream_host, upstream_port);
+        } catch (const std::exception& error) {
+            std::fprintf(stderr, "upstream: %s\n", error.what());
+            return;
+        }
+        proxy->relay(std::move(client), std::move(upstream));
+    }
+};
+
+} // namespace
+
+// forwards every connection on --port to --upstream, e.g. --port 8000 --upstream 127.0.0.1:8080
+int main(int argc, char* argv[]) {
+    uint16_t    port     = 8000;
+    std::string upstream = "127.0.0.1:8080";
+    ProxyMode   mode     = ProxyMode::AUTO;
+    for (int i = 1; i < argc; i++) {
+        bool has_value = i + 1 < argc;
+        if (std::strcmp(argv[i], "--port") == 0 && has_value) {
+            port = static_cast<uint16_t>(std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "--upstream") == 0 && has_value) {
+            upstream = argv[++i];
+        } else if (std::strcmp(argv[i], "--copy") == 0) {
+            mode = ProxyMode::COPY;
+        } else {
+            std::fprintf(stderr, "usage: %s [--port PORT] [--upstream HOST:PORT] [--copy]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    size_t colon = upstream.rfind(':');
+    if (colon == std::string::npos) {
+        std::fprintf(stderr, "upstream must be HOST:PORT\n");
+        return 1;
+    }
+
+#ifndef _WIN32
+    // splice() to a reset peer raises SIGPIPE, the error is handled where it is returned
+    std::signal(SIGPIPE, SIG_IGN);
+#endif
+
+    try {
+        EventLoop    loop(1024);
+        ProxyOptions options;
+        options.mode = mode;
+        TcpProxy proxy(loop, options);
+
+        Forwarder forwarder;
+        forwarder.proxy         = &proxy;
+        forwarder.upstream_host = upstream.substr(0, colon);
+        forwarder.upstream_port = static_cast<uint16_t>(std::atoi(upstream.c_str() + colon + 1));
+        forwarder.listener.create();
+        forwarder.listener.setReuseAddr(true);
+        forwarder.listener.bind("0.0.0.0", port);
+        forwarder.listener.listen();
+        forwarder.listener.setNonBlocking(true);
+        loop.add(forwarder.listener.fd(), PollEvent::READ,
+                 memberHandler<Forwarder, &Forwarder::onAccept>(&forwarder));
+
+        std::printf("forwarding :%u to %s\n", static_cast<unsigned>(port), upstream.c_str());
+        std::fflush(stdout);
+        loop.run();
+    } catch (const std::exception& error) {
+        std::fprintf(stderr, "error: %s\n", error.what());
+        return 1;
+    }
+    return 0;
+}
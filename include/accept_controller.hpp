@@ -0,0 +1,79 @@
+#pragma once
+
+#include "event_poll.hpp"
+#include "socket.hpp"
+#include "stats.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct AcceptOptions {
+    size_t max_per_iteration  = 64;    // accepts per readable listener before other fds get their turn
+    size_t max_connections    = 0;     // pause the listener while this many accepted connections are open, 0 is off
+    int    exhausted_pause_ms = 100;   // pause the listener this long after running out of fds, 0 keeps it armed
+    bool   reserve_fd         = true;  // hold a spare fd to accept-and-close pending connections when out of fds
+    bool   exclusive          = false; // the listener is shared with polls on other threads, wake one per connection
+};
+
+struct AcceptStats {
+    uint64_t accepted  = 0; // connections handed to the caller
+    uint64_t shed      = 0; // connections accepted and closed right away because fds ran out
+    uint64_t exhausted = 0; // accept calls that failed for lack of fds or memory
+    uint64_t capped    = 0; // readable events that hit max_per_iteration
+    uint64_t paused    = 0; // times the listener interest was dropped
+    uint64_t empty     = 0; // readable events with nothing to accept, another thread sharing the listener was faster
+};
+
+// accepts on a nonblocking listener without turning fd exhaustion into a busy loop. a level-triggered listener that
+// keeps failing with EMFILE stays readable forever, so pending connections are drained with the reserve fd and the
+// listener interest is dropped for a while instead.
+// several threads can each run a controller on the same listener with their own poll. without exclusive every
+// connection wakes all of them and all but one come back empty handed, with it the kernel wakes one (epoll only)
+class AcceptController {
+  public:
+    // registers the listener for READ with poll, under tag
+    AcceptController(Socket& listener, EventPoll& poll, AcceptOptions options = {}, uint32_t tag = 0);
+    ~AcceptController();
+
+    AcceptController(const AcceptController&)            = delete;
+    AcceptController& operator=(const AcceptController&) = delete;
+
+    // call when the listener is readable, appends up to max_per_iteration accepted sockets to out and returns how many
+    size_t acceptReady(std::vector<Socket>& out);
+
+    // call when a connection returned by acceptReady() is closed, counts towards max_connections
+    void connectionClosed();
+
+    // call once per loop iteration, re-arms the listener when an exhaustion pause is over
+    void tick();
+
+    // for the timeout of the next wait(), -1 while no pause is running
+    [[nodiscard]] int nextTimeoutMs() const;
+
+    [[nodiscard]] bool        paused() const { return m_armed_for == PollEvent::NONE; }
+    [[nodiscard]] size_t      openConnections() const { return m_open; }
+    [[nodiscard]] AcceptStats stats() const;
+
+  private:
+    Socket&       m_listener;
+    EventPoll&    m_poll;
+    AcceptOptions m_options;
+    uint32_t      m_tag;
+    Socket        m_reserve;
+    size_t        m_open            = 0;
+    uint64_t      m_paused_until_ns = 0;
+    PollEvent     m_armed_for       = PollEvent::READ;
+
+    StatCounter m_accepted;
+    StatCounter m_shed;
+    StatCounter m_exhausted;
+    StatCounter m_capped;
+    StatCounter m_paused;
+    StatCounter m_empty;
+
+    void      shedPending();
+    void      restoreReserve();
+    void      updateInterest();
+    PollEvent armedEvents() const;
+};
@@ -0,0 +1,334 @@
+#pragma once
+
+#include "event_poll.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#elif defined(__APPLE__) || defined(__FreeBSD__)
+#include <sys/event.h>
+#else
+#error "basic_event_poll.hpp needs epoll or kqueue, use EventPoll on this platform"
+#endif
+
+// header-only counterpart of EventPoll with the kernel interface fixed at compile time, so wait() and the decoding of
+// its events inline into the dispatch loop of the caller. it trades the features of EventPoll for that: no interest
+// cache, no queued changes, no latency histograms and no runtime backend choice. epoll and kqueue only, EventPoll
+// stays the portable and ABI-stable class
+
+// linux 4.5, older libc headers may not know it yet
+#if defined(__linux__) && !defined(EPOLLEXCLUSIVE)
+#define EPOLLEXCLUSIVE (1u << 28)
+#endif
+
+// a kernel poll interface as BasicEventPoll uses it. registration calls return false with errno set when the kernel
+// refuses, wait() returns -1 with errno set. entries of the last wait() are read with isWakeup() and entry()
+#if defined(__linux__)
+class EpollNative {
+  public:
+    explicit EpollNative(int max_events)
+        : m_epoll_fd(epoll_create1(EPOLL_CLOEXEC)), m_wake_fd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+          m_kernel_events(static_cast<size_t>(max_events)) {
+        struct epoll_event ev{};
+        ev.events   = EPOLLIN;
+        ev.data.u64 = token(m_wake_fd, 0);
+        if (m_epoll_fd == -1 || m_wake_fd == -1 || epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, m_wake_fd, &ev) == -1) {
+            int error = errno;
+            closeFds();
+            throw std::runtime_error(strerror(error));
+        }
+    }
+    ~EpollNative() { closeFds(); }
+
+    EpollNative(const EpollNative&)            = delete;
+    EpollNative& operator=(const EpollNative&) = delete;
+
+    bool add(socket_t fd, PollEvent event, uint32_t tag) { return control(EPOLL_CTL_ADD, fd, event, tag); }
+    bool modify(socket_t fd, PollEvent event, uint32_t tag) { return control(EPOLL_CTL_MOD, fd, event, tag); }
+    bool remove(socket_t fd) { return epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, fd, nullptr) != -1; }
+
+    int wait(int timeout_ms) {
+        return epoll_wait(m_epoll_fd, m_kernel_events.data(), static_cast<int>(m_kernel_events.size()), timeout_ms);
+    }
+
+    bool isWakeup(int index) const { return tokenFd(m_kernel_events[index].data.u64) == m_wake_fd; }
+
+    EventPoll::PollEventEntry entry(int index) const {
+        const struct epoll_event& kernel_event = m_kernel_events[index];
+        return {tokenFd(kernel_event.data.u64), fromNative(kernel_event.events), tokenTag(kernel_event.data.u64)};
+    }
+
+    // swaps entry index with the last one and drops it, the order of events carries no meaning
+    void dropEntry(int index, int count) { m_kernel_events[index] = m_kernel_events[count - 1]; }
+
+    bool drainWakeup() {
+        uint64_t value;
+        return read(m_wake_fd, &value, sizeof(value)) != -1 || errno == EAGAIN;
+    }
+    bool wakeup() {
+        uint64_t one = 1;
+        return write(m_wake_fd, &one, sizeof(one)) != -1 || errno == EAGAIN;
+    }
+
+    static uint32_t toNative(PollEvent event) {
+        uint32_t native = 0;
+        if (event & PollEvent::READ)
+            native |= EPOLLIN;
+        if (event & PollEvent::WRITE)
+            native |= EPOLLOUT;
+        if (event & PollEvent::ERR)
+            native |= (EPOLLERR | EPOLLHUP);
+        if (event & PollEvent::EXCLUSIVE)
+            native |= EPOLLEXCLUSIVE;
+        return native;
+    }
+
+    static PollEvent fromNative(uint32_t native) {
+        uint8_t res = PollEvent::NONE;
+        if (native & EPOLLIN)
+            res |= PollEvent::READ;
+        if (native & EPOLLOUT)
+            res |= PollEvent::WRITE;
+        if (native & (EPOLLERR | EPOLLHUP))
+            res |= PollEvent::ERR;
+        return static_cast<PollEvent>(res);
+    }
+
+  private:
+    int                             m_epoll_fd;
+    int                             m_wake_fd;
+    std::vector<struct epoll_event> m_kernel_events;
+
+    bool control(int op, socket_t fd, PollEvent event, uint32_t tag) {
+        struct epoll_event ev{};
+        ev.events   = toNative(event);
+        ev.data.u64 = token(fd, tag);
+        return epoll_ctl(m_epoll_fd, op, fd, &ev) != -1;
+    }
+
+    void closeFds() {
+        if (m_epoll_fd != -1)
+            close(m_epoll_fd);
+        if (m_wake_fd != -1)
+            close(m_wake_fd);
+    }
+
+    // the fd and the caller's tag share the 64-bit user data of each registration
+    static uint64_t token(socket_t fd, uint32_t tag) {
+        return (static_cast<uint64_t>(tag) << 32) | static_cast<uint32_t>(fd);
+    }
+    static socket_t tokenFd(uint64_t token) { return static_cast<socket_t>(static_cast<uint32_t>(token)); }
+    static uint32_t tokenTag(uint64_t token) { return static_cast<uint32_t>(token >> 32); }
+};
+
+using NativePoll = EpollNative;
+
+#elif defined(__APPLE__) || defined(__FreeBSD__)
+class KqueueNative {
+  public:
+    explicit KqueueNative(int max_events) : m_kqueue_fd(kqueue()), m_kernel_events(static_cast<size_t>(max_events)) {
+        struct kevent wake;
+        EV_SET(&wake, WAKE_IDENT, EVFILT_USER, EV_ADD | EV_CLEAR, 0, 0, NULL);
+        if (m_kqueue_fd == -1 || kevent(m_kqueue_fd, &wake, 1, NULL, 0, NULL) == -1) {
+            int error = errno;
+            if (m_kqueue_fd != -1)
+                close(m_kqueue_fd);
+            throw std::runtime_error(strerror(error));
+        }
+    }
+    ~KqueueNative() { close(m_kqueue_fd); }
+
+    KqueueNative(const KqueueNative&)            = delete;
+    KqueueNative& operator=(const KqueueNative&) = delete;
+
+    bool add(socket_t fd, PollEvent event, uint32_t tag) {
+        struct kevent changes[2];
+        int           n = 0;
+        if (event & PollEvent::READ)
+            EV_SET(&changes[n++], fd, EVFILT_READ, EV_ADD | EV_ENABLE, 0, 0, (void*)(uintptr_t)tag);
+        if (event & PollEvent::WRITE)
+            EV_SET(&changes[n++], fd, EVFILT_WRITE, EV_ADD | EV_ENABLE, 0, 0, (void*)(uintptr_t)tag);
+        return n == 0 || kevent(m_kqueue_fd, changes, n, NULL, 0, NULL) != -1;
+    }
+
+    bool modify(socket_t fd, PollEvent event, uint32_t tag) {
+        struct kevent changes[2];
+        if (event & PollEvent::READ)
+            EV_SET(&changes[0], fd, EVFILT_READ, EV_ADD | EV_ENABLE, 0, 0, (void*)(uintptr_t)tag);
+        else
+            EV_SET(&changes[0], fd, EVFILT_READ, EV_DELETE, 0, 0, NULL);
+        if (event & PollEvent::WRITE)
+            EV_SET(&changes[1], fd, EVFILT_WRITE, EV_ADD | EV_ENABLE, 0, 0, (void*)(uintptr_t)tag);
+        else
+            EV_SET(&changes[1], fd, EVFILT_WRITE, EV_DELETE, 0, 0, NULL);
+        // deleting a filter that was never there fails as well, the result says nothing useful
+        kevent(m_kqueue_fd, changes, 2, NULL, 0, NULL);
+        return true;
+    }
+
+    bool remove(socket_t fd) {
+        // the fd might have had only one of two filters active
+        struct kevent changes[2];
+        EV_SET(&changes[0], fd, EVFILT_READ, EV_DELETE, 0, 0, NULL);
+        EV_SET(&changes[1], fd, EVFILT_WRITE, EV_DELETE, 0, 0, NULL);
+        kevent(m_kqueue_fd, changes, 2, NULL, 0, NULL);
+        return true;
+    }
+
+    int wait(int timeout_ms) {
+        struct timespec  timeout_spec;
+        struct timespec* timeout_ptr = nullptr;
+        if (timeout_ms >= 0) {
+            timeout_spec.tv_sec  = timeout_ms / 1000;
+            timeout_spec.tv_nsec = (timeout_ms % 1000) * 1000000;
+            timeout_ptr          = &timeout_spec;
+        }
+        return kevent(m_kqueue_fd, NULL, 0, m_kernel_events.data(), static_cast<int>(m_kernel_events.size()),
+                      timeout_ptr);
+    }
+
+    bool isWakeup(int index) const { return m_kernel_events[index].filter == EVFILT_USER; }
+
+    EventPoll::PollEventEntry entry(int index) const {
+        const struct kevent& kernel_event = m_kernel_events[index];
+        return {static_cast<socket_t>(kernel_event.ident), fromNative(kernel_event.filter, kernel_event.flags),
+                static_cast<uint32_t>(reinterpret_cast<uintptr_t>(kernel_event.udata))};
+    }
+
+    void dropEntry(int index, int count) { m_kernel_events[index] = m_kernel_events[count - 1]; }
+
+    // EV_CLEAR already reset the trigger
+    bool drainWakeup() { return true; }
+    bool wakeup() {
+        struct kevent trigger;
+        EV_SET(&trigger, WAKE_IDENT, EVFILT_USER, 0, NOTE_TRIGGER, 0, NULL);
+        return kevent(m_kqueue_fd, &trigger, 1, NULL, 0, NULL) != -1;
+    }
+
+    static PollEvent fromNative(short filter, unsigned short flags) {
+        if (flags & EV_ERROR)
+            return PollEvent::ERR;
+        if (filter == EVFILT_READ)
+            return PollEvent::READ;
+        if (filter == EVFILT_WRITE)
+            return PollEvent::WRITE;
+        return PollEvent::NONE;
+    }
+
+  private:
+    int                        m_kqueue_fd;
+    std::vector<struct kevent> m_kernel_events;
+
+    // EVFILT_USER identifiers live in their own namespace, so this cannot collide with an fd
+    static constexpr uintptr_t WAKE_IDENT = 0;
+};
+
+using NativePoll = KqueueNative;
+#endif
+
+template <typename Backend> class BasicEventPoll {
+  public:
+    using Entry = EventPoll::PollEventEntry;
+
+    explicit BasicEventPoll(int max_events = 256) : m_backend(max_events) {}
+
+    BasicEventPoll(const BasicEventPoll&)            = delete;
+    BasicEventPoll& operator=(const BasicEventPoll&) = delete;
+
+    // every call reaches the kernel. exclusive registrations cannot be modified, remove and add them instead
+    void addFd(socket_t fd, PollEvent event, uint32_t tag = 0) {
+        bool ok = m_backend.add(fd, event, tag);
+        m_stats.recordCtl(CtlOp::ADD, ok);
+        if (!ok)
+            throw std::runtime_error(strerror(errno));
+    }
+    void modifyFd(socket_t fd, PollEvent event, uint32_t tag = 0) {
+        bool ok = m_backend.modify(fd, event, tag);
+        m_stats.recordCtl(CtlOp::MOD, ok);
+        if (!ok)
+            throw std::runtime_error(strerror(errno));
+    }
+    void removeFd(socket_t fd) { m_stats.recordCtl(CtlOp::DEL, m_backend.remove(fd)); }
+
+    // returns the number of events, read them with event(). wakeups are taken out before
+    size_t wait(int timeout_ms = -1) {
+        uint64_t start = monotonicNs();
+        int      n     = m_backend.wait(timeout_ms);
+        uint64_t now   = monotonicNs();
+        if (n < 0) {
+            if (errno != EINTR)
+                throw std::runtime_error(strerror(errno));
+            m_stats.recordInterrupt(now - start);
+            m_count = 0;
+            return 0;
+        }
+        for (int i = 0; i < n; i++) {
+            if (m_backend.isWakeup(i)) {
+                takeWakeup();
+                m_backend.dropEntry(i, n);
+                n--;
+                break;
+            }
+        }
+        m_stats.recordWait(static_cast<size_t>(n), now - start);
+        m_count = static_cast<size_t>(n);
+        return m_count;
+    }
+
+    [[nodiscard]] size_t count() const { return m_count; }
+    // decoded on each call, index below count()
+    [[nodiscard]] Entry event(size_t index) const { return m_backend.entry(static_cast<int>(index)); }
+
+    // thread-safe, coalesced like EventPoll::wakeup()
+    void wakeup() {
+        if (m_wakeup_pending.exchange(true))
+            return;
+        if (!m_backend.wakeup())
+            throw std::runtime_error(strerror(errno));
+    }
+
+    [[nodiscard]] PollStats stats() const { return m_stats.snapshot(); }
+    void                    resetStats() { m_stats.reset(); }
+
+  private:
+    Backend           m_backend;
+    size_t            m_count = 0;
+    PollCounters      m_stats;
+    std::atomic<bool> m_wakeup_pending{false};
+
+    void takeWakeup() {
+        // clear the flag before draining, a wakeup racing with the drain then signals again
+        m_wakeup_pending.store(false);
+        m_stats.recordWakeup();
+        if (!m_backend.drainWakeup())
+            throw std::runtime_error(strerror(errno));
+    }
+};
+
+using NativeEventPoll = BasicEventPoll<NativePoll>;
+
+// inline counterparts of Socket::tryRecv() and Socket::trySend() on a plain fd, without stats or timing. -1 when the
+// call would block, 0 from recvNow() means the peer closed
+inline socket_size_t recvNow(socket_t fd, void* buffer, size_t size) {
+    socket_size_t bytes = ::recv(fd, buffer, size, 0);
+    if (bytes < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+        throw std::runtime_error("recv failed: " + std::string(strerror(errno)));
+    return bytes;
+}
+
+inline socket_size_t sendNow(socket_t fd, const void* data, size_t size) {
+#ifdef MSG_NOSIGNAL
+    socket_size_t sent = ::send(fd, data, size, MSG_NOSIGNAL);
+#else
+    socket_size_t sent = ::send(fd, data, size, 0);
+#endif
+    if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+        throw std::runtime_error("send failed: " + std::string(strerror(errno)));
+    return sent;
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include "socket.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+// fd-indexed storage for per-connection state. every slot carries a generation that is bumped when its connection is
+// created and again when it is destroyed, so it is odd while the slot is live. registering the fd with tag(fd) as the
+// poll tag lets get() reject events that were queued for an earlier connection on the same fd number with a single
+// compare. slots sit in fixed-size pages: neighbouring fds are adjacent in memory and references stay valid while the
+// slab grows. owned by one thread, other threads hand removals to it through EventLoop::post()
+template <typename T, size_t PAGE_SLOTS = 256> class ConnectionSlab {
+  public:
+    ConnectionSlab() = default;
+    ~ConnectionSlab() { clear(); }
+
+    ConnectionSlab(const ConnectionSlab&)            = delete;
+    ConnectionSlab& operator=(const ConnectionSlab&) = delete;
+
+    template <typename... Args> T& emplace(socket_t fd, Args&&... args) {
+        Slot& slot = grownTo(fd);
+        if (live(slot.generation))
+            throw std::runtime_error("connection slot is already in use");
+
+        T* object = new (slot.storage) T(std::forward<Args>(args)...);
+        slot.generation++;
+        m_size++;
+        return *object;
+    }
+
+    void erase(socket_t fd) {
+        Slot* slot = existing(fd);
+        if (slot == nullptr || !live(slot->generation))
+            return;
+
+        slot->generation++;
+        m_size--;
+        object(*slot)->~T();
+    }
+
+    // the live connection on fd, or nullptr
+    T* find(socket_t fd) {
+        Slot* slot = existing(fd);
+        return slot != nullptr && live(slot->generation) ? object(*slot) : nullptr;
+    }
+
+    // the connection an event was tagged for, nullptr when it has been erased since, even if fd was reused
+    T* get(socket_t fd, uint32_t tag) {
+        Slot* slot = existing(fd);
+        return slot != nullptr && slot->generation == tag && live(tag) ? object(*slot) : nullptr;
+    }
+
+    // poll tag for the connection currently on fd
+    uint32_t tag(socket_t fd) const {
+        size_t index = socketSlot(fd);
+        if (index / PAGE_SLOTS >= m_pages.size())
+            return 0;
+        return m_pages[index / PAGE_SLOTS][index % PAGE_SLOTS].generation;
+    }
+
+    template <typename Fn> void forEach(Fn fn) {
+        for (auto& page : m_pages) {
+            for (size_t i = 0; i < PAGE_SLOTS; i++) {
+                if (live(page[i].generation))
+                    fn(*object(page[i]));
+            }
+        }
+    }
+
+    void clear() {
+        for (auto& page : m_pages) {
+            for (size_t i = 0; i < PAGE_SLOTS; i++) {
+                if (live(page[i].generation)) {
+                    page[i].generation++;
+                    object(page[i])->~T();
+                }
+            }
+        }
+        m_size = 0;
+    }
+
+    [[nodiscard]] size_t size() const { return m_size; }
+
+  private:
+    struct Slot {
+        uint32_t generation = 0;
+        alignas(T) unsigned char storage[sizeof(T)];
+    };
+
+    std::vector<std::unique_ptr<Slot[]>> m_pages;
+    size_t                               m_size = 0;
+
+    static bool live(uint32_t generation) { return (generation & 1) != 0; }
+    static T*   object(Slot& slot) { return reinterpret_cast<T*>(slot.storage); }
+
+    Slot* existing(socket_t fd) {
+        size_t index = socketSlot(fd);
+        if (index / PAGE_SLOTS >= m_pages.size())
+            return nullptr;
+        return &m_pages[index / PAGE_SLOTS][index % PAGE_SLOTS];
+    }
+
+    Slot& grownTo(socket_t fd) {
+        size_t index = socketSlot(fd);
+        while (index / PAGE_SLOTS >= m_pages.size())
+            m_pages.push_back(std::make_unique<Slot[]>(PAGE_SLOTS));
+        return m_pages[index / PAGE_SLOTS][index % PAGE_SLOTS];
+    }
+};
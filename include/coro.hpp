@@ -0,0 +1,240 @@
+#pragma once
+
+// C++20 coroutine layer over EventPoll, built as the separate socketpoll_coro target
+
+#include "event_poll.hpp"
+#include "socket.hpp"
+
+#include <chrono>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <optional>
+#include <queue>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+// coroutine frames are recycled through per-thread free lists in 64-byte size classes, so starting a coroutine on a
+// warm loop costs a list pop instead of a malloc
+class FramePool {
+  public:
+    static void* allocate(size_t size);
+    static void  deallocate(void* frame, size_t size) noexcept;
+};
+
+struct PooledFrame {
+    static void* operator new(size_t size) { return FramePool::allocate(size); }
+    static void  operator delete(void* frame, size_t size) noexcept { FramePool::deallocate(frame, size); }
+};
+
+template <typename T> class Task;
+
+// NOLINTBEGIN(readability-identifier-naming): the coroutine protocol names are fixed by the standard
+
+class TaskPromiseBase : public PooledFrame {
+  public:
+    struct FinalAwaiter {
+        bool await_ready() const noexcept { return false; }
+        template <typename Promise> std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> h) noexcept {
+            std::coroutine_handle<> continuation = h.promise().continuation;
+            return continuation ? continuation : std::noop_coroutine();
+        }
+        void await_resume() const noexcept {}
+    };
+
+    std::suspend_always initial_suspend() const noexcept { return {}; }
+    FinalAwaiter        final_suspend() const noexcept { return {}; }
+    void                unhandled_exception() noexcept { exception = std::current_exception(); }
+
+    std::coroutine_handle<> continuation;
+    std::exception_ptr      exception;
+};
+
+template <typename T> class TaskPromise : public TaskPromiseBase {
+  public:
+    Task<T> get_return_object() noexcept;
+    void    return_value(T result) { value.emplace(std::move(result)); }
+    T       take() {
+        if (exception)
+            std::rethrow_exception(exception);
+        return std::move(*value);
+    }
+
+    std::optional<T> value;
+};
+
+template <> class TaskPromise<void> : public TaskPromiseBase {
+  public:
+    Task<void> get_return_object() noexcept;
+    void       return_void() const noexcept {}
+    void       take() const {
+        if (exception)
+            std::rethrow_exception(exception);
+    }
+};
+
+// lazily started coroutine, runs when awaited and resumes the awaiting coroutine when it finishes
+template <typename T = void> class Task {
+  public:
+    using promise_type = TaskPromise<T>;
+    using Handle       = std::coroutine_handle<promise_type>;
+
+    Task() = default;
+    explicit Task(Handle handle) : m_handle(handle) {}
+    ~Task() {
+        if (m_handle)
+            m_handle.destroy();
+    }
+
+    Task(Task&& other) noexcept : m_handle(std::exchange(other.m_handle, nullptr)) {}
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            if (m_handle)
+                m_handle.destroy();
+            m_handle = std::exchange(other.m_handle, nullptr);
+        }
+        return *this;
+    }
+
+    Task(const Task&)            = delete;
+    Task& operator=(const Task&) = delete;
+
+    struct Awaiter {
+        Handle handle;
+
+        bool                    await_ready() const noexcept { return !handle || handle.done(); }
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+            handle.promise().continuation = awaiting;
+            return handle;
+        }
+        T await_resume() { return handle.promise().take(); }
+    };
+
+    Awaiter operator co_await() && noexcept { return Awaiter{m_handle}; }
+
+    bool valid() const { return static_cast<bool>(m_handle); }
+
+  private:
+    Handle m_handle;
+};
+
+template <typename T> Task<T> TaskPromise<T>::get_return_object() noexcept {
+    return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object() noexcept {
+    return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+}
+
+struct DetachedTask;
+
+// runs coroutines on top of an EventPoll, resuming them inline from the loop when their fd becomes ready
+class CoroLoop {
+  public:
+    explicit CoroLoop(int max_events = 256);
+    ~CoroLoop();
+
+    CoroLoop(const CoroLoop&)            = delete;
+    CoroLoop& operator=(const CoroLoop&) = delete;
+
+    // starts the task right away, the loop owns it from its first suspension until it finishes
+    void spawn(Task<void> task);
+
+    // runs until every spawned task finished or stop() was called, rethrows exceptions escaping spawned tasks
+    void run();
+    void stop() { m_stopped = true; }
+
+    class ReadyAwaiter {
+      public:
+        ReadyAwaiter(CoroLoop& loop, socket_t fd, PollEvent event) : m_loop(loop), m_fd(fd), m_event(event) {}
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> handle) { m_loop.suspendOn(m_fd, m_event, handle); }
+        void await_resume() const noexcept {}
+
+      private:
+        CoroLoop& m_loop;
+        socket_t  m_fd;
+        PollEvent m_event;
+    };
+
+    class SleepAwaiter {
+      public:
+        SleepAwaiter(CoroLoop& loop, uint64_t deadline_ns) : m_loop(loop), m_deadline_ns(deadline_ns) {}
+
+        bool await_ready() const noexcept { return m_deadline_ns <= monotonicNs(); }
+        void await_suspend(std::coroutine_handle<> handle) { m_loop.addTimer(m_deadline_ns, handle); }
+        void await_resume() const noexcept {}
+
+      private:
+        CoroLoop& m_loop;
+        uint64_t  m_deadline_ns;
+    };
+
+    // one reader and one writer may wait on an fd at a time, the fd must be nonblocking
+    ReadyAwaiter readable(socket_t fd) { return ReadyAwaiter(*this, fd, PollEvent::READ); }
+    ReadyAwaiter writable(socket_t fd) { return ReadyAwaiter(*this, fd, PollEvent::WRITE); }
+    SleepAwaiter sleepFor(std::chrono::nanoseconds duration) {
+        return SleepAwaiter(*this, monotonicNs() + static_cast<uint64_t>(duration.count()));
+    }
+
+    // drops the registration of an fd, call it before closing a socket that was awaited on
+    void forget(socket_t fd);
+    void close(Socket& socket) {
+        forget(socket.fd());
+        socket.close();
+    }
+
+    EventPoll& poll() { return m_poll; }
+
+  private:
+    friend struct DetachedTask;
+
+    struct Waiters {
+        std::coroutine_handle<> reader;
+        std::coroutine_handle<> writer;
+        PollEvent               registered = PollEvent::NONE;
+        bool                    added      = false;
+    };
+
+    struct Timer {
+        uint64_t                deadline_ns;
+        uint64_t                sequence;
+        std::coroutine_handle<> handle;
+
+        bool operator>(const Timer& other) const {
+            return deadline_ns != other.deadline_ns ? deadline_ns > other.deadline_ns : sequence > other.sequence;
+        }
+    };
+
+    EventPoll                                                      m_poll;
+    std::vector<Waiters>                                           m_waiters;
+    std::priority_queue<Timer, std::vector<Timer>, std::greater<>> m_timers;
+    uint64_t                                                       m_timer_sequence = 0;
+    std::unordered_set<void*>                                      m_roots;
+    std::exception_ptr                                             m_error;
+    bool                                                           m_stopped = false;
+
+    void suspendOn(socket_t fd, PollEvent event, std::coroutine_handle<> handle);
+    void addTimer(uint64_t deadline_ns, std::coroutine_handle<> handle);
+    void dispatch(socket_t fd, PollEvent events);
+    void fireTimers();
+    int  nextTimeout() const;
+};
+
+// NOLINTEND(readability-identifier-naming)
+
+// receives at most size bytes, returns 0 once the peer closed the connection
+Task<socket_size_t> asyncRecv(CoroLoop& loop, Socket& socket, void* buffer, size_t size);
+
+// sends all size bytes
+Task<socket_size_t> asyncSend(CoroLoop& loop, Socket& socket, const void* data, size_t size);
+
+// the listener must be nonblocking, the accepted socket is made nonblocking as well
+Task<Socket> asyncAccept(CoroLoop& loop, Socket& listener);
+
+// the socket must be created and nonblocking, throws when the connection fails
+Task<void> asyncConnect(CoroLoop& loop, Socket& socket, const std::string& host, uint16_t port);
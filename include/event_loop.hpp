@@ -0,0 +1,158 @@
+#pragma once
+
+#include "event_poll.hpp"
+#include "socket.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// a plain function pointer and its context, so dispatching an event is one indirect call and no virtual lookup
+struct EventHandler {
+    void (*fn)(void* context, socket_t fd, PollEvent events) = nullptr;
+    void* context                                            = nullptr;
+
+    explicit operator bool() const { return fn != nullptr; }
+};
+
+// binds a member function, e.g. memberHandler<Connection, &Connection::onEvent>(conn)
+template <typename T, void (T::*Method)(socket_t, PollEvent)> EventHandler memberHandler(T* object) {
+    return {[](void* context, socket_t fd, PollEvent events) { (static_cast<T*>(context)->*Method)(fd, events); },
+            object};
+}
+
+// intrusive node for EventLoop::post(). run() is called once on the loop thread and may delete or repost the task,
+// drop() instead when the loop is destroyed before getting to it
+struct LoopTask {
+    LoopTask* next               = nullptr;
+    void (*run)(LoopTask* task)  = nullptr;
+    void (*drop)(LoopTask* task) = nullptr;
+};
+
+struct LoopStats {
+    uint64_t dispatched = 0; // events handed to handlers
+    uint64_t tasks      = 0; // posted tasks run
+    uint64_t batches    = 0; // iterations that found posted tasks
+    uint64_t flushes    = 0; // LoopOutputs flushed at the end of an iteration
+    uint64_t gathered   = 0; // writes those flushes covered
+};
+
+class LoopOutput;
+
+// reactor that owns an EventPoll and dispatches its events through a flat handler table indexed by fd
+class EventLoop {
+  public:
+    explicit EventLoop(int max_events = 256, PollBackend backend = PollBackend::AUTO);
+    ~EventLoop();
+
+    EventLoop(const EventLoop&)            = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    void add(socket_t fd, PollEvent events, EventHandler handler);
+    void modify(socket_t fd, PollEvent events);
+    void remove(socket_t fd);
+
+    // thread-safe and lock-free, the task runs on the loop thread once the events of the current iteration are
+    // dispatched. tasks run in the order they were posted; only the post that finds the queue empty wakes the loop,
+    // so a burst of posts costs one wakeup
+    void post(LoopTask* task);
+    void post(std::function<void()> task);
+
+    // handlers may add, modify and remove fds, events for an fd removed earlier in the same batch are dropped even if
+    // its number was reused in the meantime
+    size_t runOnce(int timeout_ms = -1);
+
+    // runs until stop(), which other threads reach through post()
+    void run();
+    void stop() { m_stopped = true; }
+
+    [[nodiscard]] size_t     size() const { return m_size; }
+    [[nodiscard]] LoopStats  stats() const;
+    [[nodiscard]] EventPoll& poll() { return m_poll; }
+
+  private:
+    // the generation is bumped on every add and remove and registered as the poll tag, so events still pending for
+    // a removed fd never reach a handler registered later under the same number
+    struct Slot {
+        EventHandler handler;
+        uint32_t     generation = 0;
+    };
+
+    EventPoll         m_poll;
+    std::vector<Slot> m_slots;
+    size_t            m_size    = 0;
+    bool              m_stopped = false;
+
+    // producers push onto a lock-free stack, the loop takes the whole stack at once and reverses it
+    std::atomic<LoopTask*> m_posted{nullptr};
+    LoopTask*              m_batch = nullptr; // rest of a batch a task threw out of
+
+    StatCounter m_dispatched;
+    StatCounter m_tasks;
+    StatCounter m_batches;
+
+    // outputs written to during this iteration, flushed once it is done
+    std::vector<LoopOutput*> m_outputs;
+    StatCounter              m_flushes;
+    StatCounter              m_gathered;
+
+    void runPosted();
+    void flushOutputs();
+
+    friend class LoopOutput;
+};
+
+enum class OutputMode : uint8_t {
+    DIRECT, // every write is sent right away, for latency-sensitive sockets
+    GATHER, // writes are copied and sent with one call at the end of the iteration
+    CORK,   // writes are sent right away with TCP_CORK set, which is cleared at the end of the iteration. the kernel
+            // gathers the segments then, without the copy but with two extra calls per iteration. not on windows
+};
+
+// the writes of one connection, sent with as few calls as the mode allows. in GATHER and CORK mode the writes of an
+// EventLoop iteration leave once its events and posted tasks were handled, so a handler answering several pipelined
+// requests one by one costs one send. bytes the socket does not take stay pending and hold back the end-of-iteration
+// sends: register the fd for WRITE and call flush() from its handler until pending() is 0.
+// errors of the end-of-iteration send drop what is pending and set failed(), errors of direct sends are thrown.
+// belongs to the loop thread, destroy it before the loop and the socket
+class LoopOutput {
+  public:
+    LoopOutput(EventLoop& loop, Socket& socket, OutputMode mode = OutputMode::GATHER);
+    ~LoopOutput();
+
+    LoopOutput(const LoopOutput&)            = delete;
+    LoopOutput& operator=(const LoopOutput&) = delete;
+
+    // takes effect with the next write, switching to DIRECT sends what is pending first
+    void setMode(OutputMode mode);
+
+    void write(const void* data, size_t size);
+    void write(const std::string& data) { write(data.data(), data.size()); }
+
+    // sends what is pending now, same return values as Socket::trySend()
+    socket_size_t flush();
+
+    [[nodiscard]] OutputMode mode() const { return m_mode; }
+    [[nodiscard]] size_t     pending() const { return m_pending.size(); }
+    [[nodiscard]] bool       failed() const { return m_failed; }
+
+  private:
+    EventLoop*        m_loop;
+    Socket*           m_socket;
+    OutputMode        m_mode;
+    std::vector<char> m_pending;
+    uint32_t          m_writes    = 0; // gathered since the last send
+    bool              m_scheduled = false;
+    bool              m_blocked   = false; // the socket did not take everything, flush() is up to the owner
+    bool              m_corked    = false;
+    bool              m_failed    = false;
+
+    void schedule();
+    void sendDirect(const void* data, size_t size);
+    void finishIteration();
+
+    friend class EventLoop;
+};
@@ -1,26 +1,54 @@
 #pragma once
 
+#include "histogram.hpp"
 #include "socket.hpp"
+#include "stats.hpp"
 
+#include <atomic>
 #include <cstdint>
 #include <memory>
+#include <mutex>
 #include <vector>
 
 enum PollEvent : uint8_t {
-    NONE  = 0,
-    READ  = 1 << 0,
-    WRITE = 1 << 1,
-    ERR   = 1 << 2
+    NONE      = 0,
+    READ      = 1 << 0,
+    WRITE     = 1 << 1,
+    ERR       = 1 << 2,
+    // registration only: of several polls waiting on the same fd, wake one instead of all. epoll only, the io_uring
+    // backend and the other platforms accept it and wake every poll
+    EXCLUSIVE = 1 << 3
 };
 
+// kernel interfaces an EventPoll can run on. several can be compiled in (epoll and io_uring on linux), the choice is
+// made when the poll is created
+enum class PollBackend : uint8_t {
+    AUTO, // SOCKETPOLL_BACKEND from the environment if it names a usable backend, the platform default otherwise
+    EPOLL,
+    IO_URING,
+    KQUEUE,
+    WSAPOLL,
+    MEMORY // MemorySocket ends only, see memory_socket.hpp. never picked by AUTO
+};
+
+// "auto", "epoll", "io_uring", "kqueue", "wsapoll" or "memory", the values SOCKETPOLL_BACKEND takes except the last
+[[nodiscard]] const char* pollBackendName(PollBackend backend);
+// compiled in and accepted by the running kernel, probes by creating an instance
+[[nodiscard]] bool pollBackendAvailable(PollBackend backend);
+
+class PollBackendImpl;
+
 class EventPoll {
   public:
     struct PollEventEntry {
         socket_t  fd;
         PollEvent events;
+        uint32_t  tag; // as passed to addFd() or modifyFd()
     };
 
-    EventPoll(int max_events = 256);
+    // an explicit backend that is not compiled in or not supported by the kernel throws std::invalid_argument or
+    // std::runtime_error, AUTO falls back to the platform default instead
+    EventPoll(int max_events = 256, PollBackend backend = PollBackend::AUTO);
     ~EventPoll();
 
     EventPoll(const EventPoll&)            = delete;
@@ -29,16 +57,109 @@ class EventPoll {
     EventPoll(EventPoll&&)            = delete;
     EventPoll& operator=(EventPoll&&) = delete;
 
-    void addFd(socket_t fd, PollEvent event);
-    void modifyFd(socket_t fd, PollEvent event);
+    // the tag travels with the registration and comes back in every event for it, a generation number there lets the
+    // caller tell events of a closed fd from events of a new one that reused its number.
+    // registrations are cached per fd, a modifyFd() that changes neither the events nor the tag returns without a
+    // syscall. these and the queued versions below are thread-safe, wait() belongs to one thread at a time
+    void addFd(socket_t fd, PollEvent event, uint32_t tag = 0);
+    void modifyFd(socket_t fd, PollEvent event, uint32_t tag = 0);
     void removeFd(socket_t fd);
     void wait(int timeout_ms = -1);
 
-    [[nodiscard]] const std::vector<PollEventEntry>& events() const;
+    // queued versions of the above: changes for the same fd are coalesced and applied at the start of the next wait()
+    // or by commitPending(), so an add and a remove in between cancel out and repeated modifies cost one call.
+    // a remove followed by an add still reaches the kernel as both, the fd may have been closed and reused in between.
+    // errors of queued changes are thrown from wait() or commitPending() after the rest of the queue was applied.
+    // close an fd only after its queued removal was committed, or remove it with removeFd()
+    void queueAdd(socket_t fd, PollEvent event, uint32_t tag = 0);
+    void queueModify(socket_t fd, PollEvent event, uint32_t tag = 0);
+    void queueRemove(socket_t fd);
+    void commitPending();
+
+    [[nodiscard]] size_t pending() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_pending.size();
+    }
+
+    // thread-safe, makes a blocked wait() return early or the next one return right away, wakeups that arrive before
+    // the poll thread got to the previous one are coalesced into it and never show up in events()
+    void wakeup();
+
+    [[nodiscard]] const std::vector<PollEventEntry>& events() const { return m_events; }
+    [[nodiscard]] PollBackend                        backend() const { return m_backend_kind; }
+
+    [[nodiscard]] PollStats         stats() const { return m_stats.snapshot(); }
+    [[nodiscard]] HistogramSnapshot waitLatency() const { return m_wait_latency.snapshot(); }
+    [[nodiscard]] HistogramSnapshot dispatchLatency() const { return m_dispatch_latency.snapshot(); }
+
+    void resetStats() {
+        m_stats.reset();
+        m_wait_latency.reset();
+        m_dispatch_latency.reset();
+    }
+
+    // when the last wait() returned, monotonicNs() clock
+    [[nodiscard]] uint64_t readyNs() const { return m_ready_ns; }
+    // records the time since the last wait() returned, call when a handler for one of its events starts running
+    void recordDispatch() { m_dispatch_latency.record(monotonicNs() - m_ready_ns); }
 
   private:
+    static constexpr uint32_t NO_PENDING = UINT32_MAX;
+
+    // what the kernel has for an fd, as far as this poll has been told
+    struct Interest {
+        PollEvent events     = PollEvent::NONE;
+        bool      registered = false;
+        uint32_t  tag        = 0;
+        uint32_t  pending    = NO_PENDING; // index in m_pending
+    };
+
+    // what the kernel should have for an fd once the queue is applied
+    struct PendingChange {
+        socket_t  fd;
+        PollEvent events;
+        bool      registered;
+        bool      added; // by queueAdd(), not only modified
+        bool      reset; // the current registration has to go first
+        uint32_t  tag;
+        uint32_t  calls; // queued, each would have been a syscall
+    };
+
     int m_max_events;
 
-    struct Impl;
-    std::unique_ptr<Impl> m_pimpl;
+    // a virtual call per registration change and two per wait(), the events are decoded inside the backend
+    std::unique_ptr<PollBackendImpl> m_backend;
+    PollBackend                      m_backend_kind;
+
+    std::vector<PollEventEntry> m_events;
+
+    // guards the cache, the queue and the backend's registrations. wait() holds it for all but the blocking call
+    mutable std::mutex         m_mutex;
+    std::vector<Interest>      m_interest;
+    std::vector<PendingChange> m_pending;
+
+    PollCounters     m_stats;
+    LatencyHistogram m_wait_latency;
+    LatencyHistogram m_dispatch_latency;
+    uint64_t         m_ready_ns = 0;
+
+    std::atomic<bool> m_wakeup_pending{false};
+
+    // the rest run with m_mutex held
+    void           applyPending();
+    Interest&      interestFor(socket_t fd);
+    PendingChange& pendingFor(socket_t fd);
+    void           apply(const PendingChange& change);
+    uint32_t       replace(socket_t fd, PollEvent previous, PollEvent event, uint32_t tag);
+
+    void recordWait(int events, uint64_t start_ns) {
+        m_ready_ns = monotonicNs();
+        m_stats.recordWait(static_cast<size_t>(events), m_ready_ns - start_ns);
+        m_wait_latency.record(m_ready_ns - start_ns);
+    }
+    void recordInterrupt(uint64_t start_ns) {
+        m_ready_ns = monotonicNs();
+        m_stats.recordInterrupt(m_ready_ns - start_ns);
+        m_wait_latency.record(m_ready_ns - start_ns);
+    }
 };
\ No newline at end of file
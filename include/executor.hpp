@@ -0,0 +1,85 @@
+#pragma once
+
+#include "event_loop.hpp"
+#include "stats.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+struct ExecutorStats {
+    uint64_t submitted = 0;
+    uint64_t executed  = 0;
+    uint64_t stolen    = 0;
+};
+
+// work-stealing thread pool for cpu-heavy work that would otherwise stall an event loop. every worker owns a deque:
+// it pushes and pops its own work at the back and steals from the front of the others once its own deque is empty,
+// so there is no queue shared by all threads
+class Executor {
+  public:
+    explicit Executor(size_t threads = std::thread::hardware_concurrency());
+
+    // finishes all submitted tasks, then joins the workers
+    ~Executor();
+
+    Executor(const Executor&)            = delete;
+    Executor& operator=(const Executor&) = delete;
+
+    // thread-safe, tasks submitted from a worker go to its own deque, others are spread round-robin.
+    // a task that throws terminates the process
+    void submit(std::function<void()> task);
+
+    // runs work() on a worker and then done(result) on the loop thread of origin, which is woken for it
+    template <typename Work, typename Done> void offload(EventLoop& origin, Work work, Done done) {
+        using ReturnsVoid = typename std::is_void<decltype(work())>::type;
+        submit([&origin, work, done]() mutable { deliver(origin, work, done, ReturnsVoid{}); });
+    }
+
+    [[nodiscard]] size_t        threads() const { return m_workers.size(); }
+    [[nodiscard]] ExecutorStats stats() const;
+
+  private:
+    struct Worker {
+        std::mutex                        mutex;
+        std::deque<std::function<void()>> tasks;
+        StatCounter                       executed;
+        StatCounter                       stolen;
+    };
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    std::vector<std::thread>             m_threads;
+    std::atomic<size_t>                  m_next{0};
+    std::atomic<uint64_t>                m_submitted{0};
+
+    // queued tasks and sleeping workers, a submitter only touches the idle mutex when somebody sleeps
+    std::atomic<size_t>     m_pending{0};
+    std::atomic<size_t>     m_sleepers{0};
+    std::mutex              m_idle_mutex;
+    std::condition_variable m_idle;
+    bool                    m_stopping = false;
+
+    void workerLoop(size_t index);
+    bool popLocal(size_t index, std::function<void()>& task);
+    bool steal(size_t index, std::function<void()>& task);
+
+    template <typename Work, typename Done>
+    static void deliver(EventLoop& origin, Work& work, Done& done, std::false_type /*returns_void*/) {
+        auto result = work();
+        origin.post([done, result]() mutable { done(std::move(result)); });
+    }
+    template <typename Work, typename Done>
+    static void deliver(EventLoop& origin, Work& work, Done& done, std::true_type /*returns_void*/) {
+        work();
+        origin.post([done]() mutable { done(); });
+    }
+};
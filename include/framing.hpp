@@ -0,0 +1,171 @@
+#pragma once
+
+#include "socket.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// a complete frame inside a FrameBuffer, valid until the next fill(), reserve() or compact() on that buffer
+struct FrameView {
+    const char* data = nullptr;
+    size_t      size = 0;
+
+    [[nodiscard]] std::string str() const { return std::string(data, size); }
+};
+
+// receive buffer the decoders cut frames from. bytes are appended behind the unread ones and consumed from the front;
+// a frame that straddles two recv() calls stays in place until the rest arrives, and the unread tail is moved to the
+// front only when the free space at the back runs low
+class FrameBuffer {
+  public:
+    explicit FrameBuffer(size_t capacity = 64 * 1024);
+
+    // one tryRecv() into the free space, same return values
+    socket_size_t fill(Socket& socket);
+
+    // for filling the buffer by other means: make room, write up to writable() bytes at writePtr(), then commit()
+    void  reserve(size_t unread);
+    char* writePtr() { return m_data.data() + m_end; }
+    void  commit(size_t size) { m_end += size; }
+    void  append(const void* data, size_t size);
+
+    void consume(size_t size) { m_begin += size; }
+    void compact();
+    void clear() { m_begin = m_end = 0; }
+
+    [[nodiscard]] const char* data() const { return m_data.data() + m_begin; }
+    [[nodiscard]] size_t      size() const { return m_end - m_begin; }
+    [[nodiscard]] size_t      writable() const { return m_data.size() - m_end; }
+    [[nodiscard]] size_t      capacity() const { return m_data.size(); }
+
+  private:
+    std::vector<char> m_data;
+    size_t            m_begin = 0;
+    size_t            m_end   = 0;
+};
+
+// fixed-size blocks kept on a free list for the connections that have bytes to hold on to at the moment. one per loop
+// thread, not thread-safe
+class BufferPool {
+  public:
+    explicit BufferPool(size_t block_size = 4096, size_t max_free = 1024);
+    ~BufferPool();
+
+    BufferPool(const BufferPool&)            = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    char* acquire();
+    void  release(char* block);
+
+    [[nodiscard]] size_t blockSize() const { return m_block_size; }
+    [[nodiscard]] size_t inUse() const { return m_in_use; }
+    [[nodiscard]] size_t cached() const { return m_free.size(); }
+
+  private:
+    size_t             m_block_size;
+    size_t             m_max_free;
+    size_t             m_in_use = 0;
+    std::vector<char*> m_free;
+};
+
+// bytes a connection has to keep between events: the start of a frame whose rest has not arrived, or data the socket
+// did not take. holds no memory while empty, up to a block comes from the pool and more from the heap.
+// for connections that are idle most of the time, receive through one FrameBuffer per loop instead of one each:
+//     kept.restore(scratch);
+//     decoder.reset(); // for a DelimiterDecoder shared by the connections
+//     scratch.fill(socket);
+//     while (decoder.next(scratch, frame)) ...
+//     kept.keep(scratch);
+class PooledBuffer {
+  public:
+    explicit PooledBuffer(BufferPool& pool) : m_pool(&pool) {}
+    ~PooledBuffer() { clear(); }
+
+    PooledBuffer(PooledBuffer&& other) noexcept;
+    PooledBuffer& operator=(PooledBuffer&& other) noexcept;
+
+    PooledBuffer(const PooledBuffer&)            = delete;
+    PooledBuffer& operator=(const PooledBuffer&) = delete;
+
+    void append(const void* data, size_t size);
+    void consume(size_t size);
+    void clear();
+
+    // moves the unread bytes of scratch in here and clears it
+    void keep(FrameBuffer& scratch);
+    // moves the kept bytes to the front of scratch, where a decoder continues with them, and lets go of the memory
+    void restore(FrameBuffer& scratch);
+
+    // sends what is kept, same return values as trySend(). with nothing kept, send new data directly and append()
+    // only what the socket did not take
+    socket_size_t flush(Socket& socket);
+
+    [[nodiscard]] const char* data() const { return m_data; }
+    [[nodiscard]] size_t      size() const { return m_size; }
+    [[nodiscard]] bool        empty() const { return m_size == 0; }
+
+  private:
+    BufferPool* m_pool;
+    char*       m_data     = nullptr;
+    size_t      m_size     = 0;
+    size_t      m_capacity = 0; // the pool's block size when the memory is a block of it
+};
+
+enum class ByteOrder { BIG, LITTLE };
+
+// frames preceded by a 1, 2, 4 or 8 byte length that counts the payload only
+class LengthPrefixDecoder {
+  public:
+    LengthPrefixDecoder(size_t header_size, ByteOrder order, size_t max_frame = 16 * 1024 * 1024);
+
+    // cuts the next payload from the front of buffer, false when it is not complete yet. throws when the length is
+    // above max_frame, the stream cannot be resynchronised after that
+    bool next(FrameBuffer& buffer, FrameView& frame);
+
+    // writes the header for a payload of size bytes, header_size bytes long
+    void encode(uint64_t size, char* header) const;
+
+    [[nodiscard]] size_t headerSize() const { return m_header_size; }
+
+  private:
+    size_t    m_header_size;
+    ByteOrder m_order;
+    size_t    m_max_frame;
+};
+
+// frames terminated by a delimiter of one or more bytes, the delimiter is not part of the frame
+class DelimiterDecoder {
+  public:
+    explicit DelimiterDecoder(std::string delimiter, size_t max_frame = 64 * 1024);
+
+    // like LengthPrefixDecoder::next(), throws when max_frame bytes arrive without a delimiter
+    bool next(FrameBuffer& buffer, FrameView& frame);
+
+    // forgets how much of the unread data was scanned already. needed when one decoder serves several connections
+    // that take turns in a shared buffer, the kept bytes are scanned again
+    void reset() { m_scanned = 0; }
+
+  private:
+    std::string m_delimiter;
+    size_t      m_max_frame;
+    size_t      m_scanned = 0; // bytes of the unread data already known to hold no delimiter
+};
+
+enum class ScanImpl {
+    SCALAR, // plain byte loop
+    LIBC,   // memchr
+    SSE2,   // 16 bytes per compare, x86-64 only
+    AVX2,   // 32 bytes per compare, x86-64 with AVX2 at runtime only
+};
+
+// the first byte equal to byte in [begin, end), or end. scans with bestScanImpl()
+const char* findByte(const char* begin, const char* end, char byte);
+
+// the same with a fixed implementation, for tests and benchmarks. unsupported ones fall back to SCALAR
+const char* findByteWith(ScanImpl impl, const char* begin, const char* end, char byte);
+
+bool        scanImplSupported(ScanImpl impl);
+ScanImpl    bestScanImpl();
+const char* scanImplName(ScanImpl impl);
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// values below 2^HISTOGRAM_SUB_BITS are stored exactly, every power of two above that is split into
+// 2^HISTOGRAM_SUB_BITS linear sub-buckets (~3% relative error); values of 2^HISTOGRAM_MAX_BITS ns and more saturate
+constexpr unsigned HISTOGRAM_SUB_BITS = 5;
+constexpr unsigned HISTOGRAM_MAX_BITS = 40;
+constexpr size_t   HISTOGRAM_BUCKETS  = (HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BITS + 1) << HISTOGRAM_SUB_BITS;
+
+inline uint64_t monotonicNs() {
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+            .count());
+}
+
+inline size_t histogramBucket(uint64_t value) {
+    if (value < (uint64_t{1} << HISTOGRAM_SUB_BITS))
+        return static_cast<size_t>(value);
+    if (value >= (uint64_t{1} << HISTOGRAM_MAX_BITS))
+        return HISTOGRAM_BUCKETS - 1;
+#ifdef _MSC_VER
+    unsigned long msb;
+    _BitScanReverse64(&msb, value);
+#else
+    unsigned msb = 63 - static_cast<unsigned>(__builtin_clzll(value));
+#endif
+    unsigned shift = static_cast<unsigned>(msb) - HISTOGRAM_SUB_BITS;
+    return (static_cast<size_t>(shift + 1) << HISTOGRAM_SUB_BITS) +
+           static_cast<size_t>((value >> shift) & ((uint64_t{1} << HISTOGRAM_SUB_BITS) - 1));
+}
+
+// largest value that falls into the bucket
+uint64_t histogramBucketValue(size_t bucket);
+
+struct HistogramSnapshot {
+    std::vector<uint64_t> counts = std::vector<uint64_t>(HISTOGRAM_BUCKETS);
+    uint64_t              count  = 0;
+    uint64_t              sum    = 0;
+    uint64_t              min    = 0;
+    uint64_t              max    = 0;
+
+    void     merge(const HistogramSnapshot& other);
+    uint64_t percentile(double p) const;
+    double   mean() const { return count == 0 ? 0.0 : static_cast<double>(sum) / static_cast<double>(count); }
+};
+
+// single-line JSON object with count, mean, min, max and the usual percentiles
+std::string toJson(const HistogramSnapshot& snapshot);
+
+// lock-free histogram of nanosecond durations, safe to record into from any number of threads
+class LatencyHistogram {
+  public:
+    LatencyHistogram() = default;
+
+    LatencyHistogram(const LatencyHistogram&)            = delete;
+    LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+    void record(uint64_t ns) {
+        m_counts[histogramBucket(ns)].fetch_add(1, std::memory_order_relaxed);
+        m_count.fetch_add(1, std::memory_order_relaxed);
+        m_sum.fetch_add(ns, std::memory_order_relaxed);
+
+        uint64_t current = m_min.load(std::memory_order_relaxed);
+        while (ns < current && !m_min.compare_exchange_weak(current, ns, std::memory_order_relaxed)) {
+        }
+        current = m_max.load(std::memory_order_relaxed);
+        while (ns > current && !m_max.compare_exchange_weak(current, ns, std::memory_order_relaxed)) {
+        }
+    }
+
+    HistogramSnapshot snapshot() const;
+    void              reset();
+
+  private:
+    std::atomic<uint64_t> m_counts[HISTOGRAM_BUCKETS] = {};
+    std::atomic<uint64_t> m_count{0};
+    std::atomic<uint64_t> m_sum{0};
+    std::atomic<uint64_t> m_min{UINT64_MAX};
+    std::atomic<uint64_t> m_max{0};
+};
+
+// recv/send syscall durations are recorded into per-thread histograms while enabled and merged on snapshot. sockets
+// with kernel timestamps (Socket::enableTimestamps()) add the time from the kernel receiving data to recv() returning
+// it, and from a send call to the kernel handing its last byte to the device, regardless of the switch
+struct IoLatencySnapshot {
+    HistogramSnapshot recv;
+    HistogramSnapshot send;
+    HistogramSnapshot kernel_to_user;
+    HistogramSnapshot user_to_wire;
+};
+
+extern std::atomic<bool> io_timing_enabled;
+
+inline bool ioTimingEnabled() {
+    return io_timing_enabled.load(std::memory_order_relaxed);
+}
+
+void              setIoTimingEnabled(bool enable);
+void              recordRecvLatency(uint64_t ns);
+void              recordSendLatency(uint64_t ns);
+void              recordKernelToUserLatency(uint64_t ns);
+void              recordUserToWireLatency(uint64_t ns);
+IoLatencySnapshot ioLatency();
+void              resetIoLatency();
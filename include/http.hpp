@@ -0,0 +1,146 @@
+#pragma once
+
+#include "connection_slab.hpp"
+#include "event_loop.hpp"
+#include "framing.hpp"
+#include "socket.hpp"
+#include "stats.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+constexpr size_t HTTP_MAX_HEADERS = 32;
+
+struct HttpHeader {
+    FrameView name;
+    FrameView value;
+};
+
+// views into the receive buffer, valid until the handler returns
+struct HttpRequest {
+    FrameView  method;
+    FrameView  target;
+    int        version_minor = 1;
+    HttpHeader headers[HTTP_MAX_HEADERS];
+    size_t     header_count   = 0;
+    uint64_t   content_length = 0;
+    FrameView  body;
+    bool       keep_alive = true;
+
+    // case-insensitive lookup, nullptr when the header is missing
+    [[nodiscard]] const FrameView* header(const char* name) const;
+};
+
+enum class HttpParseResult { COMPLETE, INCOMPLETE, INVALID, HEADER_TOO_LARGE, BODY_TOO_LARGE };
+
+// incremental HTTP/1.1 request parser that allocates nothing. the search for the end of the header block resumes
+// where the previous call stopped, so a request trickling in is scanned once, and line ends and separators are
+// found with the vectorised findByte()
+class HttpParser {
+  public:
+    explicit HttpParser(size_t max_header = 8 * 1024, size_t max_body = 1024 * 1024)
+        : m_max_header(max_header), m_max_body(max_body) {}
+
+    // parses the request at the front of data. on COMPLETE, consumed is its length including the body and the parser
+    // is ready for the next one. chunked request bodies are rejected as INVALID
+    HttpParseResult parse(const char* data, size_t size, HttpRequest& request, size_t& consumed);
+
+    void reset() { m_scanned = 0; }
+
+  private:
+    size_t m_max_header;
+    size_t m_max_body;
+    size_t m_scanned = 0; // bytes known to hold no blank line
+};
+
+// filled in by the handler. the object is reused for every request on a connection, so the body keeps its capacity
+struct HttpResponse {
+    int         status       = 200;
+    const char* content_type = "text/plain";
+    std::string body;
+    FrameView   static_body; // sent in place of body without a copy, must stay alive for as long as the server
+    bool        close = false;
+
+    void clear();
+};
+
+struct HttpServerOptions {
+    size_t max_header    = 8 * 1024;    // request line and headers
+    size_t max_body      = 1024 * 1024; // request body
+    size_t max_pipelined = 64;          // responses gathered into one vectored write
+};
+
+struct HttpServerStats {
+    uint64_t connections = 0; // accepted connections
+    uint64_t requests    = 0; // requests handed to the handler
+    uint64_t writes      = 0; // vectored writes, fewer than requests when clients pipeline
+    uint64_t errors      = 0; // malformed or oversized requests answered with an error and a close
+};
+
+using HttpHandler = std::function<void(const HttpRequest& request, HttpResponse& response)>;
+
+// keep-alive HTTP/1.1 server on an EventLoop. the requests that arrived in one read are all answered before anything
+// is written, and the answers leave in one vectored write. while a write is blocked the connection is not read from,
+// so a client that pipelines without reading cannot grow the output without bound
+class HttpServer {
+  public:
+    // takes a listening socket and registers it with loop
+    HttpServer(EventLoop& loop, Socket listener, HttpHandler handler, HttpServerOptions options = {});
+    ~HttpServer();
+
+    HttpServer(const HttpServer&)            = delete;
+    HttpServer& operator=(const HttpServer&) = delete;
+
+    [[nodiscard]] size_t          connections() const { return m_connections.size(); }
+    [[nodiscard]] HttpServerStats stats() const;
+
+  private:
+    struct Output {
+        const char* data;   // external memory, or nullptr for a range of the connection's out string
+        size_t      offset; // into out when data is nullptr
+        size_t      size;
+    };
+
+    struct Connection {
+        Socket              socket;
+        FrameBuffer         in;
+        HttpParser          parser;
+        std::string         out;
+        std::vector<Output> pending;
+        size_t              pending_size = 0;
+        size_t              pending_sent = 0; // bytes of pending already written
+        bool                closing      = false;
+        bool                writing      = false; // waiting for writability instead of reading
+
+        Connection(Socket client, const HttpServerOptions& options)
+            : socket(std::move(client)), in(16 * 1024), parser(options.max_header, options.max_body) {}
+    };
+
+    EventLoop&                 m_loop;
+    Socket                     m_listener;
+    HttpHandler                m_handler;
+    HttpServerOptions          m_options;
+    ConnectionSlab<Connection> m_connections;
+    HttpRequest                m_request;
+    HttpResponse               m_response;
+    std::vector<IoSlice>       m_slices;
+
+    StatCounter m_accepted;
+    StatCounter m_requests;
+    StatCounter m_writes;
+    StatCounter m_errors;
+
+    void onAccept(socket_t fd, PollEvent events);
+    void onConnection(socket_t fd, PollEvent events);
+
+    void answerBuffered(socket_t fd, Connection& conn);
+    void appendResponse(Connection& conn, const HttpResponse& response, int version_minor, bool head);
+    void appendError(Connection& conn, int status);
+    void appendOutput(Connection& conn, const char* data, size_t offset, size_t size);
+    bool flush(socket_t fd, Connection& conn);
+    void close(socket_t fd);
+};
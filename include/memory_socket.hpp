@@ -0,0 +1,67 @@
+#pragma once
+
+#include "socket.hpp"
+#include "stats.hpp"
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <utility>
+
+struct MemoryPair;
+
+// one end of an in-process stream connection, for measuring and testing handler and dispatch code without the
+// kernel. the ends of a pair are registered in an EventPoll created with PollBackend::MEMORY, which reports their
+// readiness like epoll reports a socket's (level-triggered, ERR once both directions are shut down). each end buffers
+// up to the capacity of the pair, a full buffer blocks the sender like a full socket buffer does.
+// memory sockets are always nonblocking. their numbers are counted separately from descriptors and mean something to a
+// MEMORY poll only, which knows no other sockets. the ends may be used from different threads, each by one at a time
+class MemorySocket {
+  public:
+    static constexpr size_t DEFAULT_CAPACITY = 256 * 1024;
+
+    // two connected ends
+    static std::pair<MemorySocket, MemorySocket> pair(size_t capacity = DEFAULT_CAPACITY);
+
+    MemorySocket();
+    ~MemorySocket();
+
+    MemorySocket(MemorySocket&&) noexcept;
+    MemorySocket& operator=(MemorySocket&&) noexcept;
+
+    MemorySocket(const MemorySocket&)            = delete;
+    MemorySocket& operator=(const MemorySocket&) = delete;
+
+    // the peer reads what is still buffered and then 0, its sends fail
+    void     close();
+    bool     valid() const;
+    socket_t fd() const;
+
+    // WRITE: the peer reads 0 once it got the buffered bytes. READ: buffered bytes are dropped, recv returns 0 and
+    // sends of the peer fail
+    void shutdown(ShutdownMode how = ShutdownMode::WRITE);
+
+    // the same contracts as on a nonblocking Socket: recv() and send() return 0 when they would block, the try
+    // variants -1, 0 from tryRecv() means the peer shut down. sends after the peer went away throw
+    socket_size_t recv(void* buffer, size_t size);
+    socket_size_t recv(std::string& out, size_t max_size = 4096);
+    socket_size_t send(const void* data, size_t size);
+    socket_size_t send(const std::string& data);
+
+    socket_size_t tryRecv(void* buffer, size_t size);
+    socket_size_t trySend(const void* data, size_t size);
+
+    socket_size_t sendv(const IoSlice* slices, size_t count);
+    socket_size_t trySendv(const IoSlice* slices, size_t count);
+
+    [[nodiscard]] SocketStats stats() const { return m_stats.snapshot(); }
+    void                      resetStats() { m_stats.reset(); }
+
+  private:
+    std::shared_ptr<MemoryPair> m_pair;
+    int                         m_side = 0;
+    socket_t                    m_fd   = INVALID_SOCKET_FD;
+    SocketCounters              m_stats;
+
+    MemorySocket(std::shared_ptr<MemoryPair> pair, int side, socket_t fd);
+};
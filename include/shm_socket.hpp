@@ -0,0 +1,95 @@
+#pragma once
+
+#include "socket.hpp"
+#include "stats.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+
+#ifndef __linux__
+#error "shm_socket.hpp needs memfd and eventfd, linux only"
+#endif
+
+struct ShmRegion;
+
+// stream connection between two threads or processes on the same host through shared memory: a pair of
+// single-producer single-consumer byte rings in a memfd, with head and tail on cache lines of their own. sending and
+// receiving are plain memory accesses. the only syscalls are doorbells, an eventfd per end that the peer writes when
+// this end is waiting: after a tryRecv() found nothing, or a trySend() found no room. while an end keeps up, the peer
+// never rings it.
+// register fd() for READ in an EventPoll, it becomes readable for data as well as for room to send. call tryRecv()
+// until it returns -1, and retry sends that returned -1, after each event. one thread per end at a time. a peer that
+// dies without close() is not noticed
+class ShmSocket {
+  public:
+    static constexpr size_t DEFAULT_CAPACITY = 1 << 20;
+
+    // the descriptors of one end, for handing it to another process: inherited through fork() or passed over a unix
+    // socket with SCM_RIGHTS
+    struct Handles {
+        int memory        = -1; // the memfd holding both rings
+        int doorbell      = -1;
+        int peer_doorbell = -1;
+        int side          = 0;
+    };
+
+    // two connected ends, each ring holds capacity bytes rounded up to a power of two
+    static std::pair<ShmSocket, ShmSocket> pair(size_t capacity = DEFAULT_CAPACITY);
+    // takes over the descriptors, which are closed with the socket. throws when the memory is not a ring pair
+    static ShmSocket adopt(const Handles& handles);
+
+    ShmSocket();
+    ~ShmSocket();
+
+    ShmSocket(ShmSocket&&) noexcept;
+    ShmSocket& operator=(ShmSocket&&) noexcept;
+
+    ShmSocket(const ShmSocket&)            = delete;
+    ShmSocket& operator=(const ShmSocket&) = delete;
+
+    // the peer reads what is buffered and then 0, its sends fail
+    void                  close();
+    // gives up the end without telling the peer, for the copy left behind when another process took it over
+    Handles               release();
+    bool                  valid() const;
+    socket_t              fd() const { return m_handles.doorbell; }
+    [[nodiscard]] Handles handles() const { return m_handles; }
+
+    // WRITE: the peer reads 0 once it got the buffered bytes. READ: sends of the peer fail
+    void shutdown(ShutdownMode how = ShutdownMode::WRITE);
+
+    // the same contracts as on a nonblocking Socket
+    socket_size_t recv(void* buffer, size_t size);
+    socket_size_t recv(std::string& out, size_t max_size = 4096);
+    socket_size_t send(const void* data, size_t size);
+    socket_size_t send(const std::string& data);
+
+    socket_size_t tryRecv(void* buffer, size_t size);
+    socket_size_t trySend(const void* data, size_t size);
+
+    socket_size_t sendv(const IoSlice* slices, size_t count);
+    socket_size_t trySendv(const IoSlice* slices, size_t count);
+
+    [[nodiscard]] SocketStats stats() const { return m_stats.snapshot(); }
+    // doorbells this end rang for the peer, one per wait the peer could not avoid
+    [[nodiscard]] uint64_t doorbells() const { return m_doorbells.load(); }
+
+    void resetStats() {
+        m_stats.reset();
+        m_doorbells.reset();
+    }
+
+  private:
+    ShmRegion*     m_region   = nullptr;
+    size_t         m_map_size = 0;
+    Handles        m_handles;
+    bool           m_recv_armed = false; // the last tryRecv() found nothing and asked to be rung
+    bool           m_send_armed = false; // the last send found no room and asked to be rung
+    SocketCounters m_stats;
+    StatCounter    m_doorbells;
+
+    void ring(int doorbell);
+    void drainDoorbell();
+};
@@ -1,7 +1,13 @@
 #pragma once
 
+#include "stats.hpp"
+
+#include <cstddef>
 #include <cstdint>
+#include <memory>
+#include <stdexcept>
 #include <string>
+#include <vector>
 
 #ifdef _WIN32
 #include <BaseTsd.h>
@@ -17,6 +23,48 @@ using socket_t                       = int;
 constexpr socket_t INVALID_SOCKET_FD = -1;
 #endif
 
+// dense index for per-fd tables: posix descriptors are the lowest free numbers, windows socket handles are multiples
+// of four
+inline size_t socketSlot(socket_t fd) {
+#ifdef _WIN32
+    return static_cast<size_t>(fd) >> 2;
+#else
+    return static_cast<size_t>(fd);
+#endif
+}
+
+// thrown by accept when it fails, code() is the errno or WSAGetLastError() value
+class SocketError : public std::runtime_error {
+  public:
+    SocketError(const std::string& what, int code) : std::runtime_error(what), m_code(code) {}
+
+    int code() const { return m_code; }
+
+    // out of descriptors or kernel memory, retrying only helps once some are released
+    bool resourceExhausted() const;
+
+  private:
+    int m_code;
+};
+
+enum class ShutdownMode { READ, WRITE, BOTH };
+
+// one buffer of a vectored send
+struct IoSlice {
+    const void* data = nullptr;
+    size_t      size = 0;
+};
+
+// a transmit timestamp matched to the send it belongs to
+struct TxTimestamp {
+    uint64_t bytes   = 0; // sent since enableTimestamps(), up to the end of the stamped send
+    uint64_t send_ns = 0; // when the send call started, monotonicNs() clock
+    uint64_t wire_ns = 0; // when the kernel handed the last byte to the device, same clock
+};
+
+// sends still waiting for their transmit timestamps
+struct TxStampLog;
+
 class Socket {
   public:
     Socket();
@@ -38,16 +86,69 @@ class Socket {
     void setReuseAddr(bool enable = true);
     void setNonBlocking(bool enable = true);
 
+    // SO_REUSEPORT: listeners bound to the same address with it set share its connections, usually one per loop.
+    // set before bind(), throws where the platform has no such option
+    void setReusePort(bool enable = true);
+    // attaches a classic BPF program to the SO_REUSEPORT group of this listener that hands a connection to the
+    // listener numbered (cpu % listeners), where cpu is the one the kernel received its packets on and the numbers
+    // follow the order in which the listeners called listen(). a loop per CPU then handles its connections on the CPU
+    // that has their kernel state in cache. call on any listener of the group once all of them listen, linux only
+    void steerByCpu(unsigned listeners);
+    // SO_INCOMING_CPU of a connection: the CPU that last processed its packets in the kernel, -1 when unknown or not
+    // supported. lets an acceptor hand connections to the loop running on that CPU
+    int incomingCpu() const;
+
+    // TCP_CORK (TCP_NOPUSH on bsd): while set, the kernel holds back partial segments of what is sent. clearing it
+    // sends what is held back, on linux. throws where the platform has no such option
+    void setCork(bool enable = true);
+
     void   bind(const std::string& host, uint16_t port);
     void   listen(int backlog = SOMAXCONN);
     Socket accept();
     void   connect(const std::string& host, uint16_t port);
 
+    // nonblocking variants: tryAccept() returns an invalid socket when no connection is pending, tryConnect() returns
+    // false while the connection is in progress, completion is signaled by writability and checked with pendingError()
+    Socket tryAccept();
+    bool   tryConnect(const std::string& host, uint16_t port);
+    int    pendingError();
+
+    // half-close: WRITE sends a FIN after the queued data while receiving goes on
+    void shutdown(ShutdownMode how = ShutdownMode::WRITE);
+
     socket_size_t recv(void* buffer, size_t size);
     socket_size_t recv(std::string& out, size_t max_size = 4096);
     socket_size_t send(const void* data, size_t size);
     socket_size_t send(const std::string& data);
 
+    // like recv() and send() but return -1 when the call would block, so 0 from tryRecv() means the peer closed
+    socket_size_t tryRecv(void* buffer, size_t size);
+    socket_size_t trySend(const void* data, size_t size);
+
+    // gathers the slices into one send call and returns the bytes sent, which may end in the middle of any slice.
+    // counts above the platform limit send only the first slices
+    socket_size_t sendv(const IoSlice* slices, size_t count);
+    socket_size_t trySendv(const IoSlice* slices, size_t count);
+
+    // SO_TIMESTAMPING with software stamps: the kernel notes when data arrived and when each send went to the device.
+    // receive stamps come with tryRecvStamped(). transmit stamps queue up on the error queue, so polls report ERR
+    // for the socket until readTxTimestamps() took them, pendingError() stays 0 for those. both feed the
+    // kernel_to_user and user_to_wire histograms of ioLatency() and the stamp counters of stats(). linux only, throws
+    // elsewhere. enable on a connected socket
+    void enableTimestamps(bool enable = true);
+    // tryRecv() that sets kernel_ns to when the kernel received the data read last, monotonicNs() clock, or to 0 when
+    // it is not stamped. EventPoll::readyNs() splits the delay into the kernel's part and the loop's
+    socket_size_t tryRecvStamped(void* buffer, size_t size, uint64_t& kernel_ns);
+    // appends the transmit stamps that arrived since the last call and returns how many. they are matched by byte
+    // offset, so write a stamped socket through Socket only: after bytes sent past it (splice, a raw send on fd()) the
+    // stamps until the next send through Socket are dropped, and that send's stamp realigns the count
+    size_t readTxTimestamps(std::vector<TxTimestamp>& out);
+
+    [[nodiscard]] SocketStats stats() const { return m_stats.snapshot(); }
+    void                      resetStats() { m_stats.reset(); }
+
   private:
-    socket_t m_fd;
+    socket_t                    m_fd;
+    SocketCounters              m_stats;
+    std::unique_ptr<TxStampLog> m_stamps; // set while timestamps are enabled
 };
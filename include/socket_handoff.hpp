@@ -0,0 +1,54 @@
+#pragma once
+
+#include "socket.hpp"
+
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#error "socket_handoff.hpp passes descriptors with SCM_RIGHTS, posix only"
+#endif
+
+// a socket to pass on and what the successor needs to know about it
+struct HandoffEntry {
+    socket_t    fd = INVALID_SOCKET_FD;
+    std::string name; // chosen by the application, e.g. "http" for a listener or "conn 42" for a connection
+};
+
+// a socket taken over from the previous process. it shares the open file with the sender's copy, so flags like
+// O_NONBLOCK carry over, and a listener keeps its backlog: connections queued or arriving during the handoff are
+// accepted by whichever process accepts next, none is refused
+struct HandoffSocket {
+    Socket      socket;
+    std::string name;
+};
+
+// the handing side of a restart without downtime. the running process offers its sockets on a unix socket path, its
+// successor connects there with receiveHandoff(), gets duplicates of the sockets over SCM_RIGHTS and confirms once it
+// owns them. after a handoff the old process stops accepting, finishes or drops what it still serves and exits
+class HandoffServer {
+  public:
+    // replaces a stale socket file at path
+    explicit HandoffServer(const std::string& path);
+    // removes the socket file
+    ~HandoffServer();
+
+    HandoffServer(const HandoffServer&)            = delete;
+    HandoffServer& operator=(const HandoffServer&) = delete;
+
+    // readable once a successor connected, for registering in an EventPoll
+    socket_t           fd() const { return m_listener.fd(); }
+    const std::string& path() const { return m_path; }
+
+    // sends the sockets to a waiting successor and blocks up to timeout_ms for its confirmation. false when no
+    // successor is waiting, throws when the transfer fails. the sockets stay open here either way
+    bool handOff(const std::vector<HandoffEntry>& entries, int timeout_ms = 5000);
+
+  private:
+    Socket      m_listener;
+    std::string m_path;
+};
+
+// the taking side: connects to the path of a HandoffServer, receives its sockets and confirms. throws when there is
+// no server at path or the transfer fails
+std::vector<HandoffSocket> receiveHandoff(const std::string& path, int timeout_ms = 5000);
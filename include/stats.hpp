@@ -0,0 +1,138 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// bucket 0 counts empty waits, bucket i counts waits that returned [2^(i-1), 2^i) events
+constexpr size_t EVENTS_PER_WAIT_BUCKETS = 12;
+
+struct PollStats {
+    uint64_t waits             = 0;
+    uint64_t empty_waits       = 0;
+    uint64_t interrupted_waits = 0;
+    uint64_t wakeups           = 0;
+    uint64_t events            = 0;
+    uint64_t max_events        = 0;
+    uint64_t wait_ns           = 0;
+
+    uint64_t ctl_add    = 0;
+    uint64_t ctl_mod    = 0;
+    uint64_t ctl_del    = 0;
+    uint64_t ctl_errors = 0;
+    uint64_t ctl_saved  = 0; // calls that were elided by the interest cache or coalesced in a batch
+
+    uint64_t events_per_wait[EVENTS_PER_WAIT_BUCKETS] = {};
+};
+
+struct SocketStats {
+    uint64_t recv_calls  = 0;
+    uint64_t recv_bytes  = 0;
+    uint64_t recv_eagain = 0;
+    uint64_t send_calls  = 0;
+    uint64_t send_bytes  = 0;
+    uint64_t send_eagain = 0;
+    uint64_t rx_stamps   = 0; // receives that came with a kernel timestamp
+    uint64_t tx_stamps   = 0; // transmit timestamps matched to their send
+};
+
+// counter with a single writer at a time: increments are a relaxed load and store instead of a locked
+// read-modify-write, so counting costs the same as a plain integer while other threads can still take snapshots
+class StatCounter {
+  public:
+    StatCounter() = default;
+    StatCounter(const StatCounter& other) : m_value(other.load()) {}
+    StatCounter& operator=(const StatCounter& other) {
+        m_value.store(other.load(), std::memory_order_relaxed);
+        return *this;
+    }
+
+    void add(uint64_t n = 1) { m_value.store(m_value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+    void raise(uint64_t n) {
+        if (n > m_value.load(std::memory_order_relaxed))
+            m_value.store(n, std::memory_order_relaxed);
+    }
+    void     reset() { m_value.store(0, std::memory_order_relaxed); }
+    uint64_t load() const { return m_value.load(std::memory_order_relaxed); }
+
+  private:
+    std::atomic<uint64_t> m_value{0};
+};
+
+enum class CtlOp : uint8_t {
+    ADD,
+    MOD,
+    DEL
+};
+
+// EventPoll counters: wait counters are written by the waiting thread, ctl counters under the poll's mutex by whichever
+// thread changes a registration
+class PollCounters {
+  public:
+    void recordWait(size_t events, uint64_t ns);
+    void recordInterrupt(uint64_t ns);
+    void recordWakeup() { m_wakeups.add(); }
+    void recordCtl(CtlOp op, bool ok);
+    void recordCtlSaved(uint64_t calls = 1) { m_ctl_saved.add(calls); }
+
+    PollStats snapshot() const;
+    void      reset();
+
+  private:
+    StatCounter m_waits;
+    StatCounter m_empty_waits;
+    StatCounter m_interrupted_waits;
+    StatCounter m_wakeups;
+    StatCounter m_events;
+    StatCounter m_max_events;
+    StatCounter m_wait_ns;
+    StatCounter m_ctl_add;
+    StatCounter m_ctl_mod;
+    StatCounter m_ctl_del;
+    StatCounter m_ctl_errors;
+    StatCounter m_ctl_saved;
+    StatCounter m_events_per_wait[EVENTS_PER_WAIT_BUCKETS];
+};
+
+// Socket counters: written by the thread that owns the socket
+class SocketCounters {
+  public:
+    void recordRecv(int64_t bytes, bool would_block) {
+        m_recv_calls.add();
+        if (would_block)
+            m_recv_eagain.add();
+        else if (bytes > 0)
+            m_recv_bytes.add(static_cast<uint64_t>(bytes));
+    }
+    void recordSend(int64_t bytes, bool would_block) {
+        m_send_calls.add();
+        if (would_block)
+            m_send_eagain.add();
+        else if (bytes > 0)
+            m_send_bytes.add(static_cast<uint64_t>(bytes));
+    }
+    void recordRxStamp() { m_rx_stamps.add(); }
+    void recordTxStamp() { m_tx_stamps.add(); }
+
+    SocketStats snapshot() const;
+    void        reset();
+
+  private:
+    StatCounter m_recv_calls;
+    StatCounter m_recv_bytes;
+    StatCounter m_recv_eagain;
+    StatCounter m_send_calls;
+    StatCounter m_send_bytes;
+    StatCounter m_send_eagain;
+    StatCounter m_rx_stamps;
+    StatCounter m_tx_stamps;
+};
+
+// fields are added together; max_events takes the larger value
+PollStats&   operator+=(PollStats& lhs, const PollStats& rhs);
+SocketStats& operator+=(SocketStats& lhs, const SocketStats& rhs);
+
+// single-line JSON objects, including derived averages and EAGAIN rates
+std::string toJson(const PollStats& stats);
+std::string toJson(const SocketStats& stats);
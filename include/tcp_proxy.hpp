@@ -0,0 +1,71 @@
+#pragma once
+
+#include "event_loop.hpp"
+#include "socket.hpp"
+#include "stats.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+enum class ProxyMode {
+    AUTO,   // splice where the platform has it, copying otherwise
+    SPLICE, // linux only, still copies for sockets splice refuses
+    COPY,   // recv into a per-direction buffer and send from it
+};
+
+struct ProxyOptions {
+    ProxyMode mode        = ProxyMode::AUTO;
+    size_t    buffer_size = 64 * 1024; // pipe capacity or copy buffer per direction, the most held back by a slow side
+};
+
+struct ProxyStats {
+    uint64_t sessions  = 0; // relays started
+    uint64_t spliced   = 0; // bytes moved through pipes without entering user space
+    uint64_t copied    = 0; // bytes moved through copy buffers
+    uint64_t fallbacks = 0; // directions that fell back to copying, no pipe or splice refused the socket
+    uint64_t failed    = 0; // sessions ended by a socket error instead of both sides closing
+};
+
+// relays bytes between pairs of connected sockets on an EventLoop. on linux each direction runs through a pipe with
+// splice(), so payload never reaches user space. a side is read only while its direction has room and polled for
+// WRITE only while there is something queued for it, so a slow receiver throttles its sender through the tcp window.
+// an end of stream on one side is passed on as a shutdown of the other side's write half and the opposite direction
+// keeps going; the sockets are closed once both directions are done.
+// splice() into a reset peer raises SIGPIPE, which no flag turns off. unless SIGPIPE is ignored when the proxy is
+// created, it is blocked around every splice to a socket at the cost of three syscalls; servers ignoring it skip that
+class TcpProxy {
+  public:
+    explicit TcpProxy(EventLoop& loop, ProxyOptions options = {});
+    ~TcpProxy();
+
+    TcpProxy(const TcpProxy&)            = delete;
+    TcpProxy& operator=(const TcpProxy&) = delete;
+
+    // takes both sockets, connected, and makes them nonblocking
+    void relay(Socket client, Socket upstream);
+
+    [[nodiscard]] size_t     sessions() const { return m_sessions.size(); }
+    [[nodiscard]] ProxyStats stats() const;
+
+  private:
+    struct Session;
+
+    EventLoop&                            m_loop;
+    ProxyOptions                          m_options;
+    bool                                  m_guard_sigpipe = false; // SIGPIPE was not ignored at construction
+    std::vector<std::unique_ptr<Session>> m_sessions;
+
+    StatCounter m_started;
+    StatCounter m_spliced;
+    StatCounter m_copied;
+    StatCounter m_fallbacks;
+    StatCounter m_failed;
+
+    static void onEvent(void* context, socket_t fd, PollEvent events);
+
+    bool transfer(Session& session, int direction);
+    void updateInterest(Session& session);
+    void finish(Session& session, bool failed);
+};
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// binary trace of what EventPoll and Socket did, for reconstructing a latency spike after the fact. every thread writes
+// fixed-size records into a ring of its own without locks or syscalls, the newest records of each thread are kept.
+// the trace points are compiled in unless the library is configured with SOCKETPOLL_TRACE=OFF, while tracing is off at
+// runtime each of them is one relaxed load and a branch
+
+enum class TraceType : uint16_t {
+    WAIT_ENTER, // value: timeout in ms
+    WAIT_EXIT,  // value: events returned, -1 when interrupted
+    WAKEUP,     // another thread woke the poll
+    CTL_ADD,    // fd, aux: PollEvent mask, value: 0 or the errno
+    CTL_MOD,
+    CTL_DEL,
+    RECV, // fd, value: bytes, 0 when the peer closed, -errno on errors including EAGAIN
+    SEND, // the same, aux: slices of a vectored send
+};
+
+struct TraceRecord {
+    uint64_t  ns; // monotonicNs()
+    int64_t   value;
+    int64_t   fd; // -1 for records without one
+    TraceType type;
+    uint16_t  aux;
+    uint32_t  thread; // numbered in the order threads first traced, from 1
+};
+
+extern std::atomic<bool> trace_enabled;
+
+inline bool traceEnabled() {
+    return trace_enabled.load(std::memory_order_relaxed);
+}
+
+// false when the library was built without trace points, only explicit traceRecord() calls are recorded then
+bool traceCompiledIn();
+void setTraceEnabled(bool enable);
+// records per thread, rounded up to a power of two. applies to rings created afterwards, the default is 16384
+void setTraceCapacity(size_t records);
+void traceRecord(TraceType type, int64_t fd, int64_t value, uint16_t aux = 0);
+
+// writes the rings of all threads, including threads that exited, to path. returns false when the file cannot be
+// written. async-signal-safe on posix, threads keep tracing meanwhile and records they overwrite are dropped
+bool dumpTrace(const char* path);
+// dumps to path whenever the signal arrives, e.g. SIGUSR2. posix only, throws elsewhere
+void installTraceDumpSignal(int signal, const std::string& path);
+
+// the records of a dump, oldest first per thread. throws std::runtime_error for files that are not a trace dump
+std::vector<TraceRecord> readTrace(const std::string& path);
+const char*              traceTypeName(TraceType type);
+
+#ifdef SOCKETPOLL_TRACE_POINTS
+#define SOCKETPOLL_TRACE(type, fd, value, aux)                                                                         \
+    do {                                                                                                               \
+        if (traceEnabled())                                                                                            \
+            traceRecord(type, static_cast<int64_t>(fd), static_cast<int64_t>(value), static_cast<uint16_t>(aux));      \
+    } while (0)
+#else
+// nothing is evaluated, sizeof only keeps variables that exist for the trace from counting as unused
+#define SOCKETPOLL_TRACE(type, fd, value, aux)                                                                         \
+    do {                                                                                                               \
+        (void)sizeof(type);                                                                                            \
+        (void)sizeof(fd);                                                                                              \
+        (void)sizeof(value);                                                                                           \
+        (void)sizeof(aux);                                                                                             \
+    } while (0)
+#endif
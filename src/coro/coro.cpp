@@ -0,0 +1,256 @@
+#include "coro.hpp"
+
+#include <stdexcept>
+#include <system_error>
+
+namespace {
+
+constexpr size_t FRAME_GRANULARITY = 64;
+constexpr size_t FRAME_CLASSES     = 32; // frames up to 2 KiB are pooled
+
+struct FreeFrame {
+    FreeFrame* next;
+};
+
+struct FrameCache {
+    FreeFrame* heads[FRAME_CLASSES] = {};
+
+    ~FrameCache() {
+        for (FreeFrame*& head : heads) {
+            while (head != nullptr) {
+                FreeFrame* next = head->next;
+                ::operator delete(head);
+                head = next;
+            }
+        }
+    }
+};
+
+thread_local FrameCache frame_cache;
+
+size_t frameClass(size_t size) {
+    return (size + FRAME_GRANULARITY - 1) / FRAME_GRANULARITY - 1;
+}
+
+} // namespace
+
+void* FramePool::allocate(size_t size) {
+    size_t cls = frameClass(size);
+    if (cls >= FRAME_CLASSES)
+        return ::operator new(size);
+
+    FreeFrame*& head = frame_cache.heads[cls];
+    if (head == nullptr)
+        return ::operator new((cls + 1) * FRAME_GRANULARITY);
+
+    FreeFrame* frame = head;
+    head             = frame->next;
+    return frame;
+}
+
+void FramePool::deallocate(void* frame, size_t size) noexcept {
+    size_t cls = frameClass(size);
+    if (cls >= FRAME_CLASSES) {
+        ::operator delete(frame);
+        return;
+    }
+
+    auto* free             = static_cast<FreeFrame*>(frame);
+    free->next             = frame_cache.heads[cls];
+    frame_cache.heads[cls] = free;
+}
+
+// NOLINTBEGIN(readability-identifier-naming)
+
+// root of a spawned task, starts eagerly and frees its own frame when done
+struct DetachedTask {
+    struct promise_type : PooledFrame {
+        CoroLoop& loop;
+
+        promise_type(CoroLoop& owner, Task<void>& /*task*/) : loop(owner) { loop.m_roots.insert(address()); }
+        ~promise_type() { loop.m_roots.erase(address()); }
+
+        DetachedTask       get_return_object() const noexcept { return {}; }
+        std::suspend_never initial_suspend() const noexcept { return {}; }
+        std::suspend_never final_suspend() const noexcept { return {}; }
+        void               return_void() const noexcept {}
+        void               unhandled_exception() const noexcept {
+            if (!loop.m_error)
+                loop.m_error = std::current_exception();
+        }
+
+        void* address() { return std::coroutine_handle<promise_type>::from_promise(*this).address(); }
+    };
+};
+
+// NOLINTEND(readability-identifier-naming)
+
+namespace {
+
+DetachedTask runDetached(CoroLoop& /*loop*/, Task<void> task) {
+    co_await std::move(task);
+}
+
+} // namespace
+
+CoroLoop::CoroLoop(int max_events) : m_poll(max_events) {}
+
+CoroLoop::~CoroLoop() {
+    // destroying a root destroys the whole chain of tasks it is awaiting
+    std::vector<void*> roots(m_roots.begin(), m_roots.end());
+    for (void* root : roots)
+        std::coroutine_handle<>::from_address(root).destroy();
+}
+
+void CoroLoop::spawn(Task<void> task) {
+    runDetached(*this, std::move(task));
+}
+
+void CoroLoop::run() {
+    m_stopped = false;
+    while (!m_roots.empty() && !m_stopped && !m_error) {
+        m_poll.wait(nextTimeout());
+        for (const auto& event : m_poll.events()) {
+            m_poll.recordDispatch();
+            dispatch(event.fd, event.events);
+        }
+        fireTimers();
+    }
+
+    if (m_error) {
+        std::exception_ptr error = m_error;
+        m_error                  = nullptr;
+        std::rethrow_exception(error);
+    }
+}
+
+void CoroLoop::suspendOn(socket_t fd, PollEvent event, std::coroutine_handle<> handle) {
+    size_t index = socketSlot(fd);
+    if (index >= m_waiters.size())
+        m_waiters.resize(index + 1);
+
+    Waiters&                 waiters = m_waiters[index];
+    std::coroutine_handle<>& slot    = event == PollEvent::READ ? waiters.reader : waiters.writer;
+    if (slot)
+        throw std::logic_error("another coroutine is already waiting on this fd");
+
+    // interest only grows here, dispatch() narrows it once readiness arrives that nobody waits for, so a coroutine
+    // looping over recv() costs no epoll_ctl calls
+    auto wanted = static_cast<PollEvent>(waiters.registered | event);
+    if (!waiters.added) {
+        m_poll.addFd(fd, wanted);
+        waiters.added = true;
+    } else if (wanted != waiters.registered) {
+        m_poll.modifyFd(fd, wanted);
+    }
+    waiters.registered = wanted;
+    slot               = handle;
+}
+
+void CoroLoop::addTimer(uint64_t deadline_ns, std::coroutine_handle<> handle) {
+    m_timers.push({deadline_ns, m_timer_sequence++, handle});
+}
+
+void CoroLoop::forget(socket_t fd) {
+    size_t index = socketSlot(fd);
+    if (fd == INVALID_SOCKET_FD || index >= m_waiters.size())
+        return;
+    if (m_waiters[index].added)
+        m_poll.removeFd(fd);
+    m_waiters[index] = Waiters{};
+}
+
+void CoroLoop::dispatch(socket_t fd, PollEvent events) {
+    size_t index = socketSlot(fd);
+    if (index >= m_waiters.size())
+        return;
+
+    Waiters&                waiters = m_waiters[index];
+    std::coroutine_handle<> reader;
+    std::coroutine_handle<> writer;
+    if ((events & (PollEvent::READ | PollEvent::ERR)) != 0)
+        reader = std::exchange(waiters.reader, nullptr);
+    if ((events & (PollEvent::WRITE | PollEvent::ERR)) != 0)
+        writer = std::exchange(waiters.writer, nullptr);
+
+    if (!reader && !writer) {
+        // readiness nobody waits for would be reported on every wait(), narrow the interest to the actual waiters
+        uint8_t wanted = PollEvent::NONE;
+        if (waiters.reader)
+            wanted |= PollEvent::READ;
+        if (waiters.writer)
+            wanted |= PollEvent::WRITE;
+        if ((events & PollEvent::ERR) != 0 && wanted == PollEvent::NONE) {
+            m_poll.removeFd(fd);
+            waiters.added = false;
+        } else if (wanted != waiters.registered) {
+            m_poll.modifyFd(fd, static_cast<PollEvent>(wanted));
+        }
+        waiters.registered = static_cast<PollEvent>(wanted);
+        return;
+    }
+
+    // resuming may change m_waiters, so the reference is not used past this point
+    if (reader)
+        reader.resume();
+    if (writer)
+        writer.resume();
+}
+
+void CoroLoop::fireTimers() {
+    uint64_t now = monotonicNs();
+    while (!m_timers.empty() && m_timers.top().deadline_ns <= now) {
+        std::coroutine_handle<> handle = m_timers.top().handle;
+        m_timers.pop();
+        handle.resume();
+    }
+}
+
+int CoroLoop::nextTimeout() const {
+    if (m_timers.empty())
+        return -1;
+    uint64_t now = monotonicNs();
+    if (m_timers.top().deadline_ns <= now)
+        return 0;
+    return static_cast<int>((m_timers.top().deadline_ns - now + 999999) / 1000000);
+}
+
+Task<socket_size_t> asyncRecv(CoroLoop& loop, Socket& socket, void* buffer, size_t size) {
+    socket_size_t bytes;
+    while ((bytes = socket.tryRecv(buffer, size)) < 0)
+        co_await loop.readable(socket.fd());
+    co_return bytes;
+}
+
+Task<socket_size_t> asyncSend(CoroLoop& loop, Socket& socket, const void* data, size_t size) {
+    const char* next = static_cast<const char*>(data);
+    size_t      left = size;
+    while (left > 0) {
+        socket_size_t sent = socket.trySend(next, left);
+        if (sent < 0) {
+            co_await loop.writable(socket.fd());
+            continue;
+        }
+        next += sent;
+        left -= static_cast<size_t>(sent);
+    }
+    co_return static_cast<socket_size_t>(size);
+}
+
+Task<Socket> asyncAccept(CoroLoop& loop, Socket& listener) {
+    Socket accepted;
+    while (!(accepted = listener.tryAccept()).valid())
+        co_await loop.readable(listener.fd());
+    accepted.setNonBlocking(true);
+    co_return accepted;
+}
+
+Task<void> asyncConnect(CoroLoop& loop, Socket& socket, const std::string& host, uint16_t port) {
+    if (socket.tryConnect(host, port))
+        co_return;
+    co_await loop.writable(socket.fd());
+
+    int error = socket.pendingError();
+    if (error != 0)
+        throw std::runtime_error("connect failed: " + std::system_category().message(error));
+}
@@ -0,0 +1,113 @@
+#include "executor.hpp"
+
+#include <stdexcept>
+
+namespace {
+
+// lets submit() recognise calls from one of the executor's own workers
+thread_local Executor* current_executor = nullptr;
+thread_local size_t    current_worker   = 0;
+
+} // namespace
+
+Executor::Executor(size_t threads) {
+    if (threads == 0)
+        threads = 1;
+
+    for (size_t i = 0; i < threads; i++)
+        m_workers.push_back(std::make_unique<Worker>());
+    for (size_t i = 0; i < threads; i++)
+        m_threads.emplace_back([this, i]() { workerLoop(i); });
+}
+
+Executor::~Executor() {
+    {
+        std::lock_guard<std::mutex> lock(m_idle_mutex);
+        m_stopping = true;
+    }
+    m_idle.notify_all();
+    for (auto& thread : m_threads)
+        thread.join();
+}
+
+void Executor::submit(std::function<void()> task) {
+    if (!task)
+        throw std::invalid_argument("empty executor task");
+
+    // counted before the task is visible, a worker may pop it and decrement the moment the lock is released;
+    // this also pairs with the sleeper registration in workerLoop(), one of the two sides always sees the other
+    m_pending.fetch_add(1);
+    size_t index = current_executor == this ? current_worker : m_next.fetch_add(1) % m_workers.size();
+    try {
+        std::lock_guard<std::mutex> lock(m_workers[index]->mutex);
+        m_workers[index]->tasks.push_back(std::move(task));
+    } catch (...) {
+        m_pending.fetch_sub(1);
+        throw;
+    }
+    m_submitted.fetch_add(1, std::memory_order_relaxed);
+
+    if (m_sleepers.load() > 0) {
+        std::lock_guard<std::mutex> lock(m_idle_mutex);
+        m_idle.notify_one();
+    }
+}
+
+ExecutorStats Executor::stats() const {
+    ExecutorStats stats;
+    stats.submitted = m_submitted.load(std::memory_order_relaxed);
+    for (const auto& worker : m_workers) {
+        stats.executed += worker->executed.load();
+        stats.stolen += worker->stolen.load();
+    }
+    return stats;
+}
+
+void Executor::workerLoop(size_t index) {
+    current_executor = this;
+    current_worker   = index;
+
+    std::function<void()> task;
+    for (;;) {
+        if (popLocal(index, task) || steal(index, task)) {
+            m_pending.fetch_sub(1);
+            task();
+            task = nullptr;
+            m_workers[index]->executed.add(1);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_idle_mutex);
+        if (m_stopping && m_pending.load() == 0)
+            break;
+        m_sleepers.fetch_add(1);
+        m_idle.wait(lock, [this]() { return m_pending.load() > 0 || m_stopping; });
+        m_sleepers.fetch_sub(1);
+    }
+}
+
+bool Executor::popLocal(size_t index, std::function<void()>& task) {
+    Worker&                     worker = *m_workers[index];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    if (worker.tasks.empty())
+        return false;
+    // newest first, its data is most likely still in this core's cache
+    task = std::move(worker.tasks.back());
+    worker.tasks.pop_back();
+    return true;
+}
+
+bool Executor::steal(size_t index, std::function<void()>& task) {
+    for (size_t i = 1; i < m_workers.size(); i++) {
+        Worker&                     victim = *m_workers[(index + i) % m_workers.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (victim.tasks.empty())
+            continue;
+        // oldest first, it is the one the victim would get to last
+        task = std::move(victim.tasks.front());
+        victim.tasks.pop_front();
+        m_workers[index]->stolen.add(1);
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,399 @@
+#include "framing.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define FRAMING_X86_64 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define FRAMING_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define FRAMING_TARGET_AVX2
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+FrameBuffer::FrameBuffer(size_t capacity) : m_data(capacity == 0 ? 1 : capacity) {}
+
+socket_size_t FrameBuffer::fill(Socket& socket) {
+    // small reads cost a syscall each, move the unread bytes out of the way before the tail gets that short
+    if (writable() < m_data.size() / 4)
+        compact();
+    reserve(size() + 1);
+    socket_size_t received = socket.tryRecv(writePtr(), writable());
+    if (received > 0)
+        commit(static_cast<size_t>(received));
+    return received;
+}
+
+void FrameBuffer::reserve(size_t unread) {
+    unread = std::max(unread, size());
+    if (m_begin + unread <= m_data.size())
+        return;
+
+    compact();
+    if (unread > m_data.size())
+        m_data.resize(std::max(unread, m_data.size() * 2));
+}
+
+void FrameBuffer::append(const void* data, size_t size) {
+    reserve(this->size() + size);
+    std::memcpy(writePtr(), data, size);
+    commit(size);
+}
+
+void FrameBuffer::compact() {
+    if (m_begin == 0)
+        return;
+    if (m_begin != m_end)
+        std::memmove(m_data.data(), m_data.data() + m_begin, m_end - m_begin);
+    m_end -= m_begin;
+    m_begin = 0;
+}
+
+BufferPool::BufferPool(size_t block_size, size_t max_free)
+    : m_block_size(block_size == 0 ? 1 : block_size), m_max_free(max_free) {}
+
+BufferPool::~BufferPool() {
+    for (char* block : m_free)
+        delete[] block;
+}
+
+char* BufferPool::acquire() {
+    m_in_use++;
+    if (m_free.empty())
+        return new char[m_block_size];
+    char* block = m_free.back();
+    m_free.pop_back();
+    return block;
+}
+
+void BufferPool::release(char* block) {
+    m_in_use--;
+    // past the limit a burst of partial frames is given back to the allocator once it is over
+    if (m_free.size() < m_max_free)
+        m_free.push_back(block);
+    else
+        delete[] block;
+}
+
+PooledBuffer::PooledBuffer(PooledBuffer&& other) noexcept
+    : m_pool(other.m_pool), m_data(other.m_data), m_size(other.m_size), m_capacity(other.m_capacity) {
+    other.m_data     = nullptr;
+    other.m_size     = 0;
+    other.m_capacity = 0;
+}
+
+PooledBuffer& PooledBuffer::operator=(PooledBuffer&& other) noexcept {
+    if (this != &other) {
+        clear();
+        m_pool           = other.m_pool;
+        m_data           = other.m_data;
+        m_size           = other.m_size;
+        m_capacity       = other.m_capacity;
+        other.m_data     = nullptr;
+        other.m_size     = 0;
+        other.m_capacity = 0;
+    }
+    return *this;
+}
+
+void PooledBuffer::append(const void* data, size_t size) {
+    if (size == 0)
+        return;
+    size_t needed = m_size + size;
+    if (needed > m_capacity) {
+        size_t capacity = m_capacity == 0 && needed <= m_pool->blockSize() ? m_pool->blockSize()
+                                                                            : std::max(needed, m_capacity * 2);
+        char*  grown    = capacity == m_pool->blockSize() ? m_pool->acquire() : new char[capacity];
+        if (m_size > 0)
+            std::memcpy(grown, m_data, m_size);
+        size_t kept = m_size;
+        clear();
+        m_data     = grown;
+        m_size     = kept;
+        m_capacity = capacity;
+    }
+    std::memcpy(m_data + m_size, data, size);
+    m_size = needed;
+}
+
+void PooledBuffer::consume(size_t size) {
+    if (size >= m_size) {
+        clear();
+        return;
+    }
+    std::memmove(m_data, m_data + size, m_size - size);
+    m_size -= size;
+}
+
+void PooledBuffer::clear() {
+    if (m_data != nullptr) {
+        if (m_capacity == m_pool->blockSize())
+            m_pool->release(m_data);
+        else
+            delete[] m_data;
+    }
+    m_data     = nullptr;
+    m_size     = 0;
+    m_capacity = 0;
+}
+
+void PooledBuffer::keep(FrameBuffer& scratch) {
+    append(scratch.data(), scratch.size());
+    scratch.clear();
+}
+
+void PooledBuffer::restore(FrameBuffer& scratch) {
+    scratch.clear();
+    if (m_size == 0)
+        return;
+    scratch.append(m_data, m_size);
+    clear();
+}
+
+socket_size_t PooledBuffer::flush(Socket& socket) {
+    if (m_size == 0)
+        return 0;
+    socket_size_t sent = socket.trySend(m_data, m_size);
+    if (sent > 0)
+        consume(static_cast<size_t>(sent));
+    return sent;
+}
+
+LengthPrefixDecoder::LengthPrefixDecoder(size_t header_size, ByteOrder order, size_t max_frame)
+    : m_header_size(header_size), m_order(order), m_max_frame(max_frame) {
+    if (header_size != 1 && header_size != 2 && header_size != 4 && header_size != 8)
+        throw std::invalid_argument("length prefix must be 1, 2, 4 or 8 bytes");
+}
+
+bool LengthPrefixDecoder::next(FrameBuffer& buffer, FrameView& frame) {
+    if (buffer.size() < m_header_size)
+        return false;
+
+    const auto* header = reinterpret_cast<const unsigned char*>(buffer.data());
+    uint64_t    length = 0;
+    for (size_t i = 0; i < m_header_size; i++) {
+        size_t index = m_order == ByteOrder::BIG ? i : m_header_size - 1 - i;
+        length       = length << 8 | header[index];
+    }
+    if (length > m_max_frame)
+        throw std::runtime_error("frame length " + std::to_string(length) + " exceeds the limit");
+
+    size_t total = m_header_size + static_cast<size_t>(length);
+    if (buffer.size() < total)
+        return false;
+
+    frame.data = buffer.data() + m_header_size;
+    frame.size = static_cast<size_t>(length);
+    buffer.consume(total);
+    return true;
+}
+
+void LengthPrefixDecoder::encode(uint64_t size, char* header) const {
+    if (m_header_size < 8 && size >> (m_header_size * 8) != 0)
+        throw std::invalid_argument("frame length does not fit the length prefix");
+
+    for (size_t i = 0; i < m_header_size; i++) {
+        size_t index  = m_order == ByteOrder::BIG ? m_header_size - 1 - i : i;
+        header[index] = static_cast<char>(size >> (i * 8) & 0xff);
+    }
+}
+
+DelimiterDecoder::DelimiterDecoder(std::string delimiter, size_t max_frame)
+    : m_delimiter(std::move(delimiter)), m_max_frame(max_frame) {
+    if (m_delimiter.empty())
+        throw std::invalid_argument("delimiter must not be empty");
+}
+
+bool DelimiterDecoder::next(FrameBuffer& buffer, FrameView& frame) {
+    const char* begin = buffer.data();
+    const char* end   = begin + buffer.size();
+
+    // only the bytes that arrived since the last call are scanned, a long frame trickling in stays linear
+    const char* at = begin + m_scanned;
+    while ((at = findByte(at, end, m_delimiter[0])) != end) {
+        if (static_cast<size_t>(end - at) < m_delimiter.size())
+            break;
+        if (std::memcmp(at + 1, m_delimiter.data() + 1, m_delimiter.size() - 1) == 0) {
+            frame.data = begin;
+            frame.size = static_cast<size_t>(at - begin);
+            if (frame.size > m_max_frame)
+                throw std::runtime_error("delimited frame exceeds the limit");
+            buffer.consume(frame.size + m_delimiter.size());
+            m_scanned = 0;
+            return true;
+        }
+        at++;
+    }
+
+    // a partial delimiter at the end is looked at again once more bytes are in
+    m_scanned = static_cast<size_t>(at - begin);
+    if (m_scanned > m_max_frame)
+        throw std::runtime_error("delimited frame exceeds the limit");
+    return false;
+}
+
+namespace {
+
+using ScanFn = const char* (*)(const char*, const char*, char);
+
+const char* scanScalar(const char* begin, const char* end, char byte) {
+    for (const char* p = begin; p != end; p++) {
+        if (*p == byte)
+            return p;
+    }
+    return end;
+}
+
+const char* scanLibc(const char* begin, const char* end, char byte) {
+    const void* found = std::memchr(begin, byte, static_cast<size_t>(end - begin));
+    return found != nullptr ? static_cast<const char*>(found) : end;
+}
+
+#ifdef FRAMING_X86_64
+
+unsigned firstSetBit(uint32_t mask) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return static_cast<unsigned>(index);
+#else
+    return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+}
+
+const char* scanSse2(const char* begin, const char* end, char byte) {
+    const __m128i needle = _mm_set1_epi8(byte);
+    const char*   p      = begin;
+    for (; end - p >= 16; p += 16) {
+        __m128i  chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        uint32_t mask  = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, needle)));
+        if (mask != 0)
+            return p + firstSetBit(mask);
+    }
+    return scanScalar(p, end, byte);
+}
+
+// four vectors per iteration and one test for all of them keeps the loop close to load throughput, the masks are
+// only built once something matched
+FRAMING_TARGET_AVX2 const char* scanAvx2(const char* begin, const char* end, char byte) {
+    const __m256i needle = _mm256_set1_epi8(byte);
+    const char*   p      = begin;
+    for (; end - p >= 128; p += 128) {
+        __m256i a   = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)), needle);
+        __m256i b   = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32)), needle);
+        __m256i c   = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 64)), needle);
+        __m256i d   = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 96)), needle);
+        __m256i any = _mm256_or_si256(_mm256_or_si256(a, b), _mm256_or_si256(c, d));
+        if (!_mm256_testz_si256(any, any)) {
+            const __m256i hits[] = {a, b, c, d};
+            for (int i = 0;; i++) {
+                uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(hits[i]));
+                if (mask != 0)
+                    return p + i * 32 + firstSetBit(mask);
+            }
+        }
+    }
+    for (; end - p >= 32; p += 32) {
+        __m256i  chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        uint32_t mask  = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, needle)));
+        if (mask != 0)
+            return p + firstSetBit(mask);
+    }
+    return scanSse2(p, end, byte);
+}
+
+bool cpuHasAvx2() {
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") != 0;
+#elif defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx     = (info[2] & (1 << 28)) != 0;
+    // the os has to save the ymm registers on context switches too
+    if (!osxsave || !avx || (_xgetbv(0) & 6) != 6)
+        return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return false;
+#endif
+}
+
+#endif
+
+ScanFn scanFn(ScanImpl impl) {
+    if (!scanImplSupported(impl))
+        return scanScalar;
+    switch (impl) {
+    case ScanImpl::LIBC:
+        return scanLibc;
+#ifdef FRAMING_X86_64
+    case ScanImpl::SSE2:
+        return scanSse2;
+    case ScanImpl::AVX2:
+        return scanAvx2;
+#endif
+    default:
+        return scanScalar;
+    }
+}
+
+} // namespace
+
+// a direct call, no pointer that a static initialiser elsewhere could find unset
+const char* findByte(const char* begin, const char* end, char byte) {
+    return scanLibc(begin, end, byte);
+}
+
+const char* findByteWith(ScanImpl impl, const char* begin, const char* end, char byte) {
+    return scanFn(impl)(begin, end, byte);
+}
+
+bool scanImplSupported(ScanImpl impl) {
+    switch (impl) {
+    case ScanImpl::SCALAR:
+    case ScanImpl::LIBC:
+        return true;
+#ifdef FRAMING_X86_64
+    case ScanImpl::SSE2:
+        return true;
+    case ScanImpl::AVX2: {
+        static const bool supported = cpuHasAvx2();
+        return supported;
+    }
+#endif
+    default:
+        return false;
+    }
+}
+
+// libc memchr is vectorised and tuned per cpu already. the loops here gain on it only while delimiters are a few
+// hundred bytes apart or closer, where the per-frame work outweighs the scan anyway, and fall behind by a third on
+// sparse data. they stay for comparison in framing_scan
+ScanImpl bestScanImpl() {
+    return ScanImpl::LIBC;
+}
+
+const char* scanImplName(ScanImpl impl) {
+    switch (impl) {
+    case ScanImpl::SCALAR:
+        return "scalar";
+    case ScanImpl::LIBC:
+        return "libc";
+    case ScanImpl::SSE2:
+        return "sse2";
+    case ScanImpl::AVX2:
+        return "avx2";
+    }
+    return "unknown";
+}
@@ -0,0 +1,188 @@
+#include "http.hpp"
+
+#include <cstring>
+
+namespace {
+
+char lower(char c) {
+    return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+bool equalsIgnoreCase(const FrameView& view, const char* text, size_t size) {
+    if (view.size != size)
+        return false;
+    for (size_t i = 0; i < size; i++) {
+        if (lower(view.data[i]) != lower(text[i]))
+            return false;
+    }
+    return true;
+}
+
+// line without its terminating \r\n or \n, end points at the \n
+FrameView lineBefore(const char* begin, const char* end) {
+    if (end != begin && end[-1] == '\r')
+        end--;
+    return {begin, static_cast<size_t>(end - begin)};
+}
+
+bool isSpace(char c) {
+    return c == ' ' || c == '\t';
+}
+
+bool parseLength(const FrameView& value, uint64_t& length) {
+    if (value.size == 0 || value.size > 19)
+        return false;
+    length = 0;
+    for (size_t i = 0; i < value.size; i++) {
+        if (value.data[i] < '0' || value.data[i] > '9')
+            return false;
+        length = length * 10 + static_cast<uint64_t>(value.data[i] - '0');
+    }
+    return true;
+}
+
+bool parseRequestLine(const FrameView& line, HttpRequest& request) {
+    const char* end   = line.data + line.size;
+    const char* space = findByte(line.data, end, ' ');
+    if (space == line.data || space == end)
+        return false;
+    request.method = {line.data, static_cast<size_t>(space - line.data)};
+
+    const char* target = space + 1;
+    space              = findByte(target, end, ' ');
+    if (space == target || space == end)
+        return false;
+    request.target = {target, static_cast<size_t>(space - target)};
+
+    const char* version = space + 1;
+    if (end - version != 8 || std::memcmp(version, "HTTP/1.", 7) != 0 || (version[7] != '0' && version[7] != '1'))
+        return false;
+    request.version_minor = version[7] - '0';
+    return true;
+}
+
+// header semantics the parser itself needs: body length, chunking and keep-alive
+bool applyHeaders(HttpRequest& request) {
+    bool has_length        = false;
+    request.content_length = 0;
+    request.keep_alive     = request.version_minor == 1;
+
+    for (size_t i = 0; i < request.header_count; i++) {
+        const HttpHeader& header = request.headers[i];
+        if (equalsIgnoreCase(header.name, "content-length", 14)) {
+            uint64_t length;
+            // differing duplicates are a request smuggling vector, any duplicate is refused
+            if (has_length || !parseLength(header.value, length))
+                return false;
+            request.content_length = length;
+            has_length             = true;
+        } else if (equalsIgnoreCase(header.name, "transfer-encoding", 17)) {
+            return false;
+        } else if (equalsIgnoreCase(header.name, "connection", 10)) {
+            if (equalsIgnoreCase(header.value, "close", 5))
+                request.keep_alive = false;
+            else if (equalsIgnoreCase(header.value, "keep-alive", 10))
+                request.keep_alive = true;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+const FrameView* HttpRequest::header(const char* name) const {
+    size_t size = std::strlen(name);
+    for (size_t i = 0; i < header_count; i++) {
+        if (equalsIgnoreCase(headers[i].name, name, size))
+            return &headers[i].value;
+    }
+    return nullptr;
+}
+
+HttpParseResult HttpParser::parse(const char* data, size_t size, HttpRequest& request, size_t& consumed) {
+    // empty lines before a request are ignored
+    size_t skipped = 0;
+    while (skipped < size && (data[skipped] == '\r' || data[skipped] == '\n'))
+        skipped++;
+    if (skipped > m_max_header)
+        return HttpParseResult::HEADER_TOO_LARGE;
+    data += skipped;
+    size -= skipped;
+
+    // the header block ends at a line feed followed by an empty line
+    const char* end        = data + size;
+    const char* at         = data + m_scanned;
+    const char* header_end = nullptr;
+    while ((at = findByte(at, end, '\n')) != end) {
+        const char* next = at + 1;
+        if (next != end && *next == '\r')
+            next++;
+        if (next == end)
+            break;
+        if (*next == '\n') {
+            header_end = next + 1;
+            break;
+        }
+        at++;
+    }
+    m_scanned = static_cast<size_t>(at - data);
+
+    if (header_end == nullptr)
+        return size > m_max_header ? HttpParseResult::HEADER_TOO_LARGE : HttpParseResult::INCOMPLETE;
+    if (static_cast<size_t>(header_end - data) > m_max_header)
+        return HttpParseResult::HEADER_TOO_LARGE;
+
+    const char* line_end = findByte(data, header_end, '\n');
+    if (!parseRequestLine(lineBefore(data, line_end), request))
+        return HttpParseResult::INVALID;
+
+    request.header_count = 0;
+    for (const char* line = line_end + 1;; line = line_end + 1) {
+        line_end         = findByte(line, header_end, '\n');
+        FrameView header = lineBefore(line, line_end);
+        if (header.size == 0)
+            break;
+        // continuation lines are obsolete and a known smuggling vector
+        if (isSpace(header.data[0]))
+            return HttpParseResult::INVALID;
+        if (request.header_count == HTTP_MAX_HEADERS)
+            return HttpParseResult::HEADER_TOO_LARGE;
+
+        const char* header_stop = header.data + header.size;
+        const char* colon       = findByte(header.data, header_stop, ':');
+        if (colon == header.data || colon == header_stop || isSpace(colon[-1]))
+            return HttpParseResult::INVALID;
+
+        const char* value = colon + 1;
+        while (value != header_stop && isSpace(*value))
+            value++;
+        while (header_stop != value && isSpace(header_stop[-1]))
+            header_stop--;
+
+        HttpHeader& entry = request.headers[request.header_count++];
+        entry.name        = {header.data, static_cast<size_t>(colon - header.data)};
+        entry.value       = {value, static_cast<size_t>(header_stop - value)};
+    }
+
+    if (!applyHeaders(request))
+        return HttpParseResult::INVALID;
+    if (request.content_length > m_max_body)
+        return HttpParseResult::BODY_TOO_LARGE;
+
+    size_t head_size = static_cast<size_t>(header_end - data);
+    if (size - head_size < request.content_length)
+        return HttpParseResult::INCOMPLETE;
+
+    request.body = {header_end, static_cast<size_t>(request.content_length)};
+    consumed     = skipped + head_size + request.body.size;
+    m_scanned    = 0;
+    return HttpParseResult::COMPLETE;
+}
+
+void HttpResponse::clear() {
+    status       = 200;
+    content_type = "text/plain";
+    body.clear();
+    static_body = FrameView{};
+    close       = false;
+}
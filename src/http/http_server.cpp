@@ -0,0 +1,296 @@
+#include "http.hpp"
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#endif
+
+#include <cstring>
+#include <exception>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+
+const char* reasonPhrase(int status) {
+    switch (status) {
+    case 200:
+        return "OK";
+    case 201:
+        return "Created";
+    case 204:
+        return "No Content";
+    case 301:
+        return "Moved Permanently";
+    case 302:
+        return "Found";
+    case 304:
+        return "Not Modified";
+    case 400:
+        return "Bad Request";
+    case 403:
+        return "Forbidden";
+    case 404:
+        return "Not Found";
+    case 405:
+        return "Method Not Allowed";
+    case 413:
+        return "Content Too Large";
+    case 431:
+        return "Request Header Fields Too Large";
+    case 500:
+        return "Internal Server Error";
+    case 501:
+        return "Not Implemented";
+    case 503:
+        return "Service Unavailable";
+    default:
+        return "";
+    }
+}
+
+void appendNumber(std::string& out, uint64_t value) {
+    char  digits[20];
+    char* end   = digits + sizeof(digits);
+    char* begin = end;
+    do {
+        *--begin = static_cast<char>('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+    out.append(begin, end);
+}
+
+// responses are written whole, there is nothing for Nagle to merge
+void setNoDelay(Socket& socket) {
+    int enable = 1;
+    setsockopt(socket.fd(), IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&enable), sizeof(enable));
+}
+
+} // namespace
+
+HttpServer::HttpServer(EventLoop& loop, Socket listener, HttpHandler handler, HttpServerOptions options)
+    : m_loop(loop), m_listener(std::move(listener)), m_handler(std::move(handler)), m_options(options) {
+    if (!m_handler)
+        throw std::invalid_argument("http server needs a handler");
+    if (m_options.max_pipelined == 0)
+        m_options.max_pipelined = 1;
+
+    m_listener.setNonBlocking(true);
+    m_loop.add(m_listener.fd(), PollEvent::READ, memberHandler<HttpServer, &HttpServer::onAccept>(this));
+}
+
+HttpServer::~HttpServer() {
+    m_connections.forEach([this](Connection& conn) { m_loop.remove(conn.socket.fd()); });
+    m_connections.clear();
+    m_loop.remove(m_listener.fd());
+}
+
+HttpServerStats HttpServer::stats() const {
+    HttpServerStats stats;
+    stats.connections = m_accepted.load();
+    stats.requests    = m_requests.load();
+    stats.writes      = m_writes.load();
+    stats.errors      = m_errors.load();
+    return stats;
+}
+
+void HttpServer::onAccept(socket_t /*fd*/, PollEvent /*events*/) {
+    for (int i = 0; i < 64; i++) {
+        Socket client;
+        try {
+            client = m_listener.tryAccept();
+        } catch (const SocketError& error) {
+            if (!error.resourceExhausted())
+                throw;
+            return;
+        }
+        if (!client.valid())
+            return;
+
+        client.setNonBlocking(true);
+        setNoDelay(client);
+        socket_t fd = client.fd();
+        m_connections.emplace(fd, std::move(client), m_options);
+        m_loop.add(fd, PollEvent::READ, memberHandler<HttpServer, &HttpServer::onConnection>(this));
+        m_accepted.add();
+    }
+}
+
+void HttpServer::onConnection(socket_t fd, PollEvent /*events*/) {
+    Connection* conn = m_connections.find(fd);
+    if (conn == nullptr)
+        return;
+
+    if (conn->writing) {
+        if (!flush(fd, *conn))
+            return;
+        // drained, requests that were held back while the write was blocked are answered now
+        conn->writing = false;
+        m_loop.modify(fd, PollEvent::READ);
+        answerBuffered(fd, *conn);
+        return;
+    }
+
+    socket_size_t received;
+    try {
+        received = conn->in.fill(conn->socket);
+    } catch (const std::runtime_error&) {
+        close(fd);
+        return;
+    }
+    if (received == 0) {
+        close(fd);
+        return;
+    }
+    if (received > 0)
+        answerBuffered(fd, *conn);
+}
+
+void HttpServer::answerBuffered(socket_t fd, Connection& conn) {
+    for (;;) {
+        size_t answered = 0;
+        while (!conn.closing && answered < m_options.max_pipelined) {
+            size_t          consumed = 0;
+            HttpParseResult result   = conn.parser.parse(conn.in.data(), conn.in.size(), m_request, consumed);
+            if (result == HttpParseResult::INCOMPLETE)
+                break;
+            if (result != HttpParseResult::COMPLETE) {
+                appendError(conn, result == HttpParseResult::INVALID            ? 400
+                                  : result == HttpParseResult::HEADER_TOO_LARGE ? 431
+                                                                                : 413);
+                break;
+            }
+
+            m_requests.add();
+            m_response.clear();
+            try {
+                m_handler(m_request, m_response);
+            } catch (const std::exception&) {
+                appendError(conn, 500);
+                break;
+            }
+
+            if (!m_request.keep_alive || m_response.close)
+                conn.closing = true;
+            bool head = m_request.method.size == 4 && std::memcmp(m_request.method.data, "HEAD", 4) == 0;
+            appendResponse(conn, m_response, m_request.version_minor, head);
+            conn.in.consume(consumed);
+            answered++;
+        }
+
+        // more complete requests than one write takes are answered once it went out, a blocked write resumes them
+        // from onConnection()
+        if (!flush(fd, conn) || answered < m_options.max_pipelined)
+            return;
+    }
+}
+
+void HttpServer::appendResponse(Connection& conn, const HttpResponse& response, int version_minor, bool head) {
+    const FrameView body = response.static_body.data != nullptr ? response.static_body
+                                                                : FrameView{response.body.data(), response.body.size()};
+    // no length for responses that never carry a body
+    bool bodyless = response.status < 200 || response.status == 204 || response.status == 304;
+
+    size_t start = conn.out.size();
+    conn.out += "HTTP/1.1 ";
+    appendNumber(conn.out, static_cast<uint64_t>(response.status));
+    conn.out += ' ';
+    conn.out += reasonPhrase(response.status);
+    if (!bodyless) {
+        conn.out += "\r\nContent-Type: ";
+        conn.out += response.content_type;
+        conn.out += "\r\nContent-Length: ";
+        appendNumber(conn.out, body.size);
+    }
+    if (conn.closing)
+        conn.out += "\r\nConnection: close";
+    else if (version_minor == 0)
+        conn.out += "\r\nConnection: keep-alive";
+    conn.out += "\r\n\r\n";
+
+    if (bodyless || head || body.size == 0) {
+        appendOutput(conn, nullptr, start, conn.out.size() - start);
+    } else if (response.static_body.data != nullptr) {
+        appendOutput(conn, nullptr, start, conn.out.size() - start);
+        appendOutput(conn, body.data, 0, body.size);
+    } else {
+        conn.out.append(body.data, body.size);
+        appendOutput(conn, nullptr, start, conn.out.size() - start);
+    }
+}
+
+void HttpServer::appendError(Connection& conn, int status) {
+    m_errors.add();
+    m_response.clear();
+    m_response.status = status;
+    m_response.body   = reasonPhrase(status);
+    conn.closing      = true;
+    appendResponse(conn, m_response, 1, false);
+}
+
+// ranges of out that follow each other are merged, so pipelined responses without static bodies are a single slice
+void HttpServer::appendOutput(Connection& conn, const char* data, size_t offset, size_t size) {
+    conn.pending_size += size;
+    if (data == nullptr && !conn.pending.empty()) {
+        Output& last = conn.pending.back();
+        if (last.data == nullptr && last.offset + last.size == offset) {
+            last.size += size;
+            return;
+        }
+    }
+    conn.pending.push_back({data, offset, size});
+}
+
+bool HttpServer::flush(socket_t fd, Connection& conn) {
+    if (conn.pending_sent < conn.pending_size) {
+        m_slices.clear();
+        size_t skip = conn.pending_sent;
+        for (const Output& output : conn.pending) {
+            if (skip >= output.size) {
+                skip -= output.size;
+                continue;
+            }
+            const char* base = output.data != nullptr ? output.data : conn.out.data() + output.offset;
+            m_slices.push_back({base + skip, output.size - skip});
+            skip = 0;
+        }
+
+        socket_size_t sent;
+        try {
+            sent = conn.socket.trySendv(m_slices.data(), m_slices.size());
+        } catch (const std::runtime_error&) {
+            close(fd);
+            return false;
+        }
+        m_writes.add();
+        if (sent > 0)
+            conn.pending_sent += static_cast<size_t>(sent);
+
+        if (conn.pending_sent < conn.pending_size) {
+            if (!conn.writing) {
+                conn.writing = true;
+                m_loop.modify(fd, PollEvent::WRITE);
+            }
+            return false;
+        }
+    }
+
+    conn.pending.clear();
+    conn.out.clear();
+    conn.pending_size = 0;
+    conn.pending_sent = 0;
+    if (conn.closing) {
+        close(fd);
+        return false;
+    }
+    return true;
+}
+
+void HttpServer::close(socket_t fd) {
+    m_loop.remove(fd);
+    m_connections.erase(fd);
+}
@@ -0,0 +1,258 @@
+#include "event_loop.hpp"
+
+#include <algorithm>
+#include <exception>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+EventLoop::EventLoop(int max_events, PollBackend backend) : m_poll(max_events, backend) {}
+
+EventLoop::~EventLoop() {
+    LoopTask* pending[] = {m_batch, m_posted.exchange(nullptr, std::memory_order_acquire)};
+    for (LoopTask* task : pending) {
+        while (task != nullptr) {
+            LoopTask* next = task->next;
+            if (task->drop != nullptr)
+                task->drop(task);
+            task = next;
+        }
+    }
+}
+
+void EventLoop::add(socket_t fd, PollEvent events, EventHandler handler) {
+    if (fd == INVALID_SOCKET_FD || !handler)
+        throw std::invalid_argument("event loop needs a valid fd and handler");
+
+    size_t index = socketSlot(fd);
+    if (index >= m_slots.size())
+        m_slots.resize(index + 1);
+    Slot& slot = m_slots[index];
+    if (slot.handler)
+        throw std::runtime_error("fd already has a handler");
+
+    m_poll.addFd(fd, events, slot.generation + 1);
+    slot.handler = handler;
+    slot.generation++;
+    m_size++;
+}
+
+void EventLoop::modify(socket_t fd, PollEvent events) {
+    size_t index = socketSlot(fd);
+    if (index >= m_slots.size() || !m_slots[index].handler)
+        throw std::runtime_error("fd has no handler");
+    m_poll.modifyFd(fd, events, m_slots[index].generation);
+}
+
+void EventLoop::remove(socket_t fd) {
+    size_t index = socketSlot(fd);
+    if (index >= m_slots.size() || !m_slots[index].handler)
+        return;
+
+    m_poll.removeFd(fd);
+    m_slots[index].handler = EventHandler{};
+    m_slots[index].generation++;
+    m_size--;
+}
+
+size_t EventLoop::runOnce(int timeout_ms) {
+    // leftovers of a batch a task threw out of have no wakeup pending for them
+    m_poll.wait(m_batch != nullptr ? 0 : timeout_ms);
+
+    size_t dispatched = 0;
+    for (const auto& event : m_poll.events()) {
+        size_t index = socketSlot(event.fd);
+        if (index >= m_slots.size() || m_slots[index].generation != event.tag || !m_slots[index].handler)
+            continue;
+        // copied, the handler may remove itself or grow the table
+        EventHandler handler = m_slots[index].handler;
+        m_poll.recordDispatch();
+        handler.fn(handler.context, event.fd, event.events);
+        dispatched++;
+    }
+    m_dispatched.add(dispatched);
+
+    runPosted();
+    flushOutputs();
+    return dispatched;
+}
+
+void EventLoop::run() {
+    m_stopped = false;
+    while (!m_stopped)
+        runOnce();
+}
+
+void EventLoop::post(LoopTask* task) {
+    LoopTask* head = m_posted.load(std::memory_order_relaxed);
+    do {
+        task->next = head;
+    } while (!m_posted.compare_exchange_weak(head, task, std::memory_order_acq_rel, std::memory_order_relaxed));
+
+    // the loop takes the whole stack, so only the first post after that has to wake it. acquiring the empty stack
+    // orders this after the loop cleared its wakeup flag, so the wakeup is never swallowed
+    if (head == nullptr)
+        m_poll.wakeup();
+}
+
+void EventLoop::post(std::function<void()> task) {
+    struct FunctionTask : LoopTask {
+        std::function<void()> fn;
+    };
+
+    auto* node = new FunctionTask;
+    node->fn   = std::move(task);
+    node->run  = [](LoopTask* self) {
+        std::unique_ptr<FunctionTask> owned(static_cast<FunctionTask*>(self));
+        owned->fn();
+    };
+    node->drop = [](LoopTask* self) { delete static_cast<FunctionTask*>(self); };
+    post(node);
+}
+
+LoopStats EventLoop::stats() const {
+    LoopStats stats;
+    stats.dispatched = m_dispatched.load();
+    stats.tasks      = m_tasks.load();
+    stats.batches    = m_batches.load();
+    stats.flushes    = m_flushes.load();
+    stats.gathered   = m_gathered.load();
+    return stats;
+}
+
+void EventLoop::runPosted() {
+    if (m_batch == nullptr) {
+        LoopTask* stack = m_posted.exchange(nullptr, std::memory_order_acq_rel);
+        if (stack == nullptr)
+            return;
+
+        // newest first on the stack, reversed into posting order
+        while (stack != nullptr) {
+            LoopTask* next = stack->next;
+            stack->next    = m_batch;
+            m_batch        = stack;
+            stack          = next;
+        }
+        m_batches.add();
+    }
+
+    // tasks posted while these run go to the next iteration and wake it
+    while (m_batch != nullptr) {
+        LoopTask* task = m_batch;
+        m_batch        = task->next;
+        m_tasks.add();
+        task->run(task);
+    }
+}
+
+void EventLoop::flushOutputs() {
+    // sending schedules nothing, the list stays as it is meanwhile
+    for (LoopOutput* output : m_outputs)
+        output->finishIteration();
+    m_outputs.clear();
+}
+
+LoopOutput::LoopOutput(EventLoop& loop, Socket& socket, OutputMode mode)
+    : m_loop(&loop), m_socket(&socket), m_mode(mode) {}
+
+LoopOutput::~LoopOutput() {
+    if (m_scheduled) {
+        auto& outputs = m_loop->m_outputs;
+        outputs.erase(std::find(outputs.begin(), outputs.end(), this));
+    }
+    if (m_corked) {
+        try {
+            m_socket->setCork(false);
+        } catch (const std::exception&) {
+            // the socket is closed already
+        }
+    }
+}
+
+void LoopOutput::setMode(OutputMode mode) {
+    if (mode == OutputMode::DIRECT && !m_blocked)
+        flush();
+    m_mode = mode;
+}
+
+void LoopOutput::write(const void* data, size_t size) {
+    if (size == 0)
+        return;
+    switch (m_mode) {
+        case OutputMode::DIRECT:
+            sendDirect(data, size);
+            return;
+        case OutputMode::GATHER: {
+            const char* bytes = static_cast<const char*>(data);
+            m_pending.insert(m_pending.end(), bytes, bytes + size);
+            break;
+        }
+        case OutputMode::CORK:
+            if (!m_corked) {
+                m_socket->setCork(true);
+                m_corked = true;
+            }
+            sendDirect(data, size);
+            break;
+    }
+    m_writes++;
+    schedule();
+}
+
+socket_size_t LoopOutput::flush() {
+    if (m_pending.empty())
+        return 0;
+    socket_size_t sent = m_socket->trySend(m_pending.data(), m_pending.size());
+    if (sent < 0) {
+        m_blocked = true;
+        return -1;
+    }
+    m_pending.erase(m_pending.begin(), m_pending.begin() + sent);
+    m_blocked = !m_pending.empty();
+    return sent;
+}
+
+void LoopOutput::schedule() {
+    if (m_scheduled)
+        return;
+    m_scheduled = true;
+    m_loop->m_outputs.push_back(this);
+}
+
+void LoopOutput::sendDirect(const void* data, size_t size) {
+    const char* bytes = static_cast<const char*>(data);
+    // behind what is pending, or the bytes would overtake it
+    if (!m_pending.empty()) {
+        m_pending.insert(m_pending.end(), bytes, bytes + size);
+        if (!m_blocked)
+            flush();
+        return;
+    }
+    socket_size_t sent  = m_socket->trySend(data, size);
+    size_t        taken = sent < 0 ? 0 : static_cast<size_t>(sent);
+    if (taken < size) {
+        m_pending.insert(m_pending.end(), bytes + taken, bytes + size);
+        m_blocked = true;
+    }
+}
+
+void LoopOutput::finishIteration() {
+    m_scheduled = false;
+    if (m_writes > 0) {
+        m_loop->m_flushes.add();
+        m_loop->m_gathered.add(m_writes);
+        m_writes = 0;
+    }
+    try {
+        if (!m_blocked)
+            flush();
+        if (m_corked) {
+            m_corked = false;
+            m_socket->setCork(false);
+        }
+    } catch (const std::exception&) {
+        m_pending.clear();
+        m_blocked = false;
+        m_failed  = true;
+    }
+}
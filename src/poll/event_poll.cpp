@@ -0,0 +1,312 @@
+#include "event_poll.hpp"
+
+#include "poll_backend.hpp"
+#include "trace.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+namespace {
+
+// the backends SOCKETPOLL_BACKEND may name, MEMORY cannot watch real sockets
+constexpr PollBackend ALL_BACKENDS[] = {PollBackend::EPOLL, PollBackend::IO_URING, PollBackend::KQUEUE,
+                                        PollBackend::WSAPOLL};
+
+PollBackend platformBackend() {
+#if defined(__linux__)
+    return PollBackend::EPOLL;
+#elif defined(__APPLE__) || defined(__FreeBSD__)
+    return PollBackend::KQUEUE;
+#else
+    return PollBackend::WSAPOLL;
+#endif
+}
+
+std::unique_ptr<PollBackendImpl> makeBackend(PollBackend backend, int max_events, PollCounters& stats,
+                                             std::atomic<bool>& wakeup_pending) {
+    switch (backend) {
+#ifdef __linux__
+        case PollBackend::EPOLL:
+            return makeEpollBackend(max_events, stats, wakeup_pending);
+#endif
+#ifdef SOCKETPOLL_HAVE_IO_URING
+        case PollBackend::IO_URING:
+            return makeUringBackend(max_events, stats, wakeup_pending);
+#endif
+#if defined(__APPLE__) || defined(__FreeBSD__)
+        case PollBackend::KQUEUE:
+            return makeKqueueBackend(max_events, stats, wakeup_pending);
+#endif
+#ifdef _WIN32
+        case PollBackend::WSAPOLL:
+            return makeWsaPollBackend(max_events, stats, wakeup_pending);
+#endif
+        case PollBackend::MEMORY:
+            return makeMemoryBackend(max_events, stats, wakeup_pending);
+        default:
+            throw std::invalid_argument(std::string("poll backend ") + pollBackendName(backend) +
+                                        " is not compiled in");
+    }
+}
+
+// SOCKETPOLL_BACKEND, AUTO when unset or naming no backend this library knows
+PollBackend environmentBackend() {
+    const char* name = std::getenv("SOCKETPOLL_BACKEND");
+    if (name == nullptr || *name == '\0')
+        return PollBackend::AUTO;
+    if (std::strcmp(name, pollBackendName(PollBackend::AUTO)) == 0)
+        return PollBackend::AUTO;
+    for (PollBackend backend : ALL_BACKENDS) {
+        if (std::strcmp(name, pollBackendName(backend)) == 0)
+            return backend;
+    }
+    return PollBackend::AUTO;
+}
+
+} // namespace
+
+const char* pollBackendName(PollBackend backend) {
+    switch (backend) {
+        case PollBackend::AUTO:
+            return "auto";
+        case PollBackend::EPOLL:
+            return "epoll";
+        case PollBackend::IO_URING:
+            return "io_uring";
+        case PollBackend::KQUEUE:
+            return "kqueue";
+        case PollBackend::WSAPOLL:
+            return "wsapoll";
+        case PollBackend::MEMORY:
+            return "memory";
+    }
+    return "unknown";
+}
+
+bool pollBackendAvailable(PollBackend backend) {
+    if (backend == PollBackend::AUTO)
+        return true;
+    // probed on a thread of its own, closing an io_uring would otherwise cut short the caller's next blocking wait
+    bool available = false;
+    std::thread([&]() {
+        try {
+            PollCounters      stats;
+            std::atomic<bool> wakeup_pending{false};
+            makeBackend(backend, 1, stats, wakeup_pending);
+            available = true;
+        } catch (const std::exception&) {
+        }
+    }).join();
+    return available;
+}
+
+EventPoll::EventPoll(int max_events, PollBackend backend) : m_max_events(max_events), m_backend_kind(backend) {
+    if (backend == PollBackend::AUTO) {
+        // an environment asking for a backend this build or kernel lacks gets the default rather than no poll at all
+        PollBackend wanted = environmentBackend();
+        if (wanted != PollBackend::AUTO) {
+            try {
+                m_backend      = makeBackend(wanted, max_events, m_stats, m_wakeup_pending);
+                m_backend_kind = wanted;
+            } catch (const std::exception&) {
+                m_backend.reset();
+            }
+        }
+        if (!m_backend) {
+            m_backend_kind = platformBackend();
+            m_backend      = makeBackend(m_backend_kind, max_events, m_stats, m_wakeup_pending);
+        }
+    } else {
+        m_backend = makeBackend(backend, max_events, m_stats, m_wakeup_pending);
+    }
+    m_events.reserve(static_cast<size_t>(max_events));
+}
+
+EventPoll::~EventPoll() = default;
+
+void EventPoll::wait(int timeout_ms) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        applyPending();
+        m_backend->prepare();
+    }
+    m_events.clear();
+
+    SOCKETPOLL_TRACE(TraceType::WAIT_ENTER, -1, timeout_ms, 0);
+    uint64_t start = monotonicNs();
+    int      n     = m_backend->wait(timeout_ms);
+    if (n < 0) {
+        recordInterrupt(start);
+        SOCKETPOLL_TRACE(TraceType::WAIT_EXIT, -1, -1, 0);
+        return;
+    }
+    recordWait(n, start);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_backend->collect(n, m_events);
+    }
+    SOCKETPOLL_TRACE(TraceType::WAIT_EXIT, -1, m_events.size(), 0);
+}
+
+void EventPoll::wakeup() {
+    if (m_wakeup_pending.exchange(true))
+        return;
+    SOCKETPOLL_TRACE(TraceType::WAKEUP, -1, 0, 0);
+    m_backend->wakeup();
+}
+
+void EventPoll::addFd(socket_t fd, PollEvent event, uint32_t tag) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    applyPending();
+    Interest& interest  = interestFor(fd);
+    interest.registered = false;
+    m_backend->add(fd, event, tag);
+    interest.events     = event;
+    interest.tag        = tag;
+    interest.registered = true;
+}
+
+void EventPoll::modifyFd(socket_t fd, PollEvent event, uint32_t tag) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    applyPending();
+    Interest& interest = interestFor(fd);
+    if (interest.registered && interest.events == event && interest.tag == tag) {
+        m_stats.recordCtlSaved();
+        return;
+    }
+    // an unknown fd still goes to the kernel, the caller may have registered it before a failed call and the error
+    // should come from there otherwise
+    bool known          = interest.registered;
+    interest.registered = false;
+    replace(fd, known ? interest.events : PollEvent::NONE, event, tag);
+    interest.events     = event;
+    interest.tag        = tag;
+    interest.registered = true;
+}
+
+void EventPoll::removeFd(socket_t fd) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    applyPending();
+    interestFor(fd).registered = false;
+    m_backend->remove(fd);
+}
+
+void EventPoll::queueAdd(socket_t fd, PollEvent event, uint32_t tag) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    bool           registered = interestFor(fd).registered;
+    PendingChange& change     = pendingFor(fd);
+    // adding twice means the fd was closed without a remove, drop whatever is left of the old one
+    change.reset      = change.reset || registered || change.registered;
+    change.added      = true;
+    change.registered = true;
+    change.events     = event;
+    change.tag        = tag;
+}
+
+void EventPoll::queueModify(socket_t fd, PollEvent event, uint32_t tag) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    PendingChange& change = pendingFor(fd);
+    change.registered     = true;
+    change.events         = event;
+    change.tag            = tag;
+}
+
+void EventPoll::queueRemove(socket_t fd) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    PendingChange& change = pendingFor(fd);
+    change.registered     = false;
+    change.added          = false;
+}
+
+void EventPoll::commitPending() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    applyPending();
+}
+
+void EventPoll::applyPending() {
+    if (m_pending.empty())
+        return;
+
+    // one failed change does not hold back the others, the first error is passed on once all of them were tried
+    std::exception_ptr error;
+    for (const PendingChange& change : m_pending) {
+        m_interest[socketSlot(change.fd)].pending = NO_PENDING;
+        try {
+            apply(change);
+        } catch (...) {
+            if (!error)
+                error = std::current_exception();
+        }
+    }
+    m_pending.clear();
+    if (error)
+        std::rethrow_exception(error);
+}
+
+EventPoll::Interest& EventPoll::interestFor(socket_t fd) {
+    size_t index = socketSlot(fd);
+    if (index >= m_interest.size())
+        m_interest.resize(index + 1);
+    return m_interest[index];
+}
+
+EventPoll::PendingChange& EventPoll::pendingFor(socket_t fd) {
+    Interest& interest = interestFor(fd);
+    if (interest.pending == NO_PENDING) {
+        interest.pending = static_cast<uint32_t>(m_pending.size());
+        m_pending.push_back({fd, interest.events, interest.registered, false, false, interest.tag, 0});
+    }
+    PendingChange& change = m_pending[interest.pending];
+    change.calls++;
+    return change;
+}
+
+void EventPoll::apply(const PendingChange& change) {
+    Interest& interest = m_interest[socketSlot(change.fd)];
+    uint32_t  calls    = 0;
+
+    // the bookkeeping happens before each call, a failed one leaves the fd unknown and never elided
+    if (change.reset && interest.registered) {
+        interest.registered = false;
+        calls++;
+        m_backend->remove(change.fd);
+    }
+
+    if (!change.registered) {
+        if (interest.registered) {
+            interest.registered = false;
+            calls++;
+            m_backend->remove(change.fd);
+        }
+    } else if (change.added && !interest.registered) {
+        calls++;
+        m_backend->add(change.fd, change.events, change.tag);
+    } else if (!interest.registered || interest.events != change.events || interest.tag != change.tag) {
+        PollEvent previous  = interest.registered ? interest.events : PollEvent::NONE;
+        interest.registered = false;
+        calls += replace(change.fd, previous, change.events, change.tag);
+    }
+
+    if (change.registered) {
+        interest.events     = change.events;
+        interest.tag        = change.tag;
+        interest.registered = true;
+    }
+    m_stats.recordCtlSaved(change.calls - calls);
+}
+
+// exclusive wakeups are fixed when the fd is added (EPOLLEXCLUSIVE is only accepted by EPOLL_CTL_ADD), so changes to or
+// from such a registration remove and add the fd again. returns the number of calls made
+uint32_t EventPoll::replace(socket_t fd, PollEvent previous, PollEvent event, uint32_t tag) {
+    if (((previous | event) & PollEvent::EXCLUSIVE) == 0) {
+        m_backend->modify(fd, event, tag);
+        return 1;
+    }
+    m_backend->remove(fd);
+    m_backend->add(fd, event, tag);
+    return 2;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "event_poll.hpp"
+#include "trace.hpp"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+// the kernel side of an EventPoll. backends record their own ctl stats and count the wakeups they take out of the
+// event stream, the front end does the rest. every call but wait() and wakeup() comes with the front end's mutex held,
+// the registration calls possibly from another thread than the one waiting
+class PollBackendImpl {
+  public:
+    using Entry = EventPoll::PollEventEntry;
+
+    PollBackendImpl(PollCounters& stats, std::atomic<bool>& wakeup_pending)
+        : m_stats(stats), m_wakeup_pending(wakeup_pending) {}
+    virtual ~PollBackendImpl() = default;
+
+    PollBackendImpl(const PollBackendImpl&)            = delete;
+    PollBackendImpl& operator=(const PollBackendImpl&) = delete;
+
+    // add and modify throw when the kernel refuses, remove only counts the error
+    virtual void add(socket_t fd, PollEvent event, uint32_t tag)    = 0;
+    virtual void modify(socket_t fd, PollEvent event, uint32_t tag) = 0;
+    virtual void remove(socket_t fd)                                = 0;
+
+    // right before wait(), takes what it needs of the registrations while they cannot change
+    virtual void prepare() {}
+    // blocks for up to timeout_ms and returns how many kernel events there are to collect, -1 when a signal
+    // interrupted the wait
+    virtual int wait(int timeout_ms) = 0;
+    // decodes the events of the last wait() into out
+    virtual void collect(int count, std::vector<Entry>& out) = 0;
+    // called once per pending wakeup, EventPoll coalesces the rest
+    virtual void wakeup() = 0;
+
+  protected:
+    PollCounters&      m_stats;
+    std::atomic<bool>& m_wakeup_pending;
+
+    // counts a registration call and traces it, error is 0 or the errno it failed with
+    void recordCtl(CtlOp op, socket_t fd, PollEvent event, int error) {
+        m_stats.recordCtl(op, error == 0);
+        SOCKETPOLL_TRACE(op == CtlOp::ADD   ? TraceType::CTL_ADD
+                         : op == CtlOp::MOD ? TraceType::CTL_MOD
+                                            : TraceType::CTL_DEL,
+                         fd, error, event);
+    }
+};
+
+std::unique_ptr<PollBackendImpl> makeMemoryBackend(int max_events, PollCounters& stats,
+                                                   std::atomic<bool>& wakeup_pending);
+#ifdef __linux__
+std::unique_ptr<PollBackendImpl> makeEpollBackend(int max_events, PollCounters& stats,
+                                                  std::atomic<bool>& wakeup_pending);
+#endif
+#ifdef SOCKETPOLL_HAVE_IO_URING
+std::unique_ptr<PollBackendImpl> makeUringBackend(int max_events, PollCounters& stats,
+                                                  std::atomic<bool>& wakeup_pending);
+#endif
+#if defined(__APPLE__) || defined(__FreeBSD__)
+std::unique_ptr<PollBackendImpl> makeKqueueBackend(int max_events, PollCounters& stats,
+                                                   std::atomic<bool>& wakeup_pending);
+#endif
+#ifdef _WIN32
+std::unique_ptr<PollBackendImpl> makeWsaPollBackend(int max_events, PollCounters& stats,
+                                                    std::atomic<bool>& wakeup_pending);
+#endif
@@ -1,108 +1,75 @@
 #ifdef __linux__
 
-#include "event_poll.hpp"
+#include "basic_event_poll.hpp"
+#include "poll_backend.hpp"
 
 #include <cstring>
-#include <fcntl.h>
-#include <mutex>
 #include <stdexcept>
-#include <sys/epoll.h>
-#include <sys/eventfd.h>
-#include <unistd.h>
 
-struct EventPoll::Impl {
-    socket_t                        epoll_fd;
-    std::vector<struct epoll_event> kernel_events{};
-    std::vector<PollEventEntry>     active_events{};
-    std::mutex                      mutex{};
+namespace {
 
-    Impl(int max_events) : epoll_fd(epoll_create1(0)) {
-        if (epoll_fd == INVALID_SOCKET_FD)
-            throw std::runtime_error(strerror(errno));
+// the kernel calls and the event decoding are shared with the header-only BasicEventPoll
+class EpollBackend final : public PollBackendImpl {
+  public:
+    EpollBackend(int max_events, PollCounters& stats, std::atomic<bool>& wakeup_pending)
+        : PollBackendImpl(stats, wakeup_pending), m_native(max_events) {}
 
-        kernel_events.resize(max_events);
+    void add(socket_t fd, PollEvent event, uint32_t tag) override {
+        int error = m_native.add(fd, event, tag) ? 0 : errno;
+        recordCtl(CtlOp::ADD, fd, event, error);
+        if (error != 0)
+            throw std::runtime_error(strerror(error));
     }
 
-    ~Impl() {
-        if (epoll_fd != INVALID_SOCKET_FD)
-            close(epoll_fd);
+    void modify(socket_t fd, PollEvent event, uint32_t tag) override {
+        int error = m_native.modify(fd, event, tag) ? 0 : errno;
+        recordCtl(CtlOp::MOD, fd, event, error);
+        if (error != 0)
+            throw std::runtime_error(strerror(error));
     }
 
-    static uint32_t toNative(PollEvent event) {
-        uint32_t native = 0;
-        if (event & PollEvent::READ)
-            native |= EPOLLIN;
-        if (event & PollEvent::WRITE)
-            native |= EPOLLOUT;
-        if (event & PollEvent::ERR)
-            native |= (EPOLLERR | EPOLLHUP);
-        return native;
+    void remove(socket_t fd) override {
+        recordCtl(CtlOp::DEL, fd, PollEvent::NONE, m_native.remove(fd) ? 0 : errno);
     }
 
-    static PollEvent fromNative(uint32_t native) {
-        uint8_t res = PollEvent::NONE;
-        if (native & EPOLLIN)
-            res |= PollEvent::READ;
-        if (native & EPOLLOUT)
-            res |= PollEvent::WRITE;
-        if (native & (EPOLLERR | EPOLLHUP))
-            res |= PollEvent::ERR;
-        return static_cast<PollEvent>(res);
+    int wait(int timeout_ms) override {
+        int n = m_native.wait(timeout_ms);
+        if (n == -1) {
+            if (errno == EINTR)
+                return -1;
+            throw std::runtime_error(strerror(errno));
+        }
+        return n;
     }
-};
-
-EventPoll::EventPoll(int max_events) : m_pimpl(std::make_unique<Impl>(max_events)), m_max_events(max_events) {}
-EventPoll::~EventPoll() = default;
-
-void EventPoll::addFd(socket_t fd, PollEvent event) {
-    std::unique_lock<std::mutex> lock(m_pimpl->mutex);
-
-    struct epoll_event ev{};
-
-    ev.events  = Impl::toNative(event);
-    ev.data.fd = fd;
-
-    if (epoll_ctl(m_pimpl->epoll_fd, EPOLL_CTL_ADD, fd, &ev) == -1)
-        throw std::runtime_error(strerror(errno));
-}
-
-void EventPoll::modifyFd(socket_t fd, PollEvent event) {
-    std::unique_lock<std::mutex> lock(m_pimpl->mutex);
-
-    struct epoll_event ev{};
 
-    ev.events  = Impl::toNative(event);
-    ev.data.fd = fd;
-
-    if (epoll_ctl(m_pimpl->epoll_fd, EPOLL_CTL_MOD, fd, &ev) == -1)
-        throw std::runtime_error(strerror(errno));
-}
-
-void EventPoll::removeFd(socket_t fd) {
-    std::unique_lock<std::mutex> lock(m_pimpl->mutex);
-    epoll_ctl(m_pimpl->epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
-}
-
-void EventPoll::wait(int timeout_ms) {
-    int n = epoll_wait(m_pimpl->epoll_fd, m_pimpl->kernel_events.data(), m_max_events, timeout_ms);
+    void collect(int count, std::vector<Entry>& out) override {
+        for (int i = 0; i < count; i++) {
+            if (m_native.isWakeup(i)) {
+                // clear the flag before draining, a wakeup racing with the drain then signals again
+                m_wakeup_pending.store(false);
+                m_stats.recordWakeup();
+                if (!m_native.drainWakeup())
+                    throw std::runtime_error(strerror(errno));
+                continue;
+            }
+            out.push_back(m_native.entry(i));
+        }
+    }
 
-    if (n == -1) {
-        if (errno == EINTR)
-            return;
-        throw std::runtime_error(strerror(errno));
+    void wakeup() override {
+        if (!m_native.wakeup())
+            throw std::runtime_error(strerror(errno));
     }
 
-    std::unique_lock<std::mutex> lock(m_pimpl->mutex);
+  private:
+    EpollNative m_native;
+};
 
-    m_pimpl->active_events.clear();
-    for (int i = 0; i < n; i++) {
-        m_pimpl->active_events.push_back(
-            {m_pimpl->kernel_events[i].data.fd, Impl::fromNative(m_pimpl->kernel_events[i].events)});
-    }
-}
+} // namespace
 
-const std::vector<EventPoll::PollEventEntry>& EventPoll::events() const {
-    return m_pimpl->active_events;
+std::unique_ptr<PollBackendImpl> makeEpollBackend(int max_events, PollCounters& stats,
+                                                  std::atomic<bool>& wakeup_pending) {
+    return std::make_unique<EpollBackend>(max_events, stats, wakeup_pending);
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,506 @@
+#include "memory_socket.hpp"
+#include "poll_backend.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+// the in-process transport: MemorySocket pairs and the poll backend that watches them. together they stand in for
+// the kernel, so both live here
+
+namespace {
+class MemoryPollBackend;
+} // namespace
+
+// bytes sent to one end, a ring the peer fills and the end drains
+struct MemoryStream {
+    std::vector<char> ring;
+    size_t            head        = 0; // next byte to read
+    size_t            size        = 0;
+    bool              eof         = false; // the sender shut down, nothing follows the buffered bytes
+    bool              reader_gone = false; // the receiver closed or shut down reading, sends fail
+};
+
+// the registration of one end
+struct MemoryWatch {
+    MemoryPollBackend* poll   = nullptr;
+    PollEvent          events = PollEvent::NONE;
+    uint32_t           tag    = 0;
+    uint32_t           epoch  = 0;     // bumped by every add and remove, queue entries of older ones are stale
+    bool               queued = false; // on the ready queue of poll
+};
+
+struct MemoryPair : std::enable_shared_from_this<MemoryPair> {
+    std::mutex   mutex;
+    MemoryStream streams[2]; // streams[side] is what side receives
+    MemoryWatch  watches[2];
+    socket_t     fds[2] = {INVALID_SOCKET_FD, INVALID_SOCKET_FD};
+};
+
+namespace {
+
+struct MemoryEnd {
+    std::shared_ptr<MemoryPair> pair;
+    int                         side = 0;
+};
+
+// the numbers of open memory sockets, allocated like descriptors so per-fd tables stay dense
+struct MemoryFdTable {
+    std::mutex             mutex;
+    std::vector<MemoryEnd> ends;
+    std::vector<size_t>    free;
+};
+
+MemoryFdTable& memoryFds() {
+    // leaked, sockets closed during static destruction still return their numbers
+    static auto* table = new MemoryFdTable();
+    return *table;
+}
+
+socket_t fdAt(size_t index) {
+#ifdef _WIN32
+    return static_cast<socket_t>(index << 2);
+#else
+    return static_cast<socket_t>(index);
+#endif
+}
+
+socket_t openMemoryFd(const std::shared_ptr<MemoryPair>& pair, int side) {
+    MemoryFdTable&              table = memoryFds();
+    std::lock_guard<std::mutex> lock(table.mutex);
+    size_t                      index = table.ends.size();
+    if (!table.free.empty()) {
+        index = table.free.back();
+        table.free.pop_back();
+    } else {
+        table.ends.emplace_back();
+    }
+    table.ends[index] = {pair, side};
+    return fdAt(index);
+}
+
+void closeMemoryFd(socket_t fd) {
+    MemoryFdTable&              table = memoryFds();
+    std::lock_guard<std::mutex> lock(table.mutex);
+    size_t                      index = socketSlot(fd);
+    table.ends[index].pair.reset();
+    table.free.push_back(index);
+}
+
+MemoryEnd lookupMemoryFd(socket_t fd) {
+    MemoryFdTable&              table = memoryFds();
+    std::lock_guard<std::mutex> lock(table.mutex);
+    size_t                      index = socketSlot(fd);
+    return index < table.ends.size() ? table.ends[index] : MemoryEnd{};
+}
+
+size_t pushBytes(MemoryStream& stream, const char* data, size_t size) {
+    size_t capacity = stream.ring.size();
+    size_t n        = std::min(size, capacity - stream.size);
+    size_t tail     = (stream.head + stream.size) % capacity;
+    size_t first    = std::min(n, capacity - tail);
+    std::memcpy(stream.ring.data() + tail, data, first);
+    std::memcpy(stream.ring.data(), data + first, n - first);
+    stream.size += n;
+    return n;
+}
+
+size_t popBytes(MemoryStream& stream, char* out, size_t size) {
+    size_t capacity = stream.ring.size();
+    size_t n        = std::min(size, stream.size);
+    size_t first    = std::min(n, capacity - stream.head);
+    std::memcpy(out, stream.ring.data() + stream.head, first);
+    std::memcpy(out + first, stream.ring.data(), n - first);
+    stream.head = (stream.head + n) % capacity;
+    stream.size -= n;
+    return n;
+}
+
+// with the pair locked: drops the registration of the end, if it is registered with only or with any poll for nullptr
+bool unwatch(MemoryPair& pair, int side, const MemoryPollBackend* only);
+
+// what epoll would report for the end, ERR regardless of the registered events
+PollEvent readiness(const MemoryPair& pair, int side) {
+    const MemoryStream& in    = pair.streams[side];
+    const MemoryStream& out   = pair.streams[1 - side];
+    uint8_t             ready = PollEvent::NONE;
+    if (in.size > 0 || in.eof)
+        ready |= PollEvent::READ;
+    if (out.reader_gone || out.size < out.ring.size())
+        ready |= PollEvent::WRITE;
+    if (in.eof && out.reader_gone)
+        ready |= PollEvent::ERR;
+    const MemoryWatch& watch = pair.watches[side];
+    return static_cast<PollEvent>(ready & (watch.events | PollEvent::ERR));
+}
+
+class MemoryPollBackend final : public PollBackendImpl {
+  public:
+    MemoryPollBackend(int max_events, PollCounters& stats, std::atomic<bool>& wakeup_pending)
+        : PollBackendImpl(stats, wakeup_pending), m_max_events(static_cast<size_t>(max_events)) {}
+
+    ~MemoryPollBackend() override {
+        // ends still registered stop pointing here, like closing an epoll instance
+        std::vector<MemoryEnd> registered;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            registered.swap(m_registered);
+        }
+        for (const MemoryEnd& end : registered) {
+            if (!end.pair)
+                continue;
+            std::lock_guard<std::mutex> lock(end.pair->mutex);
+            MemoryWatch&                watch = end.pair->watches[end.side];
+            if (watch.poll == this)
+                watch = MemoryWatch{nullptr, PollEvent::NONE, 0, watch.epoch + 1, false};
+        }
+    }
+
+    void add(socket_t fd, PollEvent event, uint32_t tag) override {
+        int error = control(fd, event, tag, true);
+        recordCtl(CtlOp::ADD, fd, event, error);
+        if (error != 0)
+            throw std::runtime_error(strerror(error));
+    }
+
+    void modify(socket_t fd, PollEvent event, uint32_t tag) override {
+        int error = control(fd, event, tag, false);
+        recordCtl(CtlOp::MOD, fd, event, error);
+        if (error != 0)
+            throw std::runtime_error(strerror(error));
+    }
+
+    void remove(socket_t fd) override {
+        MemoryEnd end   = lookupMemoryFd(fd);
+        int       error = EBADF;
+        if (end.pair) {
+            std::lock_guard<std::mutex> lock(end.pair->mutex);
+            error = unwatch(*end.pair, end.side, this) ? 0 : ENOENT;
+        }
+        recordCtl(CtlOp::DEL, fd, PollEvent::NONE, error);
+    }
+
+    int wait(int timeout_ms) override {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms > 0 ? timeout_ms : 0);
+        m_out.clear();
+        for (;;) {
+            bool woken;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_scan.swap(m_ready);
+                woken = m_woken;
+            }
+            scan();
+            if (!m_out.empty() || woken || timeout_ms == 0)
+                return static_cast<int>(m_out.size()) + (woken ? 1 : 0);
+
+            if (!sleep(timeout_ms, deadline))
+                return 0;
+        }
+    }
+
+    void collect(int count, std::vector<Entry>& out) override {
+        out.insert(out.end(), m_out.begin(), m_out.end());
+        if (static_cast<size_t>(count) > m_out.size()) {
+            // under the lock, a wakeup after the flag is cleared then always finds m_woken cleared first
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_woken = false;
+            m_wakeup_pending.store(false);
+            m_stats.recordWakeup();
+        }
+    }
+
+    void wakeup() override {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_woken = true;
+        if (m_sleeping)
+            m_cond.notify_one();
+    }
+
+    // called with the pair locked whenever the state of an end registered here changed
+    void enqueue(MemoryPair& pair, int side) {
+        MemoryWatch& watch = pair.watches[side];
+        if (watch.queued)
+            return;
+        watch.queued = true;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_ready.push_back({pair.shared_from_this(), side, watch.epoch});
+        if (m_sleeping)
+            m_cond.notify_one();
+    }
+
+    // called with the pair locked when a registered end is closed or its registration dropped
+    void forget(socket_t fd) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        size_t                      index = socketSlot(fd);
+        if (index < m_registered.size())
+            m_registered[index].pair.reset();
+    }
+
+  private:
+    struct Candidate {
+        std::shared_ptr<MemoryPair> pair;
+        int                         side;
+        uint32_t                    epoch;
+    };
+
+    size_t                  m_max_events;
+    std::mutex              m_mutex;
+    std::condition_variable m_cond;
+    bool                    m_woken    = false;
+    bool                    m_sleeping = false;
+
+    // ends that may be ready. an end stays queued while it is ready, which makes the poll level-triggered, and is
+    // taken off at the first wait() that finds it idle
+    std::vector<Candidate> m_ready;
+    std::vector<Candidate> m_scan;
+    std::vector<Candidate> m_keep;
+    std::vector<Entry>     m_out;
+    std::vector<MemoryEnd> m_registered; // by fd, to unhook them on destruction
+
+    int control(socket_t fd, PollEvent event, uint32_t tag, bool add) {
+        MemoryEnd end = lookupMemoryFd(fd);
+        if (!end.pair)
+            return EBADF;
+        std::lock_guard<std::mutex> lock(end.pair->mutex);
+        MemoryWatch&                watch = end.pair->watches[end.side];
+        if (add && watch.poll != nullptr)
+            return EEXIST;
+        if (!add && watch.poll != this)
+            return ENOENT;
+        if (add) {
+            watch.poll   = this;
+            watch.epoch  = watch.epoch + 1;
+            watch.queued = false;
+            std::lock_guard<std::mutex> registered(m_mutex);
+            size_t                      index = socketSlot(fd);
+            if (index >= m_registered.size())
+                m_registered.resize(index + 1);
+            m_registered[index] = end;
+        }
+        watch.events = event;
+        watch.tag    = tag;
+        // readiness is only looked at by wait(), a new interest may already be satisfied
+        enqueue(*end.pair, end.side);
+        return 0;
+    }
+
+    // until an end was queued or the poll woken, false on timeout
+    bool sleep(int timeout_ms, std::chrono::steady_clock::time_point deadline) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_sleeping    = true;
+        bool signaled = true;
+        if (timeout_ms < 0)
+            m_cond.wait(lock, [this]() { return !m_ready.empty() || m_woken; });
+        else
+            signaled = m_cond.wait_until(lock, deadline, [this]() { return !m_ready.empty() || m_woken; });
+        m_sleeping = false;
+        return signaled;
+    }
+
+    void scan() {
+        m_keep.clear();
+        for (Candidate& candidate : m_scan) {
+            MemoryPair&                 pair = *candidate.pair;
+            std::lock_guard<std::mutex> lock(pair.mutex);
+            MemoryWatch&                watch = pair.watches[candidate.side];
+            if (watch.poll != this || watch.epoch != candidate.epoch)
+                continue;
+            PollEvent ready = readiness(pair, candidate.side);
+            if (ready == PollEvent::NONE) {
+                watch.queued = false;
+                continue;
+            }
+            // ready ends beyond max_events wait for the next call, at the back of the queue so all get their turn
+            if (m_out.size() < m_max_events)
+                m_out.push_back({pair.fds[candidate.side], ready, watch.tag});
+            m_keep.push_back(std::move(candidate));
+        }
+        m_scan.clear();
+        if (m_keep.empty())
+            return;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (Candidate& candidate : m_keep)
+            m_ready.push_back(std::move(candidate));
+    }
+};
+
+bool unwatch(MemoryPair& pair, int side, const MemoryPollBackend* only) {
+    MemoryWatch& watch = pair.watches[side];
+    if (watch.poll == nullptr || (only != nullptr && watch.poll != only))
+        return false;
+    watch.poll->forget(pair.fds[side]);
+    watch = MemoryWatch{nullptr, PollEvent::NONE, 0, watch.epoch + 1, false};
+    return true;
+}
+
+// with the pair locked, after the state of side changed
+void signalEnd(MemoryPair& pair, int side) {
+    MemoryPollBackend* poll = pair.watches[side].poll;
+    if (poll != nullptr)
+        poll->enqueue(pair, side);
+}
+
+} // namespace
+
+std::unique_ptr<PollBackendImpl> makeMemoryBackend(int max_events, PollCounters& stats,
+                                                   std::atomic<bool>& wakeup_pending) {
+    return std::make_unique<MemoryPollBackend>(max_events, stats, wakeup_pending);
+}
+
+std::pair<MemorySocket, MemorySocket> MemorySocket::pair(size_t capacity) {
+    if (capacity == 0)
+        throw std::invalid_argument("memory socket capacity must not be 0");
+    auto pair = std::make_shared<MemoryPair>();
+    for (int side = 0; side < 2; side++) {
+        pair->streams[side].ring.resize(capacity);
+        pair->fds[side] = openMemoryFd(pair, side);
+    }
+    return {MemorySocket(pair, 0, pair->fds[0]), MemorySocket(pair, 1, pair->fds[1])};
+}
+
+MemorySocket::MemorySocket() = default;
+
+MemorySocket::MemorySocket(std::shared_ptr<MemoryPair> pair, int side, socket_t fd)
+    : m_pair(std::move(pair)), m_side(side), m_fd(fd) {}
+
+MemorySocket::~MemorySocket() {
+    close();
+}
+
+MemorySocket::MemorySocket(MemorySocket&& other) noexcept
+    : m_pair(std::move(other.m_pair)), m_side(other.m_side), m_fd(other.m_fd), m_stats(other.m_stats) {
+    other.m_fd = INVALID_SOCKET_FD;
+    other.m_stats.reset();
+}
+
+MemorySocket& MemorySocket::operator=(MemorySocket&& other) noexcept {
+    if (this != &other) {
+        close();
+        m_pair     = std::move(other.m_pair);
+        m_side     = other.m_side;
+        m_fd       = other.m_fd;
+        m_stats    = other.m_stats;
+        other.m_fd = INVALID_SOCKET_FD;
+        other.m_stats.reset();
+    }
+    return *this;
+}
+
+void MemorySocket::close() {
+    if (!m_pair)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(m_pair->mutex);
+        MemoryStream&               in = m_pair->streams[m_side];
+        in.reader_gone                 = true;
+        in.size                        = 0;
+        m_pair->streams[1 - m_side].eof = true;
+        unwatch(*m_pair, m_side, nullptr);
+        signalEnd(*m_pair, 1 - m_side);
+    }
+    closeMemoryFd(m_fd);
+    m_pair.reset();
+    m_fd = INVALID_SOCKET_FD;
+}
+
+bool MemorySocket::valid() const {
+    return m_pair != nullptr;
+}
+
+socket_t MemorySocket::fd() const {
+    return m_fd;
+}
+
+void MemorySocket::shutdown(ShutdownMode how) {
+    if (!m_pair)
+        throw std::runtime_error("shutdown on invalid socket");
+    std::lock_guard<std::mutex> lock(m_pair->mutex);
+    if (how != ShutdownMode::WRITE) {
+        MemoryStream& in = m_pair->streams[m_side];
+        in.reader_gone   = true;
+        in.eof           = true;
+        in.size          = 0;
+    }
+    if (how != ShutdownMode::READ)
+        m_pair->streams[1 - m_side].eof = true;
+    signalEnd(*m_pair, m_side);
+    signalEnd(*m_pair, 1 - m_side);
+}
+
+socket_size_t MemorySocket::tryRecv(void* buffer, size_t size) {
+    if (!m_pair)
+        throw std::runtime_error("recv on invalid socket");
+
+    std::lock_guard<std::mutex> lock(m_pair->mutex);
+    MemoryStream&               in = m_pair->streams[m_side];
+    if (in.size == 0 && !in.eof) {
+        m_stats.recordRecv(-1, true);
+        return -1;
+    }
+    auto bytes = static_cast<socket_size_t>(popBytes(in, static_cast<char*>(buffer), size));
+    m_stats.recordRecv(bytes, false);
+    if (bytes > 0)
+        signalEnd(*m_pair, 1 - m_side);
+    return bytes;
+}
+
+socket_size_t MemorySocket::recv(void* buffer, size_t size) {
+    socket_size_t bytes = tryRecv(buffer, size);
+    return bytes < 0 ? 0 : bytes;
+}
+
+socket_size_t MemorySocket::recv(std::string& out, size_t max_size) {
+    std::vector<char> buffer(max_size);
+    socket_size_t     bytes = recv(buffer.data(), buffer.size());
+    if (bytes > 0)
+        out.assign(buffer.data(), static_cast<size_t>(bytes));
+    return bytes;
+}
+
+socket_size_t MemorySocket::trySend(const void* data, size_t size) {
+    IoSlice slice{data, size};
+    return trySendv(&slice, 1);
+}
+
+socket_size_t MemorySocket::send(const void* data, size_t size) {
+    socket_size_t sent = trySend(data, size);
+    return sent < 0 ? 0 : sent;
+}
+
+socket_size_t MemorySocket::send(const std::string& data) {
+    return send(data.data(), data.size());
+}
+
+socket_size_t MemorySocket::trySendv(const IoSlice* slices, size_t count) {
+    if (!m_pair)
+        throw std::runtime_error("send on invalid socket");
+
+    std::lock_guard<std::mutex> lock(m_pair->mutex);
+    MemoryStream&               out = m_pair->streams[1 - m_side];
+    if (out.reader_gone || out.eof) {
+        m_stats.recordSend(-1, false);
+        throw std::runtime_error("send failed: " + std::string(strerror(EPIPE)));
+    }
+    size_t sent = 0;
+    for (size_t i = 0; i < count && out.size < out.ring.size(); i++)
+        sent += pushBytes(out, static_cast<const char*>(slices[i].data), slices[i].size);
+    if (sent == 0 && out.size == out.ring.size()) {
+        m_stats.recordSend(-1, true);
+        return -1;
+    }
+    m_stats.recordSend(static_cast<int64_t>(sent), false);
+    if (sent > 0)
+        signalEnd(*m_pair, 1 - m_side);
+    return static_cast<socket_size_t>(sent);
+}
+
+socket_size_t MemorySocket::sendv(const IoSlice* slices, size_t count) {
+    socket_size_t sent = trySendv(slices, count);
+    return sent < 0 ? 0 : sent;
+}
@@ -0,0 +1,377 @@
+#ifdef SOCKETPOLL_HAVE_IO_URING
+
+#include "poll_backend.hpp"
+
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <stdexcept>
+#include <string>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+int uringSetup(unsigned entries, io_uring_params* params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+int uringEnter(int ring_fd, unsigned submit, unsigned wait_nr, unsigned flags, const void* arg, size_t arg_size) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, ring_fd, submit, wait_nr, flags, arg, arg_size));
+}
+
+// every registration is a one-shot IORING_OP_POLL_ADD that is armed again once its completion was collected, so a
+// still ready fd completes again right after it is resubmitted with the next wait(), the same level-triggered
+// behaviour as epoll. registration changes and the resubmissions are queued and go to the kernel together with the
+// wait, in one io_uring_enter() call. changes made from another thread while a wait blocks are submitted right away
+class UringBackend final : public PollBackendImpl {
+  public:
+    UringBackend(int max_events, PollCounters& stats, std::atomic<bool>& wakeup_pending)
+        : PollBackendImpl(stats, wakeup_pending), m_max_events(static_cast<unsigned>(max_events)) {
+        // every fd has at most one poll request in flight, a large completion queue keeps bursts from overflowing
+        io_uring_params params{};
+        params.flags      = IORING_SETUP_CQSIZE | IORING_SETUP_COOP_TASKRUN;
+        params.cq_entries = CQ_ENTRIES;
+        m_ring_fd         = uringSetup(SQ_ENTRIES, &params);
+        if (m_ring_fd < 0 && errno == EINVAL) {
+            // COOP_TASKRUN needs linux 5.19
+            params            = io_uring_params{};
+            params.flags      = IORING_SETUP_CQSIZE;
+            params.cq_entries = CQ_ENTRIES;
+            m_ring_fd         = uringSetup(SQ_ENTRIES, &params);
+        }
+        if (m_ring_fd < 0)
+            throw std::runtime_error("io_uring_setup failed: " + std::string(strerror(errno)));
+
+        // timed waits need EXT_ARG (5.11), and completions must not be dropped when the queue runs full
+        unsigned required = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+        if ((params.features & required) != required) {
+            close(m_ring_fd);
+            throw std::runtime_error("io_uring is missing features this backend needs");
+        }
+
+        try {
+            mapRings(params);
+            m_wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (m_wake_fd == -1)
+                throw std::runtime_error(strerror(errno));
+        } catch (...) {
+            release();
+            throw;
+        }
+        armWake();
+    }
+
+    // closing a ring finishes its teardown from a kernel worker that signals the creating thread, so the next blocking
+    // wait there may return early once. the front end counts that as an interrupted wait
+    ~UringBackend() override { release(); }
+
+    void add(socket_t fd, PollEvent event, uint32_t tag) override {
+        // a request left from before the fd was closed without a remove holds the old file and would never complete
+        // for the new one, cancel it so only the new request stays
+        Registration& registration = slot(fd);
+        if (registration.armed)
+            cancel(fd, registration);
+        registration.events     = event;
+        registration.tag        = tag;
+        registration.registered = true;
+        registration.sequence++;
+        arm(fd, registration);
+        recordCtl(CtlOp::ADD, fd, event, 0);
+        submitWhileWaiting();
+    }
+
+    void modify(socket_t fd, PollEvent event, uint32_t tag) override {
+        Registration& registration = slot(fd);
+        recordCtl(CtlOp::MOD, fd, event, registration.registered ? 0 : ENOENT);
+        if (!registration.registered)
+            throw std::runtime_error(strerror(ENOENT));
+
+        if (registration.armed)
+            cancel(fd, registration);
+        registration.events = event;
+        registration.tag    = tag;
+        registration.sequence++;
+        arm(fd, registration);
+        submitWhileWaiting();
+    }
+
+    void remove(socket_t fd) override {
+        Registration& registration = slot(fd);
+        recordCtl(CtlOp::DEL, fd, PollEvent::NONE, registration.registered ? 0 : ENOENT);
+        if (!registration.registered)
+            return;
+
+        if (registration.armed)
+            cancel(fd, registration);
+        registration.registered = false;
+        registration.sequence++;
+        submitWhileWaiting();
+    }
+
+    // the wait submits what is queued now, m_sq_local may move on under the front end's lock while it runs
+    void prepare() override {
+        m_submit = unsubmitted();
+        m_waiting.store(true);
+    }
+
+    int wait(int timeout_ms) override {
+        unsigned flags   = IORING_ENTER_GETEVENTS;
+        unsigned wait_nr = ready() > 0 || timeout_ms == 0 ? 0 : 1;
+
+        __kernel_timespec      timeout{};
+        io_uring_getevents_arg arg{};
+        const void*            arg_ptr  = nullptr;
+        size_t                 arg_size = 0;
+        if (wait_nr > 0 && timeout_ms > 0) {
+            timeout.tv_sec  = timeout_ms / 1000;
+            timeout.tv_nsec = (timeout_ms % 1000) * 1000000;
+            arg.sigmask_sz  = _NSIG / 8;
+            arg.ts          = reinterpret_cast<uint64_t>(&timeout);
+            flags |= IORING_ENTER_EXT_ARG;
+            arg_ptr  = &arg;
+            arg_size = sizeof(arg);
+        }
+
+        int rc = uringEnter(m_ring_fd, m_submit, wait_nr, flags, arg_ptr, arg_size);
+        m_waiting.store(false);
+        // ETIME is the timeout, EBUSY and EAGAIN a completion queue that has to be drained first
+        if (rc < 0 && errno != ETIME && errno != EBUSY && errno != EAGAIN) {
+            if (errno == EINTR)
+                return -1;
+            throw std::runtime_error("io_uring_enter failed: " + std::string(strerror(errno)));
+        }
+
+        unsigned count = ready();
+        return static_cast<int>(count < m_max_events ? count : m_max_events);
+    }
+
+    void collect(int count, std::vector<Entry>& out) override {
+        unsigned head = *m_cq_head;
+        for (int i = 0; i < count; i++, head++) {
+            const io_uring_cqe& cqe = m_cqes[head & m_cq_mask];
+            if (cqe.user_data == WAKE_DATA) {
+                m_wakeup_pending.store(false);
+                m_stats.recordWakeup();
+                uint64_t value;
+                if (read(m_wake_fd, &value, sizeof(value)) == -1 && errno != EAGAIN)
+                    throw std::runtime_error(strerror(errno));
+                armWake();
+                continue;
+            }
+            if (cqe.user_data == IGNORED_DATA)
+                continue;
+
+            // completions of a request that was cancelled or replaced since carry an old sequence number
+            socket_t fd = static_cast<socket_t>(static_cast<uint32_t>(cqe.user_data));
+            size_t   index = socketSlot(fd);
+            if (index >= m_fds.size())
+                continue;
+            Registration& registration = m_fds[index];
+            if (!registration.armed || requestData(fd, registration) != cqe.user_data)
+                continue;
+
+            registration.armed = false;
+            if (cqe.res < 0) {
+                // the request failed, e.g. the fd was closed before it was submitted. once submitted it holds the file
+                // and a close without a remove leaves it pending instead
+                out.push_back({fd, PollEvent::ERR, registration.tag});
+                continue;
+            }
+            out.push_back({fd, fromNative(static_cast<uint32_t>(cqe.res)), registration.tag});
+            arm(fd, registration);
+        }
+        __atomic_store_n(m_cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    void wakeup() override {
+        uint64_t one = 1;
+        if (write(m_wake_fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+            throw std::runtime_error(strerror(errno));
+    }
+
+  private:
+    struct Registration {
+        PollEvent events     = PollEvent::NONE;
+        bool      registered = false;
+        bool      armed      = false; // a poll request is in flight
+        uint32_t  tag        = 0;
+        uint32_t  sequence   = 0;
+    };
+
+    static constexpr unsigned SQ_ENTRIES = 256;
+    static constexpr unsigned CQ_ENTRIES = 4096;
+
+    // user data of requests whose completions carry no fd, an fd never has all 32 bits set
+    static constexpr uint64_t WAKE_DATA    = UINT64_MAX - 1;
+    static constexpr uint64_t IGNORED_DATA = UINT64_MAX;
+
+    unsigned m_max_events;
+    int      m_ring_fd = -1;
+    int      m_wake_fd = -1;
+
+    void*         m_ring      = MAP_FAILED;
+    size_t        m_ring_size = 0;
+    io_uring_sqe* m_sqes      = static_cast<io_uring_sqe*>(MAP_FAILED);
+    size_t        m_sqes_size = 0;
+
+    unsigned*     m_sq_head  = nullptr;
+    unsigned*     m_sq_tail  = nullptr;
+    unsigned*     m_sq_array = nullptr;
+    unsigned      m_sq_mask  = 0;
+    unsigned      m_sq_size  = 0;
+    unsigned      m_sq_local = 0; // tail including entries not published yet
+    unsigned      m_submit   = 0; // what the next wait() submits, taken by prepare()
+    unsigned*     m_cq_head  = nullptr;
+    unsigned*     m_cq_tail  = nullptr;
+    unsigned      m_cq_mask  = 0;
+    io_uring_cqe* m_cqes     = nullptr;
+
+    std::vector<Registration> m_fds;
+    std::atomic<bool>         m_waiting{false}; // between prepare() and the return of the blocking enter
+
+    void mapRings(const io_uring_params& params) {
+        size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        m_ring_size    = sq_size > cq_size ? sq_size : cq_size;
+        m_ring         = mmap(nullptr, m_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring_fd,
+                              IORING_OFF_SQ_RING);
+        if (m_ring == MAP_FAILED)
+            throw std::runtime_error("io_uring ring mmap failed: " + std::string(strerror(errno)));
+
+        m_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+        m_sqes      = static_cast<io_uring_sqe*>(mmap(nullptr, m_sqes_size, PROT_READ | PROT_WRITE,
+                                                      MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_SQES));
+        if (m_sqes == MAP_FAILED)
+            throw std::runtime_error("io_uring sqe mmap failed: " + std::string(strerror(errno)));
+
+        char* ring = static_cast<char*>(m_ring);
+        m_sq_head  = reinterpret_cast<unsigned*>(ring + params.sq_off.head);
+        m_sq_tail  = reinterpret_cast<unsigned*>(ring + params.sq_off.tail);
+        m_sq_array = reinterpret_cast<unsigned*>(ring + params.sq_off.array);
+        m_sq_mask  = *reinterpret_cast<unsigned*>(ring + params.sq_off.ring_mask);
+        m_sq_size  = params.sq_entries;
+        m_sq_local = *m_sq_tail;
+        m_cq_head  = reinterpret_cast<unsigned*>(ring + params.cq_off.head);
+        m_cq_tail  = reinterpret_cast<unsigned*>(ring + params.cq_off.tail);
+        m_cq_mask  = *reinterpret_cast<unsigned*>(ring + params.cq_off.ring_mask);
+        m_cqes     = reinterpret_cast<io_uring_cqe*>(ring + params.cq_off.cqes);
+    }
+
+    void release() {
+        if (m_sqes != MAP_FAILED)
+            munmap(m_sqes, m_sqes_size);
+        if (m_ring != MAP_FAILED)
+            munmap(m_ring, m_ring_size);
+        if (m_ring_fd != -1)
+            close(m_ring_fd);
+        if (m_wake_fd != -1)
+            close(m_wake_fd);
+    }
+
+    Registration& slot(socket_t fd) {
+        size_t index = socketSlot(fd);
+        if (index >= m_fds.size())
+            m_fds.resize(index + 1);
+        return m_fds[index];
+    }
+
+    [[nodiscard]] unsigned ready() const { return __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE) - *m_cq_head; }
+    [[nodiscard]] unsigned unsubmitted() const { return m_sq_local - __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE); }
+
+    // the fd below the sequence number of its registration
+    static uint64_t requestData(socket_t fd, const Registration& registration) {
+        return (static_cast<uint64_t>(registration.sequence) << 32) | static_cast<uint32_t>(fd);
+    }
+
+    // queues a request, submitting what is queued already when the submission queue is full
+    void push(const io_uring_sqe& sqe) {
+        if (unsubmitted() == m_sq_size) {
+            if (uringEnter(m_ring_fd, unsubmitted(), 0, 0, nullptr, 0) < 0 && errno != EBUSY && errno != EAGAIN)
+                throw std::runtime_error("io_uring_enter failed: " + std::string(strerror(errno)));
+            if (unsubmitted() == m_sq_size)
+                throw std::runtime_error("io_uring submission queue is full");
+        }
+        unsigned index    = m_sq_local & m_sq_mask;
+        m_sqes[index]     = sqe;
+        m_sq_array[index] = index;
+        m_sq_local++;
+        __atomic_store_n(m_sq_tail, m_sq_local, __ATOMIC_RELEASE);
+    }
+
+    // a change from another thread would otherwise sit in the queue until the wait it raced with returns. best effort,
+    // what fails to go in here is submitted by the next wait()
+    void submitWhileWaiting() {
+        if (m_waiting.load())
+            uringEnter(m_ring_fd, unsubmitted(), 0, 0, nullptr, 0);
+    }
+
+    void arm(socket_t fd, Registration& registration) {
+        io_uring_sqe sqe{};
+        sqe.opcode        = IORING_OP_POLL_ADD;
+        sqe.fd            = static_cast<int>(fd);
+        sqe.poll32_events = toNative(registration.events);
+        sqe.user_data     = requestData(fd, registration);
+        push(sqe);
+        registration.armed = true;
+    }
+
+    void cancel(socket_t fd, Registration& registration) {
+        io_uring_sqe sqe{};
+        sqe.opcode    = IORING_OP_POLL_REMOVE;
+        sqe.addr      = requestData(fd, registration);
+        sqe.user_data = IGNORED_DATA;
+        push(sqe);
+        registration.armed = false;
+    }
+
+    void armWake() {
+        io_uring_sqe sqe{};
+        sqe.opcode        = IORING_OP_POLL_ADD;
+        sqe.fd            = m_wake_fd;
+        sqe.poll32_events = toNative(PollEvent::READ);
+        sqe.user_data     = WAKE_DATA;
+        push(sqe);
+    }
+
+    // poll requests have no exclusive mode, PollEvent::EXCLUSIVE is dropped. poll32_events is read as two swapped
+    // 16-bit halves on big-endian machines
+    static uint32_t toNative(PollEvent event) {
+        uint32_t native = 0;
+        if (event & PollEvent::READ)
+            native |= POLLIN;
+        if (event & PollEvent::WRITE)
+            native |= POLLOUT;
+        if (event & PollEvent::ERR)
+            native |= POLLERR | POLLHUP;
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        native = (native << 16) | (native >> 16);
+#endif
+        return native;
+    }
+
+    static PollEvent fromNative(uint32_t native) {
+        uint8_t res = PollEvent::NONE;
+        if (native & POLLIN)
+            res |= PollEvent::READ;
+        if (native & POLLOUT)
+            res |= PollEvent::WRITE;
+        if (native & (POLLERR | POLLHUP))
+            res |= PollEvent::ERR;
+        return static_cast<PollEvent>(res);
+    }
+};
+
+} // namespace
+
+std::unique_ptr<PollBackendImpl> makeUringBackend(int max_events, PollCounters& stats,
+                                                  std::atomic<bool>& wakeup_pending) {
+    return std::make_unique<UringBackend>(max_events, stats, wakeup_pending);
+}
+
+#endif
@@ -1,22 +1,131 @@
 #ifdef _WIN32
 
-#include "event_poll.hpp"
+#include "poll_backend.hpp"
 
+#include <cerrno>
 #include <cstring>
-#include <mutex>
 #include <stdexcept>
+#include <string>
 #include <unordered_map>
 #include <winsock2.h>
 #include <ws2tcpip.h>
 
-struct EventPoll::Impl {
-    std::vector<WSAPOLLFD>                  poll_fds{};
-    std::unordered_map<socket_t, PollEvent> fd_map{};
-    std::vector<PollEventEntry>             active_events{};
-    std::mutex                              mutex{};
+namespace {
+
+class WsaPollBackend final : public PollBackendImpl {
+  public:
+    // WSAPoll has no user event, so wakeups are datagrams on a loopback UDP socket connected to itself
+    WsaPollBackend(int max_events, PollCounters& stats, std::atomic<bool>& wakeup_pending)
+        : PollBackendImpl(stats, wakeup_pending) {
+        WSADATA data;
+        int     err = WSAStartup(MAKEWORD(2, 2), &data);
+        if (err != 0)
+            throw std::runtime_error("WSAStartup failed: " + std::to_string(err));
+
+        sockaddr_in addr{};
+        int         len         = sizeof(addr);
+        u_long      nonblocking = 1;
+        addr.sin_family         = AF_INET;
+        addr.sin_addr.s_addr    = htonl(INADDR_LOOPBACK);
+
+        m_wake_socket = ::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        if (m_wake_socket == INVALID_SOCKET || ::bind(m_wake_socket, reinterpret_cast<sockaddr*>(&addr), len) != 0 ||
+            ::getsockname(m_wake_socket, reinterpret_cast<sockaddr*>(&addr), &len) != 0 ||
+            ::connect(m_wake_socket, reinterpret_cast<sockaddr*>(&addr), len) != 0 ||
+            ioctlsocket(m_wake_socket, FIONBIO, &nonblocking) != 0) {
+            err = WSAGetLastError();
+            if (m_wake_socket != INVALID_SOCKET)
+                closesocket(m_wake_socket);
+            WSACleanup();
+            throw std::runtime_error("wakeup socket setup failed: " + std::to_string(err));
+        }
+
+        m_poll_fds.reserve(max_events + 1);
+        rebuildPollArray();
+    }
+
+    ~WsaPollBackend() override {
+        closesocket(m_wake_socket);
+        WSACleanup();
+    }
+
+    void add(socket_t fd, PollEvent event, uint32_t tag) override {
+        bool exists = m_fd_map.find(fd) != m_fd_map.end();
+        recordCtl(CtlOp::ADD, fd, event, exists ? EEXIST : 0);
+        if (exists) {
+            throw std::runtime_error("File descriptor already exists");
+        }
+
+        m_fd_map[fd] = {event, tag};
+        rebuildPollArray();
+    }
+
+    void modify(socket_t fd, PollEvent event, uint32_t tag) override {
+        auto it = m_fd_map.find(fd);
+        recordCtl(CtlOp::MOD, fd, event, it != m_fd_map.end() ? 0 : ENOENT);
+        if (it == m_fd_map.end()) {
+            throw std::runtime_error("File descriptor not found");
+        }
+
+        it->second = {event, tag};
+        rebuildPollArray();
+    }
 
-    Impl(int max_events) { poll_fds.reserve(max_events); }
-    ~Impl() = default;
+    void remove(socket_t fd) override {
+        recordCtl(CtlOp::DEL, fd, PollEvent::NONE, m_fd_map.erase(fd) != 0 ? 0 : ENOENT);
+        rebuildPollArray();
+    }
+
+    // WSAPoll writes its results into the array it polls, registration changes while it runs must not touch that one
+    void prepare() override { m_ready_fds = m_poll_fds; }
+
+    int wait(int timeout_ms) override {
+        int n = WSAPoll(m_ready_fds.data(), static_cast<ULONG>(m_ready_fds.size()), timeout_ms);
+        if (n == SOCKET_ERROR) {
+            int error = WSAGetLastError();
+            if (error == WSAEINTR)
+                return -1;
+            throw std::runtime_error("WSAPoll failed: " + std::to_string(error));
+        }
+        return n;
+    }
+
+    void collect(int /*count*/, std::vector<Entry>& out) override {
+        for (const auto& pfd : m_ready_fds) {
+            if (pfd.fd == m_wake_socket) {
+                if (pfd.revents != 0) {
+                    m_wakeup_pending.store(false);
+                    m_stats.recordWakeup();
+                    char drain[64];
+                    while (::recv(m_wake_socket, drain, sizeof(drain), 0) > 0) {
+                    }
+                }
+                continue;
+            }
+            // an fd removed while WSAPoll ran has no registration left to report to
+            auto it = m_fd_map.find(pfd.fd);
+            if (pfd.revents != 0 && it != m_fd_map.end()) {
+                out.push_back({pfd.fd, fromNative(pfd.revents), it->second.tag});
+            }
+        }
+    }
+
+    void wakeup() override {
+        char byte = 1;
+        if (::send(m_wake_socket, &byte, 1, 0) == SOCKET_ERROR && WSAGetLastError() != WSAEWOULDBLOCK)
+            throw std::runtime_error("wakeup failed: " + std::to_string(WSAGetLastError()));
+    }
+
+  private:
+    struct Registration {
+        PollEvent events;
+        uint32_t  tag;
+    };
+
+    std::vector<WSAPOLLFD>                     m_poll_fds{};
+    std::vector<WSAPOLLFD>                     m_ready_fds{}; // the copy the last wait() ran on
+    std::unordered_map<socket_t, Registration> m_fd_map{};
+    SOCKET                                     m_wake_socket = INVALID_SOCKET;
 
     static short toNative(PollEvent event) {
         short native = 0;
@@ -41,83 +150,28 @@ struct EventPoll::Impl {
     }
 
     void rebuildPollArray() {
-        poll_fds.clear();
-        for (const auto& entry : fd_map) {
+        m_poll_fds.clear();
+
+        WSAPOLLFD wake{};
+        wake.fd     = m_wake_socket;
+        wake.events = POLLRDNORM;
+        m_poll_fds.push_back(wake);
+
+        for (const auto& entry : m_fd_map) {
             WSAPOLLFD pfd{};
             pfd.fd      = entry.first;
-            pfd.events  = toNative(entry.second);
+            pfd.events  = toNative(entry.second.events);
             pfd.revents = 0;
-            poll_fds.push_back(pfd);
+            m_poll_fds.push_back(pfd);
         }
     }
 };
 
-EventPoll::EventPoll(int max_events) : m_pimpl(std::make_unique<Impl>(max_events)), m_max_events(max_events) {}
-EventPoll::~EventPoll() = default;
-
-void EventPoll::addFd(socket_t fd, PollEvent event) {
-    std::unique_lock<std::mutex> lock(m_pimpl->mutex);
-
-    if (m_pimpl->fd_map.find(fd) != m_pimpl->fd_map.end()) {
-        throw std::runtime_error("File descriptor already exists");
-    }
-
-    m_pimpl->fd_map[fd] = event;
-    m_pimpl->rebuildPollArray();
-}
-
-void EventPoll::modifyFd(socket_t fd, PollEvent event) {
-    std::unique_lock<std::mutex> lock(m_pimpl->mutex);
-
-    auto it = m_pimpl->fd_map.find(fd);
-    if (it == m_pimpl->fd_map.end()) {
-        throw std::runtime_error("File descriptor not found");
-    }
-
-    it->second = event;
-    m_pimpl->rebuildPollArray();
-}
-
-void EventPoll::removeFd(socket_t fd) {
-    std::unique_lock<std::mutex> lock(m_pimpl->mutex);
-
-    m_pimpl->fd_map.erase(fd);
-    m_pimpl->rebuildPollArray();
-}
-
-void EventPoll::wait(int timeout_ms) {
-    std::vector<WSAPOLLFD> poll_fds_copy;
-
-    {
-        std::unique_lock<std::mutex> lock(m_pimpl->mutex);
-        if (m_pimpl->poll_fds.empty()) {
-            m_pimpl->active_events.clear();
-            return;
-        }
-        poll_fds_copy = m_pimpl->poll_fds;
-    }
-
-    int n = WSAPoll(poll_fds_copy.data(), static_cast<ULONG>(poll_fds_copy.size()), timeout_ms);
-
-    if (n == SOCKET_ERROR) {
-        int error = WSAGetLastError();
-        if (error == WSAEINTR)
-            return;
-        throw std::runtime_error("WSAPoll failed: " + std::to_string(error));
-    }
-
-    std::unique_lock<std::mutex> lock(m_pimpl->mutex);
-    m_pimpl->active_events.clear();
-
-    for (const auto& pfd : poll_fds_copy) {
-        if (pfd.revents != 0) {
-            m_pimpl->active_events.push_back({pfd.fd, Impl::fromNative(pfd.revents)});
-        }
-    }
-}
+} // namespace
 
-const std::vector<EventPoll::PollEventEntry>& EventPoll::events() const {
-    return m_pimpl->active_events;
+std::unique_ptr<PollBackendImpl> makeWsaPollBackend(int max_events, PollCounters& stats,
+                                                    std::atomic<bool>& wakeup_pending) {
+    return std::make_unique<WsaPollBackend>(max_events, stats, wakeup_pending);
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,331 @@
+#include "tcp_proxy.hpp"
+
+#ifdef __linux__
+#include <cerrno>
+#include <csignal>
+#include <ctime>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#ifdef __linux__
+namespace {
+
+bool sigpipeIgnored() {
+    struct sigaction action{};
+    return sigaction(SIGPIPE, nullptr, &action) == 0 && action.sa_handler == SIG_IGN;
+}
+
+// splice() has no MSG_NOSIGNAL. unless the process ignores SIGPIPE, it is blocked for the call and a SIGPIPE the call
+// raised is taken off the thread again, so a reset peer fails the session instead of killing the process
+ssize_t spliceOut(int pipe_read, int fd, size_t size, bool guard) {
+    if (!guard)
+        return ::splice(pipe_read, nullptr, fd, nullptr, size, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+
+    sigset_t sigpipe;
+    sigset_t previous;
+    sigset_t pending;
+    sigemptyset(&sigpipe);
+    sigaddset(&sigpipe, SIGPIPE);
+    // one that was pending already is not ours to take
+    sigpending(&pending);
+    bool was_pending = sigismember(&pending, SIGPIPE) == 1;
+    pthread_sigmask(SIG_BLOCK, &sigpipe, &previous);
+
+    ssize_t moved = ::splice(pipe_read, nullptr, fd, nullptr, size, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    int     error = errno;
+    if (moved < 0 && error == EPIPE && !was_pending) {
+        timespec none{};
+        while (sigtimedwait(&sigpipe, nullptr, &none) == -1 && errno == EINTR) {
+        }
+    }
+    pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+    errno = error;
+    return moved;
+}
+
+} // namespace
+#endif
+
+struct TcpProxy::Session {
+    struct Side {
+        Socket    socket;
+        PollEvent interest   = PollEvent::NONE;
+        bool      registered = false;
+    };
+
+    // bytes read from one side and not yet written to the other, in a pipe or in a buffer
+    struct Direction {
+        bool              eof        = false; // the source sent its FIN
+        bool              shut       = false; // and it was passed on
+        bool              spliced    = false;
+        bool              fell_back  = false; // switched to copying since the last look
+        int               pipe_read  = -1;
+        int               pipe_write = -1;
+        size_t            capacity   = 0;
+        size_t            queued     = 0;
+        size_t            begin      = 0; // of the queued bytes in buffer
+        std::vector<char> buffer;
+
+        Direction() = default;
+        ~Direction() { closePipe(); }
+
+        Direction(const Direction&)            = delete;
+        Direction& operator=(const Direction&) = delete;
+
+        // false when this direction had to fall back to copying
+        bool open(const ProxyOptions& options) {
+#ifdef __linux__
+            int fds[2];
+            if (options.mode != ProxyMode::COPY && ::pipe2(fds, O_NONBLOCK | O_CLOEXEC) == 0) {
+                pipe_read  = fds[0];
+                pipe_write = fds[1];
+                spliced    = true;
+                // the kernel rounds up to whole pages and caps unprivileged sizes, take whatever it settled on
+                ::fcntl(pipe_write, F_SETPIPE_SZ, static_cast<int>(options.buffer_size));
+                int size = ::fcntl(pipe_write, F_GETPIPE_SZ);
+                capacity = size > 0 ? static_cast<size_t>(size) : 64 * 1024;
+                return true;
+            }
+            useBuffer(options.buffer_size);
+            return options.mode == ProxyMode::COPY;
+#else
+            useBuffer(options.buffer_size);
+            return true;
+#endif
+        }
+
+        [[nodiscard]] size_t space() const {
+            return spliced ? capacity - queued : buffer.size() - queued;
+        }
+
+        void fill(Socket& from) {
+            if (eof || space() == 0)
+                return;
+#ifdef __linux__
+            if (spliced) {
+                ssize_t moved = ::splice(from.fd(), nullptr, pipe_write, nullptr, capacity - queued,
+                                         SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+                if (moved > 0) {
+                    queued += static_cast<size_t>(moved);
+                    return;
+                }
+                if (moved == 0) {
+                    eof = true;
+                    return;
+                }
+                if (errno == EAGAIN)
+                    return;
+                // sockets splice cannot read from, e.g. with a tls layer in the kernel, are relayed by copying
+                if ((errno != EINVAL && errno != ENOSYS) || queued != 0)
+                    throw std::runtime_error("splice failed: " + std::string(strerror(errno)));
+                useBuffer(capacity);
+                fell_back = true;
+            }
+#endif
+            if (begin + queued == buffer.size()) {
+                std::memmove(buffer.data(), buffer.data() + begin, queued);
+                begin = 0;
+            }
+            socket_size_t received = from.tryRecv(buffer.data() + begin + queued, buffer.size() - begin - queued);
+            if (received == 0)
+                eof = true;
+            else if (received > 0)
+                queued += static_cast<size_t>(received);
+        }
+
+        // bytes written to the other side
+        size_t drain(Socket& to, bool guard_sigpipe) {
+            if (queued == 0)
+                return 0;
+#ifdef __linux__
+            if (spliced) {
+                ssize_t moved = spliceOut(pipe_read, to.fd(), queued, guard_sigpipe);
+                if (moved < 0) {
+                    if (errno == EAGAIN)
+                        return 0;
+                    throw std::runtime_error("splice failed: " + std::string(strerror(errno)));
+                }
+                queued -= static_cast<size_t>(moved);
+                return static_cast<size_t>(moved);
+            }
+#else
+            (void)guard_sigpipe;
+#endif
+            socket_size_t sent = to.trySend(buffer.data() + begin, queued);
+            if (sent <= 0)
+                return 0;
+            queued -= static_cast<size_t>(sent);
+            begin = queued == 0 ? 0 : begin + static_cast<size_t>(sent);
+            return static_cast<size_t>(sent);
+        }
+
+      private:
+        void useBuffer(size_t size) {
+            closePipe();
+            spliced = false;
+            buffer.resize(size == 0 ? 1 : size);
+        }
+
+        void closePipe() {
+#ifdef __linux__
+            if (pipe_read != -1)
+                ::close(pipe_read);
+            if (pipe_write != -1)
+                ::close(pipe_write);
+#endif
+            pipe_read = pipe_write = -1;
+        }
+    };
+
+    TcpProxy* proxy = nullptr;
+    size_t    index = 0; // in m_sessions
+    Side      sides[2];
+    // directions[i] reads from sides[i] and writes to sides[1 - i]
+    Direction directions[2];
+};
+
+TcpProxy::TcpProxy(EventLoop& loop, ProxyOptions options) : m_loop(loop), m_options(options) {
+#ifdef __linux__
+    m_guard_sigpipe = !sigpipeIgnored();
+#else
+    if (m_options.mode == ProxyMode::SPLICE)
+        throw std::invalid_argument("splice is only available on linux");
+#endif
+}
+
+TcpProxy::~TcpProxy() {
+    for (auto& session : m_sessions) {
+        for (auto& side : session->sides) {
+            if (side.registered)
+                m_loop.remove(side.socket.fd());
+        }
+    }
+}
+
+void TcpProxy::relay(Socket client, Socket upstream) {
+    if (!client.valid() || !upstream.valid())
+        throw std::invalid_argument("proxy needs two valid sockets");
+
+    auto session             = std::make_unique<Session>();
+    session->proxy           = this;
+    session->index           = m_sessions.size();
+    session->sides[0].socket = std::move(client);
+    session->sides[1].socket = std::move(upstream);
+    for (int i = 0; i < 2; i++) {
+        session->sides[i].socket.setNonBlocking(true);
+        if (!session->directions[i].open(m_options))
+            m_fallbacks.add();
+    }
+
+    Session& added = *session;
+    m_sessions.push_back(std::move(session));
+    m_started.add();
+    updateInterest(added);
+}
+
+ProxyStats TcpProxy::stats() const {
+    ProxyStats stats;
+    stats.sessions  = m_started.load();
+    stats.spliced   = m_spliced.load();
+    stats.copied    = m_copied.load();
+    stats.fallbacks = m_fallbacks.load();
+    stats.failed    = m_failed.load();
+    return stats;
+}
+
+void TcpProxy::onEvent(void* context, socket_t fd, PollEvent events) {
+    Session&  session = *static_cast<Session*>(context);
+    TcpProxy& proxy   = *session.proxy;
+    int       side    = session.sides[0].socket.fd() == fd ? 0 : 1;
+
+    // readable feeds this side's direction, writable drains the one towards it. errors surface from either
+    if ((events & (PollEvent::READ | PollEvent::ERR)) != 0 && !proxy.transfer(session, side))
+        return;
+    if ((events & (PollEvent::WRITE | PollEvent::ERR)) != 0 && !proxy.transfer(session, 1 - side))
+        return;
+    proxy.updateInterest(session);
+}
+
+// moves what it can in one direction, false when that ended the session
+bool TcpProxy::transfer(Session& session, int direction) {
+    Session::Direction& dir  = session.directions[direction];
+    Socket&             from = session.sides[direction].socket;
+    Socket&             to   = session.sides[1 - direction].socket;
+
+    try {
+        size_t moved = dir.drain(to, m_guard_sigpipe);
+        dir.fill(from);
+        moved += dir.drain(to, m_guard_sigpipe);
+        (dir.spliced ? m_spliced : m_copied).add(moved);
+        if (dir.fell_back) {
+            dir.fell_back = false;
+            m_fallbacks.add();
+        }
+
+        if (dir.eof && dir.queued == 0 && !dir.shut) {
+            to.shutdown(ShutdownMode::WRITE);
+            dir.shut = true;
+        }
+    } catch (const std::runtime_error&) {
+        finish(session, true);
+        return false;
+    }
+
+    if (session.directions[0].shut && session.directions[1].shut) {
+        finish(session, false);
+        return false;
+    }
+    return true;
+}
+
+void TcpProxy::updateInterest(Session& session) {
+    for (int i = 0; i < 2; i++) {
+        const Session::Direction& out  = session.directions[i];
+        const Session::Direction& in   = session.directions[1 - i];
+        Session::Side&            side = session.sides[i];
+
+        int wanted = PollEvent::NONE;
+        if (!out.eof && out.space() > 0)
+            wanted |= PollEvent::READ;
+        if (in.queued > 0)
+            wanted |= PollEvent::WRITE;
+
+        // a side with nothing to do leaves the poll set entirely, a hangup would keep reporting it otherwise
+        socket_t fd = side.socket.fd();
+        if (wanted == PollEvent::NONE) {
+            if (side.registered)
+                m_loop.remove(fd);
+            side.registered = false;
+        } else if (!side.registered) {
+            m_loop.add(fd, static_cast<PollEvent>(wanted), EventHandler{&TcpProxy::onEvent, &session});
+            side.registered = true;
+        } else if (wanted != side.interest) {
+            m_loop.modify(fd, static_cast<PollEvent>(wanted));
+        }
+        side.interest = static_cast<PollEvent>(wanted);
+    }
+}
+
+void TcpProxy::finish(Session& session, bool failed) {
+    for (auto& side : session.sides) {
+        if (side.registered)
+            m_loop.remove(side.socket.fd());
+    }
+    if (failed)
+        m_failed.add();
+
+    // swap-remove, the sockets and pipes close with the session
+    size_t index = session.index;
+    if (index + 1 != m_sessions.size()) {
+        std::swap(m_sessions[index], m_sessions.back());
+        m_sessions[index]->index = index;
+    }
+    m_sessions.pop_back();
+}
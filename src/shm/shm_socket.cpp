@@ -0,0 +1,364 @@
+#include "shm_socket.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <new>
+#include <stdexcept>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+// the atomics are shared between processes, which only works for lock-free ones
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2, "shared rings need lock-free atomics");
+
+namespace {
+
+constexpr uint64_t SHM_MAGIC  = 0x53504f4c4c53484dULL; // "SPOLLSHM"
+constexpr size_t   CACHE_LINE = 64;
+
+// one direction. the producer's and the consumer's fields sit on separate cache lines, so neither side's writes
+// invalidate the line the other one polls
+struct ShmRing {
+    alignas(CACHE_LINE) std::atomic<uint64_t> tail;
+    std::atomic<uint32_t> writer_closed;
+    std::atomic<uint32_t> writer_waiting; // the producer found no room and waits for the doorbell
+
+    alignas(CACHE_LINE) std::atomic<uint64_t> head;
+    std::atomic<uint32_t> reader_closed;
+    std::atomic<uint32_t> reader_waiting; // the consumer found nothing and waits for the doorbell
+};
+
+[[noreturn]] void throwErrno(const char* what) {
+    throw std::runtime_error(std::string(what) + " failed: " + strerror(errno));
+}
+
+size_t roundUpPow2(size_t value) {
+    size_t result = CACHE_LINE;
+    while (result < value)
+        result <<= 1;
+    return result;
+}
+
+} // namespace
+
+// the start of the memfd, the data of both rings follows
+struct ShmRegion {
+    uint64_t magic;
+    uint64_t capacity;
+    ShmRing  rings[2]; // rings[side] is what side receives
+
+    char* data(int side) {
+        return reinterpret_cast<char*>(this) + sizeof(ShmRegion) + static_cast<size_t>(side) * capacity;
+    }
+};
+
+namespace {
+
+size_t regionSize(size_t capacity) {
+    return sizeof(ShmRegion) + 2 * capacity;
+}
+
+ShmRegion* mapRegion(int memory, size_t size) {
+    void* map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, memory, 0);
+    if (map == MAP_FAILED)
+        throwErrno("mmap");
+    return static_cast<ShmRegion*>(map);
+}
+
+void closeHandles(const ShmSocket::Handles& handles) {
+    for (int fd : {handles.memory, handles.doorbell, handles.peer_doorbell}) {
+        if (fd != -1)
+            ::close(fd);
+    }
+}
+
+// copies into or out of the ring at position, wrapping around its end
+void copyIn(char* ring, size_t capacity, uint64_t position, const char* data, size_t size) {
+    size_t offset = static_cast<size_t>(position & (capacity - 1));
+    size_t first  = std::min(size, capacity - offset);
+    std::memcpy(ring + offset, data, first);
+    std::memcpy(ring, data + first, size - first);
+}
+
+void copyOut(const char* ring, size_t capacity, uint64_t position, char* out, size_t size) {
+    size_t offset = static_cast<size_t>(position & (capacity - 1));
+    size_t first  = std::min(size, capacity - offset);
+    std::memcpy(out, ring + offset, first);
+    std::memcpy(out + first, ring, size - first);
+}
+
+} // namespace
+
+std::pair<ShmSocket, ShmSocket> ShmSocket::pair(size_t capacity) {
+    capacity = roundUpPow2(capacity);
+
+    int memory = memfd_create("socketpoll-shm", MFD_CLOEXEC);
+    if (memory == -1)
+        throwErrno("memfd_create");
+    Handles first{memory, -1, -1, 0};
+    Handles second{-1, -1, -1, 1};
+    try {
+        if (ftruncate(memory, static_cast<off_t>(regionSize(capacity))) == -1)
+            throwErrno("ftruncate");
+        first.doorbell = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (first.doorbell == -1)
+            throwErrno("eventfd");
+        second.doorbell = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (second.doorbell == -1)
+            throwErrno("eventfd");
+        // each end owns its descriptors, so either can be handed to another process on its own
+        second.memory        = fcntl(memory, F_DUPFD_CLOEXEC, 0);
+        first.peer_doorbell  = fcntl(second.doorbell, F_DUPFD_CLOEXEC, 0);
+        second.peer_doorbell = fcntl(first.doorbell, F_DUPFD_CLOEXEC, 0);
+        if (second.memory == -1 || first.peer_doorbell == -1 || second.peer_doorbell == -1)
+            throwErrno("fcntl(F_DUPFD_CLOEXEC)");
+
+        // a fresh memfd reads as zeros, which is the empty state of both rings
+        ShmRegion* region = mapRegion(memory, regionSize(capacity));
+        new (region) ShmRegion{};
+        region->capacity = capacity;
+        region->magic    = SHM_MAGIC;
+        munmap(region, regionSize(capacity));
+    } catch (...) {
+        closeHandles(first);
+        closeHandles(second);
+        throw;
+    }
+    return {adopt(first), adopt(second)};
+}
+
+ShmSocket ShmSocket::adopt(const Handles& handles) {
+    ShmSocket socket;
+    socket.m_handles = handles;
+
+    struct stat info{};
+    if (fstat(handles.memory, &info) == -1)
+        throwErrno("fstat");
+    if (static_cast<size_t>(info.st_size) < sizeof(ShmRegion) || (handles.side != 0 && handles.side != 1))
+        throw std::invalid_argument("not a shared memory ring pair");
+    // only a ring we recognised gets mapped into the socket, close() would otherwise mark foreign memory closed and
+    // ring whatever peer_doorbell is
+    size_t     size   = static_cast<size_t>(info.st_size);
+    ShmRegion* region = mapRegion(handles.memory, size);
+    if (region->magic != SHM_MAGIC || regionSize(region->capacity) != size) {
+        munmap(region, size);
+        throw std::invalid_argument("not a shared memory ring pair");
+    }
+    socket.m_map_size = size;
+    socket.m_region   = region;
+    return socket;
+}
+
+ShmSocket::ShmSocket() = default;
+
+ShmSocket::~ShmSocket() {
+    close();
+}
+
+ShmSocket::ShmSocket(ShmSocket&& other) noexcept
+    : m_region(other.m_region), m_map_size(other.m_map_size), m_handles(other.m_handles),
+      m_recv_armed(other.m_recv_armed), m_send_armed(other.m_send_armed), m_stats(other.m_stats),
+      m_doorbells(other.m_doorbells) {
+    other.m_region  = nullptr;
+    other.m_handles = Handles{};
+    other.resetStats();
+}
+
+ShmSocket& ShmSocket::operator=(ShmSocket&& other) noexcept {
+    if (this != &other) {
+        close();
+        m_region        = other.m_region;
+        m_map_size      = other.m_map_size;
+        m_handles       = other.m_handles;
+        m_recv_armed    = other.m_recv_armed;
+        m_send_armed    = other.m_send_armed;
+        m_stats         = other.m_stats;
+        m_doorbells     = other.m_doorbells;
+        other.m_region  = nullptr;
+        other.m_handles = Handles{};
+        other.resetStats();
+    }
+    return *this;
+}
+
+void ShmSocket::close() {
+    if (m_region != nullptr) {
+        m_region->rings[1 - m_handles.side].writer_closed.store(1, std::memory_order_release);
+        m_region->rings[m_handles.side].reader_closed.store(1, std::memory_order_release);
+        if (m_handles.peer_doorbell != -1)
+            ring(m_handles.peer_doorbell);
+        munmap(m_region, m_map_size);
+        m_region = nullptr;
+    }
+    // also what adopt() left behind when it threw
+    closeHandles(m_handles);
+    m_handles = Handles{};
+}
+
+ShmSocket::Handles ShmSocket::release() {
+    if (m_region != nullptr) {
+        munmap(m_region, m_map_size);
+        m_region = nullptr;
+    }
+    Handles handles = m_handles;
+    m_handles       = Handles{};
+    return handles;
+}
+
+bool ShmSocket::valid() const {
+    return m_region != nullptr;
+}
+
+void ShmSocket::shutdown(ShutdownMode how) {
+    if (m_region == nullptr)
+        throw std::runtime_error("shutdown on invalid socket");
+    if (how != ShutdownMode::READ)
+        m_region->rings[1 - m_handles.side].writer_closed.store(1, std::memory_order_release);
+    if (how != ShutdownMode::WRITE)
+        m_region->rings[m_handles.side].reader_closed.store(1, std::memory_order_release);
+    ring(m_handles.peer_doorbell);
+}
+
+socket_size_t ShmSocket::tryRecv(void* buffer, size_t size) {
+    if (m_region == nullptr)
+        throw std::runtime_error("recv on invalid socket");
+
+    ShmRing& in       = m_region->rings[m_handles.side];
+    uint64_t capacity = m_region->capacity;
+    uint64_t head     = in.head.load(std::memory_order_relaxed);
+    // closed first: data sent before the close is then visible in tail
+    bool     closed   = in.writer_closed.load(std::memory_order_acquire) != 0;
+    uint64_t tail     = in.tail.load(std::memory_order_acquire);
+    if (head == tail && !closed) {
+        // about to wait: ask to be rung, then look again for data that came before the producer could see the request
+        drainDoorbell();
+        in.reader_waiting.store(1, std::memory_order_seq_cst);
+        closed = in.writer_closed.load(std::memory_order_seq_cst) != 0;
+        tail   = in.tail.load(std::memory_order_seq_cst);
+        if (head == tail && !closed) {
+            m_recv_armed = true;
+            m_stats.recordRecv(-1, true);
+            return -1;
+        }
+        in.reader_waiting.store(0, std::memory_order_relaxed);
+    }
+    m_recv_armed = false;
+
+    size_t n = static_cast<size_t>(std::min<uint64_t>(size, tail - head));
+    copyOut(m_region->data(m_handles.side), capacity, head, static_cast<char*>(buffer), n);
+    in.head.store(head + n, std::memory_order_release);
+    m_stats.recordRecv(static_cast<int64_t>(n), false);
+
+    // the producer may be waiting for the room this made
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (n > 0 && in.writer_waiting.load(std::memory_order_relaxed) != 0 && in.writer_waiting.exchange(0) != 0)
+        ring(m_handles.peer_doorbell);
+    return static_cast<socket_size_t>(n);
+}
+
+socket_size_t ShmSocket::recv(void* buffer, size_t size) {
+    socket_size_t bytes = tryRecv(buffer, size);
+    return bytes < 0 ? 0 : bytes;
+}
+
+socket_size_t ShmSocket::recv(std::string& out, size_t max_size) {
+    std::vector<char> buffer(max_size);
+    socket_size_t     bytes = recv(buffer.data(), buffer.size());
+    if (bytes > 0)
+        out.assign(buffer.data(), static_cast<size_t>(bytes));
+    return bytes;
+}
+
+socket_size_t ShmSocket::trySend(const void* data, size_t size) {
+    IoSlice slice{data, size};
+    return trySendv(&slice, 1);
+}
+
+socket_size_t ShmSocket::send(const void* data, size_t size) {
+    socket_size_t sent = trySend(data, size);
+    return sent < 0 ? 0 : sent;
+}
+
+socket_size_t ShmSocket::send(const std::string& data) {
+    return send(data.data(), data.size());
+}
+
+socket_size_t ShmSocket::trySendv(const IoSlice* slices, size_t count) {
+    if (m_region == nullptr)
+        throw std::runtime_error("send on invalid socket");
+
+    ShmRing& out = m_region->rings[1 - m_handles.side];
+    if (out.reader_closed.load(std::memory_order_acquire) != 0 ||
+        out.writer_closed.load(std::memory_order_relaxed) != 0) {
+        m_stats.recordSend(-1, false);
+        throw std::runtime_error("send failed: " + std::string(strerror(EPIPE)));
+    }
+
+    uint64_t capacity = m_region->capacity;
+    uint64_t tail     = out.tail.load(std::memory_order_relaxed);
+    uint64_t head     = out.head.load(std::memory_order_acquire);
+    if (tail - head == capacity) {
+        drainDoorbell();
+        out.writer_waiting.store(1, std::memory_order_seq_cst);
+        head = out.head.load(std::memory_order_seq_cst);
+        if (tail - head == capacity) {
+            m_send_armed = true;
+            m_stats.recordSend(-1, true);
+            return -1;
+        }
+        out.writer_waiting.store(0, std::memory_order_relaxed);
+    }
+    m_send_armed = false;
+
+    char*  data = m_region->data(1 - m_handles.side);
+    size_t sent = 0;
+    for (size_t i = 0; i < count && tail - head < capacity; i++) {
+        size_t n = static_cast<size_t>(std::min<uint64_t>(slices[i].size, capacity - (tail - head)));
+        copyIn(data, capacity, tail, static_cast<const char*>(slices[i].data), n);
+        tail += n;
+        sent += n;
+    }
+    out.tail.store(tail, std::memory_order_release);
+    m_stats.recordSend(static_cast<int64_t>(sent), false);
+
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sent > 0 && out.reader_waiting.load(std::memory_order_relaxed) != 0 && out.reader_waiting.exchange(0) != 0)
+        ring(m_handles.peer_doorbell);
+    return static_cast<socket_size_t>(sent);
+}
+
+socket_size_t ShmSocket::sendv(const IoSlice* slices, size_t count) {
+    socket_size_t sent = trySendv(slices, count);
+    return sent < 0 ? 0 : sent;
+}
+
+void ShmSocket::ring(int doorbell) {
+    // the only failure on an eventfd is a full counter, which stays readable anyway
+    uint64_t one = 1;
+    if (::write(doorbell, &one, sizeof(one)) == -1)
+        return;
+    if (doorbell == m_handles.peer_doorbell)
+        m_doorbells.add();
+}
+
+void ShmSocket::drainDoorbell() {
+    uint64_t value;
+    if (::read(m_handles.doorbell, &value, sizeof(value)) == -1 && errno != EAGAIN)
+        throwErrno("doorbell read");
+    // one doorbell serves both directions. a ring for the one this call is not about is repeated, or the event
+    // for it would be lost
+    const ShmRing& in   = m_region->rings[m_handles.side];
+    const ShmRing& out  = m_region->rings[1 - m_handles.side];
+    bool readable = in.tail.load(std::memory_order_acquire) != in.head.load(std::memory_order_relaxed) ||
+                    in.writer_closed.load(std::memory_order_acquire) != 0;
+    bool writable = out.tail.load(std::memory_order_relaxed) - out.head.load(std::memory_order_acquire) <
+                        m_region->capacity ||
+                    out.reader_closed.load(std::memory_order_acquire) != 0;
+    if ((m_recv_armed && readable) || (m_send_armed && writable))
+        ring(m_handles.doorbell);
+}
@@ -0,0 +1,138 @@
+#include "accept_controller.hpp"
+
+#include "histogram.hpp"
+
+#include <stdexcept>
+#include <utility>
+
+AcceptController::AcceptController(Socket& listener, EventPoll& poll, AcceptOptions options, uint32_t tag)
+    : m_listener(listener), m_poll(poll), m_options(options), m_tag(tag) {
+    if (m_options.max_per_iteration == 0)
+        m_options.max_per_iteration = 1;
+    if (m_options.reserve_fd)
+        m_reserve.create();
+    m_poll.addFd(m_listener.fd(), armedEvents(), m_tag);
+}
+
+AcceptController::~AcceptController() {
+    m_poll.removeFd(m_listener.fd());
+}
+
+size_t AcceptController::acceptReady(std::vector<Socket>& out) {
+    if (m_options.reserve_fd && !m_reserve.valid())
+        restoreReserve();
+
+    size_t accepted = 0;
+    while (!paused() && accepted < m_options.max_per_iteration) {
+        Socket client;
+        try {
+            client = m_listener.tryAccept();
+        } catch (const SocketError& error) {
+            if (!error.resourceExhausted())
+                throw;
+            m_exhausted.add();
+            shedPending();
+            if (m_options.exhausted_pause_ms > 0)
+                m_paused_until_ns = monotonicNs() + static_cast<uint64_t>(m_options.exhausted_pause_ms) * 1000000;
+            updateInterest();
+            break;
+        }
+        if (!client.valid()) {
+            if (accepted == 0)
+                m_empty.add();
+            return accepted;
+        }
+
+        out.push_back(std::move(client));
+        accepted++;
+        m_open++;
+        m_accepted.add();
+        if (m_options.max_connections != 0 && m_open >= m_options.max_connections)
+            updateInterest();
+    }
+
+    if (accepted == m_options.max_per_iteration)
+        m_capped.add();
+    return accepted;
+}
+
+void AcceptController::connectionClosed() {
+    if (m_open > 0)
+        m_open--;
+    updateInterest();
+}
+
+void AcceptController::tick() {
+    if (m_paused_until_ns != 0 && monotonicNs() >= m_paused_until_ns) {
+        m_paused_until_ns = 0;
+        updateInterest();
+    }
+}
+
+int AcceptController::nextTimeoutMs() const {
+    if (m_paused_until_ns == 0)
+        return -1;
+    uint64_t now = monotonicNs();
+    if (now >= m_paused_until_ns)
+        return 0;
+    return static_cast<int>((m_paused_until_ns - now + 999999) / 1000000);
+}
+
+AcceptStats AcceptController::stats() const {
+    AcceptStats stats;
+    stats.accepted  = m_accepted.load();
+    stats.shed      = m_shed.load();
+    stats.exhausted = m_exhausted.load();
+    stats.capped    = m_capped.load();
+    stats.paused    = m_paused.load();
+    stats.empty     = m_empty.load();
+    return stats;
+}
+
+// frees the reserve fd so the pending connections can be accepted and closed, telling their clients to go away
+// instead of leaving them in the backlog, then takes the fd back
+void AcceptController::shedPending() {
+    if (!m_reserve.valid())
+        return;
+
+    m_reserve.close();
+    for (;;) {
+        Socket client;
+        try {
+            client = m_listener.tryAccept();
+        } catch (const SocketError& error) {
+            if (!error.resourceExhausted())
+                throw;
+            break;
+        }
+        if (!client.valid())
+            break;
+        m_shed.add();
+    }
+
+    restoreReserve();
+}
+
+void AcceptController::restoreReserve() {
+    try {
+        m_reserve.create();
+    } catch (const std::runtime_error&) {
+        // still out of fds, acceptReady() tries again
+    }
+}
+
+void AcceptController::updateInterest() {
+    bool      full   = m_options.max_connections != 0 && m_open >= m_options.max_connections;
+    PollEvent wanted = full || m_paused_until_ns != 0 ? PollEvent::NONE : PollEvent::READ;
+    if (wanted == m_armed_for)
+        return;
+
+    m_poll.modifyFd(m_listener.fd(), wanted == PollEvent::NONE ? PollEvent::NONE : armedEvents(), m_tag);
+    if (wanted == PollEvent::NONE)
+        m_paused.add();
+    m_armed_for = wanted;
+}
+
+PollEvent AcceptController::armedEvents() const {
+    return m_options.exclusive ? static_cast<PollEvent>(PollEvent::READ | PollEvent::EXCLUSIVE) : PollEvent::READ;
+}
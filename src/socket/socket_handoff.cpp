@@ -0,0 +1,237 @@
+#include "socket_handoff.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr uint32_t HANDOFF_MAGIC = 0x534f4846; // "SOHF"
+constexpr char     HANDOFF_ACK   = 'k';
+// the count comes from the peer, only this much is reserved up front before the entries prove it
+constexpr uint32_t RESERVE_LIMIT = 4096;
+// names are short labels, a larger size from the peer is rejected before anything is allocated for it
+constexpr uint32_t NAME_LIMIT = 4096;
+
+// opens the transfer, followed by count entries, each a header carrying the descriptor and then the name
+struct Preamble {
+    uint32_t magic;
+    uint32_t count;
+};
+
+struct EntryHeader {
+    uint32_t magic;
+    uint32_t name_size;
+};
+
+[[noreturn]] void throwErrno(const std::string& what) {
+    throw std::runtime_error("handoff " + what + " failed: " + strerror(errno));
+}
+
+sockaddr_un unixAddress(const std::string& path) {
+    sockaddr_un addr{};
+    if (path.empty() || path.size() >= sizeof(addr.sun_path))
+        throw std::invalid_argument("handoff path must be 1 to " + std::to_string(sizeof(addr.sun_path) - 1) +
+                                    " characters: " + path);
+    addr.sun_family = AF_UNIX;
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    return addr;
+}
+
+Socket unixSocket() {
+    Socket s(::socket(AF_UNIX, SOCK_STREAM, 0));
+    if (!s.valid())
+        throwErrno("socket");
+    if (fcntl(s.fd(), F_SETFD, FD_CLOEXEC) == -1)
+        throwErrno("fcntl(FD_CLOEXEC)");
+#ifdef SO_NOSIGPIPE
+    int on = 1;
+    setsockopt(s.fd(), SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+    return s;
+}
+
+// the channel blocks, a peer that stops responding fails it after timeout_ms
+void setTimeouts(const Socket& s, int timeout_ms) {
+    timeval timeout{};
+    timeout.tv_sec  = timeout_ms / 1000;
+    timeout.tv_usec = (timeout_ms % 1000) * 1000;
+    if (setsockopt(s.fd(), SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) == -1 ||
+        setsockopt(s.fd(), SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout)) == -1)
+        throwErrno("setsockopt(SO_RCVTIMEO)");
+}
+
+void sendAll(const Socket& s, const void* data, size_t size) {
+#ifdef MSG_NOSIGNAL
+    int flags = MSG_NOSIGNAL;
+#else
+    int flags = 0;
+#endif
+    const char* bytes = static_cast<const char*>(data);
+    while (size > 0) {
+        ssize_t sent = ::send(s.fd(), bytes, size, flags);
+        if (sent < 0) {
+            if (errno == EINTR)
+                continue;
+            throwErrno("send");
+        }
+        bytes += sent;
+        size -= static_cast<size_t>(sent);
+    }
+}
+
+void recvAll(const Socket& s, void* out, size_t size) {
+    char* bytes = static_cast<char*>(out);
+    while (size > 0) {
+        ssize_t n = ::recv(s.fd(), bytes, size, 0);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            throwErrno("recv");
+        }
+        if (n == 0)
+            throw std::runtime_error("handoff peer closed the channel early");
+        bytes += n;
+        size -= static_cast<size_t>(n);
+    }
+}
+
+// the descriptor rides on the first byte of the header
+void sendEntry(const Socket& s, const HandoffEntry& entry) {
+    EntryHeader header{HANDOFF_MAGIC, static_cast<uint32_t>(entry.name.size())};
+    iovec       iov{&header, sizeof(header)};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+
+    msghdr message{};
+    message.msg_iov        = &iov;
+    message.msg_iovlen     = 1;
+    message.msg_control    = control;
+    message.msg_controllen = sizeof(control);
+    cmsghdr* cmsg          = CMSG_FIRSTHDR(&message);
+    cmsg->cmsg_level       = SOL_SOCKET;
+    cmsg->cmsg_type        = SCM_RIGHTS;
+    cmsg->cmsg_len         = CMSG_LEN(sizeof(int));
+    std::memcpy(CMSG_DATA(cmsg), &entry.fd, sizeof(int));
+
+    ssize_t sent;
+    while ((sent = ::sendmsg(s.fd(), &message, 0)) < 0 && errno == EINTR) {
+    }
+    if (sent < 0)
+        throwErrno("sendmsg");
+    sendAll(s, reinterpret_cast<const char*>(&header) + sent, sizeof(header) - static_cast<size_t>(sent));
+    sendAll(s, entry.name.data(), entry.name.size());
+}
+
+HandoffSocket recvEntry(const Socket& s) {
+    EntryHeader header{};
+    iovec       iov{&header, sizeof(header)};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+
+    msghdr message{};
+    message.msg_iov        = &iov;
+    message.msg_iovlen     = 1;
+    message.msg_control    = control;
+    message.msg_controllen = sizeof(control);
+#ifdef MSG_CMSG_CLOEXEC
+    int flags = MSG_CMSG_CLOEXEC;
+#else
+    int flags = 0;
+#endif
+    ssize_t n;
+    while ((n = ::recvmsg(s.fd(), &message, flags)) < 0 && errno == EINTR) {
+    }
+    if (n < 0)
+        throwErrno("recvmsg");
+    if (n == 0)
+        throw std::runtime_error("handoff peer closed the channel early");
+
+    HandoffSocket entry;
+    cmsghdr*      cmsg = CMSG_FIRSTHDR(&message);
+    if (cmsg != nullptr && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+        int fd;
+        std::memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+        entry.socket = Socket(fd);
+#ifndef MSG_CMSG_CLOEXEC
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+#endif
+    }
+    if ((message.msg_flags & MSG_CTRUNC) != 0 || !entry.socket.valid())
+        throw std::runtime_error("handoff entry arrived without its descriptor");
+
+    recvAll(s, reinterpret_cast<char*>(&header) + n, sizeof(header) - static_cast<size_t>(n));
+    if (header.magic != HANDOFF_MAGIC)
+        throw std::runtime_error("handoff entry is malformed");
+    if (header.name_size > NAME_LIMIT)
+        throw std::runtime_error("handoff entry name is too long: " + std::to_string(header.name_size) + " bytes");
+    entry.name.resize(header.name_size);
+    recvAll(s, &entry.name[0], entry.name.size());
+    return entry;
+}
+
+} // namespace
+
+HandoffServer::HandoffServer(const std::string& path) : m_listener(unixSocket()), m_path(path) {
+    sockaddr_un addr = unixAddress(path);
+    ::unlink(path.c_str());
+    if (::bind(m_listener.fd(), reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == -1)
+        throwErrno("bind to " + path);
+    if (::listen(m_listener.fd(), 4) == -1)
+        throwErrno("listen");
+    m_listener.setNonBlocking(true);
+}
+
+HandoffServer::~HandoffServer() {
+    ::unlink(m_path.c_str());
+}
+
+bool HandoffServer::handOff(const std::vector<HandoffEntry>& entries, int timeout_ms) {
+    // errno is read before a Socket exists, nothing in between may change it
+    int fd = ::accept(m_listener.fd(), nullptr, nullptr);
+    if (fd == -1) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ECONNABORTED)
+            return false;
+        throwErrno("accept");
+    }
+    Socket channel(fd);
+    // bsd passes O_NONBLOCK on to accepted sockets
+    channel.setNonBlocking(false);
+    setTimeouts(channel, timeout_ms);
+
+    Preamble preamble{HANDOFF_MAGIC, static_cast<uint32_t>(entries.size())};
+    sendAll(channel, &preamble, sizeof(preamble));
+    for (const auto& entry : entries)
+        sendEntry(channel, entry);
+
+    char ack = 0;
+    recvAll(channel, &ack, 1);
+    if (ack != HANDOFF_ACK)
+        throw std::runtime_error("handoff was not confirmed");
+    return true;
+}
+
+std::vector<HandoffSocket> receiveHandoff(const std::string& path, int timeout_ms) {
+    sockaddr_un addr    = unixAddress(path);
+    Socket      channel = unixSocket();
+    if (::connect(channel.fd(), reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == -1)
+        throwErrno("connect to " + path);
+    setTimeouts(channel, timeout_ms);
+
+    Preamble preamble{};
+    recvAll(channel, &preamble, sizeof(preamble));
+    if (preamble.magic != HANDOFF_MAGIC)
+        throw std::runtime_error("no handoff server at " + path);
+
+    std::vector<HandoffSocket> sockets;
+    sockets.reserve(std::min(preamble.count, RESERVE_LIMIT));
+    for (uint32_t i = 0; i < preamble.count; i++)
+        sockets.push_back(recvEntry(channel));
+    sendAll(channel, &HANDOFF_ACK, 1);
+    return sockets;
+}
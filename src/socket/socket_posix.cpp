@@ -1,35 +1,106 @@
 #ifndef _WIN32
 
+#include "histogram.hpp"
 #include "socket.hpp"
+#include "trace.hpp"
 
 #include <arpa/inet.h>
 #include <cerrno>
 #include <cstddef>
+#include <climits>
 #include <cstring>
+#include <ctime>
+#include <deque>
 #include <fcntl.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <stdexcept>
 #include <string>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #include <vector>
 
+#ifdef __linux__
+#include <linux/errqueue.h>
+#include <linux/filter.h>
+#include <linux/net_tstamp.h>
+#endif
+
+struct TxStampLog {
+    struct Send {
+        uint64_t end; // bytes sent up to the end of this send
+        uint64_t start_ns;
+    };
+
+    uint64_t         sent = 0;
+    std::deque<Send> sends; // oldest first
+};
+
+namespace {
+
+// a peer that went away fails the send with EPIPE instead of killing the process
+#ifdef MSG_NOSIGNAL
+constexpr int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+constexpr int SEND_FLAGS = 0;
+#endif
+
+// the same for platforms without MSG_NOSIGNAL, where it is a socket option
+int noSigpipe(int fd) {
+#ifdef SO_NOSIGPIPE
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+    return fd;
+}
+
+// sends remembered while their stamps are not read, the oldest are forgotten beyond that
+constexpr size_t TX_STAMP_BACKLOG = 4096;
+
+void logSend(TxStampLog& log, socket_size_t bytes, uint64_t start_ns) {
+    if (bytes <= 0)
+        return;
+    log.sent += static_cast<uint64_t>(bytes);
+    log.sends.push_back({log.sent, start_ns});
+    if (log.sends.size() > TX_STAMP_BACKLOG)
+        log.sends.pop_front();
+}
+
+#ifdef __linux__
+// software stamps are CLOCK_REALTIME, they are moved to the monotonicNs() clock by their age
+uint64_t stampToMonotonic(const timespec& stamp) {
+    timespec now{};
+    clock_gettime(CLOCK_REALTIME, &now);
+    uint64_t monotonic = monotonicNs();
+    int64_t  age       = (static_cast<int64_t>(now.tv_sec) - stamp.tv_sec) * 1000000000 + (now.tv_nsec - stamp.tv_nsec);
+    return age > 0 && static_cast<uint64_t>(age) < monotonic ? monotonic - static_cast<uint64_t>(age) : monotonic;
+}
+#endif
+
+} // namespace
+
 Socket::Socket() : m_fd(INVALID_SOCKET_FD) {}
 Socket::Socket(socket_t fd) : m_fd(fd) {}
 Socket::~Socket() {
     close();
 }
 
-Socket::Socket(Socket&& other) noexcept : m_fd(other.m_fd) {
+Socket::Socket(Socket&& other) noexcept
+    : m_fd(other.m_fd), m_stats(other.m_stats), m_stamps(std::move(other.m_stamps)) {
     other.m_fd = INVALID_SOCKET_FD;
+    other.m_stats.reset();
 }
 
 Socket& Socket::operator=(Socket&& other) noexcept {
     if (this != &other) {
         close();
         m_fd       = other.m_fd;
+        m_stats    = other.m_stats;
+        m_stamps   = std::move(other.m_stamps);
         other.m_fd = INVALID_SOCKET_FD;
+        other.m_stats.reset();
     }
     return *this;
 }
@@ -38,6 +109,7 @@ void Socket::create() {
     m_fd = ::socket(AF_INET, SOCK_STREAM, 0);
     if (m_fd < 0)
         throw std::runtime_error("socket creation failed");
+    noSigpipe(m_fd);
 }
 
 void Socket::close() {
@@ -45,6 +117,7 @@ void Socket::close() {
         ::close(m_fd);
         m_fd = INVALID_SOCKET_FD;
     }
+    m_stamps.reset();
 }
 
 bool Socket::valid() const {
@@ -67,6 +140,58 @@ void Socket::setReuseAddr(bool enable) {
         throw std::runtime_error("setsockopt(SO_REUSEADDR) failed");
 }
 
+void Socket::setReusePort(bool enable) {
+    int opt = enable ? 1 : 0;
+    if (::setsockopt(m_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0)
+        throw std::runtime_error("setsockopt(SO_REUSEPORT) failed: " + std::string(strerror(errno)));
+}
+
+void Socket::setCork(bool enable) {
+    int opt = enable ? 1 : 0;
+#if defined(TCP_CORK)
+    if (::setsockopt(m_fd, IPPROTO_TCP, TCP_CORK, &opt, sizeof(opt)) < 0)
+        throw std::runtime_error("setsockopt(TCP_CORK) failed: " + std::string(strerror(errno)));
+#elif defined(TCP_NOPUSH)
+    if (::setsockopt(m_fd, IPPROTO_TCP, TCP_NOPUSH, &opt, sizeof(opt)) < 0)
+        throw std::runtime_error("setsockopt(TCP_NOPUSH) failed: " + std::string(strerror(errno)));
+#else
+    (void)opt;
+    throw std::runtime_error("TCP_CORK is not supported on this platform");
+#endif
+}
+
+void Socket::steerByCpu(unsigned listeners) {
+    if (listeners == 0)
+        throw std::invalid_argument("steerByCpu needs at least one listener");
+#ifdef __linux__
+    // A = cpu % listeners, the returned index picks the socket of the group
+    sock_filter code[] = {
+        {BPF_LD | BPF_W | BPF_ABS, 0, 0, static_cast<uint32_t>(SKF_AD_OFF + SKF_AD_CPU)},
+        {BPF_ALU | BPF_MOD | BPF_K, 0, 0, listeners},
+        {BPF_RET | BPF_A, 0, 0, 0},
+    };
+    sock_fprog program{};
+    program.len    = sizeof(code) / sizeof(code[0]);
+    program.filter = code;
+    if (::setsockopt(m_fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &program, sizeof(program)) < 0)
+        throw std::runtime_error("setsockopt(SO_ATTACH_REUSEPORT_CBPF) failed: " + std::string(strerror(errno)));
+#else
+    throw std::runtime_error("steering by CPU is not supported on this platform");
+#endif
+}
+
+int Socket::incomingCpu() const {
+#ifdef SO_INCOMING_CPU
+    int       cpu = -1;
+    socklen_t len = sizeof(cpu);
+    if (::getsockopt(m_fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &len) < 0)
+        return -1;
+    return cpu;
+#else
+    return -1;
+#endif
+}
+
 void Socket::setNonBlocking(bool enable) {
     int flags = fcntl(m_fd, F_GETFL, 0);
     if (flags == -1)
@@ -99,11 +224,29 @@ void Socket::listen(int backlog) {
         throw std::runtime_error("listen failed: " + std::string(strerror(errno)));
 }
 
+bool SocketError::resourceExhausted() const {
+    return m_code == EMFILE || m_code == ENFILE || m_code == ENOBUFS || m_code == ENOMEM;
+}
+
 Socket Socket::accept() {
     int client_fd = ::accept(m_fd, nullptr, nullptr);
-    if (client_fd < 0)
-        throw std::runtime_error("accept failed: " + std::string(strerror(errno)));
-    return Socket(client_fd);
+    if (client_fd < 0) {
+        // saved first, the order the message and the code are evaluated in is unspecified
+        int error = errno;
+        throw SocketError("accept failed: " + std::string(strerror(error)), error);
+    }
+    return Socket(noSigpipe(client_fd));
+}
+
+Socket Socket::tryAccept() {
+    int client_fd = ::accept(m_fd, nullptr, nullptr);
+    if (client_fd < 0) {
+        int error = errno;
+        if (error == EAGAIN || error == EWOULDBLOCK || error == EINTR || error == ECONNABORTED)
+            return Socket();
+        throw SocketError("accept failed: " + std::string(strerror(error)), error);
+    }
+    return Socket(noSigpipe(client_fd));
 }
 
 void Socket::connect(const std::string& host, uint16_t port) {
@@ -116,19 +259,61 @@ void Socket::connect(const std::string& host, uint16_t port) {
         throw std::runtime_error("connect failed: " + std::string(strerror(errno)));
 }
 
-socket_size_t Socket::recv(void* buffer, size_t size) {
+bool Socket::tryConnect(const std::string& host, uint16_t port) {
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port   = htons(port);
+    if (::inet_pton(AF_INET, host.c_str(), &addr.sin_addr) <= 0)
+        throw std::runtime_error("invalid address");
+    if (::connect(m_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0)
+        return true;
+    if (errno == EINPROGRESS || errno == EINTR)
+        return false;
+    throw std::runtime_error("connect failed: " + std::string(strerror(errno)));
+}
+
+int Socket::pendingError() {
+    int       error = 0;
+    socklen_t len   = sizeof(error);
+    if (::getsockopt(m_fd, SOL_SOCKET, SO_ERROR, &error, &len) < 0)
+        return errno;
+    return error;
+}
+
+void Socket::shutdown(ShutdownMode how) {
+    int native = how == ShutdownMode::READ ? SHUT_RD : how == ShutdownMode::WRITE ? SHUT_WR : SHUT_RDWR;
+    if (::shutdown(m_fd, native) < 0)
+        throw std::runtime_error("shutdown failed: " + std::string(strerror(errno)));
+}
+
+socket_size_t Socket::tryRecv(void* buffer, size_t size) {
     if (m_fd == INVALID_SOCKET_FD)
         throw std::runtime_error("recv on invalid socket");
 
-    ssize_t bytes = ::recv(m_fd, buffer, size, 0);
+    // errno is copied before the hooks run, a thread's first latency record sets up state that may change it
+    uint64_t start = ioTimingEnabled() ? monotonicNs() : 0;
+    ssize_t  bytes = ::recv(m_fd, buffer, size, 0);
+    int      error = bytes < 0 ? errno : 0;
+    SOCKETPOLL_TRACE(TraceType::RECV, m_fd, bytes < 0 ? -error : bytes, 0);
+    if (start != 0)
+        recordRecvLatency(monotonicNs() - start);
+
     if (bytes < 0) {
-        if (errno == EAGAIN || errno == EWOULDBLOCK)
-            return 0; // not an error, just no data
-        throw std::runtime_error("recv failed: " + std::string(strerror(errno)));
+        bool would_block = error == EAGAIN || error == EWOULDBLOCK;
+        m_stats.recordRecv(bytes, would_block);
+        if (would_block)
+            return -1;
+        throw std::runtime_error("recv failed: " + std::string(strerror(error)));
     }
+    m_stats.recordRecv(bytes, false);
     return bytes;
 }
 
+socket_size_t Socket::recv(void* buffer, size_t size) {
+    socket_size_t bytes = tryRecv(buffer, size);
+    return bytes < 0 ? 0 : bytes; // not an error, just no data
+}
+
 socket_size_t Socket::recv(std::string& out, size_t max_size) {
     std::vector<char> buffer(max_size);
     ssize_t           bytes = recv(buffer.data(), buffer.size());
@@ -137,21 +322,219 @@ socket_size_t Socket::recv(std::string& out, size_t max_size) {
     }
     return bytes;
 }
-socket_size_t Socket::send(const void* data, size_t size) {
+socket_size_t Socket::trySend(const void* data, size_t size) {
     if (m_fd == INVALID_SOCKET_FD)
         throw std::runtime_error("send on invalid socket");
 
-    ssize_t sent = ::send(m_fd, data, size, 0);
+    bool     timed = ioTimingEnabled();
+    uint64_t start = timed || m_stamps ? monotonicNs() : 0;
+    ssize_t  sent  = ::send(m_fd, data, size, SEND_FLAGS);
+    int      error = sent < 0 ? errno : 0;
+    SOCKETPOLL_TRACE(TraceType::SEND, m_fd, sent < 0 ? -error : sent, 0);
+    if (timed)
+        recordSendLatency(monotonicNs() - start);
+
     if (sent < 0) {
-        if (errno == EAGAIN || errno == EWOULDBLOCK) {
-            return 0;
+        bool would_block = error == EAGAIN || error == EWOULDBLOCK;
+        m_stats.recordSend(sent, would_block);
+        if (would_block) {
+            return -1;
         }
-        throw std::runtime_error("send failed: " + std::string(strerror(errno)));
+        throw std::runtime_error("send failed: " + std::string(strerror(error)));
     }
+    m_stats.recordSend(sent, false);
+    if (m_stamps)
+        logSend(*m_stamps, sent, start);
     return sent;
 }
+
+socket_size_t Socket::send(const void* data, size_t size) {
+    socket_size_t sent = trySend(data, size);
+    return sent < 0 ? 0 : sent;
+}
 socket_size_t Socket::send(const std::string& data) {
     return send(data.data(), data.size());
 }
 
-#endif
\ No newline at end of file
+// IoSlice is laid out like iovec, so the slices go to the kernel as they are
+static_assert(sizeof(IoSlice) == sizeof(iovec) && offsetof(IoSlice, data) == offsetof(iovec, iov_base) &&
+                  offsetof(IoSlice, size) == offsetof(iovec, iov_len),
+              "IoSlice must match iovec");
+
+socket_size_t Socket::trySendv(const IoSlice* slices, size_t count) {
+    if (m_fd == INVALID_SOCKET_FD)
+        throw std::runtime_error("send on invalid socket");
+
+    msghdr message{};
+    message.msg_iov    = reinterpret_cast<iovec*>(const_cast<IoSlice*>(slices));
+    message.msg_iovlen = static_cast<decltype(message.msg_iovlen)>(count < IOV_MAX ? count : IOV_MAX);
+
+    bool     timed = ioTimingEnabled();
+    uint64_t start = timed || m_stamps ? monotonicNs() : 0;
+    ssize_t  sent  = ::sendmsg(m_fd, &message, SEND_FLAGS);
+    int      error = sent < 0 ? errno : 0;
+    SOCKETPOLL_TRACE(TraceType::SEND, m_fd, sent < 0 ? -error : sent, message.msg_iovlen);
+    if (timed)
+        recordSendLatency(monotonicNs() - start);
+
+    if (sent < 0) {
+        bool would_block = error == EAGAIN || error == EWOULDBLOCK;
+        m_stats.recordSend(sent, would_block);
+        if (would_block)
+            return -1;
+        throw std::runtime_error("send failed: " + std::string(strerror(error)));
+    }
+    m_stats.recordSend(sent, false);
+    if (m_stamps)
+        logSend(*m_stamps, sent, start);
+    return sent;
+}
+
+socket_size_t Socket::sendv(const IoSlice* slices, size_t count) {
+    socket_size_t sent = trySendv(slices, count);
+    return sent < 0 ? 0 : sent;
+}
+
+void Socket::enableTimestamps(bool enable) {
+#ifdef __linux__
+    // setting OPT_ID while it is set keeps the kernel's numbering, a new log would start at 0 against it. after a
+    // disable, setting it again restarts the numbering at the next byte, as does the new log
+    if (enable == (m_stamps != nullptr))
+        return;
+    // OPT_ID numbers transmit stamps by byte offset, OPT_TSONLY leaves the sent data out of the error queue
+    int flags = enable ? SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE |
+                             SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY
+                       : 0;
+    if (::setsockopt(m_fd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) < 0)
+        throw std::runtime_error("setsockopt(SO_TIMESTAMPING) failed: " + std::string(strerror(errno)));
+    if (enable)
+        m_stamps.reset(new TxStampLog());
+    else
+        m_stamps.reset();
+#else
+    (void)enable;
+    throw std::runtime_error("kernel timestamps are not supported on this platform");
+#endif
+}
+
+socket_size_t Socket::tryRecvStamped(void* buffer, size_t size, uint64_t& kernel_ns) {
+    kernel_ns = 0;
+#ifdef __linux__
+    if (m_fd == INVALID_SOCKET_FD)
+        throw std::runtime_error("recv on invalid socket");
+
+    iovec iov{buffer, size};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(scm_timestamping))];
+    msghdr message{};
+    message.msg_iov        = &iov;
+    message.msg_iovlen     = 1;
+    message.msg_control    = control;
+    message.msg_controllen = sizeof(control);
+
+    uint64_t start = ioTimingEnabled() ? monotonicNs() : 0;
+    ssize_t  bytes = ::recvmsg(m_fd, &message, 0);
+    int      error = bytes < 0 ? errno : 0;
+    SOCKETPOLL_TRACE(TraceType::RECV, m_fd, bytes < 0 ? -error : bytes, 0);
+    if (start != 0)
+        recordRecvLatency(monotonicNs() - start);
+
+    if (bytes < 0) {
+        bool would_block = error == EAGAIN || error == EWOULDBLOCK;
+        m_stats.recordRecv(bytes, would_block);
+        if (would_block)
+            return -1;
+        throw std::runtime_error("recv failed: " + std::string(strerror(error)));
+    }
+    m_stats.recordRecv(bytes, false);
+
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(&message); cmsg != nullptr; cmsg = CMSG_NXTHDR(&message, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_TIMESTAMPING)
+            continue;
+        scm_timestamping stamps;
+        std::memcpy(&stamps, CMSG_DATA(cmsg), sizeof(stamps));
+        if (stamps.ts[0].tv_sec == 0 && stamps.ts[0].tv_nsec == 0)
+            continue;
+        kernel_ns = stampToMonotonic(stamps.ts[0]);
+        m_stats.recordRxStamp();
+        recordKernelToUserLatency(monotonicNs() - kernel_ns);
+    }
+    return bytes;
+#else
+    return tryRecv(buffer, size);
+#endif
+}
+
+size_t Socket::readTxTimestamps(std::vector<TxTimestamp>& out) {
+#ifdef __linux__
+    if (m_stamps == nullptr)
+        return 0;
+
+    size_t found = 0;
+    for (;;) {
+        alignas(cmsghdr) char control[CMSG_SPACE(sizeof(scm_timestamping)) + CMSG_SPACE(sizeof(sock_extended_err)) +
+                                      CMSG_SPACE(sizeof(sockaddr_storage))];
+        msghdr message{};
+        message.msg_control    = control;
+        message.msg_controllen = sizeof(control);
+        if (::recvmsg(m_fd, &message, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            if (errno == EINTR)
+                continue;
+            throw std::runtime_error("recvmsg(MSG_ERRQUEUE) failed: " + std::string(strerror(errno)));
+        }
+
+        scm_timestamping stamps{};
+        bool             stamped = false;
+        bool             sent    = false;
+        uint32_t         key     = 0;
+        for (cmsghdr* cmsg = CMSG_FIRSTHDR(&message); cmsg != nullptr; cmsg = CMSG_NXTHDR(&message, cmsg)) {
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPING) {
+                std::memcpy(&stamps, CMSG_DATA(cmsg), sizeof(stamps));
+                stamped = true;
+            } else if ((cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) ||
+                       (cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR)) {
+                sock_extended_err error;
+                std::memcpy(&error, CMSG_DATA(cmsg), sizeof(error));
+                sent = error.ee_errno == ENOMSG && error.ee_origin == SO_EE_ORIGIN_TIMESTAMPING &&
+                       error.ee_info == SCM_TSTAMP_SND;
+                key  = error.ee_data;
+            }
+        }
+        if (!stamped || !sent)
+            continue;
+
+        // the key is the offset of the last byte the stamp covers, in 32 bits. bytes that reached the fd past Socket
+        // (splice, a raw send) moved it ahead of the log: the first key beyond everything logged shifts the log to
+        // match, taking the stamp for the latest send
+        auto&   sends = m_stamps->sends;
+        int32_t ahead = static_cast<int32_t>(key - static_cast<uint32_t>(m_stamps->sent - 1));
+        if (ahead > 0) {
+            m_stamps->sent += static_cast<uint64_t>(ahead);
+            for (auto& send : sends)
+                send.end += static_cast<uint64_t>(ahead);
+        }
+        // sends before the key lost their stamps when the kernel merged them into a later one
+        while (!sends.empty() && static_cast<int32_t>(key - static_cast<uint32_t>(sends.front().end - 1)) > 0)
+            sends.pop_front();
+        if (sends.empty() || static_cast<uint32_t>(sends.front().end - 1) != key)
+            continue;
+
+        TxTimestamp stamp;
+        stamp.bytes   = sends.front().end;
+        stamp.send_ns = sends.front().start_ns;
+        stamp.wire_ns = stampToMonotonic(stamps.ts[0]);
+        sends.pop_front();
+        out.push_back(stamp);
+        m_stats.recordTxStamp();
+        recordUserToWireLatency(stamp.wire_ns > stamp.send_ns ? stamp.wire_ns - stamp.send_ns : 0);
+        found++;
+    }
+    return found;
+#else
+    (void)out;
+    return 0;
+#endif
+}
+
+#endif
@@ -26,7 +26,12 @@ struct WSAInit {
 
 static WSAInit wsa_init;
 
+#include "histogram.hpp"
 #include "socket.hpp"
+#include "trace.hpp"
+
+// no kernel timestamps on windows, enableTimestamps() never creates one
+struct TxStampLog {};
 
 Socket::Socket() : m_fd(INVALID_SOCKET) {}
 Socket::Socket(socket_t fd) : m_fd(fd) {}
@@ -34,15 +39,20 @@ Socket::~Socket() {
     close();
 }
 
-Socket::Socket(Socket&& other) noexcept : m_fd(other.m_fd) {
+Socket::Socket(Socket&& other) noexcept
+    : m_fd(other.m_fd), m_stats(other.m_stats), m_stamps(std::move(other.m_stamps)) {
     other.m_fd = INVALID_SOCKET_FD;
+    other.m_stats.reset();
 }
 
 Socket& Socket::operator=(Socket&& other) noexcept {
     if (this != &other) {
         close();
         m_fd       = other.m_fd;
+        m_stats    = other.m_stats;
+        m_stamps   = std::move(other.m_stamps);
         other.m_fd = INVALID_SOCKET_FD;
+        other.m_stats.reset();
     }
     return *this;
 }
@@ -80,6 +90,22 @@ void Socket::setReuseAddr(bool enable) {
     setsockopt(m_fd, SOL_SOCKET, SO_REUSEADDR, (char*)&opt, sizeof(opt));
 }
 
+void Socket::setReusePort(bool /*enable*/) {
+    throw std::runtime_error("SO_REUSEPORT is not supported on windows");
+}
+
+void Socket::setCork(bool /*enable*/) {
+    throw std::runtime_error("TCP_CORK is not supported on windows");
+}
+
+void Socket::steerByCpu(unsigned /*listeners*/) {
+    throw std::runtime_error("steering by CPU is not supported on this platform");
+}
+
+int Socket::incomingCpu() const {
+    return -1;
+}
+
 void Socket::setNonBlocking(bool enable) {
     u_long mode = enable ? 1 : 0;
     ioctlsocket(m_fd, FIONBIO, &mode);
@@ -105,10 +131,26 @@ void Socket::listen(int backlog) {
         throw std::runtime_error("listen failed");
 }
 
+bool SocketError::resourceExhausted() const {
+    return m_code == WSAEMFILE || m_code == WSAENOBUFS;
+}
+
 Socket Socket::accept() {
     socket_t client_fd = ::accept(m_fd, nullptr, nullptr);
     if (client_fd == INVALID_SOCKET) {
-        throw std::runtime_error("accept failed: " + std::to_string(WSAGetLastError()));
+        int error = WSAGetLastError();
+        throw SocketError("accept failed: " + std::to_string(error), error);
+    }
+    return Socket(client_fd);
+}
+
+Socket Socket::tryAccept() {
+    socket_t client_fd = ::accept(m_fd, nullptr, nullptr);
+    if (client_fd == INVALID_SOCKET) {
+        int error = WSAGetLastError();
+        if (error == WSAEWOULDBLOCK || error == WSAECONNRESET)
+            return Socket();
+        throw SocketError("accept failed: " + std::to_string(error), error);
     }
     return Socket(client_fd);
 }
@@ -123,19 +165,59 @@ void Socket::connect(const std::string& host, uint16_t port) {
         throw std::runtime_error("connect failed");
 }
 
-socket_size_t Socket::recv(void* buffer, size_t size) {
+bool Socket::tryConnect(const std::string& host, uint16_t port) {
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port   = htons(port);
+    if (::inet_pton(AF_INET, host.c_str(), &addr.sin_addr) <= 0)
+        throw std::runtime_error("invalid address");
+    if (::connect(m_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0)
+        return true;
+    if (WSAGetLastError() == WSAEWOULDBLOCK)
+        return false;
+    throw std::runtime_error("connect failed: " + std::to_string(WSAGetLastError()));
+}
+
+int Socket::pendingError() {
+    int error = 0;
+    int len   = sizeof(error);
+    if (::getsockopt(m_fd, SOL_SOCKET, SO_ERROR, reinterpret_cast<char*>(&error), &len) == SOCKET_ERROR)
+        return WSAGetLastError();
+    return error;
+}
+
+void Socket::shutdown(ShutdownMode how) {
+    int native = how == ShutdownMode::READ ? SD_RECEIVE : how == ShutdownMode::WRITE ? SD_SEND : SD_BOTH;
+    if (::shutdown(m_fd, native) == SOCKET_ERROR)
+        throw std::runtime_error("shutdown failed: " + std::to_string(WSAGetLastError()));
+}
+
+socket_size_t Socket::tryRecv(void* buffer, size_t size) {
     if (m_fd == INVALID_SOCKET_FD)
         throw std::runtime_error("recv on invalid socket");
 
+    uint64_t      start = ioTimingEnabled() ? monotonicNs() : 0;
     socket_size_t bytes = ::recv(m_fd, static_cast<char*>(buffer), static_cast<int>(size), 0);
+    SOCKETPOLL_TRACE(TraceType::RECV, m_fd, bytes < 0 ? -WSAGetLastError() : bytes, 0);
+    if (start != 0)
+        recordRecvLatency(monotonicNs() - start);
+
     if (bytes < 0) {
-        if (WSAGetLastError() == WSAEWOULDBLOCK)
-            return 0; // not an error, just no data
+        bool would_block = WSAGetLastError() == WSAEWOULDBLOCK;
+        m_stats.recordRecv(bytes, would_block);
+        if (would_block)
+            return -1;
         throw std::runtime_error("recv failed");
     }
+    m_stats.recordRecv(bytes, false);
     return bytes;
 }
 
+socket_size_t Socket::recv(void* buffer, size_t size) {
+    socket_size_t bytes = tryRecv(buffer, size);
+    return bytes < 0 ? 0 : bytes; // not an error, just no data
+}
+
 socket_size_t Socket::recv(std::string& out, size_t max_size) {
     std::vector<char> buffer(max_size);
     socket_size_t     bytes = recv(buffer.data(), buffer.size());
@@ -144,21 +226,82 @@ socket_size_t Socket::recv(std::string& out, size_t max_size) {
     }
     return bytes;
 }
-socket_size_t Socket::send(const void* data, size_t size) {
+socket_size_t Socket::trySend(const void* data, size_t size) {
     if (m_fd == INVALID_SOCKET_FD)
         throw std::runtime_error("send on invalid socket");
 
-    socket_size_t sent = ::send(m_fd, static_cast<const char*>(data), static_cast<int>(size), 0);
+    uint64_t      start = ioTimingEnabled() ? monotonicNs() : 0;
+    socket_size_t sent  = ::send(m_fd, static_cast<const char*>(data), static_cast<int>(size), 0);
+    SOCKETPOLL_TRACE(TraceType::SEND, m_fd, sent < 0 ? -WSAGetLastError() : sent, 0);
+    if (start != 0)
+        recordSendLatency(monotonicNs() - start);
+
     if (sent < 0) {
-        if (WSAGetLastError() == WSAEWOULDBLOCK) {
-            return 0;
+        bool would_block = WSAGetLastError() == WSAEWOULDBLOCK;
+        m_stats.recordSend(sent, would_block);
+        if (would_block) {
+            return -1;
         }
         throw std::runtime_error("send failed");
     }
+    m_stats.recordSend(sent, false);
     return sent;
 }
+
+socket_size_t Socket::send(const void* data, size_t size) {
+    socket_size_t sent = trySend(data, size);
+    return sent < 0 ? 0 : sent;
+}
 socket_size_t Socket::send(const std::string& data) {
     return send(data.data(), data.size());
 }
 
-#endif
\ No newline at end of file
+socket_size_t Socket::trySendv(const IoSlice* slices, size_t count) {
+    if (m_fd == INVALID_SOCKET_FD)
+        throw std::runtime_error("send on invalid socket");
+
+    // WSABUF puts the length first, the slices are copied
+    std::array<WSABUF, 64> buffers;
+    DWORD                  used = static_cast<DWORD>(count < buffers.size() ? count : buffers.size());
+    for (DWORD i = 0; i < used; i++) {
+        buffers[i].buf = static_cast<CHAR*>(const_cast<void*>(slices[i].data));
+        buffers[i].len = static_cast<ULONG>(slices[i].size);
+    }
+
+    uint64_t start  = ioTimingEnabled() ? monotonicNs() : 0;
+    DWORD    sent   = 0;
+    int      result = WSASend(m_fd, buffers.data(), used, &sent, 0, nullptr, nullptr);
+    SOCKETPOLL_TRACE(TraceType::SEND, m_fd, result == SOCKET_ERROR ? -WSAGetLastError() : sent, used);
+    if (start != 0)
+        recordSendLatency(monotonicNs() - start);
+
+    if (result == SOCKET_ERROR) {
+        bool would_block = WSAGetLastError() == WSAEWOULDBLOCK;
+        m_stats.recordSend(-1, would_block);
+        if (would_block)
+            return -1;
+        throw std::runtime_error("send failed");
+    }
+    m_stats.recordSend(static_cast<int64_t>(sent), false);
+    return static_cast<socket_size_t>(sent);
+}
+
+socket_size_t Socket::sendv(const IoSlice* slices, size_t count) {
+    socket_size_t sent = trySendv(slices, count);
+    return sent < 0 ? 0 : sent;
+}
+
+void Socket::enableTimestamps(bool /*enable*/) {
+    throw std::runtime_error("kernel timestamps are not supported on this platform");
+}
+
+socket_size_t Socket::tryRecvStamped(void* buffer, size_t size, uint64_t& kernel_ns) {
+    kernel_ns = 0;
+    return tryRecv(buffer, size);
+}
+
+size_t Socket::readTxTimestamps(std::vector<TxTimestamp>& /*out*/) {
+    return 0;
+}
+
+#endif
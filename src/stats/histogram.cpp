@@ -0,0 +1,166 @@
+#include "histogram.hpp"
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <sstream>
+
+uint64_t histogramBucketValue(size_t bucket) {
+    if (bucket < (size_t{1} << HISTOGRAM_SUB_BITS))
+        return bucket;
+    size_t   group = bucket >> HISTOGRAM_SUB_BITS;
+    uint64_t sub   = bucket & ((size_t{1} << HISTOGRAM_SUB_BITS) - 1);
+    unsigned shift = static_cast<unsigned>(group - 1);
+    uint64_t low   = ((uint64_t{1} << HISTOGRAM_SUB_BITS) + sub) << shift;
+    return low + (uint64_t{1} << shift) - 1;
+}
+
+void HistogramSnapshot::merge(const HistogramSnapshot& other) {
+    if (other.count == 0)
+        return;
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++)
+        counts[i] += other.counts[i];
+    min = count == 0 ? other.min : std::min(min, other.min);
+    max = std::max(max, other.max);
+    count += other.count;
+    sum += other.sum;
+}
+
+uint64_t HistogramSnapshot::percentile(double p) const {
+    if (count == 0)
+        return 0;
+    if (p <= 0.0)
+        return min;
+
+    auto rank = static_cast<uint64_t>(p / 100.0 * static_cast<double>(count) + 0.5);
+    rank      = std::max<uint64_t>(rank, 1);
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += counts[i];
+        if (seen >= rank)
+            return std::min(std::max(histogramBucketValue(i), min), max);
+    }
+    return max;
+}
+
+std::string toJson(const HistogramSnapshot& snapshot) {
+    std::ostringstream out;
+    out << "{\"count\":" << snapshot.count << ",\"mean\":" << snapshot.mean() << ",\"min\":" << snapshot.min
+        << ",\"p50\":" << snapshot.percentile(50) << ",\"p90\":" << snapshot.percentile(90)
+        << ",\"p99\":" << snapshot.percentile(99) << ",\"p999\":" << snapshot.percentile(99.9)
+        << ",\"p9999\":" << snapshot.percentile(99.99) << ",\"max\":" << snapshot.max << "}";
+    return out.str();
+}
+
+HistogramSnapshot LatencyHistogram::snapshot() const {
+    HistogramSnapshot snapshot;
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++)
+        snapshot.counts[i] = m_counts[i].load(std::memory_order_relaxed);
+    snapshot.count = m_count.load(std::memory_order_relaxed);
+    snapshot.sum   = m_sum.load(std::memory_order_relaxed);
+    snapshot.min   = snapshot.count == 0 ? 0 : m_min.load(std::memory_order_relaxed);
+    snapshot.max   = m_max.load(std::memory_order_relaxed);
+    return snapshot;
+}
+
+void LatencyHistogram::reset() {
+    for (auto& bucket : m_counts)
+        bucket.store(0, std::memory_order_relaxed);
+    m_count.store(0, std::memory_order_relaxed);
+    m_sum.store(0, std::memory_order_relaxed);
+    m_min.store(UINT64_MAX, std::memory_order_relaxed);
+    m_max.store(0, std::memory_order_relaxed);
+}
+
+std::atomic<bool> io_timing_enabled{false};
+
+namespace {
+
+struct ThreadIoLatency {
+    LatencyHistogram recv;
+    LatencyHistogram send;
+    LatencyHistogram kernel_to_user;
+    LatencyHistogram user_to_wire;
+};
+
+// live per-thread histograms plus the totals of threads that already exited
+struct IoLatencyRegistry {
+    std::mutex                    mutex;
+    std::vector<ThreadIoLatency*> threads;
+    IoLatencySnapshot             retired;
+};
+
+IoLatencyRegistry& registry() {
+    static IoLatencyRegistry* instance = new IoLatencyRegistry(); // leaked so thread exits during shutdown are safe
+    return *instance;
+}
+
+struct ThreadIoLatencyHandle {
+    std::unique_ptr<ThreadIoLatency> latency = std::make_unique<ThreadIoLatency>();
+
+    ThreadIoLatencyHandle() {
+        std::lock_guard<std::mutex> lock(registry().mutex);
+        registry().threads.push_back(latency.get());
+    }
+
+    ~ThreadIoLatencyHandle() {
+        std::lock_guard<std::mutex> lock(registry().mutex);
+        auto&                       threads = registry().threads;
+        threads.erase(std::remove(threads.begin(), threads.end(), latency.get()), threads.end());
+        registry().retired.recv.merge(latency->recv.snapshot());
+        registry().retired.send.merge(latency->send.snapshot());
+        registry().retired.kernel_to_user.merge(latency->kernel_to_user.snapshot());
+        registry().retired.user_to_wire.merge(latency->user_to_wire.snapshot());
+    }
+};
+
+ThreadIoLatency& threadIoLatency() {
+    thread_local ThreadIoLatencyHandle handle;
+    return *handle.latency;
+}
+
+} // namespace
+
+void setIoTimingEnabled(bool enable) {
+    io_timing_enabled.store(enable, std::memory_order_relaxed);
+}
+
+void recordRecvLatency(uint64_t ns) {
+    threadIoLatency().recv.record(ns);
+}
+
+void recordSendLatency(uint64_t ns) {
+    threadIoLatency().send.record(ns);
+}
+
+void recordKernelToUserLatency(uint64_t ns) {
+    threadIoLatency().kernel_to_user.record(ns);
+}
+
+void recordUserToWireLatency(uint64_t ns) {
+    threadIoLatency().user_to_wire.record(ns);
+}
+
+IoLatencySnapshot ioLatency() {
+    std::lock_guard<std::mutex> lock(registry().mutex);
+    IoLatencySnapshot           snapshot = registry().retired;
+    for (ThreadIoLatency* thread : registry().threads) {
+        snapshot.recv.merge(thread->recv.snapshot());
+        snapshot.send.merge(thread->send.snapshot());
+        snapshot.kernel_to_user.merge(thread->kernel_to_user.snapshot());
+        snapshot.user_to_wire.merge(thread->user_to_wire.snapshot());
+    }
+    return snapshot;
+}
+
+void resetIoLatency() {
+    std::lock_guard<std::mutex> lock(registry().mutex);
+    registry().retired = IoLatencySnapshot{};
+    for (ThreadIoLatency* thread : registry().threads) {
+        thread->recv.reset();
+        thread->send.reset();
+        thread->kernel_to_user.reset();
+        thread->user_to_wire.reset();
+    }
+}
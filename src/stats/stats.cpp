@@ -0,0 +1,169 @@
+#include "stats.hpp"
+
+#include <sstream>
+
+namespace {
+
+size_t eventsBucket(size_t events) {
+    size_t bucket = 0;
+    while (events != 0 && bucket + 1 < EVENTS_PER_WAIT_BUCKETS) {
+        events >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+double ratio(uint64_t num, uint64_t den) {
+    return den == 0 ? 0.0 : static_cast<double>(num) / static_cast<double>(den);
+}
+
+} // namespace
+
+void PollCounters::recordWait(size_t events, uint64_t ns) {
+    m_waits.add();
+    m_wait_ns.add(ns);
+    m_events.add(events);
+    m_max_events.raise(events);
+    m_events_per_wait[eventsBucket(events)].add();
+    if (events == 0)
+        m_empty_waits.add();
+}
+
+void PollCounters::recordInterrupt(uint64_t ns) {
+    m_waits.add();
+    m_wait_ns.add(ns);
+    m_interrupted_waits.add();
+}
+
+void PollCounters::recordCtl(CtlOp op, bool ok) {
+    switch (op) {
+        case CtlOp::ADD:
+            m_ctl_add.add();
+            break;
+        case CtlOp::MOD:
+            m_ctl_mod.add();
+            break;
+        case CtlOp::DEL:
+            m_ctl_del.add();
+            break;
+    }
+    if (!ok)
+        m_ctl_errors.add();
+}
+
+PollStats PollCounters::snapshot() const {
+    PollStats stats;
+    stats.waits             = m_waits.load();
+    stats.empty_waits       = m_empty_waits.load();
+    stats.interrupted_waits = m_interrupted_waits.load();
+    stats.wakeups           = m_wakeups.load();
+    stats.events            = m_events.load();
+    stats.max_events        = m_max_events.load();
+    stats.wait_ns           = m_wait_ns.load();
+    stats.ctl_add           = m_ctl_add.load();
+    stats.ctl_mod           = m_ctl_mod.load();
+    stats.ctl_del           = m_ctl_del.load();
+    stats.ctl_errors        = m_ctl_errors.load();
+    stats.ctl_saved         = m_ctl_saved.load();
+    for (size_t i = 0; i < EVENTS_PER_WAIT_BUCKETS; i++)
+        stats.events_per_wait[i] = m_events_per_wait[i].load();
+    return stats;
+}
+
+void PollCounters::reset() {
+    m_waits.reset();
+    m_empty_waits.reset();
+    m_interrupted_waits.reset();
+    m_wakeups.reset();
+    m_events.reset();
+    m_max_events.reset();
+    m_wait_ns.reset();
+    m_ctl_add.reset();
+    m_ctl_mod.reset();
+    m_ctl_del.reset();
+    m_ctl_errors.reset();
+    m_ctl_saved.reset();
+    for (auto& bucket : m_events_per_wait)
+        bucket.reset();
+}
+
+SocketStats SocketCounters::snapshot() const {
+    SocketStats stats;
+    stats.recv_calls  = m_recv_calls.load();
+    stats.recv_bytes  = m_recv_bytes.load();
+    stats.recv_eagain = m_recv_eagain.load();
+    stats.send_calls  = m_send_calls.load();
+    stats.send_bytes  = m_send_bytes.load();
+    stats.send_eagain = m_send_eagain.load();
+    stats.rx_stamps   = m_rx_stamps.load();
+    stats.tx_stamps   = m_tx_stamps.load();
+    return stats;
+}
+
+void SocketCounters::reset() {
+    m_recv_calls.reset();
+    m_recv_bytes.reset();
+    m_recv_eagain.reset();
+    m_send_calls.reset();
+    m_send_bytes.reset();
+    m_send_eagain.reset();
+    m_rx_stamps.reset();
+    m_tx_stamps.reset();
+}
+
+PollStats& operator+=(PollStats& lhs, const PollStats& rhs) {
+    lhs.waits += rhs.waits;
+    lhs.empty_waits += rhs.empty_waits;
+    lhs.interrupted_waits += rhs.interrupted_waits;
+    lhs.wakeups += rhs.wakeups;
+    lhs.events += rhs.events;
+    lhs.max_events = lhs.max_events > rhs.max_events ? lhs.max_events : rhs.max_events;
+    lhs.wait_ns += rhs.wait_ns;
+    lhs.ctl_add += rhs.ctl_add;
+    lhs.ctl_mod += rhs.ctl_mod;
+    lhs.ctl_del += rhs.ctl_del;
+    lhs.ctl_errors += rhs.ctl_errors;
+    lhs.ctl_saved += rhs.ctl_saved;
+    for (size_t i = 0; i < EVENTS_PER_WAIT_BUCKETS; i++)
+        lhs.events_per_wait[i] += rhs.events_per_wait[i];
+    return lhs;
+}
+
+SocketStats& operator+=(SocketStats& lhs, const SocketStats& rhs) {
+    lhs.recv_calls += rhs.recv_calls;
+    lhs.recv_bytes += rhs.recv_bytes;
+    lhs.recv_eagain += rhs.recv_eagain;
+    lhs.send_calls += rhs.send_calls;
+    lhs.send_bytes += rhs.send_bytes;
+    lhs.send_eagain += rhs.send_eagain;
+    lhs.rx_stamps += rhs.rx_stamps;
+    lhs.tx_stamps += rhs.tx_stamps;
+    return lhs;
+}
+
+std::string toJson(const PollStats& stats) {
+    std::ostringstream out;
+    out << "{\"waits\":" << stats.waits << ",\"empty_waits\":" << stats.empty_waits
+        << ",\"interrupted_waits\":" << stats.interrupted_waits << ",\"wakeups\":" << stats.wakeups
+        << ",\"events\":" << stats.events
+        << ",\"max_events\":" << stats.max_events << ",\"avg_events\":" << ratio(stats.events, stats.waits)
+        << ",\"wait_ns\":" << stats.wait_ns << ",\"avg_wait_ns\":" << ratio(stats.wait_ns, stats.waits)
+        << ",\"ctl_add\":" << stats.ctl_add << ",\"ctl_mod\":" << stats.ctl_mod << ",\"ctl_del\":" << stats.ctl_del
+        << ",\"ctl_errors\":" << stats.ctl_errors << ",\"ctl_saved\":" << stats.ctl_saved << ",\"events_per_wait\":[";
+    for (size_t i = 0; i < EVENTS_PER_WAIT_BUCKETS; i++)
+        out << (i == 0 ? "" : ",") << stats.events_per_wait[i];
+    out << "]}";
+    return out.str();
+}
+
+std::string toJson(const SocketStats& stats) {
+    std::ostringstream out;
+    out << "{\"recv_calls\":" << stats.recv_calls << ",\"recv_bytes\":" << stats.recv_bytes
+        << ",\"recv_eagain\":" << stats.recv_eagain
+        << ",\"recv_eagain_rate\":" << ratio(stats.recv_eagain, stats.recv_calls)
+        << ",\"send_calls\":" << stats.send_calls << ",\"send_bytes\":" << stats.send_bytes
+        << ",\"send_eagain\":" << stats.send_eagain
+        << ",\"send_eagain_rate\":" << ratio(stats.send_eagain, stats.send_calls)
+        << ",\"rx_stamps\":" << stats.rx_stamps << ",\"tx_stamps\":" << stats.tx_stamps << "}";
+    return out.str();
+}
@@ -0,0 +1,322 @@
+#include "trace.hpp"
+
+#include "histogram.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <cstdio>
+#else
+#include <csignal>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+std::atomic<bool> trace_enabled{false};
+
+namespace {
+
+// file layout: FileHeader, then per ring a RingHeader, its records oldest first and the index of the first record
+// that was still intact once they were written
+constexpr char     TRACE_MAGIC[8]  = {'S', 'P', 'T', 'R', 'A', 'C', 'E', '1'};
+constexpr size_t   MAX_TRACE_RINGS = 1024;
+constexpr uint64_t DEFAULT_RECORDS = 16384;
+
+struct FileHeader {
+    char     magic[8];
+    uint32_t record_size;
+    uint32_t rings;
+};
+
+struct RingHeader {
+    uint64_t end;   // index one past the newest record
+    uint64_t count; // records that follow
+};
+
+// single writer, the thread that owns it. a ring outlives its thread and is handed to the next thread that starts
+// tracing, so a dump still has what exited threads did
+struct TraceRing {
+    std::atomic<uint64_t> head{0};
+    std::atomic<bool>     owned{true};
+    uint64_t              mask;
+    TraceRecord*          records;
+
+    explicit TraceRing(uint64_t capacity) : mask(capacity - 1), records(new TraceRecord[capacity]) {}
+};
+
+// fixed slots instead of a container, a signal handler walks them without locking or allocating. rings are never
+// freed, threads that exit during shutdown may still write
+std::atomic<TraceRing*> trace_rings[MAX_TRACE_RINGS];
+std::atomic<size_t>     trace_ring_count{0};
+std::atomic<uint64_t>   trace_capacity{DEFAULT_RECORDS};
+std::atomic<uint32_t>   trace_threads{0};
+
+TraceRing* claimRing() {
+    size_t count = trace_ring_count.load(std::memory_order_acquire);
+    for (size_t i = 0; i < count && i < MAX_TRACE_RINGS; i++) {
+        TraceRing* ring = trace_rings[i].load(std::memory_order_acquire);
+        bool       free = false;
+        if (ring != nullptr && ring->owned.compare_exchange_strong(free, true))
+            return ring;
+    }
+
+    size_t index = trace_ring_count.fetch_add(1);
+    if (index >= MAX_TRACE_RINGS)
+        return nullptr;
+    auto* ring = new TraceRing(trace_capacity.load());
+    trace_rings[index].store(ring, std::memory_order_release);
+    return ring;
+}
+
+struct ThreadTraceHandle {
+    TraceRing* ring   = nullptr;
+    uint32_t   thread = trace_threads.fetch_add(1) + 1;
+
+    // trace points sit between a syscall and the errno check after it
+    ThreadTraceHandle() {
+        int saved = errno;
+        ring      = claimRing();
+        errno     = saved;
+    }
+
+    ~ThreadTraceHandle() {
+        if (ring != nullptr)
+            ring->owned.store(false, std::memory_order_release);
+    }
+};
+
+// plain writes, open(), write() and close() are async-signal-safe
+class DumpFile {
+  public:
+    explicit DumpFile(const char* path) {
+#ifdef _WIN32
+        m_file = std::fopen(path, "wb");
+#else
+        m_fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+#endif
+    }
+    ~DumpFile() {
+#ifdef _WIN32
+        if (m_file != nullptr)
+            std::fclose(m_file);
+#else
+        if (m_fd != -1)
+            ::close(m_fd);
+#endif
+    }
+
+    DumpFile(const DumpFile&)            = delete;
+    DumpFile& operator=(const DumpFile&) = delete;
+
+    bool valid() const {
+#ifdef _WIN32
+        return m_file != nullptr;
+#else
+        return m_fd != -1;
+#endif
+    }
+
+    bool write(const void* data, size_t size) {
+#ifdef _WIN32
+        return std::fwrite(data, 1, size, m_file) == size;
+#else
+        const char* at = static_cast<const char*>(data);
+        while (size > 0) {
+            ssize_t written = ::write(m_fd, at, size);
+            if (written < 0) {
+                if (errno == EINTR)
+                    continue;
+                return false;
+            }
+            at += written;
+            size -= static_cast<size_t>(written);
+        }
+        return true;
+#endif
+    }
+
+  private:
+#ifdef _WIN32
+    FILE* m_file = nullptr;
+#else
+    int m_fd = -1;
+#endif
+};
+
+bool dumpRing(DumpFile& file, TraceRing* ring) {
+    uint64_t capacity = ring->mask + 1;
+    uint64_t end      = ring->head.load(std::memory_order_acquire);
+    uint64_t count    = end < capacity ? end : capacity;
+
+    RingHeader header{end, count};
+    if (!file.write(&header, sizeof(header)))
+        return false;
+
+    // oldest first: the part from the start index to the end of the array, then the wrapped part
+    uint64_t first  = (end - count) & ring->mask;
+    uint64_t before = count < capacity - first ? count : capacity - first;
+    if (!file.write(ring->records + first, before * sizeof(TraceRecord)) ||
+        !file.write(ring->records, (count - before) * sizeof(TraceRecord)))
+        return false;
+
+    // the writer went on meanwhile, whatever it got to again is not the record that was meant to be dumped
+    uint64_t now    = ring->head.load(std::memory_order_acquire);
+    uint64_t intact = now > capacity ? now - capacity : 0;
+    return file.write(&intact, sizeof(intact));
+}
+
+#ifndef _WIN32
+char trace_dump_path[4096];
+
+void dumpOnSignal(int /*signal*/) {
+    int saved = errno;
+    dumpTrace(trace_dump_path);
+    errno = saved;
+}
+#endif
+
+} // namespace
+
+bool traceCompiledIn() {
+#ifdef SOCKETPOLL_TRACE_POINTS
+    return true;
+#else
+    return false;
+#endif
+}
+
+void setTraceEnabled(bool enable) {
+    trace_enabled.store(enable, std::memory_order_relaxed);
+}
+
+void setTraceCapacity(size_t records) {
+    uint64_t capacity = 1;
+    while (capacity < records)
+        capacity <<= 1;
+    trace_capacity.store(capacity);
+}
+
+void traceRecord(TraceType type, int64_t fd, int64_t value, uint16_t aux) {
+    thread_local ThreadTraceHandle handle;
+    TraceRing*                     ring = handle.ring;
+    if (ring == nullptr)
+        return;
+
+    uint64_t     head   = ring->head.load(std::memory_order_relaxed);
+    TraceRecord& record = ring->records[head & ring->mask];
+    record.ns           = monotonicNs();
+    record.value        = value;
+    record.fd           = fd;
+    record.type         = type;
+    record.aux          = aux;
+    record.thread       = handle.thread;
+    ring->head.store(head + 1, std::memory_order_release);
+}
+
+bool dumpTrace(const char* path) {
+    DumpFile file(path);
+    if (!file.valid())
+        return false;
+
+    size_t count = trace_ring_count.load(std::memory_order_acquire);
+    if (count > MAX_TRACE_RINGS)
+        count = MAX_TRACE_RINGS;
+    // a ring whose slot is still being filled in is left out, it has nothing yet
+    uint32_t rings = 0;
+    for (size_t i = 0; i < count; i++)
+        rings += trace_rings[i].load(std::memory_order_acquire) != nullptr ? 1 : 0;
+
+    FileHeader header{};
+    std::memcpy(header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+    header.record_size = sizeof(TraceRecord);
+    header.rings       = rings;
+    if (!file.write(&header, sizeof(header)))
+        return false;
+
+    for (size_t i = 0; i < count && rings > 0; i++) {
+        TraceRing* ring = trace_rings[i].load(std::memory_order_acquire);
+        if (ring == nullptr)
+            continue;
+        if (!dumpRing(file, ring))
+            return false;
+        rings--;
+    }
+    return true;
+}
+
+void installTraceDumpSignal(int signal, const std::string& path) {
+#ifdef _WIN32
+    (void)signal;
+    (void)path;
+    throw std::runtime_error("trace dumps on a signal are not supported on windows");
+#else
+    if (path.size() >= sizeof(trace_dump_path))
+        throw std::invalid_argument("trace dump path is too long");
+    std::memcpy(trace_dump_path, path.c_str(), path.size() + 1);
+
+    struct sigaction action{};
+    action.sa_handler = dumpOnSignal;
+    action.sa_flags   = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(signal, &action, nullptr) != 0)
+        throw std::runtime_error("sigaction failed: " + std::string(strerror(errno)));
+#endif
+}
+
+std::vector<TraceRecord> readTrace(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+        throw std::runtime_error("cannot open " + path);
+
+    FileHeader header{};
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        std::memcmp(header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0)
+        throw std::runtime_error(path + " is not a trace dump");
+    if (header.record_size != sizeof(TraceRecord))
+        throw std::runtime_error(path + " was written with a different record layout");
+
+    std::vector<TraceRecord> records;
+    for (uint32_t r = 0; r < header.rings; r++) {
+        RingHeader ring{};
+        if (!in.read(reinterpret_cast<char*>(&ring), sizeof(ring)) || ring.count > ring.end)
+            throw std::runtime_error(path + " is truncated");
+
+        std::vector<TraceRecord> dumped(static_cast<size_t>(ring.count));
+        uint64_t                 intact = 0;
+        auto                     size   = static_cast<std::streamsize>(ring.count * sizeof(TraceRecord));
+        if (!in.read(reinterpret_cast<char*>(dumped.data()), size) ||
+            !in.read(reinterpret_cast<char*>(&intact), sizeof(intact)))
+            throw std::runtime_error(path + " is truncated");
+
+        uint64_t first = ring.end - ring.count;
+        size_t   skip  = intact > first ? static_cast<size_t>(intact - first) : 0;
+        for (size_t i = skip; i < dumped.size(); i++)
+            records.push_back(dumped[i]);
+    }
+    return records;
+}
+
+const char* traceTypeName(TraceType type) {
+    switch (type) {
+        case TraceType::WAIT_ENTER:
+            return "wait_enter";
+        case TraceType::WAIT_EXIT:
+            return "wait_exit";
+        case TraceType::WAKEUP:
+            return "wakeup";
+        case TraceType::CTL_ADD:
+            return "ctl_add";
+        case TraceType::CTL_MOD:
+            return "ctl_mod";
+        case TraceType::CTL_DEL:
+            return "ctl_del";
+        case TraceType::RECV:
+            return "recv";
+        case TraceType::SEND:
+            return "send";
+    }
+    return "unknown";
+}
@@ -0,0 +1,159 @@
+#include "accept_controller.hpp"
+#include "event_poll.hpp"
+#include "socket.hpp"
+#include "test_utils.hpp"
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+
+std::vector<Socket> connectClients(uint16_t port, size_t count) {
+    std::vector<Socket> clients(count);
+    for (auto& client : clients) {
+        client.create();
+        client.connect("127.0.0.1", port);
+    }
+    return clients;
+}
+
+} // namespace
+
+TEST_CASE("AcceptController: Limits") {
+    uint16_t  port     = findAvailablePort();
+    Socket    listener = listenLoopback(port, true);
+    EventPoll poll;
+
+    SECTION("Accepts per call are capped") {
+        AcceptOptions options;
+        options.max_per_iteration = 3;
+        AcceptController    controller(listener, poll, options);
+        std::vector<Socket> clients = connectClients(port, 5);
+
+        std::vector<Socket> accepted;
+        REQUIRE(controller.acceptReady(accepted) == 3);
+        REQUIRE(controller.acceptReady(accepted) == 2);
+        REQUIRE(controller.acceptReady(accepted) == 0);
+        REQUIRE(accepted.size() == 5);
+        REQUIRE(controller.stats().accepted == 5);
+        REQUIRE(controller.stats().capped == 1);
+    }
+
+    SECTION("The listener pauses at max_connections and resumes below it") {
+        AcceptOptions options;
+        options.max_connections = 2;
+        AcceptController    controller(listener, poll, options);
+        std::vector<Socket> clients = connectClients(port, 3);
+
+        std::vector<Socket> accepted;
+        REQUIRE(controller.acceptReady(accepted) == 2);
+        REQUIRE(controller.paused());
+        REQUIRE(controller.acceptReady(accepted) == 0);
+
+        poll.wait(50);
+        REQUIRE(poll.events().empty());
+
+        accepted.pop_back();
+        controller.connectionClosed();
+        REQUIRE_FALSE(controller.paused());
+        poll.wait(1000);
+        REQUIRE(poll.events().size() == 1);
+        REQUIRE(controller.acceptReady(accepted) == 1);
+        REQUIRE(controller.stats().paused == 2);
+    }
+
+    SECTION("Polls sharing an exclusive listener split its connections") {
+        EventPoll     other;
+        AcceptOptions options;
+        options.exclusive       = true;
+        options.max_connections = 1;
+        AcceptController first(listener, poll, options);
+        AcceptController second(listener, other, options);
+
+        // one takes the connection, the other finds nothing left
+        std::vector<Socket> clients = connectClients(port, 1);
+        std::vector<Socket> accepted;
+        REQUIRE(first.acceptReady(accepted) == 1);
+        REQUIRE(second.acceptReady(accepted) == 0);
+        REQUIRE(second.stats().empty == 1);
+
+        // pausing and resuming an exclusive registration replaces it, it cannot be modified in place
+        REQUIRE(first.paused());
+        first.connectionClosed();
+        REQUIRE_FALSE(first.paused());
+        clients = connectClients(port, 1);
+        poll.wait(1000);
+        REQUIRE(poll.events().size() == 1);
+        REQUIRE(first.acceptReady(accepted) == 1);
+    }
+}
+
+#ifndef _WIN32
+TEST_CASE("AcceptController: Fd exhaustion") {
+    uint16_t  port     = findAvailablePort();
+    Socket    listener = listenLoopback(port, true);
+    EventPoll poll;
+
+    AcceptOptions options;
+    options.exhausted_pause_ms = 30;
+    AcceptController    controller(listener, poll, options);
+    std::vector<Socket> clients = connectClients(port, 4);
+
+    // lower the fd limit and use up everything below it, the only fd left for accepting is the controller's reserve
+    rlimit saved{};
+    getrlimit(RLIMIT_NOFILE, &saved);
+    rlimit lowered = saved;
+    {
+        Socket probe;
+        probe.create();
+        lowered.rlim_cur = static_cast<rlim_t>(probe.fd()) + 16;
+    }
+    setrlimit(RLIMIT_NOFILE, &lowered);
+
+    std::vector<Socket> hogs;
+    for (;;) {
+        Socket hog;
+        try {
+            hog.create();
+        } catch (const std::runtime_error&) {
+            break;
+        }
+        hogs.push_back(std::move(hog));
+    }
+
+    std::vector<Socket> accepted;
+    REQUIRE_NOTHROW(controller.acceptReady(accepted));
+    hogs.clear();
+    setrlimit(RLIMIT_NOFILE, &saved);
+
+    AcceptStats stats = controller.stats();
+    REQUIRE(accepted.empty());
+    REQUIRE(stats.exhausted == 1);
+    REQUIRE(stats.shed == 4);
+    REQUIRE(controller.paused());
+    REQUIRE(controller.nextTimeoutMs() > 0);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(40));
+    controller.tick();
+    REQUIRE_FALSE(controller.paused());
+    REQUIRE(controller.nextTimeoutMs() == -1);
+
+    // the shed clients see their connection closed
+    char buffer[1];
+    for (auto& client : clients)
+        REQUIRE(client.recv(buffer, sizeof(buffer)) == 0);
+
+    // back to normal once fds are available again
+    std::vector<Socket> late = connectClients(port, 1);
+    poll.wait(1000);
+    REQUIRE(controller.acceptReady(accepted) == 1);
+}
+#endif
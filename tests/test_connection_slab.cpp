@@ -0,0 +1,91 @@
+#include "connection_slab.hpp"
+#include "event_poll.hpp"
+#include "socket.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+struct Connection {
+    std::string name;
+    int*        destroyed;
+
+    Connection(std::string n, int* counter) : name(std::move(n)), destroyed(counter) {}
+    ~Connection() { (*destroyed)++; }
+};
+
+} // namespace
+
+TEST_CASE("ConnectionSlab: Lifetime") {
+    int                        destroyed = 0;
+    ConnectionSlab<Connection> slab;
+
+    SECTION("Emplace, find and erase") {
+        Connection& conn = slab.emplace(5, "first", &destroyed);
+        REQUIRE(slab.size() == 1);
+        REQUIRE(slab.find(5) == &conn);
+        REQUIRE(slab.find(6) == nullptr);
+        REQUIRE(slab.find(100000) == nullptr);
+        REQUIRE_THROWS_AS(slab.emplace(5, "again", &destroyed), std::runtime_error);
+
+        slab.erase(5);
+        REQUIRE(destroyed == 1);
+        REQUIRE(slab.size() == 0);
+        REQUIRE(slab.find(5) == nullptr);
+        REQUIRE_NOTHROW(slab.erase(5));
+    }
+
+    SECTION("Stale tags are rejected after the fd is reused") {
+        slab.emplace(7, "old", &destroyed);
+        uint32_t old_tag = slab.tag(7);
+        REQUIRE(slab.get(7, old_tag)->name == "old");
+
+        slab.erase(7);
+        REQUIRE(slab.get(7, old_tag) == nullptr);
+
+        slab.emplace(7, "new", &destroyed);
+        uint32_t new_tag = slab.tag(7);
+        REQUIRE(new_tag != old_tag);
+        REQUIRE(slab.get(7, old_tag) == nullptr);
+        REQUIRE(slab.get(7, new_tag)->name == "new");
+    }
+
+    SECTION("References stay valid while the slab grows") {
+        Connection& first = slab.emplace(1, "first", &destroyed);
+        for (int fd = 2; fd < 2000; fd++)
+            slab.emplace(fd, "filler", &destroyed);
+        REQUIRE(slab.find(1) == &first);
+        REQUIRE(first.name == "first");
+
+        size_t visited = 0;
+        slab.forEach([&](Connection& /*conn*/) { visited++; });
+        REQUIRE(visited == 1999);
+
+        slab.clear();
+        REQUIRE(destroyed == 1999);
+        REQUIRE(slab.size() == 0);
+    }
+}
+
+TEST_CASE("ConnectionSlab: Tags round-trip through EventPoll") {
+    int                        destroyed = 0;
+    ConnectionSlab<Connection> slab;
+    EventPoll                  poll;
+    Socket                     s;
+    s.create();
+
+    slab.emplace(s.fd(), "conn", &destroyed);
+    poll.addFd(s.fd(), static_cast<PollEvent>(PollEvent::READ | PollEvent::WRITE), slab.tag(s.fd()));
+    poll.wait(1000);
+
+    REQUIRE(poll.events().size() == 1);
+    const auto& event = poll.events()[0];
+    REQUIRE(event.fd == s.fd());
+    REQUIRE(event.tag == slab.tag(s.fd()));
+    REQUIRE(slab.get(event.fd, event.tag)->name == "conn");
+
+    slab.erase(s.fd());
+    REQUIRE(slab.get(event.fd, event.tag) == nullptr);
+}
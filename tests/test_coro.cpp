@@ -0,0 +1,128 @@
+#include "coro.hpp"
+#include "socket.hpp"
+#include "test_utils.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+Task<int> answer() {
+    co_return 42;
+}
+
+Task<int> addAnswers() {
+    int a = co_await answer();
+    int b = co_await answer();
+    co_return a + b;
+}
+
+Task<void> fail() {
+    throw std::runtime_error("boom");
+    co_return;
+}
+
+Task<void> echoOnce(CoroLoop& loop, Socket& listener) {
+    Socket client = co_await asyncAccept(loop, listener);
+    char   buffer[64];
+    for (;;) {
+        socket_size_t bytes = co_await asyncRecv(loop, client, buffer, sizeof(buffer));
+        if (bytes == 0)
+            break;
+        co_await asyncSend(loop, client, buffer, static_cast<size_t>(bytes));
+    }
+    loop.close(client);
+}
+
+Task<void> talk(CoroLoop& loop, uint16_t port, std::string& reply) {
+    Socket client;
+    client.create();
+    client.setNonBlocking(true);
+    co_await asyncConnect(loop, client, "127.0.0.1", port);
+
+    std::string message = "hello coroutines";
+    co_await asyncSend(loop, client, message.data(), message.size());
+    char buffer[64];
+    while (reply.size() < message.size()) {
+        socket_size_t bytes = co_await asyncRecv(loop, client, buffer, sizeof(buffer));
+        if (bytes == 0)
+            break;
+        reply.append(buffer, static_cast<size_t>(bytes));
+    }
+    loop.close(client);
+}
+
+} // namespace
+
+TEST_CASE("Coro: Tasks") {
+    CoroLoop loop;
+
+    SECTION("Awaiting nested tasks returns their values") {
+        int result = 0;
+        loop.spawn([](int& out) -> Task<void> { out = co_await addAnswers(); }(result));
+        loop.run();
+        REQUIRE(result == 84);
+    }
+
+    SECTION("Exceptions propagate to the awaiting task") {
+        bool caught = false;
+        loop.spawn([](bool& out) -> Task<void> {
+            try {
+                co_await fail();
+            } catch (const std::runtime_error&) {
+                out = true;
+            }
+        }(caught));
+        loop.run();
+        REQUIRE(caught);
+    }
+
+    SECTION("Exceptions escaping a spawned task are rethrown by run()") {
+        loop.spawn(fail());
+        REQUIRE_THROWS_AS(loop.run(), std::runtime_error);
+    }
+}
+
+TEST_CASE("Coro: Frame pool reuses frames") {
+    void* first = FramePool::allocate(100);
+    FramePool::deallocate(first, 100);
+    void* second = FramePool::allocate(120);
+    REQUIRE(second == first);
+    FramePool::deallocate(second, 120);
+}
+
+TEST_CASE("Coro: Sleep") {
+    CoroLoop loop;
+    auto     start = std::chrono::steady_clock::now();
+    loop.spawn([](CoroLoop& l) -> Task<void> { co_await l.sleepFor(std::chrono::milliseconds(20)); }(loop));
+    loop.run();
+    REQUIRE(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(20));
+}
+
+TEST_CASE("Coro: Echo over loopback") {
+    uint16_t port     = findAvailablePort();
+    Socket   listener = listenLoopback(port, true);
+
+    CoroLoop    loop;
+    std::string reply;
+    loop.spawn(echoOnce(loop, listener));
+    loop.spawn(talk(loop, port, reply));
+    loop.run();
+
+    REQUIRE(reply == "hello coroutines");
+}
+
+TEST_CASE("Coro: Connect failure throws") {
+    uint16_t port = findAvailablePort();
+
+    CoroLoop loop;
+    loop.spawn([](CoroLoop& l, uint16_t p) -> Task<void> {
+        Socket client;
+        client.create();
+        client.setNonBlocking(true);
+        co_await asyncConnect(l, client, "127.0.0.1", p);
+    }(loop, port));
+    REQUIRE_THROWS_AS(loop.run(), std::runtime_error);
+}
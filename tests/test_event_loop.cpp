@@ -0,0 +1,347 @@
+#include "event_loop.hpp"
+#include "socket.hpp"
+#include "test_utils.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+
+struct Counter {
+    int       calls       = 0;
+    socket_t  last_fd     = INVALID_SOCKET_FD;
+    PollEvent last_events = PollEvent::NONE;
+
+    void onEvent(socket_t fd, PollEvent events) {
+        calls++;
+        last_fd     = fd;
+        last_events = events;
+    }
+};
+
+std::pair<Socket, Socket> loopbackPair(Socket& listener, uint16_t port) {
+    Socket client;
+    client.create();
+    client.connect("127.0.0.1", port);
+    Socket accepted = listener.accept();
+    return std::make_pair(std::move(client), std::move(accepted));
+}
+
+} // namespace
+
+TEST_CASE("EventLoop: Registration") {
+    EventLoop loop;
+    Socket    s;
+    s.create();
+    Counter counter;
+
+    SECTION("Add and remove track the handler count") {
+        loop.add(s.fd(), PollEvent::READ, memberHandler<Counter, &Counter::onEvent>(&counter));
+        REQUIRE(loop.size() == 1);
+        loop.remove(s.fd());
+        REQUIRE(loop.size() == 0);
+        REQUIRE_NOTHROW(loop.remove(s.fd()));
+    }
+
+    SECTION("Adding an fd twice throws") {
+        loop.add(s.fd(), PollEvent::READ, memberHandler<Counter, &Counter::onEvent>(&counter));
+        REQUIRE_THROWS_AS(loop.add(s.fd(), PollEvent::READ, memberHandler<Counter, &Counter::onEvent>(&counter)),
+                          std::runtime_error);
+    }
+
+    SECTION("Missing handler throws") {
+        REQUIRE_THROWS_AS(loop.add(s.fd(), PollEvent::READ, EventHandler{}), std::invalid_argument);
+    }
+}
+
+TEST_CASE("EventLoop: Dispatch") {
+    uint16_t port = findAvailablePort();
+    Socket   listener = listenLoopback(port);
+
+    auto      first  = loopbackPair(listener, port);
+    auto      second = loopbackPair(listener, port);
+    EventLoop loop;
+
+    SECTION("Events reach the handler registered for their fd") {
+        Counter a;
+        Counter b;
+        loop.add(first.second.fd(), PollEvent::READ, memberHandler<Counter, &Counter::onEvent>(&a));
+        loop.add(second.second.fd(), PollEvent::READ, memberHandler<Counter, &Counter::onEvent>(&b));
+
+        first.first.send("x");
+        REQUIRE(loop.runOnce(1000) == 1);
+        REQUIRE(a.calls == 1);
+        REQUIRE(a.last_fd == first.second.fd());
+        REQUIRE((a.last_events & PollEvent::READ) != 0);
+        REQUIRE(b.calls == 0);
+    }
+
+    SECTION("Every dispatched event is timed from the end of its wait") {
+        Counter a;
+        loop.add(first.second.fd(), PollEvent::READ, memberHandler<Counter, &Counter::onEvent>(&a));
+        loop.poll().resetStats();
+
+        first.first.send("x");
+        REQUIRE(loop.runOnce(1000) == 1);
+        REQUIRE(loop.poll().dispatchLatency().count == 1);
+        // still readable, dispatched again
+        REQUIRE(loop.runOnce(1000) == 1);
+        REQUIRE(loop.poll().dispatchLatency().count == 2);
+    }
+
+    SECTION("Removing an fd drops its pending events in the same batch") {
+        // whichever handler runs first removes the other fd
+        struct Remover {
+            EventLoop* loop;
+            socket_t   a;
+            socket_t   b;
+            int        calls = 0;
+
+            void onEvent(socket_t fd, PollEvent /*events*/) {
+                calls++;
+                loop->remove(fd == a ? b : a);
+            }
+        };
+
+        Remover remover{&loop, first.second.fd(), second.second.fd()};
+        loop.add(remover.a, PollEvent::READ, memberHandler<Remover, &Remover::onEvent>(&remover));
+        loop.add(remover.b, PollEvent::READ, memberHandler<Remover, &Remover::onEvent>(&remover));
+        first.first.send("x");
+        second.first.send("x");
+
+        // wait until both are readable so they arrive in one batch
+        EventPoll probe;
+        probe.addFd(remover.a, PollEvent::READ);
+        probe.addFd(remover.b, PollEvent::READ);
+        while (probe.events().size() < 2)
+            probe.wait(1000);
+
+        loop.runOnce(1000);
+        REQUIRE(remover.calls == 1);
+        REQUIRE(loop.size() == 1);
+    }
+
+    SECTION("Events of a removed fd never reach a handler that reused its number") {
+        // the first handler to run closes the other connection and registers a fresh socket, which gets the same fd
+        struct Reuser {
+            EventLoop* loop;
+            Socket*    a;
+            Socket*    b;
+            Counter*   reused;
+            Socket     fresh;
+            int        calls        = 0;
+            bool       number_reuse = false;
+
+            void onEvent(socket_t fd, PollEvent /*events*/) {
+                calls++;
+                Socket*  victim = fd == a->fd() ? b : a;
+                socket_t number = victim->fd();
+                loop->remove(number);
+                victim->close();
+                fresh.create();
+                number_reuse = fresh.fd() == number;
+                if (number_reuse)
+                    loop->add(fresh.fd(), PollEvent::READ, memberHandler<Counter, &Counter::onEvent>(reused));
+            }
+        };
+
+        Counter reused;
+        Reuser  reuser{&loop, &first.second, &second.second, &reused, Socket()};
+        loop.add(first.second.fd(), PollEvent::READ, memberHandler<Reuser, &Reuser::onEvent>(&reuser));
+        loop.add(second.second.fd(), PollEvent::READ, memberHandler<Reuser, &Reuser::onEvent>(&reuser));
+        first.first.send("x");
+        second.first.send("x");
+
+        EventPoll probe;
+        probe.addFd(first.second.fd(), PollEvent::READ);
+        probe.addFd(second.second.fd(), PollEvent::READ);
+        while (probe.events().size() < 2)
+            probe.wait(1000);
+
+        loop.runOnce(1000);
+        REQUIRE(reuser.calls == 1);
+        REQUIRE(reuser.number_reuse);
+        REQUIRE(reused.calls == 0);
+    }
+
+    SECTION("Stop from a handler ends run()") {
+        struct Stopper {
+            EventLoop* loop;
+            void       onEvent(socket_t /*fd*/, PollEvent /*events*/) { loop->stop(); }
+        };
+
+        Stopper stopper{&loop};
+        loop.add(first.second.fd(), PollEvent::READ, memberHandler<Stopper, &Stopper::onEvent>(&stopper));
+        first.first.send("x");
+        loop.run();
+        REQUIRE(loop.size() == 1);
+    }
+}
+
+TEST_CASE("EventLoop: Post") {
+    EventLoop loop;
+
+    SECTION("Tasks posted from other threads run on the loop thread") {
+        std::thread::id loop_thread = std::this_thread::get_id();
+        std::thread::id ran_on;
+        int             ran = 0;
+
+        std::thread poster([&]() {
+            for (int i = 0; i < 100; i++)
+                loop.post([&]() { ran++; });
+            loop.post([&]() {
+                ran_on = std::this_thread::get_id();
+                loop.stop();
+            });
+        });
+        loop.run();
+        poster.join();
+
+        REQUIRE(ran == 100);
+        REQUIRE(ran_on == loop_thread);
+    }
+
+    SECTION("Tasks posted from a task run in a later iteration") {
+        int order = 0;
+        int inner = 0;
+        loop.post([&]() { loop.post([&]() { inner = ++order; }); });
+        loop.runOnce(0);
+        REQUIRE(inner == 0);
+        loop.runOnce(1000);
+        REQUIRE(inner == 1);
+    }
+
+    SECTION("A burst of posts costs one wakeup and runs as one batch in order") {
+        std::vector<int> order;
+        std::thread      poster([&]() {
+            for (int i = 0; i < 1000; i++)
+                loop.post([&order, i]() { order.push_back(i); });
+        });
+        poster.join();
+
+        loop.runOnce(1000);
+        REQUIRE(order.size() == 1000);
+        for (int i = 0; i < 1000; i++)
+            REQUIRE(order[i] == i);
+        REQUIRE(loop.poll().stats().wakeups == 1);
+        REQUIRE(loop.stats().batches == 1);
+        REQUIRE(loop.stats().tasks == 1000);
+    }
+
+    SECTION("Intrusive tasks need no allocation") {
+        struct Bump : LoopTask {
+            int count = 0;
+        };
+
+        Bump bump;
+        bump.run = [](LoopTask* self) { static_cast<Bump*>(self)->count++; };
+        loop.post(&bump);
+        loop.runOnce(1000);
+        loop.post(&bump);
+        loop.runOnce(1000);
+        REQUIRE(bump.count == 2);
+    }
+}
+
+TEST_CASE("EventLoop: Unrun tasks are dropped with the loop") {
+    struct Tracked : LoopTask {
+        bool* dropped;
+    };
+
+    bool    dropped = false;
+    Tracked task;
+    task.dropped = &dropped;
+    task.run     = [](LoopTask* /*self*/) {};
+    task.drop    = [](LoopTask* self) { *static_cast<Tracked*>(self)->dropped = true; };
+    {
+        EventLoop loop;
+        loop.post(&task);
+    }
+    REQUIRE(dropped);
+}
+
+TEST_CASE("EventLoop: Coalesced output") {
+    uint16_t port = findAvailablePort();
+    Socket   listener = listenLoopback(port);
+
+    auto      pair = loopbackPair(listener, port);
+    EventLoop loop;
+
+    // answers each byte of a pipelined batch with a write of its own
+    struct Responder {
+        Socket*     socket;
+        LoopOutput* output;
+
+        void onEvent(socket_t /*fd*/, PollEvent /*events*/) {
+            char          requests[16];
+            socket_size_t n = socket->tryRecv(requests, sizeof(requests));
+            for (socket_size_t i = 0; i < n; i++)
+                output->write(std::string("reply ") + requests[i] + "\n");
+        }
+    };
+
+    auto roundTrip = [&](LoopOutput& output) {
+        Responder responder{&pair.second, &output};
+        pair.second.setNonBlocking(true);
+        pair.second.resetStats();
+        loop.add(pair.second.fd(), PollEvent::READ, memberHandler<Responder, &Responder::onEvent>(&responder));
+        pair.first.send("abc");
+        REQUIRE(loop.runOnce(1000) == 1);
+        loop.remove(pair.second.fd());
+
+        std::string replies;
+        while (replies.size() < 24) {
+            std::string more;
+            REQUIRE(pair.first.recv(more) > 0);
+            replies += more;
+        }
+        REQUIRE(replies == "reply a\nreply b\nreply c\n");
+        REQUIRE(output.pending() == 0);
+        return pair.second.stats().send_calls;
+    };
+
+    SECTION("Gathered writes leave with one send") {
+        LoopOutput output(loop, pair.second);
+        REQUIRE(roundTrip(output) == 1);
+        REQUIRE(loop.stats().flushes == 1);
+        REQUIRE(loop.stats().gathered == 3);
+    }
+
+    SECTION("Direct writes bypass it") {
+        LoopOutput output(loop, pair.second, OutputMode::DIRECT);
+        REQUIRE(roundTrip(output) == 3);
+        REQUIRE(loop.stats().flushes == 0);
+    }
+
+#ifdef __linux__
+    SECTION("Corked writes are released at the end of the iteration") {
+        LoopOutput output(loop, pair.second, OutputMode::CORK);
+        REQUIRE(roundTrip(output) == 3);
+        REQUIRE(loop.stats().flushes == 1);
+    }
+#endif
+
+    SECTION("Switching to direct sends what is pending") {
+        LoopOutput output(loop, pair.second);
+        output.write("held");
+        REQUIRE(output.pending() == 4);
+        output.setMode(OutputMode::DIRECT);
+        REQUIRE(output.pending() == 0);
+        std::string received;
+        REQUIRE(pair.first.recv(received) == 4);
+        REQUIRE(received == "held");
+    }
+
+    SECTION("A failed send at the end of the iteration is reported") {
+        LoopOutput output(loop, pair.second);
+        pair.second.shutdown(ShutdownMode::WRITE);
+        output.write("late");
+        loop.runOnce(0);
+        REQUIRE(output.failed());
+        REQUIRE(output.pending() == 0);
+    }
+}
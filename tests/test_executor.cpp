@@ -0,0 +1,81 @@
+#include "event_loop.hpp"
+#include "executor.hpp"
+
+#include <atomic>
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+
+TEST_CASE("Executor: Runs submitted tasks") {
+    std::atomic<int> ran{0};
+    {
+        Executor executor(4);
+        REQUIRE(executor.threads() == 4);
+        for (int i = 0; i < 1000; i++)
+            executor.submit([&]() { ran++; });
+    }
+    REQUIRE(ran == 1000);
+
+    Executor executor(1);
+    REQUIRE_THROWS_AS(executor.submit(nullptr), std::invalid_argument);
+}
+
+TEST_CASE("Executor: Idle workers steal from a busy one") {
+    std::atomic<int> ran{0};
+    ExecutorStats    stats;
+    {
+        Executor executor(4);
+        // the nested tasks all land on the deque of the worker running the outer one
+        executor.submit([&]() {
+            for (int i = 0; i < 200; i++) {
+                executor.submit([&]() {
+                    std::this_thread::sleep_for(std::chrono::microseconds(200));
+                    ran++;
+                });
+            }
+        });
+        while (ran < 200)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        stats = executor.stats();
+    }
+    REQUIRE(stats.submitted == 201);
+    REQUIRE(stats.executed >= 200);
+    REQUIRE(stats.stolen > 0);
+}
+
+TEST_CASE("Executor: Offload delivers results to the originating loop") {
+    EventLoop       loop;
+    Executor        executor(2);
+    std::thread::id loop_thread = std::this_thread::get_id();
+    std::thread::id work_thread;
+    std::thread::id done_thread;
+    int             result = 0;
+
+    executor.offload(
+        loop,
+        [&]() {
+            work_thread = std::this_thread::get_id();
+            return 6 * 7;
+        },
+        [&](int value) {
+            done_thread = std::this_thread::get_id();
+            result      = value;
+            loop.stop();
+        });
+    loop.run();
+
+    REQUIRE(result == 42);
+    REQUIRE(work_thread != loop_thread);
+    REQUIRE(done_thread == loop_thread);
+
+    bool done = false;
+    executor.offload(
+        loop, []() {},
+        [&]() {
+            done = true;
+            loop.stop();
+        });
+    loop.run();
+    REQUIRE(done);
+}
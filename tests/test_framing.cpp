@@ -0,0 +1,247 @@
+#include "event_poll.hpp"
+#include "framing.hpp"
+#include "socket.hpp"
+#include "test_utils.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+TEST_CASE("Framing: Byte scanners") {
+    std::string haystack(300, 'a');
+    for (ScanImpl impl : {ScanImpl::SCALAR, ScanImpl::LIBC, ScanImpl::SSE2, ScanImpl::AVX2}) {
+        if (!scanImplSupported(impl))
+            continue;
+        INFO(scanImplName(impl));
+
+        // every position covers the vector bodies, the second vector of an unrolled step and the scalar tail
+        for (size_t at = 0; at < haystack.size(); at++) {
+            haystack[at]      = '\n';
+            const char* begin = haystack.data();
+            const char* end   = begin + haystack.size();
+            REQUIRE(findByteWith(impl, begin, end, '\n') == begin + at);
+            REQUIRE(findByteWith(impl, begin + at + 1, end, '\n') == end);
+            haystack[at] = 'a';
+        }
+        REQUIRE(findByteWith(impl, haystack.data(), haystack.data(), 'a') == haystack.data());
+    }
+    REQUIRE(scanImplSupported(bestScanImpl()));
+}
+
+TEST_CASE("Framing: Length prefix") {
+    for (size_t width : {1, 2, 4, 8}) {
+        for (ByteOrder order : {ByteOrder::BIG, ByteOrder::LITTLE}) {
+            LengthPrefixDecoder decoder(width, order);
+            std::string         payload(200, 'p');
+
+            std::string wire(width, '\0');
+            decoder.encode(payload.size(), &wire[0]);
+            wire += payload;
+
+            FrameBuffer buffer(16);
+            FrameView   frame;
+            // one byte at a time, so the header and the payload straddle every boundary
+            for (size_t i = 0; i + 1 < wire.size(); i++) {
+                buffer.append(&wire[i], 1);
+                REQUIRE_FALSE(decoder.next(buffer, frame));
+            }
+            buffer.append(&wire.back(), 1);
+            REQUIRE(decoder.next(buffer, frame));
+            REQUIRE(frame.str() == payload);
+            REQUIRE(buffer.size() == 0);
+        }
+    }
+
+    SECTION("Header byte order") {
+        char big[4];
+        char little[4];
+        LengthPrefixDecoder(4, ByteOrder::BIG).encode(0x01020304, big);
+        LengthPrefixDecoder(4, ByteOrder::LITTLE).encode(0x01020304, little);
+        REQUIRE(std::string(big, 4) == std::string("\x01\x02\x03\x04", 4));
+        REQUIRE(std::string(little, 4) == std::string("\x04\x03\x02\x01", 4));
+    }
+
+    SECTION("Limits") {
+        char header[2];
+        REQUIRE_THROWS_AS(LengthPrefixDecoder(3, ByteOrder::BIG), std::invalid_argument);
+        REQUIRE_THROWS_AS(LengthPrefixDecoder(1, ByteOrder::BIG).encode(256, header), std::invalid_argument);
+
+        LengthPrefixDecoder decoder(2, ByteOrder::BIG, 100);
+        decoder.encode(101, header);
+        FrameBuffer buffer;
+        FrameView   frame;
+        buffer.append(header, 2);
+        REQUIRE_THROWS_AS(decoder.next(buffer, frame), std::runtime_error);
+    }
+}
+
+TEST_CASE("Framing: Delimiters") {
+    DelimiterDecoder decoder("\r\n", 64);
+    FrameBuffer      buffer(8);
+    FrameView        frame;
+
+    SECTION("Several frames in one read are views into the buffer") {
+        buffer.append("one\r\ntwo\r\n\r\nthree", 17);
+        std::vector<FrameView> frames;
+        while (decoder.next(buffer, frame))
+            frames.push_back(frame);
+
+        REQUIRE(frames.size() == 3);
+        REQUIRE(frames[0].str() == "one");
+        REQUIRE(frames[1].str() == "two");
+        REQUIRE(frames[2].size == 0);
+        REQUIRE(frames[1].data == frames[0].data + 5);
+        REQUIRE(std::string(buffer.data(), buffer.size()) == "three");
+    }
+
+    SECTION("A delimiter split across reads") {
+        buffer.append("abc\r", 4);
+        REQUIRE_FALSE(decoder.next(buffer, frame));
+        buffer.append("\nde", 3);
+        REQUIRE(decoder.next(buffer, frame));
+        REQUIRE(frame.str() == "abc");
+        REQUIRE_FALSE(decoder.next(buffer, frame));
+    }
+
+    SECTION("A lone first byte is part of the frame") {
+        buffer.append("a\rb\r", 4);
+        REQUIRE_FALSE(decoder.next(buffer, frame));
+        buffer.append("\n", 1);
+        REQUIRE(decoder.next(buffer, frame));
+        REQUIRE(frame.str() == "a\rb");
+    }
+
+    SECTION("Frames above the limit throw") {
+        std::string line(65, 'x');
+        buffer.append(line.data(), line.size());
+        REQUIRE_THROWS_AS(decoder.next(buffer, frame), std::runtime_error);
+    }
+}
+
+TEST_CASE("Framing: Filling from a socket") {
+    uint16_t port = findAvailablePort();
+    Socket   listener;
+    listener.create();
+    listener.setReuseAddr(true);
+    listener.bind("127.0.0.1", port);
+    listener.listen();
+
+    Socket client;
+    client.create();
+    client.connect("127.0.0.1", port);
+    Socket server = listener.accept();
+    server.setNonBlocking(true);
+    EventPoll poll;
+    poll.addFd(server.fd(), PollEvent::READ);
+
+    FrameBuffer      buffer(16);
+    DelimiterDecoder decoder("\n");
+    FrameView        frame;
+    REQUIRE(buffer.fill(server) == -1);
+
+    // longer than the buffer, it has to grow while the line is incomplete
+    std::string line(100, 'l');
+    line += '\n';
+    client.send(line.data(), line.size());
+
+    while (!decoder.next(buffer, frame)) {
+        if (buffer.fill(server) == -1)
+            poll.wait(1000);
+    }
+    REQUIRE(frame.size == 100);
+    REQUIRE(buffer.capacity() >= 101);
+
+    client.close();
+    poll.wait(1000);
+    REQUIRE(buffer.fill(server) == 0);
+}
+
+TEST_CASE("Framing: Pooled buffers") {
+    BufferPool pool(16, 2);
+
+    SECTION("Idle connections hold no memory, partial frames take a block") {
+        FrameBuffer      scratch(64);
+        DelimiterDecoder decoder("\r\n");
+        PooledBuffer     kept(pool);
+        FrameView        frame;
+        REQUIRE(kept.data() == nullptr);
+
+        scratch.append("hel", 3);
+        REQUIRE_FALSE(decoder.next(scratch, frame));
+        kept.keep(scratch);
+        REQUIRE(scratch.size() == 0);
+        REQUIRE(kept.size() == 3);
+        REQUIRE(pool.inUse() == 1);
+
+        // the decoder picks up where it stopped, the delimiter is split across the two reads
+        kept.restore(scratch);
+        REQUIRE(kept.empty());
+        REQUIRE(pool.inUse() == 0);
+        scratch.append("lo\r", 3);
+        REQUIRE_FALSE(decoder.next(scratch, frame));
+        kept.keep(scratch);
+        kept.restore(scratch);
+        scratch.append("\n", 1);
+        REQUIRE(decoder.next(scratch, frame));
+        REQUIRE(frame.str() == "hello");
+        kept.keep(scratch);
+        REQUIRE(kept.data() == nullptr);
+        REQUIRE(pool.cached() == 1);
+    }
+
+    SECTION("More than a block moves to the heap") {
+        PooledBuffer buffer(pool);
+        std::string  data(40, 'x');
+        buffer.append(data.data(), 10);
+        REQUIRE(pool.inUse() == 1);
+        buffer.append(data.data() + 10, 30);
+        REQUIRE(pool.inUse() == 0);
+        REQUIRE(buffer.size() == 40);
+        buffer.consume(35);
+        REQUIRE(std::string(buffer.data(), buffer.size()) == "xxxxx");
+
+        PooledBuffer moved(std::move(buffer));
+        REQUIRE(buffer.empty());
+        REQUIRE(moved.size() == 5);
+        moved.consume(5);
+        REQUIRE(moved.data() == nullptr);
+    }
+
+    SECTION("The free list is bounded") {
+        std::vector<PooledBuffer> buffers;
+        for (int i = 0; i < 4; i++) {
+            buffers.emplace_back(pool);
+            buffers.back().append("x", 1);
+        }
+        REQUIRE(pool.inUse() == 4);
+        buffers.clear();
+        REQUIRE(pool.inUse() == 0);
+        REQUIRE(pool.cached() == 2);
+    }
+
+    SECTION("Unsent data is flushed") {
+        uint16_t port = findAvailablePort();
+        Socket   listener;
+        listener.create();
+        listener.setReuseAddr(true);
+        listener.bind("127.0.0.1", port);
+        listener.listen();
+
+        Socket client;
+        client.create();
+        client.connect("127.0.0.1", port);
+        Socket server = listener.accept();
+
+        PooledBuffer pending(pool);
+        REQUIRE(pending.flush(server) == 0);
+        pending.append("reply", 5);
+        REQUIRE(pending.flush(server) == 5);
+        REQUIRE(pending.empty());
+        REQUIRE(pool.inUse() == 0);
+
+        std::string received;
+        client.recv(received);
+        REQUIRE(received == "reply");
+    }
+}
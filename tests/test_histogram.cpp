@@ -0,0 +1,137 @@
+#include "event_poll.hpp"
+#include "histogram.hpp"
+#include "socket.hpp"
+#include "test_utils.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+TEST_CASE("Histogram: Buckets") {
+    SECTION("Small values are exact") {
+        for (uint64_t v = 0; v < 32; v++) {
+            REQUIRE(histogramBucket(v) == v);
+            REQUIRE(histogramBucketValue(histogramBucket(v)) == v);
+        }
+    }
+
+    SECTION("Buckets are monotonic and bound the value") {
+        size_t previous = 0;
+        for (uint64_t v = 1; v < (uint64_t{1} << 36); v = v * 3 / 2 + 1) {
+            size_t bucket = histogramBucket(v);
+            REQUIRE(bucket >= previous);
+            REQUIRE(bucket < HISTOGRAM_BUCKETS);
+            REQUIRE(histogramBucketValue(bucket) >= v);
+            // relative error stays within one sub-bucket
+            REQUIRE(histogramBucketValue(bucket) - v <= v / 16);
+            previous = bucket;
+        }
+    }
+
+    SECTION("Huge values saturate") {
+        REQUIRE(histogramBucket(UINT64_MAX) == HISTOGRAM_BUCKETS - 1);
+    }
+}
+
+TEST_CASE("Histogram: Recording and percentiles") {
+    LatencyHistogram histogram;
+
+    SECTION("Empty") {
+        HistogramSnapshot snapshot = histogram.snapshot();
+        REQUIRE(snapshot.count == 0);
+        REQUIRE(snapshot.percentile(99) == 0);
+    }
+
+    SECTION("Uniform values") {
+        for (uint64_t v = 1; v <= 1000; v++)
+            histogram.record(v * 1000);
+
+        HistogramSnapshot snapshot = histogram.snapshot();
+        REQUIRE(snapshot.count == 1000);
+        REQUIRE(snapshot.min == 1000);
+        REQUIRE(snapshot.max == 1000000);
+        REQUIRE(snapshot.percentile(50) >= 500000);
+        REQUIRE(snapshot.percentile(50) <= 520000);
+        REQUIRE(snapshot.percentile(99) >= 990000);
+        REQUIRE(snapshot.percentile(100) == 1000000);
+    }
+
+    SECTION("Reset") {
+        histogram.record(5);
+        histogram.reset();
+        REQUIRE(histogram.snapshot().count == 0);
+    }
+}
+
+TEST_CASE("Histogram: Merge across threads") {
+    std::vector<std::unique_ptr<LatencyHistogram>> histograms;
+    std::vector<std::thread>                       threads;
+    for (int t = 0; t < 4; t++) {
+        histograms.push_back(std::make_unique<LatencyHistogram>());
+        LatencyHistogram* histogram = histograms.back().get();
+        threads.emplace_back([histogram, t]() {
+            for (uint64_t i = 0; i < 1000; i++)
+                histogram->record((t + 1) * 100);
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+
+    HistogramSnapshot merged;
+    for (auto& histogram : histograms)
+        merged.merge(histogram->snapshot());
+
+    REQUIRE(merged.count == 4000);
+    REQUIRE(merged.min == 100);
+    REQUIRE(merged.max == 400);
+    REQUIRE(merged.sum == 1000 * (100 + 200 + 300 + 400));
+    REQUIRE(toJson(merged).find("\"count\":4000") != std::string::npos);
+}
+
+TEST_CASE("Histogram: EventPoll and Socket hooks") {
+    SECTION("Wait and dispatch latency") {
+        EventPoll poll;
+        poll.wait(5);
+        poll.recordDispatch();
+
+        REQUIRE(poll.waitLatency().count == 1);
+        REQUIRE(poll.waitLatency().max >= 4 * 1000 * 1000);
+        REQUIRE(poll.dispatchLatency().count == 1);
+
+        poll.resetStats();
+        REQUIRE(poll.waitLatency().count == 0);
+    }
+
+    SECTION("Syscall latency is recorded only while enabled") {
+        uint16_t port = findAvailablePort();
+        Socket   server;
+        server.create();
+        server.setReuseAddr(true);
+        server.bind("127.0.0.1", port);
+        server.listen();
+
+        Socket client;
+        client.create();
+        client.connect("127.0.0.1", port);
+        Socket accepted = server.accept();
+
+        resetIoLatency();
+        client.send("a");
+        REQUIRE(ioLatency().send.count == 0);
+
+        setIoTimingEnabled(true);
+        std::thread sender([&]() { client.send("b"); });
+        sender.join();
+
+        std::string data;
+        accepted.recv(data);
+        setIoTimingEnabled(false);
+
+        // the sending thread has exited, its samples must survive
+        IoLatencySnapshot latency = ioLatency();
+        REQUIRE(latency.send.count == 1);
+        REQUIRE(latency.recv.count == 1);
+    }
+}
@@ -0,0 +1,149 @@
+#include "event_loop.hpp"
+#include "http.hpp"
+#include "socket.hpp"
+#include "test_utils.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <cstring>
+#include <string>
+#include <utility>
+
+namespace {
+
+HttpParseResult parseAll(HttpParser& parser, const std::string& text, HttpRequest& request, size_t& consumed) {
+    return parser.parse(text.data(), text.size(), request, consumed);
+}
+
+} // namespace
+
+TEST_CASE("Http: Parser") {
+    HttpParser  parser(256, 16);
+    HttpRequest request;
+    size_t      consumed = 0;
+
+    SECTION("Request line and headers") {
+        std::string text = "GET /index.html?q=1 HTTP/1.1\r\nHost: example.com\r\nX-Padded:  a b \t\r\n\r\n";
+        REQUIRE(parseAll(parser, text, request, consumed) == HttpParseResult::COMPLETE);
+        REQUIRE(consumed == text.size());
+        REQUIRE(request.method.str() == "GET");
+        REQUIRE(request.target.str() == "/index.html?q=1");
+        REQUIRE(request.version_minor == 1);
+        REQUIRE(request.header_count == 2);
+        REQUIRE(request.header("host")->str() == "example.com");
+        REQUIRE(request.header("x-padded")->str() == "a b");
+        REQUIRE(request.header("Accept") == nullptr);
+        REQUIRE(request.keep_alive);
+    }
+
+    SECTION("Incremental input") {
+        std::string text = "POST /submit HTTP/1.1\nContent-Length: 5\n\nhello";
+        for (size_t size = 0; size < text.size(); size++)
+            REQUIRE(parser.parse(text.data(), size, request, consumed) == HttpParseResult::INCOMPLETE);
+        REQUIRE(parseAll(parser, text, request, consumed) == HttpParseResult::COMPLETE);
+        REQUIRE(request.body.str() == "hello");
+    }
+
+    SECTION("Pipelined requests are parsed one at a time") {
+        std::string text = "\r\nGET /a HTTP/1.1\r\n\r\nGET /b HTTP/1.0\r\n\r\n";
+        REQUIRE(parseAll(parser, text, request, consumed) == HttpParseResult::COMPLETE);
+        REQUIRE(request.target.str() == "/a");
+
+        std::string rest = text.substr(consumed);
+        REQUIRE(parseAll(parser, rest, request, consumed) == HttpParseResult::COMPLETE);
+        REQUIRE(request.target.str() == "/b");
+        REQUIRE(consumed == rest.size());
+        REQUIRE_FALSE(request.keep_alive);
+    }
+
+    SECTION("Connection header") {
+        REQUIRE(parseAll(parser, "GET / HTTP/1.1\r\nConnection: Close\r\n\r\n", request, consumed) ==
+                HttpParseResult::COMPLETE);
+        REQUIRE_FALSE(request.keep_alive);
+        REQUIRE(parseAll(parser, "GET / HTTP/1.0\r\nConnection: keep-alive\r\n\r\n", request, consumed) ==
+                HttpParseResult::COMPLETE);
+        REQUIRE(request.keep_alive);
+    }
+
+    SECTION("Malformed requests") {
+        const char* invalid[] = {
+            "GET /\r\n\r\n",
+            "GET / HTTP/2.0\r\n\r\n",
+            "GET / HTTP/1.1\r\nNo-Colon\r\n\r\n",
+            "GET / HTTP/1.1\r\nName : value\r\n\r\n",
+            "GET / HTTP/1.1\r\nA: b\r\n folded\r\n\r\n",
+            "POST / HTTP/1.1\r\nContent-Length: 1\r\nContent-Length: 1\r\n\r\n",
+            "POST / HTTP/1.1\r\nContent-Length: -1\r\n\r\n",
+            "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n",
+        };
+        for (const char* text : invalid) {
+            HttpParser fresh(256, 16);
+            REQUIRE(fresh.parse(text, std::strlen(text), request, consumed) == HttpParseResult::INVALID);
+        }
+    }
+
+    SECTION("Limits") {
+        std::string long_header = "GET / HTTP/1.1\r\nX: " + std::string(300, 'x');
+        REQUIRE(parseAll(parser, long_header, request, consumed) == HttpParseResult::HEADER_TOO_LARGE);
+
+        HttpParser fresh(256, 16);
+        REQUIRE(parseAll(fresh, "POST / HTTP/1.1\r\nContent-Length: 17\r\n\r\n", request, consumed) ==
+                HttpParseResult::BODY_TOO_LARGE);
+    }
+}
+
+TEST_CASE("Http: Server") {
+    uint16_t port = findAvailablePort();
+    Socket   listener;
+    listener.create();
+    listener.setReuseAddr(true);
+    listener.bind("127.0.0.1", port);
+    listener.listen();
+
+    EventLoop  loop;
+    HttpServer server(loop, std::move(listener), [](const HttpRequest& request, HttpResponse& response) {
+        if (request.target.str() == "/missing")
+            response.status = 404;
+        response.body = request.target.str();
+    });
+
+    Socket client;
+    client.create();
+    client.connect("127.0.0.1", port);
+    client.setNonBlocking(true);
+
+    auto exchange = [&](const std::string& requests, const std::string& expected) {
+        client.send(requests);
+        std::string received;
+        while (received.size() < expected.size()) {
+            loop.runOnce(10);
+            std::string part;
+            client.recv(part);
+            received += part;
+        }
+        REQUIRE(received == expected);
+    };
+
+    SECTION("Pipelined requests are answered in one write") {
+        exchange("GET /a HTTP/1.1\r\n\r\nGET /missing HTTP/1.1\r\n\r\nHEAD /c HTTP/1.1\r\n\r\n",
+                 "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: 2\r\n\r\n/a"
+                 "HTTP/1.1 404 Not Found\r\nContent-Type: text/plain\r\nContent-Length: 8\r\n\r\n/missing"
+                 "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: 2\r\n\r\n");
+        REQUIRE(server.stats().requests == 3);
+        REQUIRE(server.stats().writes == 1);
+        REQUIRE(server.connections() == 1);
+    }
+
+    SECTION("Connection: close ends the connection") {
+        exchange("GET /bye HTTP/1.1\r\nConnection: close\r\n\r\n",
+                 "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: 4\r\nConnection: close\r\n\r\n/bye");
+        REQUIRE(server.connections() == 0);
+    }
+
+    SECTION("Malformed requests get a 400") {
+        exchange("BROKEN\r\n\r\n",
+                 "HTTP/1.1 400 Bad Request\r\nContent-Type: text/plain\r\nContent-Length: 11\r\nConnection: "
+                 "close\r\n\r\nBad Request");
+        REQUIRE(server.stats().errors == 1);
+        REQUIRE(server.connections() == 0);
+    }
+}
@@ -0,0 +1,197 @@
+#include "event_loop.hpp"
+#include "event_poll.hpp"
+#include "memory_socket.hpp"
+#include "socket.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+namespace {
+
+PollEvent eventsFor(const EventPoll& poll, socket_t fd) {
+    for (const auto& event : poll.events()) {
+        if (event.fd == fd)
+            return event.events;
+    }
+    return PollEvent::NONE;
+}
+
+} // namespace
+
+TEST_CASE("MemorySocket: Streams") {
+    auto  ends = MemorySocket::pair(8);
+    auto& a    = ends.first;
+    auto& b    = ends.second;
+    REQUIRE(a.valid());
+    REQUIRE(a.fd() != b.fd());
+
+    SECTION("Bytes arrive in order") {
+        REQUIRE(a.send("hello") == 5);
+        std::string out;
+        REQUIRE(b.recv(out) == 5);
+        REQUIRE(out == "hello");
+        REQUIRE(b.tryRecv(&out[0], out.size()) == -1);
+    }
+
+    SECTION("A full buffer blocks the sender") {
+        REQUIRE(a.send("0123456789") == 8);
+        REQUIRE(a.trySend("x", 1) == -1);
+        char buffer[16];
+        REQUIRE(b.recv(buffer, 3) == 3);
+        // wraps around the end of the ring
+        IoSlice slices[] = {{"ab", 2}, {"cd", 2}};
+        REQUIRE(a.sendv(slices, 2) == 3);
+        REQUIRE(b.recv(buffer, sizeof(buffer)) == 8);
+        REQUIRE(std::string(buffer, 8) == "34567abc");
+        REQUIRE(a.stats().send_eagain == 1);
+    }
+
+    SECTION("Shutdown and close") {
+        a.send("bye");
+        a.shutdown(ShutdownMode::WRITE);
+        char buffer[8];
+        REQUIRE(b.tryRecv(buffer, sizeof(buffer)) == 3);
+        REQUIRE(b.tryRecv(buffer, sizeof(buffer)) == 0);
+        REQUIRE(b.send("still") == 5);
+        REQUIRE(a.recv(buffer, sizeof(buffer)) == 5);
+
+        b.close();
+        REQUIRE_FALSE(b.valid());
+        REQUIRE(a.tryRecv(buffer, sizeof(buffer)) == 0);
+        REQUIRE_THROWS_AS(a.send("x"), std::runtime_error);
+    }
+}
+
+TEST_CASE("MemorySocket: Readiness") {
+    EventPoll poll(16, PollBackend::MEMORY);
+    REQUIRE(poll.backend() == PollBackend::MEMORY);
+    auto  ends = MemorySocket::pair(4);
+    auto& a    = ends.first;
+    auto& b    = ends.second;
+
+    SECTION("Level-triggered read and write") {
+        poll.addFd(b.fd(), PollEvent::READ, 7);
+        poll.wait(0);
+        REQUIRE(poll.events().empty());
+
+        a.send("ab");
+        poll.wait(0);
+        REQUIRE(poll.events().size() == 1);
+        REQUIRE(poll.events()[0].fd == b.fd());
+        REQUIRE(poll.events()[0].tag == 7);
+        // still readable until drained
+        poll.wait(0);
+        REQUIRE(eventsFor(poll, b.fd()) == PollEvent::READ);
+        char buffer[4];
+        b.recv(buffer, sizeof(buffer));
+        poll.wait(0);
+        REQUIRE(poll.events().empty());
+
+        poll.addFd(a.fd(), PollEvent::WRITE);
+        a.send("abcd");
+        poll.wait(0);
+        REQUIRE(eventsFor(poll, a.fd()) == PollEvent::NONE);
+        REQUIRE(eventsFor(poll, b.fd()) == PollEvent::READ);
+        b.recv(buffer, 1);
+        poll.wait(0);
+        REQUIRE(eventsFor(poll, a.fd()) == PollEvent::WRITE);
+    }
+
+    SECTION("Modify and remove") {
+        a.send("x");
+        poll.addFd(b.fd(), PollEvent::WRITE);
+        poll.wait(0);
+        REQUIRE(eventsFor(poll, b.fd()) == PollEvent::WRITE);
+        poll.modifyFd(b.fd(), PollEvent::READ);
+        poll.wait(0);
+        REQUIRE(eventsFor(poll, b.fd()) == PollEvent::READ);
+        poll.removeFd(b.fd());
+        poll.wait(0);
+        REQUIRE(poll.events().empty());
+    }
+
+    SECTION("Peer close is reported") {
+        poll.addFd(b.fd(), PollEvent::READ);
+        a.close();
+        poll.wait(0);
+        REQUIRE((eventsFor(poll, b.fd()) & PollEvent::READ) != 0);
+        REQUIRE((eventsFor(poll, b.fd()) & PollEvent::ERR) != 0);
+    }
+
+    SECTION("Closed ends leave the poll") {
+        poll.addFd(b.fd(), PollEvent::WRITE);
+        b.close();
+        poll.wait(0);
+        REQUIRE(poll.events().empty());
+        REQUIRE(poll.stats().ctl_add == 1);
+    }
+
+    SECTION("Unknown numbers and second registrations fail") {
+        REQUIRE_THROWS_AS(poll.addFd(b.fd() + 1000, PollEvent::READ), std::runtime_error);
+        poll.addFd(b.fd(), PollEvent::READ);
+        REQUIRE_THROWS_AS(poll.addFd(b.fd(), PollEvent::READ), std::runtime_error);
+    }
+
+    SECTION("Blocking waits end on data from another thread or a wakeup") {
+        poll.addFd(b.fd(), PollEvent::READ);
+        std::thread sender([&a]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            a.send("x");
+        });
+        poll.wait(5000);
+        sender.join();
+        REQUIRE(eventsFor(poll, b.fd()) == PollEvent::READ);
+
+        char buffer[4];
+        b.recv(buffer, sizeof(buffer));
+        std::thread waker([&poll]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            poll.wakeup();
+        });
+        auto start = std::chrono::steady_clock::now();
+        poll.wait(5000);
+        waker.join();
+        REQUIRE(poll.events().empty());
+        REQUIRE(std::chrono::steady_clock::now() - start < std::chrono::seconds(4));
+        REQUIRE(poll.stats().wakeups == 1);
+
+        start = std::chrono::steady_clock::now();
+        poll.wait(30);
+        REQUIRE(poll.events().empty());
+        REQUIRE(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(25));
+    }
+}
+
+TEST_CASE("MemorySocket: Event loop echo") {
+    struct Echo {
+        MemorySocket socket;
+        size_t       echoed = 0;
+
+        void onEvent(socket_t /*fd*/, PollEvent /*events*/) {
+            char          buffer[64];
+            socket_size_t n = socket.tryRecv(buffer, sizeof(buffer));
+            if (n > 0)
+                echoed += static_cast<size_t>(socket.send(buffer, static_cast<size_t>(n)));
+        }
+    };
+
+    EventLoop loop(64, PollBackend::MEMORY);
+    auto      ends = MemorySocket::pair();
+    Echo      echo{std::move(ends.second)};
+    loop.add(echo.socket.fd(), PollEvent::READ, memberHandler<Echo, &Echo::onEvent>(&echo));
+
+    MemorySocket& client = ends.first;
+    for (int i = 0; i < 100; i++) {
+        std::string message = "message " + std::to_string(i);
+        client.send(message);
+        REQUIRE(loop.runOnce(0) == 1);
+        std::string reply;
+        client.recv(reply);
+        REQUIRE(reply == message);
+    }
+    REQUIRE(loop.runOnce(0) == 0);
+    REQUIRE(echo.echoed > 0);
+}
@@ -6,13 +6,19 @@
 #include <winsock2.h>
 #include <ws2tcpip.h>
 #else
+#include "basic_event_poll.hpp"
 #include <netinet/in.h>
 #include <sys/socket.h>
 #endif
 
+#include <atomic>
 #include <catch2/catch_test_macros.hpp>
 #include <chrono>
+#include <cstdlib>
+#include <exception>
+#include <string>
 #include <thread>
+#include <vector>
 
 TEST_CASE("EventPoll: Construction") {
     SECTION("Default construction") {
@@ -211,4 +217,344 @@ TEST_CASE("EventPoll: Integration with socket") {
 
         client_thread.join();
     }
-}
\ No newline at end of file
+}
+
+TEST_CASE("EventPoll: Wakeup") {
+    EventPoll poll;
+
+    SECTION("Wakeup from another thread ends a blocking wait") {
+        std::thread waker([&]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            poll.wakeup();
+        });
+
+        auto start = std::chrono::steady_clock::now();
+        poll.wait(5000);
+        REQUIRE(std::chrono::steady_clock::now() - start < std::chrono::seconds(5));
+        REQUIRE(poll.events().empty());
+        waker.join();
+    }
+
+    SECTION("Repeated wakeups are coalesced") {
+        poll.wakeup();
+        poll.wakeup();
+        poll.wakeup();
+        poll.wait(1000);
+        REQUIRE(poll.events().empty());
+
+        auto start = std::chrono::steady_clock::now();
+        poll.wait(50);
+        REQUIRE(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(40));
+    }
+}
+
+TEST_CASE("EventPoll: Interest cache and queued changes") {
+    uint16_t port = findAvailablePort();
+    Socket   server;
+    server.create();
+    server.setReuseAddr(true);
+    server.bind("127.0.0.1", port);
+    server.listen();
+
+    Socket client;
+    client.create();
+    client.connect("127.0.0.1", port);
+    Socket accepted = server.accept();
+
+    EventPoll poll;
+
+    SECTION("Modifying to the same events skips the kernel") {
+        poll.addFd(client.fd(), PollEvent::READ, 7);
+        poll.modifyFd(client.fd(), PollEvent::READ, 7);
+        poll.modifyFd(client.fd(), PollEvent::READ, 7);
+        poll.modifyFd(client.fd(), PollEvent::WRITE, 7);
+        poll.modifyFd(client.fd(), PollEvent::WRITE, 8);
+
+        PollStats stats = poll.stats();
+        REQUIRE(stats.ctl_mod == 2);
+        REQUIRE(stats.ctl_saved == 2);
+
+        poll.wait(100);
+        REQUIRE(poll.events().size() == 1);
+        REQUIRE(poll.events()[0].tag == 8);
+    }
+
+    SECTION("A removed fd is not elided when it comes back") {
+        poll.addFd(client.fd(), PollEvent::WRITE);
+        poll.removeFd(client.fd());
+        REQUIRE_THROWS(poll.modifyFd(client.fd(), PollEvent::WRITE));
+        poll.addFd(client.fd(), PollEvent::WRITE);
+        poll.wait(100);
+        REQUIRE(poll.events().size() == 1);
+    }
+
+    SECTION("Changes for one fd are coalesced before wait") {
+        poll.queueAdd(client.fd(), PollEvent::READ, 1);
+        poll.queueModify(client.fd(), PollEvent::WRITE, 2);
+        poll.queueModify(client.fd(), PollEvent::WRITE, 3);
+        poll.queueAdd(accepted.fd(), PollEvent::WRITE);
+        poll.queueRemove(accepted.fd());
+        REQUIRE(poll.pending() == 2);
+
+        poll.wait(100);
+        REQUIRE(poll.pending() == 0);
+        REQUIRE(poll.events().size() == 1);
+        REQUIRE(poll.events()[0].fd == client.fd());
+        REQUIRE(poll.events()[0].tag == 3);
+
+        PollStats stats = poll.stats();
+        REQUIRE(stats.ctl_add == 1);
+        REQUIRE(stats.ctl_mod == 0);
+        REQUIRE(stats.ctl_del == 0);
+        REQUIRE(stats.ctl_saved == 4);
+    }
+
+    SECTION("A queued remove and add both reach the kernel") {
+        poll.addFd(client.fd(), PollEvent::READ, 1);
+        poll.queueRemove(client.fd());
+        poll.queueAdd(client.fd(), PollEvent::WRITE, 2);
+        poll.commitPending();
+
+        PollStats stats = poll.stats();
+        REQUIRE(stats.ctl_add == 2);
+        REQUIRE(stats.ctl_del == 1);
+        poll.wait(100);
+        REQUIRE(poll.events().size() == 1);
+        REQUIRE(poll.events()[0].tag == 2);
+    }
+
+    SECTION("Exclusive registrations are replaced instead of modified") {
+        poll.addFd(client.fd(), static_cast<PollEvent>(PollEvent::READ | PollEvent::EXCLUSIVE), 1);
+        REQUIRE_NOTHROW(poll.modifyFd(client.fd(), static_cast<PollEvent>(PollEvent::WRITE | PollEvent::EXCLUSIVE), 2));
+
+        PollStats stats = poll.stats();
+        REQUIRE(stats.ctl_add == 2);
+        REQUIRE(stats.ctl_del == 1);
+        REQUIRE(stats.ctl_mod == 0);
+        poll.wait(100);
+        REQUIRE(poll.events().size() == 1);
+        REQUIRE(poll.events()[0].events == PollEvent::WRITE);
+        REQUIRE(poll.events()[0].tag == 2);
+    }
+
+    SECTION("Errors of queued changes surface after the rest was applied") {
+        poll.queueModify(client.fd(), PollEvent::WRITE);
+        poll.queueAdd(accepted.fd(), PollEvent::WRITE);
+        REQUIRE_THROWS(poll.commitPending());
+        REQUIRE(poll.pending() == 0);
+
+        poll.wait(100);
+        REQUIRE(poll.events().size() == 1);
+        REQUIRE(poll.events()[0].fd == accepted.fd());
+    }
+}
+
+#ifndef _WIN32
+TEST_CASE("EventPoll: Registration from other threads") {
+    constexpr uint32_t THREADS = 4;
+    constexpr uint32_t ROUNDS  = 200;
+
+    // every registering thread makes a readable fd, registers it and waits until the polling thread saw its tag.
+    // the poll lives on a thread of its own for the reason given in the backends test below
+    auto exercise = [&](PollBackend backend) {
+        EventPoll             poll(64, backend);
+        std::atomic<bool>     done{false};
+        std::atomic<bool>     failed{false};
+        std::atomic<uint32_t> seen[THREADS];
+        for (auto& round : seen)
+            round = 0;
+
+        std::thread waiter([&]() {
+            while (!done) {
+                poll.wait(10);
+                for (const auto& event : poll.events())
+                    seen[event.tag >> 16] = event.tag & 0xffff;
+            }
+        });
+        std::vector<std::thread> threads;
+        for (uint32_t t = 0; t < THREADS; t++) {
+            threads.emplace_back([&, t]() {
+                for (uint32_t round = 1; round <= ROUNDS && !failed; round++) {
+                    int pair[2];
+                    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, pair) != 0 || ::send(pair[1], "x", 1, 0) != 1) {
+                        failed = true;
+                        return;
+                    }
+                    uint32_t tag = (t << 16) | round;
+                    poll.queueAdd(pair[0], PollEvent::WRITE, tag);
+                    poll.modifyFd(pair[0], PollEvent::READ, tag);
+                    poll.modifyFd(pair[0], PollEvent::READ, tag);
+                    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+                    while (seen[t] != round && !failed) {
+                        if (std::chrono::steady_clock::now() > deadline)
+                            failed = true;
+                        std::this_thread::yield();
+                    }
+                    poll.removeFd(pair[0]);
+                    ::close(pair[0]);
+                    ::close(pair[1]);
+                }
+            });
+        }
+        for (auto& thread : threads)
+            thread.join();
+        done = true;
+        waiter.join();
+        return !failed && poll.pending() == 0 && poll.stats().ctl_saved >= THREADS * ROUNDS;
+    };
+
+    for (PollBackend backend : {PollBackend::EPOLL, PollBackend::IO_URING}) {
+        if (!pollBackendAvailable(backend))
+            continue;
+        INFO(pollBackendName(backend));
+        bool passed = false;
+        std::thread([&]() { passed = exercise(backend); }).join();
+        REQUIRE(passed);
+    }
+}
+#endif
+
+TEST_CASE("EventPoll: Backends") {
+    REQUIRE(pollBackendAvailable(PollBackend::AUTO));
+    REQUIRE(EventPoll().backend() != PollBackend::AUTO);
+#ifdef __linux__
+    REQUIRE(pollBackendAvailable(PollBackend::EPOLL));
+#endif
+#ifndef _WIN32
+    {
+        // a name that is no backend gets the default like an unusable one, the environment is put back after
+        const char* set      = std::getenv("SOCKETPOLL_BACKEND");
+        std::string previous = set != nullptr ? set : "";
+        unsetenv("SOCKETPOLL_BACKEND");
+        PollBackend fallback = EventPoll().backend();
+        setenv("SOCKETPOLL_BACKEND", "no-such-backend", 1);
+        PollBackend chosen = EventPoll().backend();
+        if (set != nullptr)
+            setenv("SOCKETPOLL_BACKEND", previous.c_str(), 1);
+        else
+            unsetenv("SOCKETPOLL_BACKEND");
+        REQUIRE(chosen == fallback);
+    }
+#endif
+
+    uint16_t port = findAvailablePort();
+    Socket   server;
+    server.create();
+    server.setReuseAddr(true);
+    server.bind("127.0.0.1", port);
+    server.listen();
+
+    Socket client;
+    client.create();
+    client.connect("127.0.0.1", port);
+    Socket accepted = server.accept();
+
+    auto exercise = [&](PollBackend backend) {
+        EventPoll poll(16, backend);
+        REQUIRE(poll.backend() == backend);
+
+        // nothing to read yet, and a retagged registration reports the new tag only
+        poll.addFd(accepted.fd(), PollEvent::READ, 1);
+        poll.wait(0);
+        REQUIRE(poll.events().empty());
+        poll.modifyFd(accepted.fd(), static_cast<PollEvent>(PollEvent::READ | PollEvent::WRITE), 2);
+        poll.wait(100);
+        REQUIRE(poll.events().size() == 1);
+        REQUIRE(poll.events()[0].events == PollEvent::WRITE);
+        REQUIRE(poll.events()[0].tag == 2);
+
+        // level-triggered: unread data keeps being reported
+        poll.modifyFd(accepted.fd(), PollEvent::READ, 3);
+        client.send(std::string("x"));
+        for (int i = 0; i < 2; i++) {
+            poll.wait(100);
+            REQUIRE(poll.events().size() == 1);
+            REQUIRE(poll.events()[0].events == PollEvent::READ);
+            REQUIRE(poll.events()[0].tag == 3);
+        }
+        std::string received;
+        accepted.recv(received);
+
+        poll.wakeup();
+        poll.wait(1000);
+        REQUIRE(poll.events().empty());
+        REQUIRE(poll.stats().wakeups == 1);
+
+        poll.removeFd(accepted.fd());
+        client.send(std::string("y"));
+        poll.wait(50);
+        REQUIRE(poll.events().empty());
+        accepted.recv(received);
+    };
+
+    for (PollBackend backend :
+         {PollBackend::EPOLL, PollBackend::IO_URING, PollBackend::KQUEUE, PollBackend::WSAPOLL}) {
+        if (!pollBackendAvailable(backend)) {
+            REQUIRE_THROWS(EventPoll(16, backend));
+            continue;
+        }
+        INFO(pollBackendName(backend));
+        // a closed io_uring interrupts the next blocking wait of the thread that created it, keep that away from the
+        // tests running after this one
+        std::exception_ptr error;
+        std::thread([&]() {
+            try {
+                exercise(backend);
+            } catch (...) {
+                error = std::current_exception();
+            }
+        }).join();
+        if (error)
+            std::rethrow_exception(error);
+    }
+}
+
+#ifndef _WIN32
+TEST_CASE("BasicEventPoll: Inline front end") {
+    uint16_t port = findAvailablePort();
+    Socket   server;
+    server.create();
+    server.setReuseAddr(true);
+    server.bind("127.0.0.1", port);
+    server.listen();
+
+    Socket client;
+    client.create();
+    client.connect("127.0.0.1", port);
+    Socket accepted = server.accept();
+    accepted.setNonBlocking(true);
+
+    NativeEventPoll poll(16);
+    poll.addFd(accepted.fd(), PollEvent::READ, 7);
+    REQUIRE(poll.wait(0) == 0);
+
+    char byte = 'x';
+    REQUIRE(sendNow(client.fd(), &byte, 1) == 1);
+    REQUIRE(poll.wait(100) == 1);
+    EventPoll::PollEventEntry event = poll.event(0);
+    REQUIRE(event.fd == accepted.fd());
+    REQUIRE(event.events == PollEvent::READ);
+    REQUIRE(event.tag == 7);
+
+    // the wakeup is counted and taken out, the still unread byte is reported next to it
+    poll.wakeup();
+    poll.wakeup();
+    REQUIRE(poll.wait(100) == 1);
+    REQUIRE(poll.event(0).tag == 7);
+    REQUIRE(poll.stats().wakeups == 1);
+
+    char received = 0;
+    REQUIRE(recvNow(accepted.fd(), &received, 1) == 1);
+    REQUIRE(received == 'x');
+    REQUIRE(recvNow(accepted.fd(), &received, 1) == -1);
+
+    poll.modifyFd(accepted.fd(), static_cast<PollEvent>(PollEvent::READ | PollEvent::WRITE), 8);
+    REQUIRE(poll.wait(100) == 1);
+    REQUIRE(poll.event(0).events == PollEvent::WRITE);
+    REQUIRE(poll.event(0).tag == 8);
+
+    poll.removeFd(accepted.fd());
+    REQUIRE(poll.wait(0) == 0);
+    REQUIRE_THROWS_AS(poll.modifyFd(accepted.fd(), PollEvent::READ), std::runtime_error);
+}
+#endif
@@ -0,0 +1,207 @@
+#ifdef __linux__
+
+#include "event_poll.hpp"
+#include "shm_socket.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <stdexcept>
+#include <string>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+// the other process owns the end now
+void dropCopy(ShmSocket& end) {
+    ShmSocket::Handles handles = end.release();
+    for (int fd : {handles.memory, handles.doorbell, handles.peer_doorbell})
+        close(fd);
+}
+
+} // namespace
+
+TEST_CASE("ShmSocket: Streams") {
+    auto  ends = ShmSocket::pair(64);
+    auto& a    = ends.first;
+    auto& b    = ends.second;
+    REQUIRE(a.valid());
+    REQUIRE(a.fd() != b.fd());
+
+    SECTION("Bytes arrive in order") {
+        REQUIRE(a.send("hello") == 5);
+        std::string out;
+        REQUIRE(b.recv(out) == 5);
+        REQUIRE(out == "hello");
+        REQUIRE(b.tryRecv(&out[0], out.size()) == -1);
+        REQUIRE(b.stats().recv_eagain == 1);
+    }
+
+    SECTION("A full ring blocks the sender") {
+        std::string block(64, 'x');
+        REQUIRE(a.send(block) == 64);
+        REQUIRE(a.trySend("y", 1) == -1);
+        char buffer[128];
+        REQUIRE(b.recv(buffer, 10) == 10);
+        // wraps around the end of the ring
+        IoSlice slices[] = {{"abcdefgh", 8}, {"ijkl", 4}};
+        REQUIRE(a.sendv(slices, 2) == 10);
+        REQUIRE(b.recv(buffer, sizeof(buffer)) == 64);
+        REQUIRE(std::string(buffer + 54, 10) == "abcdefghij");
+        REQUIRE(a.stats().send_eagain == 1);
+    }
+
+    SECTION("Shutdown and close") {
+        a.send("bye");
+        a.shutdown(ShutdownMode::WRITE);
+        char buffer[8];
+        REQUIRE(b.tryRecv(buffer, sizeof(buffer)) == 3);
+        REQUIRE(b.tryRecv(buffer, sizeof(buffer)) == 0);
+        REQUIRE(b.send("still") == 5);
+        REQUIRE(a.recv(buffer, sizeof(buffer)) == 5);
+        REQUIRE_THROWS_AS(a.send("x"), std::runtime_error);
+
+        b.close();
+        REQUIRE_FALSE(b.valid());
+        REQUIRE(a.tryRecv(buffer, sizeof(buffer)) == 0);
+    }
+
+    SECTION("Adopting something else fails") {
+        ShmSocket::Handles handles;
+        handles.memory        = memfd_create("not-a-ring", MFD_CLOEXEC);
+        handles.peer_doorbell = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        REQUIRE(ftruncate(handles.memory, 4096) == 0);
+        int memory   = dup(handles.memory);
+        int doorbell = dup(handles.peer_doorbell);
+        REQUIRE_THROWS(ShmSocket::adopt(handles));
+
+        // neither the memory nor the doorbell were touched on the way out
+        char     page[4096];
+        uint64_t rung = 0;
+        REQUIRE(pread(memory, page, sizeof(page), 0) == static_cast<ssize_t>(sizeof(page)));
+        REQUIRE(std::string(page, sizeof(page)) == std::string(sizeof(page), '\0'));
+        REQUIRE(read(doorbell, &rung, sizeof(rung)) == -1);
+        close(memory);
+        close(doorbell);
+    }
+}
+
+TEST_CASE("ShmSocket: Doorbells") {
+    auto  ends = ShmSocket::pair(1024);
+    auto& a    = ends.first;
+    auto& b    = ends.second;
+    char  buffer[1024];
+
+    SECTION("Only a waiting peer is rung") {
+        // b never waited, so a keeps its sends to memory
+        for (int i = 0; i < 100; i++) {
+            a.send("x");
+            REQUIRE(b.recv(buffer, sizeof(buffer)) == 1);
+        }
+        REQUIRE(a.doorbells() == 0);
+
+        REQUIRE(b.tryRecv(buffer, sizeof(buffer)) == -1);
+        a.send("x");
+        a.send("y");
+        REQUIRE(a.doorbells() == 1);
+    }
+
+    SECTION("EventPoll reports data and room through fd()") {
+        EventPoll poll(4);
+        poll.addFd(b.fd(), PollEvent::READ, 1);
+        poll.addFd(a.fd(), PollEvent::READ, 2);
+        REQUIRE(b.tryRecv(buffer, sizeof(buffer)) == -1);
+        poll.wait(0);
+        REQUIRE(poll.events().empty());
+
+        a.send("ping");
+        poll.wait(0);
+        REQUIRE(poll.events().size() == 1);
+        REQUIRE(poll.events()[0].tag == 1);
+        REQUIRE(b.tryRecv(buffer, sizeof(buffer)) == 4);
+        REQUIRE(b.tryRecv(buffer, sizeof(buffer)) == -1);
+        poll.wait(0);
+        REQUIRE(poll.events().empty());
+
+        std::string block(1024, 'z');
+        REQUIRE(a.send(block) == 1024);
+        REQUIRE(a.trySend("z", 1) == -1);
+        REQUIRE(b.recv(buffer, 1) == 1);
+        poll.wait(0);
+        // b got rung for the data, a for the room b made
+        REQUIRE(poll.events().size() == 2);
+        REQUIRE(a.trySend("z", 1) == 1);
+    }
+
+    SECTION("A ring for the other direction is not lost") {
+        std::string block(1024, 'z');
+        a.send(block);
+        REQUIRE(a.trySend("z", 1) == -1);
+        b.recv(buffer, 1);
+        // a drains the doorbell while it waits for data, the ring for room has to survive that
+        REQUIRE(a.tryRecv(buffer, sizeof(buffer)) == -1);
+        EventPoll poll(4);
+        poll.addFd(a.fd(), PollEvent::READ);
+        poll.wait(0);
+        REQUIRE(poll.events().size() == 1);
+    }
+}
+
+TEST_CASE("ShmSocket: Between processes") {
+    auto ends = ShmSocket::pair(4096);
+
+    pid_t child = fork();
+    REQUIRE(child != -1);
+    if (child == 0) {
+        // echoes until the parent closes its end
+        ShmSocket echo = std::move(ends.second);
+        dropCopy(ends.first);
+        EventPoll poll(1);
+        poll.addFd(echo.fd(), PollEvent::READ);
+        char buffer[256];
+        for (;;) {
+            socket_size_t n = echo.tryRecv(buffer, sizeof(buffer));
+            if (n == 0)
+                _exit(0);
+            if (n < 0) {
+                poll.wait(1000);
+                continue;
+            }
+            for (socket_size_t sent = 0; sent < n;) {
+                socket_size_t r = echo.trySend(buffer + sent, static_cast<size_t>(n - sent));
+                if (r < 0)
+                    poll.wait(1000);
+                else
+                    sent += r;
+            }
+        }
+    }
+
+    ShmSocket client = std::move(ends.first);
+    dropCopy(ends.second);
+    EventPoll poll(1);
+    poll.addFd(client.fd(), PollEvent::READ);
+    for (int i = 0; i < 200; i++) {
+        std::string message = "message " + std::to_string(i);
+        client.send(message);
+        std::string reply;
+        char        buffer[64];
+        while (reply.size() < message.size()) {
+            socket_size_t n = client.tryRecv(buffer, sizeof(buffer));
+            if (n < 0)
+                poll.wait(5000);
+            else
+                reply.append(buffer, static_cast<size_t>(n));
+        }
+        REQUIRE(reply == message);
+    }
+    client.close();
+
+    int status = 0;
+    REQUIRE(waitpid(child, &status, 0) == child);
+    REQUIRE(WIFEXITED(status));
+    REQUIRE(WEXITSTATUS(status) == 0);
+}
+
+#endif
@@ -1,3 +1,5 @@
+#include "event_poll.hpp"
+#include "histogram.hpp"
 #include "socket.hpp"
 #include "test_utils.hpp"
 
@@ -19,7 +21,9 @@ using socket_t = int;
 
 #include <catch2/catch_test_macros.hpp>
 #include <chrono>
+#include <stdexcept>
 #include <thread>
+#include <vector>
 
 TEST_CASE("Socket: Construction and destruction") {
     SECTION("Default construction") {
@@ -261,4 +265,241 @@ TEST_CASE("Socket: Send and receive") {
 
         client_thread.join();
     }
+
+    SECTION("Vectored send") {
+        Socket server;
+        server.create();
+        server.setReuseAddr(true);
+        server.bind("127.0.0.1", port);
+        server.listen();
+
+        Socket client;
+        client.create();
+        client.connect("127.0.0.1", port);
+        Socket accepted = server.accept();
+
+        IoSlice slices[3];
+        slices[0] = {"Hel", 3};
+        slices[1] = {"", 0};
+        slices[2] = {"lo", 2};
+        REQUIRE(client.sendv(slices, 3) == 5);
+
+        std::string received;
+        while (received.size() < 5) {
+            std::string part;
+            accepted.recv(part);
+            received += part;
+        }
+        REQUIRE(received == "Hello");
+    }
+
+    SECTION("Half close") {
+        Socket server;
+        server.create();
+        server.setReuseAddr(true);
+        server.bind("127.0.0.1", port);
+        server.listen();
+
+        Socket client;
+        client.create();
+        client.connect("127.0.0.1", port);
+        Socket accepted = server.accept();
+
+        client.send(std::string("last"));
+        client.shutdown(ShutdownMode::WRITE);
+
+        std::string received;
+        REQUIRE(accepted.recv(received) == 4);
+        REQUIRE(accepted.recv(received) == 0);
+
+        // the other direction still works
+        accepted.send(std::string("reply"));
+        REQUIRE(client.recv(received) == 5);
+        REQUIRE(received == "reply");
+    }
+
+    SECTION("Sending to a peer that went away throws instead of raising SIGPIPE") {
+        Socket server;
+        server.create();
+        server.setReuseAddr(true);
+        server.bind("127.0.0.1", port);
+        server.listen();
+
+        Socket client;
+        client.create();
+        client.connect("127.0.0.1", port);
+        server.accept().close();
+
+        // the first send after the close draws a reset, a later one fails
+        bool failed = false;
+        for (int i = 0; i < 100 && !failed; i++) {
+            try {
+                client.trySend("x", 1);
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            } catch (const std::runtime_error&) {
+                failed = true;
+            }
+        }
+        REQUIRE(failed);
+    }
 }
+
+TEST_CASE("Socket: Nonblocking accept and connect") {
+    uint16_t port = findAvailablePort();
+
+    Socket server;
+    server.create();
+    server.setReuseAddr(true);
+    server.bind("127.0.0.1", port);
+    server.listen();
+    server.setNonBlocking(true);
+
+    SECTION("tryAccept without pending connection") {
+        Socket accepted = server.tryAccept();
+        REQUIRE_FALSE(accepted.valid());
+    }
+
+    SECTION("tryConnect completes asynchronously") {
+        Socket client;
+        client.create();
+        client.setNonBlocking(true);
+
+        bool connected = client.tryConnect("127.0.0.1", port);
+        if (!connected)
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        REQUIRE(client.pendingError() == 0);
+
+        Socket accepted = server.tryAccept();
+        REQUIRE(accepted.valid());
+    }
+
+    SECTION("tryConnect to a closed port reports the error") {
+        server.close();
+
+        Socket client;
+        client.create();
+        client.setNonBlocking(true);
+
+        bool connected = false;
+        try {
+            connected = client.tryConnect("127.0.0.1", port);
+        } catch (const std::runtime_error&) {
+            // refused synchronously
+            return;
+        }
+        REQUIRE_FALSE(connected);
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        REQUIRE(client.pendingError() != 0);
+    }
+}
+
+#ifdef __linux__
+TEST_CASE("Socket: Reuseport steering by CPU") {
+    uint16_t port = findAvailablePort();
+
+    constexpr unsigned  LISTENERS = 2;
+    std::vector<Socket> listeners(LISTENERS);
+    for (Socket& listener : listeners) {
+        listener.create();
+        listener.setReusePort(true);
+        listener.bind("127.0.0.1", port);
+        listener.listen();
+        listener.setNonBlocking(true);
+    }
+    listeners[1].steerByCpu(LISTENERS);
+
+    std::vector<Socket> clients(16);
+    for (Socket& client : clients) {
+        client.create();
+        client.connect("127.0.0.1", port);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+    // every connection waits on the listener its packets' CPU maps to
+    size_t accepted_count = 0;
+    for (unsigned i = 0; i < LISTENERS; i++) {
+        Socket accepted;
+        while ((accepted = listeners[i].tryAccept()).valid()) {
+            int cpu = accepted.incomingCpu();
+            REQUIRE(cpu >= 0);
+            REQUIRE(static_cast<unsigned>(cpu) % LISTENERS == i);
+            accepted_count++;
+        }
+    }
+    REQUIRE(accepted_count == clients.size());
+
+    Socket plain;
+    plain.create();
+    REQUIRE_THROWS_AS(plain.steerByCpu(0), std::invalid_argument);
+}
+
+TEST_CASE("Socket: Kernel timestamps") {
+    uint16_t port = findAvailablePort();
+    Socket   server;
+    server.create();
+    server.setReuseAddr(true);
+    server.bind("127.0.0.1", port);
+    server.listen();
+    Socket client;
+    client.create();
+    client.connect("127.0.0.1", port);
+    Socket accepted = server.accept();
+    accepted.setNonBlocking(true);
+    client.enableTimestamps();
+    accepted.enableTimestamps();
+    resetIoLatency();
+
+    EventPoll poll(2);
+    poll.addFd(accepted.fd(), PollEvent::READ);
+    client.send("ping");
+    client.send("pong!");
+
+    // the second send may trail the first by an ack
+    char          buffer[16];
+    uint64_t      kernel_ns = 0;
+    socket_size_t received  = 0;
+    while (received < 9) {
+        poll.wait(1000);
+        REQUIRE(poll.events().size() == 1);
+        socket_size_t n = accepted.tryRecvStamped(buffer, sizeof(buffer), kernel_ns);
+        REQUIRE(n > 0);
+        REQUIRE(kernel_ns > 0);
+        REQUIRE(kernel_ns <= monotonicNs());
+        received += n;
+    }
+    REQUIRE(accepted.stats().rx_stamps >= 1);
+    REQUIRE(accepted.tryRecvStamped(buffer, sizeof(buffer), kernel_ns) == -1);
+    REQUIRE(kernel_ns == 0);
+
+    // transmit stamps wait on the error queue, which polls report as ERR
+    poll.addFd(client.fd(), PollEvent::READ);
+    std::vector<TxTimestamp> stamps;
+    for (int i = 0; i < 100 && stamps.size() < 2; i++) {
+        poll.wait(10);
+        client.readTxTimestamps(stamps);
+    }
+    REQUIRE(stamps.size() == 2);
+    REQUIRE(stamps[0].bytes == 4);
+    REQUIRE(stamps[1].bytes == 9);
+    REQUIRE(stamps[1].send_ns > stamps[0].send_ns);
+    REQUIRE(client.pendingError() == 0);
+    poll.wait(0);
+    REQUIRE(poll.events().empty());
+
+    REQUIRE(client.stats().tx_stamps == 2);
+    IoLatencySnapshot latency = ioLatency();
+    REQUIRE(latency.kernel_to_user.count == accepted.stats().rx_stamps);
+    REQUIRE(latency.user_to_wire.count == 2);
+
+    // bytes sent past Socket shift the kernel's numbering, the next send through it realigns the log
+    REQUIRE(::send(client.fd(), "raw", 3, 0) == 3);
+    client.send("after");
+    stamps.clear();
+    for (int i = 0; i < 100 && stamps.empty(); i++) {
+        poll.wait(10);
+        client.readTxTimestamps(stamps);
+    }
+    REQUIRE(stamps.size() == 1);
+    REQUIRE(stamps[0].bytes == 17);
+}
+#endif
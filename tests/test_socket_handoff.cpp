@@ -0,0 +1,233 @@
+#ifndef _WIN32
+
+#include "event_poll.hpp"
+#include "socket.hpp"
+#include "socket_handoff.hpp"
+#include "test_utils.hpp"
+
+#include <atomic>
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+
+namespace {
+
+std::string handoffPath() {
+    return "/tmp/socketpoll-handoff-" + std::to_string(getpid()) + ".sock";
+}
+
+// a bare unix listener standing in for a HandoffServer that does not follow the protocol
+Socket impostorListener(const std::string& path) {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    ::unlink(path.c_str());
+    Socket listener(::socket(AF_UNIX, SOCK_STREAM, 0));
+    REQUIRE(::bind(listener.fd(), reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0);
+    REQUIRE(::listen(listener.fd(), 1) == 0);
+    return listener;
+}
+
+} // namespace
+
+TEST_CASE("SocketHandoff: Sockets arrive with their names") {
+    HandoffServer server(handoffPath());
+    REQUIRE(server.handOff({}) == false);
+
+    uint16_t port     = findAvailablePort();
+    Socket   listener = listenLoopback(port);
+    Socket   client;
+    client.create();
+    client.connect("127.0.0.1", port);
+    Socket conn = listener.accept();
+
+    std::vector<HandoffSocket> received;
+    std::thread                successor([&]() { received = receiveHandoff(server.path()); });
+    EventPoll                  poll(1);
+    poll.addFd(server.fd(), PollEvent::READ);
+    while (!server.handOff({{listener.fd(), "listener"}, {conn.fd(), "conn 1"}}))
+        poll.wait(1000);
+    successor.join();
+
+    REQUIRE(received.size() == 2);
+    REQUIRE(received[0].name == "listener");
+    REQUIRE(received[1].name == "conn 1");
+    REQUIRE(received[0].socket.fd() != listener.fd());
+
+    // the copies work after the originals are gone
+    listener.close();
+    conn.close();
+    client.send("x");
+    char byte = 0;
+    REQUIRE(received[1].socket.recv(&byte, 1) == 1);
+    REQUIRE(byte == 'x');
+    Socket second;
+    second.create();
+    second.connect("127.0.0.1", port);
+    REQUIRE(received[0].socket.accept().valid());
+
+    REQUIRE_THROWS_AS(receiveHandoff(server.path() + ".missing"), std::runtime_error);
+}
+
+TEST_CASE("SocketHandoff: A peer announcing more than it sends fails the transfer") {
+    std::string path     = handoffPath();
+    Socket      listener = impostorListener(path);
+
+    // the magic, then a count no transfer reaches, then nothing
+    std::thread impostor([&]() {
+        Socket   channel(::accept(listener.fd(), nullptr, nullptr));
+        uint32_t preamble[2] = {0x534f4846, UINT32_MAX};
+        channel.send(preamble, sizeof(preamble));
+    });
+    REQUIRE_THROWS_AS(receiveHandoff(path, 1000), std::runtime_error);
+    impostor.join();
+    ::unlink(path.c_str());
+}
+
+TEST_CASE("SocketHandoff: An oversized name fails the transfer") {
+    std::string path     = handoffPath();
+    Socket      listener = impostorListener(path);
+
+    // one well formed entry carrying a descriptor, except that its name claims 4 GiB
+    std::thread impostor([&]() {
+        Socket   channel(::accept(listener.fd(), nullptr, nullptr));
+        uint32_t preamble[2] = {0x534f4846, 1};
+        channel.send(preamble, sizeof(preamble));
+
+        uint32_t header[2] = {0x534f4846, UINT32_MAX};
+        iovec    iov{header, sizeof(header)};
+        alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+        msghdr message{};
+        message.msg_iov        = &iov;
+        message.msg_iovlen     = 1;
+        message.msg_control    = control;
+        message.msg_controllen = sizeof(control);
+        cmsghdr* cmsg          = CMSG_FIRSTHDR(&message);
+        cmsg->cmsg_level       = SOL_SOCKET;
+        cmsg->cmsg_type        = SCM_RIGHTS;
+        cmsg->cmsg_len         = CMSG_LEN(sizeof(int));
+        int fd                 = listener.fd();
+        std::memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+        ::sendmsg(channel.fd(), &message, 0);
+    });
+    // the channel closing would fail the transfer as well, so the cap has to be what stopped it
+    std::string error;
+    try {
+        receiveHandoff(path, 1000);
+    } catch (const std::runtime_error& e) {
+        error = e.what();
+    }
+    REQUIRE(error.find("too long") != std::string::npos);
+    impostor.join();
+    ::unlink(path.c_str());
+}
+
+TEST_CASE("SocketHandoff: A restart refuses no connections") {
+    constexpr int BEFORE = 50;
+    constexpr int TOTAL  = 200;
+    HandoffServer server(handoffPath());
+    uint16_t      port = findAvailablePort();
+
+    // the successor knows nothing but the handoff path
+    pid_t child = fork();
+    REQUIRE(child != -1);
+    if (child == 0) {
+        std::vector<HandoffSocket> sockets;
+        try {
+            sockets = receiveHandoff(server.path(), 10000);
+        } catch (const std::exception&) {
+            _exit(2);
+        }
+        if (sockets.size() != 2 || sockets[0].name != "listener" || sockets[1].name != "kept")
+            _exit(3);
+        sockets[1].socket.send("n", 1);
+
+        EventPoll poll(1);
+        poll.addFd(sockets[0].socket.fd(), PollEvent::READ);
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        while (std::chrono::steady_clock::now() < deadline) {
+            poll.wait(100);
+            if (poll.events().empty())
+                continue;
+            Socket conn = sockets[0].socket.accept();
+            char   byte = 0;
+            conn.recv(&byte, 1);
+            conn.send("n", 1);
+            if (byte == 'q')
+                _exit(0);
+        }
+        _exit(4);
+    }
+
+    Socket            listener = listenLoopback(port);
+    std::atomic<int>  refused{0};
+    std::atomic<int>  old_replies{0};
+    std::atomic<int>  new_replies{0};
+    std::atomic<char> kept_reply{0};
+    std::thread       clients([&]() {
+        Socket kept;
+        kept.create();
+        kept.connect("127.0.0.1", port);
+        kept.send("k", 1);
+        for (int i = 0; i < TOTAL; i++) {
+            Socket conn;
+            conn.create();
+            try {
+                conn.connect("127.0.0.1", port);
+            } catch (const std::runtime_error&) {
+                refused++;
+                continue;
+            }
+            conn.send(i == TOTAL - 1 ? "q" : "c", 1);
+            char reply = 0;
+            conn.recv(&reply, 1);
+            if (reply == 'o')
+                old_replies++;
+            else if (reply == 'n')
+                new_replies++;
+        }
+        char reply = 0;
+        kept.recv(&reply, 1);
+        kept_reply = reply;
+    });
+
+    // serve a while, then stop accepting and hand everything over while clients keep connecting
+    Socket kept;
+    for (int served = 0; served < BEFORE;) {
+        Socket conn = listener.accept();
+        char   byte = 0;
+        conn.recv(&byte, 1);
+        if (byte == 'k') {
+            kept = std::move(conn);
+        } else {
+            conn.send("o", 1);
+            served++;
+        }
+    }
+    EventPoll poll(1);
+    poll.addFd(server.fd(), PollEvent::READ);
+    while (!server.handOff({{listener.fd(), "listener"}, {kept.fd(), "kept"}}))
+        poll.wait(1000);
+    listener.close();
+    kept.close();
+
+    clients.join();
+    int status = 0;
+    REQUIRE(waitpid(child, &status, 0) == child);
+    REQUIRE(WIFEXITED(status));
+    REQUIRE(WEXITSTATUS(status) == 0);
+    REQUIRE(refused == 0);
+    REQUIRE(old_replies == BEFORE);
+    REQUIRE(new_replies == TOTAL - BEFORE);
+    REQUIRE(kept_reply == 'n');
+}
+
+#endif
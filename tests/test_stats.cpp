@@ -0,0 +1,158 @@
+#include "event_poll.hpp"
+#include "socket.hpp"
+#include "stats.hpp"
+#include "test_utils.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <thread>
+
+TEST_CASE("Stats: EventPoll counters") {
+    EventPoll poll;
+    Socket    s;
+    s.create();
+
+    SECTION("Ctl calls are counted by type") {
+        poll.addFd(s.fd(), PollEvent::READ);
+        poll.modifyFd(s.fd(), PollEvent::WRITE);
+        poll.modifyFd(s.fd(), PollEvent::READ);
+        poll.removeFd(s.fd());
+
+        PollStats stats = poll.stats();
+        REQUIRE(stats.ctl_add == 1);
+        REQUIRE(stats.ctl_mod == 2);
+        REQUIRE(stats.ctl_del == 1);
+        REQUIRE(stats.ctl_errors == 0);
+    }
+
+    SECTION("Failed ctl calls are counted as errors") {
+        REQUIRE_THROWS(poll.modifyFd(s.fd(), PollEvent::READ));
+        REQUIRE(poll.stats().ctl_errors == 1);
+    }
+
+    SECTION("Empty waits and block time") {
+        poll.wait(20);
+        poll.wait(0);
+
+        PollStats stats = poll.stats();
+        REQUIRE(stats.waits == 2);
+        REQUIRE(stats.empty_waits == 2);
+        REQUIRE(stats.events_per_wait[0] == 2);
+        REQUIRE(stats.wait_ns >= 10 * 1000 * 1000);
+    }
+
+    SECTION("Events per wait") {
+        uint16_t port = findAvailablePort();
+        Socket   server;
+        server.create();
+        server.setReuseAddr(true);
+        server.bind("127.0.0.1", port);
+        server.listen();
+
+        Socket client;
+        client.create();
+        client.connect("127.0.0.1", port);
+        Socket accepted = server.accept();
+
+        poll.addFd(client.fd(), PollEvent::WRITE);
+        poll.addFd(accepted.fd(), PollEvent::WRITE);
+        poll.wait(100);
+
+        PollStats stats = poll.stats();
+        REQUIRE(stats.waits == 1);
+        REQUIRE(stats.events == 2);
+        REQUIRE(stats.max_events == 2);
+        REQUIRE(stats.events_per_wait[2] == 1);
+    }
+
+    SECTION("Reset") {
+        poll.addFd(s.fd(), PollEvent::READ);
+        poll.wait(0);
+        poll.resetStats();
+
+        PollStats stats = poll.stats();
+        REQUIRE(stats.waits == 0);
+        REQUIRE(stats.ctl_add == 0);
+    }
+}
+
+TEST_CASE("Stats: Socket counters") {
+    uint16_t port = findAvailablePort();
+
+    Socket server;
+    server.create();
+    server.setReuseAddr(true);
+    server.bind("127.0.0.1", port);
+    server.listen();
+
+    Socket client;
+    client.create();
+    client.connect("127.0.0.1", port);
+    Socket accepted = server.accept();
+    accepted.setNonBlocking(true);
+
+    SECTION("Bytes and calls") {
+        client.send("Hello");
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+        char buffer[16];
+        REQUIRE(accepted.recv(buffer, sizeof(buffer)) == 5);
+
+        REQUIRE(client.stats().send_calls == 1);
+        REQUIRE(client.stats().send_bytes == 5);
+        REQUIRE(accepted.stats().recv_calls == 1);
+        REQUIRE(accepted.stats().recv_bytes == 5);
+        REQUIRE(accepted.stats().recv_eagain == 0);
+    }
+
+    SECTION("EAGAIN is counted") {
+        char buffer[16];
+        REQUIRE(accepted.recv(buffer, sizeof(buffer)) == 0);
+
+        SocketStats stats = accepted.stats();
+        REQUIRE(stats.recv_calls == 1);
+        REQUIRE(stats.recv_eagain == 1);
+        REQUIRE(stats.recv_bytes == 0);
+    }
+
+    SECTION("Counters move with the socket") {
+        client.send("Hi");
+
+        Socket moved(std::move(client));
+        REQUIRE(moved.stats().send_bytes == 2);
+        REQUIRE(client.stats().send_calls == 0);
+    }
+}
+
+TEST_CASE("Stats: Export") {
+    SECTION("Merge poll stats") {
+        PollStats a;
+        a.waits              = 2;
+        a.max_events         = 4;
+        a.events_per_wait[1] = 1;
+
+        PollStats b;
+        b.waits              = 3;
+        b.max_events         = 7;
+        b.events_per_wait[1] = 2;
+
+        a += b;
+        REQUIRE(a.waits == 5);
+        REQUIRE(a.max_events == 7);
+        REQUIRE(a.events_per_wait[1] == 3);
+    }
+
+    SECTION("JSON contains counters and rates") {
+        SocketStats stats;
+        stats.recv_calls  = 4;
+        stats.recv_eagain = 1;
+
+        std::string json = toJson(stats);
+        REQUIRE(json.find("\"recv_calls\":4") != std::string::npos);
+        REQUIRE(json.find("\"recv_eagain_rate\":0.25") != std::string::npos);
+
+        std::string poll_json = toJson(PollStats{});
+        REQUIRE(poll_json.front() == '{');
+        REQUIRE(poll_json.find("\"events_per_wait\":[0,0,") != std::string::npos);
+    }
+}
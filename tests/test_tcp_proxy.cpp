@@ -0,0 +1,164 @@
+#include "event_loop.hpp"
+#include "socket.hpp"
+#include "tcp_proxy.hpp"
+#include "test_utils.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <utility>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#endif
+
+namespace {
+
+struct Relay {
+    Socket client;   // talks to the proxy
+    Socket upstream; // the proxy talks to it
+};
+
+// client <-> proxy <-> upstream over loopback, with the two inner ends handed to the proxy
+Relay startRelay(TcpProxy& proxy) {
+    uint16_t port = findAvailablePort();
+    Socket   listener = listenLoopback(port);
+
+    Relay relay;
+    relay.client.create();
+    relay.client.connect("127.0.0.1", port);
+    Socket inner_client = listener.accept();
+
+    Socket inner_upstream;
+    inner_upstream.create();
+    inner_upstream.connect("127.0.0.1", port);
+    relay.upstream = listener.accept();
+
+    proxy.relay(std::move(inner_client), std::move(inner_upstream));
+    relay.client.setNonBlocking(true);
+    relay.upstream.setNonBlocking(true);
+    return relay;
+}
+
+// reads until the peer closes, running the loop in between
+std::string readToEnd(EventLoop& loop, Socket& socket) {
+    std::string received;
+    char        buffer[4096];
+    for (int spins = 0; spins < 10000; spins++) {
+        loop.runOnce(1);
+        socket_size_t n = socket.tryRecv(buffer, sizeof(buffer));
+        if (n == 0)
+            return received;
+        if (n > 0)
+            received.append(buffer, static_cast<size_t>(n));
+    }
+    FAIL("no end of stream");
+    return received;
+}
+
+} // namespace
+
+TEST_CASE("TcpProxy: Relays both directions with half-close") {
+    for (ProxyMode mode : {ProxyMode::AUTO, ProxyMode::COPY}) {
+        EventLoop    loop;
+        ProxyOptions options;
+        options.mode = mode;
+        TcpProxy proxy(loop, options);
+        Relay    relay = startRelay(proxy);
+        REQUIRE(proxy.sessions() == 1);
+
+        // the client is done sending but still waits for the answer
+        relay.client.send(std::string("ping"));
+        relay.client.shutdown(ShutdownMode::WRITE);
+        REQUIRE(readToEnd(loop, relay.upstream) == "ping");
+        REQUIRE(proxy.sessions() == 1);
+
+        relay.upstream.send(std::string("pong"));
+        relay.upstream.shutdown(ShutdownMode::WRITE);
+        REQUIRE(readToEnd(loop, relay.client) == "pong");
+        REQUIRE(proxy.sessions() == 0);
+
+        ProxyStats stats = proxy.stats();
+        REQUIRE(stats.sessions == 1);
+        REQUIRE(stats.failed == 0);
+        REQUIRE(stats.fallbacks == 0);
+#ifdef __linux__
+        REQUIRE((mode == ProxyMode::AUTO ? stats.spliced : stats.copied) == 8);
+#else
+        REQUIRE(stats.copied == 8);
+#endif
+    }
+}
+
+TEST_CASE("TcpProxy: A slow receiver throttles the sender") {
+    for (ProxyMode mode : {ProxyMode::AUTO, ProxyMode::COPY}) {
+        EventLoop    loop;
+        ProxyOptions options;
+        options.mode        = mode;
+        options.buffer_size = 16 * 1024;
+        TcpProxy proxy(loop, options);
+        Relay    relay = startRelay(proxy);
+
+        std::string payload(32 * 1024 * 1024, '\0');
+        for (size_t i = 0; i < payload.size(); i++)
+            payload[i] = static_cast<char>(i * 7 % 251);
+
+        // nobody reads upstream, so the proxy has to stop reading and the client has to run into a full window
+        size_t sent    = 0;
+        int    stalled = 0;
+        while (sent < payload.size() && stalled < 100) {
+            socket_size_t n = relay.client.trySend(payload.data() + sent, payload.size() - sent);
+            loop.runOnce(0);
+            if (n > 0) {
+                sent += static_cast<size_t>(n);
+                stalled = 0;
+            } else {
+                stalled++;
+            }
+        }
+        REQUIRE(sent < payload.size());
+
+        std::string received;
+        char        buffer[65536];
+        while (received.size() < payload.size()) {
+            if (sent < payload.size()) {
+                socket_size_t n = relay.client.trySend(payload.data() + sent, payload.size() - sent);
+                if (n > 0)
+                    sent += static_cast<size_t>(n);
+            }
+            loop.runOnce(1);
+            socket_size_t n = relay.upstream.tryRecv(buffer, sizeof(buffer));
+            if (n > 0)
+                received.append(buffer, static_cast<size_t>(n));
+        }
+        REQUIRE(received == payload);
+    }
+}
+
+#ifndef _WIN32
+TEST_CASE("TcpProxy: A reset upstream fails the session") {
+    for (ProxyMode mode : {ProxyMode::AUTO, ProxyMode::COPY}) {
+        EventLoop    loop;
+        ProxyOptions options;
+        options.mode = mode;
+        TcpProxy proxy(loop, options);
+        Relay    relay = startRelay(proxy);
+
+        // upstream is done sending, then resets. the proxy's end of it is in CLOSE_WAIT, where the reset turns the
+        // next write into EPIPE, and splice() raises SIGPIPE with it
+        relay.upstream.shutdown(ShutdownMode::WRITE);
+        REQUIRE(readToEnd(loop, relay.client).empty());
+        linger reset{1, 0};
+        REQUIRE(setsockopt(relay.upstream.fd(), SOL_SOCKET, SO_LINGER, &reset, sizeof(reset)) == 0);
+        relay.upstream.close();
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+        relay.client.send(std::string("into the void"));
+        for (int spins = 0; spins < 1000 && proxy.sessions() > 0; spins++)
+            loop.runOnce(1);
+        REQUIRE(proxy.sessions() == 0);
+        REQUIRE(proxy.stats().failed == 1);
+    }
+}
+#endif
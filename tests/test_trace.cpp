@@ -0,0 +1,141 @@
+#include "event_poll.hpp"
+#include "socket.hpp"
+#include "test_utils.hpp"
+#include "trace.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+std::string tracePath() {
+#ifdef _WIN32
+    const char* dir = std::getenv("TEMP");
+#else
+    const char* dir = std::getenv("TMPDIR");
+#endif
+    return std::string(dir != nullptr && *dir != '\0' ? dir : "/tmp") + "/socketpoll_test_trace.bin";
+}
+
+std::vector<TraceRecord> dumpAndRead() {
+    std::string path = tracePath();
+    REQUIRE(dumpTrace(path.c_str()));
+    std::vector<TraceRecord> records = readTrace(path);
+    std::remove(path.c_str());
+    return records;
+}
+
+const TraceRecord* findRecord(const std::vector<TraceRecord>& records, TraceType type, int64_t fd) {
+    for (auto it = records.rbegin(); it != records.rend(); ++it) {
+        if (it->type == type && it->fd == fd)
+            return &*it;
+    }
+    return nullptr;
+}
+
+} // namespace
+
+TEST_CASE("Trace: Poll and socket records") {
+    uint16_t port = findAvailablePort();
+    Socket   server;
+    server.create();
+    server.setReuseAddr(true);
+    server.bind("127.0.0.1", port);
+    server.listen();
+    Socket client;
+    client.create();
+    client.connect("127.0.0.1", port);
+    Socket accepted = server.accept();
+
+    SECTION("Enabled tracing records the loop") {
+        EventPoll poll;
+        setTraceEnabled(true);
+        poll.addFd(accepted.fd(), PollEvent::READ);
+        client.send("ping");
+        poll.wait(1000);
+        char buffer[16];
+        accepted.recv(buffer, sizeof(buffer));
+        setTraceEnabled(false);
+
+        std::vector<TraceRecord> records = dumpAndRead();
+        if (!traceCompiledIn())
+            return;
+
+        const TraceRecord* add = findRecord(records, TraceType::CTL_ADD, accepted.fd());
+        REQUIRE(add != nullptr);
+        REQUIRE(add->value == 0);
+        REQUIRE(add->aux == PollEvent::READ);
+
+        const TraceRecord* send = findRecord(records, TraceType::SEND, client.fd());
+        REQUIRE(send != nullptr);
+        REQUIRE(send->value == 4);
+
+        const TraceRecord* exit = findRecord(records, TraceType::WAIT_EXIT, -1);
+        REQUIRE(exit != nullptr);
+        REQUIRE(exit->value == 1);
+
+        const TraceRecord* recv = findRecord(records, TraceType::RECV, accepted.fd());
+        REQUIRE(recv != nullptr);
+        REQUIRE(recv->value == 4);
+        REQUIRE(recv->thread == add->thread);
+        REQUIRE(recv->ns >= exit->ns);
+        REQUIRE(exit->ns >= send->ns);
+    }
+
+    SECTION("Disabled tracing records nothing") {
+        size_t before = dumpAndRead().size();
+        client.send("ping");
+        char buffer[16];
+        accepted.recv(buffer, sizeof(buffer));
+        REQUIRE(dumpAndRead().size() == before);
+    }
+
+    SECTION("Failed calls carry the error") {
+        setTraceEnabled(true);
+        socket_t fd = client.fd();
+        client.setNonBlocking(true);
+        char buffer[16];
+        REQUIRE(client.tryRecv(buffer, sizeof(buffer)) < 0);
+        setTraceEnabled(false);
+
+        if (!traceCompiledIn())
+            return;
+        std::vector<TraceRecord> records = dumpAndRead();
+        const TraceRecord*       recv    = findRecord(records, TraceType::RECV, fd);
+        REQUIRE(recv != nullptr);
+        REQUIRE(recv->value < 0);
+    }
+}
+
+TEST_CASE("Trace: Rings keep the newest records") {
+    constexpr int64_t MARKER = 1 << 30;
+    setTraceCapacity(8);
+    std::thread([]() {
+        for (int64_t i = 0; i < 20; i++)
+            traceRecord(TraceType::WAKEUP, MARKER, i);
+    }).join();
+    setTraceCapacity(16384);
+
+    // the ring of the exited thread is still dumped
+    std::vector<int64_t> values;
+    for (const TraceRecord& record : dumpAndRead()) {
+        if (record.fd == MARKER)
+            values.push_back(record.value);
+    }
+    REQUIRE(values == std::vector<int64_t>{12, 13, 14, 15, 16, 17, 18, 19});
+}
+
+TEST_CASE("Trace: Reading rejects other files") {
+    std::string path = tracePath();
+    FILE*       file = std::fopen(path.c_str(), "wb");
+    REQUIRE(file != nullptr);
+    std::fputs("not a trace", file);
+    std::fclose(file);
+    REQUIRE_THROWS_AS(readTrace(path), std::runtime_error);
+    std::remove(path.c_str());
+}
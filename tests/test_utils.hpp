@@ -23,4 +23,16 @@ inline uint16_t findAvailablePort() {
 #endif
     getsockname(s.fd(), reinterpret_cast<sockaddr*>(&addr), &len);
     return ntohs(addr.sin_port);
-}
\ No newline at end of file
+}
+
+// a listening socket on 127.0.0.1:port, the usual server side of a loopback test
+inline Socket listenLoopback(uint16_t port, bool nonblocking = false) {
+    Socket listener;
+    listener.create();
+    listener.setReuseAddr(true);
+    listener.bind("127.0.0.1", port);
+    listener.listen();
+    if (nonblocking)
+        listener.setNonBlocking(true);
+    return listener;
+}
@@ -0,0 +1,115 @@
+#include "event_poll.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::string eventNames(uint16_t mask) {
+    std::string names;
+    auto        add = [&](uint16_t bit, const char* name) {
+        if ((mask & bit) == 0)
+            return;
+        if (!names.empty())
+            names += '|';
+        names += name;
+    };
+    add(PollEvent::READ, "read");
+    add(PollEvent::WRITE, "write");
+    add(PollEvent::ERR, "err");
+    add(PollEvent::EXCLUSIVE, "exclusive");
+    return names.empty() ? "none" : names;
+}
+
+// what a record's value and aux mean depends on its type, see TraceType
+std::string describe(const TraceRecord& record) {
+    char text[160];
+    switch (record.type) {
+        case TraceType::WAIT_ENTER:
+            std::snprintf(text, sizeof(text), "timeout=%" PRId64 "ms", record.value);
+            break;
+        case TraceType::WAIT_EXIT:
+            if (record.value < 0)
+                std::snprintf(text, sizeof(text), "interrupted");
+            else
+                std::snprintf(text, sizeof(text), "events=%" PRId64, record.value);
+            break;
+        case TraceType::WAKEUP:
+            text[0] = '\0';
+            break;
+        case TraceType::CTL_ADD:
+        case TraceType::CTL_MOD:
+        case TraceType::CTL_DEL:
+            std::snprintf(text, sizeof(text), "fd=%" PRId64 " events=%s%s%s", record.fd, eventNames(record.aux).c_str(),
+                          record.value != 0 ? " error=" : "",
+                          record.value != 0 ? std::strerror(static_cast<int>(record.value)) : "");
+            break;
+        case TraceType::RECV:
+        case TraceType::SEND:
+            if (record.value < 0)
+                std::snprintf(text, sizeof(text), "fd=%" PRId64 " error=%s", record.fd,
+                              std::strerror(static_cast<int>(-record.value)));
+            else if (record.value == 0 && record.type == TraceType::RECV)
+                std::snprintf(text, sizeof(text), "fd=%" PRId64 " closed", record.fd);
+            else
+                std::snprintf(text, sizeof(text), "fd=%" PRId64 " bytes=%" PRId64, record.fd, record.value);
+            if (record.aux > 1)
+                return std::string(text) + " slices=" + std::to_string(record.aux);
+            break;
+        default:
+            std::snprintf(text, sizeof(text), "fd=%" PRId64 " value=%" PRId64 " aux=%u", record.fd, record.value,
+                          static_cast<unsigned>(record.aux));
+            break;
+    }
+    return text;
+}
+
+} // namespace
+
+// prints a dump written by dumpTrace() as one line per record, all threads merged in time order. times are in
+// microseconds from the first record, e.g. socketpoll_trace_decode /tmp/trace.bin [--thread 2]
+int main(int argc, char* argv[]) {
+    const char* path   = nullptr;
+    uint32_t    thread = 0;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--thread") == 0 && i + 1 < argc) {
+            thread = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (path == nullptr && argv[i][0] != '-') {
+            path = argv[i];
+        } else {
+            std::fprintf(stderr, "usage: %s DUMP [--thread N]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (path == nullptr) {
+        std::fprintf(stderr, "usage: %s DUMP [--thread N]\n", argv[0]);
+        return 2;
+    }
+
+    std::vector<TraceRecord> records;
+    try {
+        records = readTrace(path);
+    } catch (const std::exception& error) {
+        std::fprintf(stderr, "%s\n", error.what());
+        return 1;
+    }
+    std::stable_sort(records.begin(), records.end(),
+                     [](const TraceRecord& a, const TraceRecord& b) { return a.ns < b.ns; });
+
+    uint64_t origin = records.empty() ? 0 : records.front().ns;
+    for (const TraceRecord& record : records) {
+        if (thread != 0 && record.thread != thread)
+            continue;
+        std::string fields = describe(record);
+        std::printf("%12.3f  t%-3u %-10s%s%s\n", static_cast<double>(record.ns - origin) / 1000.0, record.thread,
+                    traceTypeName(record.type), fields.empty() ? "" : " ", fields.c_str());
+    }
+    return 0;
+}